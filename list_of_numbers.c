@@ -10,6 +10,7 @@
 
 #include "list_of_numbers.h"
 #include "phone_forward.h"
+#include "phone_counters.h"
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
@@ -17,180 +18,341 @@
 
 
 /**
- * @brief Sprawdza czy podany numer zaczyna sie prefiksem
+ * @brief Porównuję napisy leksykograficznie
+ * Zmodyfikowana funkcja strcmp
+ * @param firstStr - wskaźnik na pierwszy napis
+ * @param secondStr - wskaźnik na drugi napis
+ * @return int - liczba dodatnia/ujemna/zero w zależności od wyniku porównania
+ */
+static int compare(const char *firstStr, const char *secondStr) {
+    COUNTERS_ADD(COUNTER_COMPARES, 1);
+    const unsigned char *tmpFirstStr = (const unsigned char *) firstStr;
+    const unsigned char *tmpSecondStr = (const unsigned char *) secondStr;
+    unsigned char signFirstStr, signSecondStr;
+    do {
+        signFirstStr = (unsigned char) *tmpFirstStr++;
+        signSecondStr = (unsigned char) *tmpSecondStr++;
+        if (signFirstStr == '\0') {
+            return get_digit(signFirstStr) - get_digit(signSecondStr);
+        }
+    } while (get_digit(signFirstStr) == get_digit(signSecondStr));
+    return get_digit(signFirstStr) - get_digit(signSecondStr);
+}
+
+
+int compareNumbers(const char *firstStr, const char *secondStr) {
+    return compare(firstStr, secondStr);
+}
+
+
+/**
+ * @brief Porównuje numer z prefiksem.
+ * Porównuje tylko pierwsze strlen(prefix) znaków numeru, więc wszystkie
+ * numery zaczynające sie prefiksem sa mu "równe".
  * @param number - wskaźnik na numer(przekierowanie).
  * @param prefix - wskaźnik na prefiks.
- * @return true  - jeśli numer zaczyna sie prefiksem.
- * @return false -  jeśli numer nie zaczyna sie prefiksem.
+ * @return 0, jeśli numer zaczyna sie prefiksem, liczba ujemna, jeśli numer
+ *         jest leksykograficznie mniejszy od numerów z tym prefiksem,
+ *         liczba dodatnia wpp.
  */
-static bool hasAPrefix(char *number, const char *prefix) {
-    if (strlen(prefix) > strlen(number)) {
-        return false;
+static int comparePrefix(const char *number, const char *prefix) {
+    COUNTERS_ADD(COUNTER_COMPARES, 1);
+    while (*prefix != '\0') {
+        if (*number == '\0') {
+            return -1;
+        }
+        int digitNumb = get_digit(*number);
+        int digitPref = get_digit(*prefix);
+        if (digitNumb != digitPref) {
+            return digitNumb - digitPref;
+        }
+        number++;
+        prefix++;
     }
-    char *prefixTemp = (char *) prefix;
-    char *numberTemp = number;
-    int digitPref = get_digit(*prefixTemp);
-    int digitNumb = get_digit(*numberTemp);
+    return 0;
+}
+
 
-    while ((*prefixTemp != '\0') && (digitPref == digitNumb)) {
-        prefixTemp++;
-        numberTemp++;
-        digitPref = get_digit(*prefixTemp);
-        digitNumb = get_digit(*numberTemp);
+/**
+ * @brief Wyszukuje binarnie pierwszy numer nie mniejszy od "num".
+ * @param list - wskaźnik na listę.
+ * @param num - wskaźnik na szukany numer.
+ * @return indeks pierwszego numeru >= num (lub rozmiar listy).
+ */
+static size_t lowerBound(List const *list, const char *num) {
+    size_t low = 0, high = list->size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (compare(list->numbers[mid], num) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
     }
+    return low;
+}
 
-    if (*prefixTemp != '\0') {
-        return false;
+
+/**
+ * @brief Wyszukuje binarnie granice przedziału numerów zaczynających sie prefiksem.
+ * @param list - wskaźnik na listę.
+ * @param prefix - wskaźnik na prefiks.
+ * @param strict - false: pierwszy numer z prefiksem lub większy,
+ *                 true: pierwszy numer większy od wszystkich numerów z prefiksem.
+ * @return indeks szukanej granicy przedziału.
+ */
+static size_t prefixBound(List const *list, const char *prefix, bool strict) {
+    size_t low = 0, high = list->size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = comparePrefix(list->numbers[mid], prefix);
+        if (cmp < 0 || (strict && cmp == 0)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
     }
-    return true;
+    return low;
 }
 
 
-void deleteFrwdStartsWthPref(List **list, const char *prefix) {
-    // Usuwam elementy na początku.
-    while (*list && hasAPrefix((*list)->forwarding, prefix)) {
-        List *tmp = *list;
-        *list = (*list)->next;
-        free(tmp->forwarding);
-        tmp->forwarding = NULL;
-        free(tmp);
-        tmp = NULL;
+/**
+ * @brief Usuwa z listy numery o indeksach z przedziału [from, to).
+ * Zwalnia usuwane numery i przesuwa ogon tablicy jedną operacją.
+ * Pusta lista jest usuwana.
+ * @param list - wskaźnik na wskaźnik listy.
+ * @param from - początek przedziału.
+ * @param to - koniec przedziału.
+ * @return łączna długość usuniętych numerów (wraz z '\0').
+ */
+static size_t deleteRange(List **list, size_t from, size_t to) {
+    size_t bytes = 0;
+    if (from >= to) {
+        return bytes;
+    }
+    for (size_t i = from; i < to; i++) {
+        bytes += strlen((*list)->numbers[i]) + 1;
+        free((*list)->numbers[i]);
     }
+    memmove((*list)->numbers + from, (*list)->numbers + to,
+            sizeof(char *) * ((*list)->size - to));
+    (*list)->size -= to - from;
 
-    // Usuwam element w środku lub na końcu listy.
-    for (List *current = *list; current != NULL; current = current->next) {
-        while (current->next != NULL && hasAPrefix(current->next->forwarding, prefix)) {
-            List *tmp = current->next;
-            current->next = tmp->next;
-            free(tmp->forwarding);
-            tmp->forwarding = NULL;
-            free(tmp);
-            tmp = NULL;
-        }
+    if ((*list)->size == 0) {
+        listDelete(*list);
+        *list = NULL;
+    }
+    return bytes;
+}
+
+
+size_t deleteFrwdStartsWthPref(List **list, const char *prefix) {
+    if (*list == NULL) {
+        return 0;
     }
+    size_t from = prefixBound(*list, prefix, false);
+    size_t to = prefixBound(*list, prefix, true);
+    return deleteRange(list, from, to);
+}
+
+
+size_t deleteFrwdFromList(List **list, const char *num) {
+    if (*list == NULL) {
+        return 0;
+    }
+    size_t idx = lowerBound(*list, num);
+    if (idx < (*list)->size && compare((*list)->numbers[idx], num) == 0) {
+        return deleteRange(list, idx, idx + 1);
+    }
+    return 0;
 }
 
 
 /**
- * @brief Porównuję napisy leksykograficznie
- * Zmodyfikowana funkcja strcmp
- * @param firstStr - wskaźnik na pierwszy napis
- * @param secondStr - wskaźnik na drugi napis
- * @return int - liczba dodatnia/ujemna/zero w zależności od wyniku porównania
+ * @brief Zapewnia miejsce na kolejny numer w liście.
+ * @param list - wskaźnik na wskaźnik listy (tworzy ja, jeśli jest NULL).
+ * @return Wartość @p true, jeśli w tablicy jest miejsce na kolejny numer.
+ *         Wartość @p false, jeśli nie udało sie alokować pamięci.
  */
-static int compare(const char *firstStr, const char *secondStr) {
-    const unsigned char *tmpFirstStr = (const unsigned char *) firstStr;
-    const unsigned char *tmpSecondStr = (const unsigned char *) secondStr;
-    unsigned char signFirstStr, signSecondStr;
-    do {
-        signFirstStr = (unsigned char) *tmpFirstStr++;
-        signSecondStr = (unsigned char) *tmpSecondStr++;
-        if (signFirstStr == '\0') {
-            return get_digit(signFirstStr) - get_digit(signSecondStr);
+static bool reserveInList(List **list) {
+    if (*list == NULL) {
+        COUNTERS_ADD(COUNTER_ALLOCATIONS, 1);
+        *list = malloc(sizeof(List));
+        if (*list == NULL) {
+            return false;
         }
-    } while (get_digit(signFirstStr) == get_digit(signSecondStr));
-    return get_digit(signFirstStr) - get_digit(signSecondStr);
+        (*list)->numbers = NULL;
+        (*list)->size = 0;
+        (*list)->capacity = 0;
+    }
+    if ((*list)->size == (*list)->capacity) {
+        size_t newCapacity = (*list)->capacity ? 2 * (*list)->capacity : 4;
+        COUNTERS_ADD(COUNTER_ALLOCATIONS, 1);
+        char **newNumbers = realloc((*list)->numbers, sizeof(char *) * newCapacity);
+        if (newNumbers == NULL) {
+            return false;
+        }
+        (*list)->numbers = newNumbers;
+        (*list)->capacity = newCapacity;
+    }
+    return true;
 }
 
 
-void deleteFrwdFromList(List **list, const char *num) {
-    // Usuwam element na początku.
-    if (*list && (compare((*list)->forwarding, num) == 0)) {
-        List *tmp = *list;
-        *list = (*list)->next;
-        if (tmp->forwarding != NULL) {
-            free(tmp->forwarding);
-            tmp->forwarding = NULL;
-            free(tmp);
-            tmp = NULL;
+bool insertToList(List **list, const char *num) {
+    bool created = (*list == NULL);
+    size_t idx = 0;
+
+    if (*list != NULL && (*list)->size > 0
+        && compare((*list)->numbers[(*list)->size - 1], num) < 0) {
+        idx = (*list)->size;    // Numery wstawiane rosnąco dopisuje na koniec.
+    } else if (*list != NULL) {
+        idx = lowerBound(*list, num);
+        if (idx < (*list)->size && compare((*list)->numbers[idx], num) == 0) {
+            return true;
+        }
+    }
+    COUNTERS_ADD(COUNTER_ALLOCATIONS, 1);
+    char *copy = malloc(sizeof(char) * (strlen(num) + 1));
+    if (copy == NULL || !reserveInList(list)) {
+        free(copy);
+        if (created && *list != NULL) {
+            listDelete(*list);
+            *list = NULL;
         }
-        return;
+        return false;
     }
+    memcpy(copy, num, sizeof(char) * (strlen(num) + 1));
 
-    // Usuwam element w środku lub na końcu listy.
-    for (List *current = *list; current != NULL; current = current->next) {
-        if ((current->next != NULL) && (current->next->forwarding != NULL)
-            && (compare(current->next->forwarding, num) == 0)) {
+    memmove((*list)->numbers + idx + 1, (*list)->numbers + idx,
+            sizeof(char *) * ((*list)->size - idx));
+    (*list)->numbers[idx] = copy;
+    (*list)->size++;
+    return true;
+}
 
-            List *tmp = current->next;
-            current->next = tmp->next;
-            if (tmp->forwarding != NULL) {
-                free(tmp->forwarding);
-                tmp->forwarding = NULL;
-                free(tmp);
-                tmp = NULL;
-            }
-            break;
+
+bool listMerge(List **list, List **other, size_t *duplicateBytes) {
+    *duplicateBytes = 0;
+    if (*other == NULL) {
+        return true;
+    }
+    if (*list == NULL) {
+        *list = *other;
+        *other = NULL;
+        return true;
+    }
+    List *first = *list, *second = *other;
+    COUNTERS_ADD(COUNTER_ALLOCATIONS, 1);
+    char **numbers = malloc(sizeof(char *) * (first->size + second->size));
+    if (numbers == NULL) {
+        return false;
+    }
+    size_t i = 0, j = 0, size = 0;
+    while (i < first->size || j < second->size) {
+        int cmp = i == first->size ? 1
+                  : j == second->size ? -1
+                  : compare(first->numbers[i], second->numbers[j]);
+        if (cmp <= 0) {
+            numbers[size++] = first->numbers[i++];
+        } else {
+            numbers[size++] = second->numbers[j++];
+        }
+        if (cmp == 0) {     // Numer jest w obu listach.
+            *duplicateBytes += strlen(second->numbers[j]) + 1;
+            free(second->numbers[j++]);
         }
     }
+    free(first->numbers);
+    first->numbers = numbers;
+    first->size = size;
+    first->capacity = size;
+    free(second->numbers);
+    free(second);
+    *other = NULL;
+    return true;
 }
 
 
-List *insertToList(List *list, const char *num) {
-    List *ptr = malloc(sizeof(List));
-    if (ptr == NULL) {
-        return NULL;
-    }
-    ptr->forwarding = malloc(sizeof(char) * (strlen(num) + 1));
-    if (ptr->forwarding == NULL) {
-        free(ptr);
-        ptr = NULL;
-        return NULL;
+/**
+ * @brief Porównuje numer z pierwszymi @p length znakami napisu.
+ * @param number - wskaźnik na numer.
+ * @param num - wskaźnik na napis.
+ * @param length - liczba porównywanych znaków napisu @p num.
+ * @return int - liczba dodatnia/ujemna/zero w zależności od wyniku porównania
+ */
+static int compareN(const char *number, const char *num, size_t length) {
+    COUNTERS_ADD(COUNTER_COMPARES, 1);
+    for (size_t i = 0; i < length; i++) {
+        if (number[i] == '\0') {
+            return -1;
+        }
+        if (get_digit(number[i]) != get_digit(num[i])) {
+            return get_digit(number[i]) - get_digit(num[i]);
+        }
     }
-    memcpy(ptr->forwarding, (char *) num, sizeof(char) * (strlen(num) + 1));
-    ptr->next = NULL;
+    return number[length] == '\0' ? 0 : 1;
+}
+
 
+bool listContains(List const *list, const char *num, size_t length) {
     if (list == NULL) {
-        ptr->next = list;
-        return ptr;
-    } else if (compare(num, list->forwarding) < 0) {
-        ptr->next = list;
-        return ptr;
-    } else {
-        List *cur = list;
-        while (cur->next != NULL && compare(num, cur->next->forwarding) >= 0) {
-            if (compare(num, cur->next->forwarding) == 0) {
-                free(ptr->forwarding);
-                free(ptr);
-                return list;
-            }
-            cur = cur->next;
+        return false;
+    }
+    size_t low = 0, high = list->size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = compareN(list->numbers[mid], num, length);
+        if (cmp == 0) {
+            return true;
+        } else if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
-        ptr->next = cur->next;
-        cur->next = ptr;
-        return list;
     }
+    return false;
 }
 
 
-List **getListOfForwardings(PhoneReverse *pfRev, const char *num) {
-    PhoneReverse *curr = pfRev;
-    size_t numberLength = strlen(num);
-    for (size_t i = 0; i < numberLength; i++) {
-        if (!curr->children[get_digit(*num)]) {
-            break;
+size_t listUpperBound(List const *list, const char *num) {
+    if (list == NULL) {
+        return 0;
+    }
+    size_t low = 0, high = list->size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (compare(list->numbers[mid], num) <= 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
-        curr = curr->children[get_digit(*num)];
-        num++;
     }
-    return &curr->listOfFrwd;
+    return low;
+}
+
+
+size_t listSize(List const *list) {
+    return list != NULL ? list->size : 0;
+}
+
+
+char const *listGet(List const *list, size_t idx) {
+    if (list == NULL || idx >= list->size) {
+        return NULL;
+    }
+    return list->numbers[idx];
 }
 
 
 void listDelete(List *list) {
     if (list != NULL) {
-        List *current = list;
-        List *next;
-        while (current != NULL) {
-            next = current->next;
-            if (current->forwarding != NULL) {
-                free(current->forwarding);
-                current->forwarding = NULL;
-            }
-            free(current);
-            current = NULL;
-            current = next;
+        for (size_t i = 0; i < list->size; i++) {
+            free(list->numbers[i]);
+            list->numbers[i] = NULL;
         }
+        free(list->numbers);
+        free(list);
         list = NULL;
     }
-}
\ No newline at end of file
+}
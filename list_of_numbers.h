@@ -10,6 +10,8 @@
 
 #ifndef LIST_OF_NUMBERS_H
 #define LIST_OF_NUMBERS_H
+#include <stdbool.h>
+#include <stddef.h>
 #include "phone_reverse.h"
 
 
@@ -17,10 +19,14 @@
 /**
  * @brief Lista przekierowań.
  * Przechowuje przekierowania (jest używana dla pfRev i w funkcji phfwdGet).
+ * Numery trzymam w tablicy posortowanej leksykograficznie, dzięki czemu
+ * wyszukiwanie numeru oraz przedziału numerów o wspólnym prefiksie
+ * odbywa sie wyszukiwaniem binarnym.
  */
 struct List {
-    char *forwarding;  ///<przekierowanie(numer).
-    struct List *next;  ///<wskaźnik na następny element.
+    char **numbers;  ///<posortowana tablica przekierowań(numerów).
+    size_t size;  ///<liczba numerów w tablicy.
+    size_t capacity;  ///<rozmiar zaalokowanej tablicy.
 };
 /**
  * @brief to jest typ Lista
@@ -29,44 +35,112 @@ struct List {
 typedef struct List List;
 
 
+/**
+ * @brief Sprawdza, czy znak może wystąpić w numerze.
+ * To jest alfabet numerów używany przez @ref isStringAPhoneNumber.
+ * @param c - znak.
+ * @return Wartość @p true, jeśli znak jest cyfra, '*' lub '#'.
+ */
+static inline bool isNumberChar(char c) {
+    return (c >= '0' && c <= '9') || c == '*' || c == '#';
+}
+
+
+/**
+ * @brief Porównuje numery leksykograficznie (w kolejności 0-9, '*', '#').
+ * @param firstStr - wskaźnik na pierwszy numer.
+ * @param secondStr - wskaźnik na drugi numer.
+ * @return int - liczba dodatnia/ujemna/zero w zależności od wyniku porównania
+ */
+int compareNumbers(const char *firstStr, const char *secondStr);
+
+
 /**
  * @brief Dodaje przekierowanie (odwrócone) do listy
  * Dodaje przekierowanie (odwrócone) do listy posortowanej leksykograficznie
  * W wierzchołku pod numerem (numeruje od 0 do CHILDREN_NUMB - 1) ostatniej cyfry przekierowania "dokąd" trzymam
- * listę numerów przekierowań "skąd".
- * @param list - wskaźnik na listę z których sa przekierowania
+ * listę numerów przekierowań "skąd". Jeśli lista nie istnieje (NULL), jest tworzona.
+ * Numer już obecny w liście nie jest dodawany ponownie.
+ * @param list - wskaźnik na wskaźnik listy, z których sa przekierowania
  * @param num  - wskaźnik na napis do którego jest przekierowanie
+ * @return Wartość @p true, jeśli numer jest w liście.
+ *         Wartość @p false, jeśli nie udało sie alokować pamięci
+ *         (lista pozostaje wtedy niezmieniona).
+ */
+bool insertToList(List **list, const char *num);
+
+
+/**
+ * @brief Przenosi numery z drugiej listy do pierwszej.
+ * Scala obie posortowane listy jednym przejściem, przejmując numery drugiej
+ * listy; numery obecne w obu listach zostają w pierwszej liście raz. Druga
+ * lista jest usuwana.
+ * @param list - wskaźnik na wskaźnik listy docelowej.
+ * @param other - wskaźnik na wskaźnik listy przenoszonej.
+ * @param duplicateBytes - wskaźnik na łączną długość numerów obecnych
+ *                         w obu listach (wraz z '\0').
+ * @return Wartość @p true, jeśli listy zostały scalone.
+ *         Wartość @p false, jeśli nie udało sie alokować pamięci
+ *         (listy pozostają wtedy niezmienione).
  */
-List *insertToList(List *list, const char *num);
+bool listMerge(List **list, List **other, size_t *duplicateBytes);
 
 
 /**
  * @brief Usuwanie z listy przekierowań, które sa takie same jak "num" (leksykograficznie)
  *
- * @param list - wskaźnik na listę.
+ * @param list - wskaźnik na wskaźnik listy.
  * @param num - wskaźnik na szukane przekierowanie.
+ * @return łączna długość usuniętych numerów (wraz z '\0').
  */
-void deleteFrwdFromList(List **list, const char *num);
+size_t deleteFrwdFromList(List **list, const char *num);
 
 
 /**
  * @brief Usuwanie z listy przekierowań zaczynających sie prefiksem "prefix"
- *
- * @param list - wskaźnik na listę.
+ * Numery o wspólnym prefiksie tworzą w posortowanej liście spójny przedział,
+ * który znajduje wyszukiwaniem binarnym i wycinam jedną operacją.
+ * @param list - wskaźnik na wskaźnik listy.
  * @param prefix - wskaźnik na prefiks.
+ * @return łączna długość usuniętych numerów (wraz z '\0').
+ */
+size_t deleteFrwdStartsWthPref(List **list, const char *prefix);
+
+
+/**
+ * @brief Sprawdza, czy lista zawiera numer złożony z pierwszych znaków napisu.
+ * @param list - wskaźnik na listę (może byc NULL).
+ * @param num - wskaźnik na napis.
+ * @param length - liczba początkowych znaków napisu @p num tworzących numer.
+ * @return Wartość @p true, jeśli numer jest w liście, @p false wpp.
+ */
+bool listContains(List const *list, const char *num, size_t length);
+
+
+/**
+ * @brief Wyszukuje binarnie pierwszy numer większy od "num".
+ * @param list - wskaźnik na listę (może byc NULL).
+ * @param num - wskaźnik na numer.
+ * @return indeks pierwszego numeru > num (lub rozmiar listy).
+ */
+size_t listUpperBound(List const *list, const char *num);
+
+
+/**
+ * @brief Zwraca liczbę numerów w liście.
+ * @param list - wskaźnik na listę (może byc NULL).
+ * @return liczba numerów w liście.
  */
-void deleteFrwdStartsWthPref(List **list, const char *prefix);
+size_t listSize(List const *list);
 
 
 /**
- * @brief Funkcja znajduje i zwraca listę przekierowań
- * Funkcja znajduje i zwraca listę przekierowań w drzewie odwróconym
- * za podanym prefiksem.
- * @param pfRev - wskaźnik na drzewo odwrócone.
- * @param num - wskaźnik na numer przekierowania "skąd".
- * @return lista przekierowań "dokąd"
+ * @brief Udostępnia numer o podanym indeksie.
+ * @param list - wskaźnik na listę (może byc NULL).
+ * @param idx - indeks numeru.
+ * @return Wskaźnik na numer lub NULL, jeśli indeks ma za duża wartość.
  */
-List **getListOfForwardings(PhoneReverse *pfRev, const char *num);
+char const *listGet(List const *list, size_t idx);
 
 
 /**
@@ -77,4 +151,4 @@ List **getListOfForwardings(PhoneReverse *pfRev, const char *num);
 void listDelete(List *list);
 
 
-#endif //LIST_OF_NUMBERS_H
\ No newline at end of file
+#endif //LIST_OF_NUMBERS_H
@@ -9,27 +9,83 @@
  */
 
 #include "phnum.h"
-#include "../../../../Pobrane/Telegram Desktop/duże/src/list_of_numbers.h"
+#include "list_of_numbers.h"
+#include "phone_counters.h"
+#include "phone_memory.h"
 #include <stdlib.h>
+#include <string.h>
 
 
 
+PhoneNumbers *phnumNew(struct List const *list) {
+    size_t count = listSize(list);
+    size_t chars = 0;
+    for (size_t i = 0; i < count; i++) {
+        chars += strlen(listGet(list, i)) + 1;
+    }
+
+    COUNTERS_ADD(COUNTER_ALLOCATIONS, 1);
+    MEMORY_ENTER(MEMORY_RESULTS);
+    PhoneNumbers *pnum = malloc(sizeof(PhoneNumbers) + sizeof(size_t) * count + sizeof(char) * chars);
+    MEMORY_LEAVE();
+    if (pnum == NULL) {
+        return NULL;
+    }
+    pnum->count = count;
+    char *buffer = (char *) (pnum->offsets + count);
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t length = strlen(listGet(list, i)) + 1;
+        pnum->offsets[i] = offset;
+        memcpy(buffer + offset, listGet(list, i), sizeof(char) * length);
+        offset += length;
+    }
+    return pnum;
+}
+
+
+PhoneNumbers *phnumNewFromParts(PhoneNumberParts const *parts, size_t count) {
+    size_t chars = 0;
+    for (size_t i = 0; i < count; i++) {
+        chars += parts[i].firstLength + parts[i].secondLength + 1;
+    }
+
+    COUNTERS_ADD(COUNTER_ALLOCATIONS, 1);
+    MEMORY_ENTER(MEMORY_RESULTS);
+    PhoneNumbers *pnum = malloc(sizeof(PhoneNumbers) + sizeof(size_t) * count + sizeof(char) * chars);
+    MEMORY_LEAVE();
+    if (pnum == NULL) {
+        return NULL;
+    }
+    pnum->count = count;
+    char *buffer = (char *) (pnum->offsets + count);
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        pnum->offsets[i] = offset;
+        memcpy(buffer + offset, parts[i].first, sizeof(char) * parts[i].firstLength);
+        offset += parts[i].firstLength;
+        memcpy(buffer + offset, parts[i].second, sizeof(char) * parts[i].secondLength);
+        offset += parts[i].secondLength;
+        buffer[offset++] = '\0';
+    }
+    return pnum;
+}
+
+
+PhoneNumbers *phnumNewJoined(char const *first, char const *second) {
+    PhoneNumberParts parts = {first, strlen(first), second, strlen(second)};
+    return phnumNewFromParts(&parts, 1);
+}
+
+
+size_t phnumSize(PhoneNumbers const *pnum) {
+    return pnum != NULL ? pnum->count : 0;
+}
+
+
 char const *phnumGet(PhoneNumbers const *pnum, size_t idx) {
-    if ((pnum != NULL)) {
-        char const *p = NULL;
-        if (pnum->allNumbers != NULL) {
-            List *current = pnum->allNumbers;
-            int i = 0;
-            while (current != NULL && i <= (int) idx) {
-                if (i == (int) idx) {
-                    p = current->forwarding;
-                    break;
-                }
-                current = current->next;
-                i++;
-            }
-        }
-        return p;
+    if ((pnum != NULL) && (idx < pnum->count)) {
+        return (char const *) (pnum->offsets + pnum->count) + pnum->offsets[idx];
     } else {
         return NULL;
     }
@@ -37,11 +93,6 @@ char const *phnumGet(PhoneNumbers const *pnum, size_t idx) {
 
 
 void phnumDelete(PhoneNumbers *pnum) {
-    if (pnum != NULL) {
-        // Usuwanie przekierowania (listy)
-        listDelete(pnum->allNumbers);
-        // Usuwam podstrukturę i strukturę.
-        free(pnum);
-        pnum = NULL;
-    }
-}
\ No newline at end of file
+    // Cała struktura zajmuje jeden blok pamięci.
+    free(pnum);
+}
@@ -16,10 +16,13 @@
 
 /**
  * @brief Przechowuje strukturę numerów przekierowanych.
- * Przechowuję wszystkie wynikowe przekierowania w liście
+ * Przechowuję wszystkie wynikowe przekierowania w jednym bloku pamięci:
+ * liczba numerów, tablica przesunięć numerów i bufor znaków, w którym numery
+ * (zakończone znakiem '\0') leżą jeden za drugim zaraz za tablica przesunięć.
  */
 struct PhoneNumbers {
-    struct List *allNumbers;  ///<wskaźnik na listę numerów.
+    size_t count;  ///<liczba numerów.
+    size_t offsets[];  ///<przesunięcia kolejnych numerów w buforze znaków.
 };
 /**
  * @brief To jest typ PhoneNumbers.
@@ -28,6 +31,63 @@ struct PhoneNumbers {
 typedef struct PhoneNumbers PhoneNumbers;
 
 
+struct List;
+
+
+/** @brief Tworzy strukturę z numerów listy.
+ * Kopiuje numery z listy (w tej samej kolejności) do nowej struktury
+ * zajmującej jeden blok pamięci.
+ * @param[in] list - wskaźnik na listę numerów (NULL oznacza pusty ciąg).
+ * @return Wskaźnik na utworzona strukturę lub NULL, gdy nie udało sie
+ *         alokować pamięci.
+ */
+PhoneNumbers *phnumNew(struct List const *list);
+
+
+/**
+ * @brief Numer złożony z dwóch części, zapisywany bez napisu pośredniego.
+ */
+struct PhoneNumberParts {
+    char const *first;  ///<początek numeru.
+    size_t firstLength;  ///<liczba znaków początku.
+    char const *second;  ///<koniec numeru.
+    size_t secondLength;  ///<liczba znaków końca.
+};
+/**
+ * @brief To jest typ PhoneNumberParts.
+ *
+ */
+typedef struct PhoneNumberParts PhoneNumberParts;
+
+
+/** @brief Tworzy strukturę z numerów złożonych z części.
+ * Wykonuje dokładnie jedna alokację (blok wyniku), bez napisów pośrednich.
+ * @param[in] parts - tablica numerów (w kolejności wyniku);
+ * @param[in] count - liczba numerów.
+ * @return Wskaźnik na utworzona strukturę lub NULL, gdy nie udało sie
+ *         alokować pamięci.
+ */
+PhoneNumbers *phnumNewFromParts(PhoneNumberParts const *parts, size_t count);
+
+
+/** @brief Tworzy strukturę z jednym numerem będącym sklejeniem napisów.
+ * Wykonuje dokładnie jedna alokację (blok wyniku), bez napisów pośrednich.
+ * @param[in] first  - wskaźnik na początek numeru;
+ * @param[in] second - wskaźnik na koniec numeru (może byc pusty).
+ * @return Wskaźnik na utworzona strukturę lub NULL, gdy nie udało sie
+ *         alokować pamięci.
+ */
+PhoneNumbers *phnumNewJoined(char const *first, char const *second);
+
+
+/** @brief Zwraca liczbę numerów.
+ * @param[in] pnum - wskaźnik na strukturę przechowująca ciąg numerów telefonów.
+ * @return Liczba numerów w ciągu. Wartość 0, jeśli wskaźnik @p pnum ma
+ *         wartość NULL.
+ */
+size_t phnumSize(PhoneNumbers const *pnum);
+
+
 /** @brief Udostępnia numer.
  * Udostępnia wskaźnik na napis reprezentujący numer. Napisy sa indeksowane
  * kolejno od zera.
@@ -0,0 +1,621 @@
+/** @file
+ * Program mierzący wydajność operacji na przekierowaniach numerów
+ * telefonicznych na syntetycznych obciążeniach.
+ * Obciążenia many_ops, very_long i many_remove odpowiadają scenariuszom
+ * testów o tych nazwach, ale ich parametry można zmieniać argumentami
+ * postaci nazwa=wartość. Wyniki sa wypisywane na standardowe wyjście jako
+ * obiekty JSON, po jednym w wierszu. Argument engine wybiera silnik
+ * (phone_engine.h); engine=all wykonuje to samo obciążenie kolejno na
+ * wszystkich silnikach, co pozwala porównać je obok siebie.
+ * Program jest linkowany z opcjami -Wl,--wrap=malloc itd., a funkcje
+ * przechwytujące rozliczają pamięć z podziałem na rodzaje bloków
+ * (phone_memory.h).
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "phone_forward.h"
+#include "phone_engine.h"
+#include "phone_memory.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+
+
+/**
+ * @brief Parametry obciążenia.
+ */
+struct BenchConfig {
+    char const *workload;  ///<nazwa obciążenia.
+    size_t rules;  ///<liczba przekierowań dodawanych na początku.
+    size_t ops;  ///<liczba operacji w fazie mieszanej.
+    size_t minLength;  ///<najmniejsza długość numeru.
+    size_t maxLength;  ///<największa długość numeru.
+    size_t fanIn;  ///<średnia liczba przekierowań na ten sam numer "dokąd".
+    unsigned reads;  ///<procent odczytów w fazie mieszanej.
+    bool nested;  ///<czy numery "skąd" sa kolejnymi prefiksami jednego numeru.
+    uint64_t seed;  ///<ziarno generatora liczb losowych.
+    PhoneForwardEngine const *engine;  ///<mierzony silnik (NULL oznacza wszystkie).
+};
+
+
+/**
+ * @brief Mierzone rodzaje operacji.
+ */
+enum BenchOperation {
+    BENCH_ADD,  ///<phfwdAdd.
+    BENCH_GET,  ///<phfwdGet.
+    BENCH_REVERSE,  ///<phfwdReverse.
+    BENCH_GET_REVERSE,  ///<phfwdGetReverse.
+    BENCH_REMOVE,  ///<phfwdRemove.
+    BENCH_OPERATIONS  ///<liczba rodzajów operacji.
+};
+
+
+/** @brief Nazwy rodzajów operacji w wynikach. */
+static char const *const operationNames[BENCH_OPERATIONS] = {
+        "add", "get", "reverse", "get_reverse", "remove"
+};
+
+
+/** @brief Nazwy rodzajów bloków pamięci w wynikach. */
+static char const *const categoryNames[MEMORY_CATEGORIES] = {
+        "other", "forward_nodes", "reverse_nodes", "forwardings", "reverse_lists", "results"
+};
+
+
+/**
+ * @brief Czasy wykonania operacji jednego rodzaju.
+ */
+struct Latencies {
+    uint64_t *ns;  ///<czasy kolejnych operacji w nanosekundach.
+    size_t size;  ///<liczba operacji.
+    size_t capacity;  ///<rozmiar tablicy ns.
+};
+
+
+/**
+ * @brief Stan przebiegu pomiarów.
+ */
+struct Bench {
+    struct BenchConfig config;  ///<parametry obciążenia.
+    PhoneForward *pf;  ///<mierzona struktura.
+    uint64_t random;  ///<stan generatora liczb losowych.
+    char **sources;  ///<numery "skąd" dodanych przekierowań.
+    size_t sourcesCount;  ///<liczba numerów "skąd".
+    char **targets;  ///<pula numerów "dokąd".
+    size_t targetsCount;  ///<liczba numerów "dokąd".
+    char *query;  ///<bufor na numer zapytania.
+    struct Latencies latencies[BENCH_OPERATIONS];  ///<czasy operacji.
+};
+
+
+/**
+ * @brief Obciążenia predefiniowane (odpowiedniki testów).
+ */
+static struct BenchConfig const presets[] = {
+        {"many_ops", 100000, 1000000, 1, 12, 4, 90, false, 1, NULL},
+        {"very_long", 2000, 3000, 1000, 5000, 1, 90, false, 1, NULL},
+        {"many_remove", 10000, 300, 10000, 10000, 10000, 50, true, 1, NULL},
+};
+
+
+/**
+ * @brief Losuje liczbę (xorshift64*).
+ * @param bench - wskaźnik na stan pomiarów.
+ * @return losowa liczba.
+ */
+static uint64_t nextRandom(struct Bench *bench) {
+    bench->random ^= bench->random >> 12;
+    bench->random ^= bench->random << 25;
+    bench->random ^= bench->random >> 27;
+    return bench->random * 0x2545f4914f6cdd1dULL;
+}
+
+
+/**
+ * @brief Losuje liczbę z przedziału [low, high].
+ * @param bench - wskaźnik na stan pomiarów.
+ * @param low - dolny koniec przedziału.
+ * @param high - górny koniec przedziału.
+ * @return losowa liczba.
+ */
+static size_t randomBetween(struct Bench *bench, size_t low, size_t high) {
+    return low + (size_t) (nextRandom(bench) % (high - low + 1));
+}
+
+
+/**
+ * @brief Wypełnia bufor losowymi cyframi.
+ * @param bench - wskaźnik na stan pomiarów.
+ * @param buffer - wskaźnik na bufor.
+ * @param length - liczba cyfr.
+ */
+static void randomDigits(struct Bench *bench, char *buffer, size_t length) {
+    static char const digits[] = "0123456789*#";
+    for (size_t i = 0; i < length; i++) {
+        buffer[i] = digits[nextRandom(bench) % CHILDREN_NUMB];
+    }
+    buffer[length] = '\0';
+}
+
+
+/**
+ * @brief Tworzy losowy numer o długości z przedziału z parametrów.
+ * @param bench - wskaźnik na stan pomiarów.
+ * @return wskaźnik na numer lub NULL, gdy nie udało sie alokować pamięci.
+ */
+static char *randomNumber(struct Bench *bench) {
+    size_t length = randomBetween(bench, bench->config.minLength, bench->config.maxLength);
+    char *number = malloc(sizeof(char) * (length + 1));
+    if (number != NULL) {
+        randomDigits(bench, number, length);
+    }
+    return number;
+}
+
+
+/**
+ * @brief Zwraca bieżący czas w nanosekundach.
+ * @return czas zegara monotonicznego.
+ */
+static uint64_t now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000u + (uint64_t) time.tv_nsec;
+}
+
+
+/**
+ * @brief Zapisuje czas operacji.
+ * @param bench - wskaźnik na stan pomiarów.
+ * @param operation - rodzaj operacji.
+ * @param start - czas rozpoczęcia operacji.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool record(struct Bench *bench, enum BenchOperation operation, uint64_t start) {
+    uint64_t ns = now() - start;
+    struct Latencies *latencies = &bench->latencies[operation];
+    if (latencies->size == latencies->capacity) {
+        size_t capacity = latencies->capacity ? 2 * latencies->capacity : 1024;
+        uint64_t *newNs = realloc(latencies->ns, sizeof(uint64_t) * capacity);
+        if (newNs == NULL) {
+            return false;
+        }
+        latencies->ns = newNs;
+        latencies->capacity = capacity;
+    }
+    latencies->ns[latencies->size++] = ns;
+    return true;
+}
+
+
+/**
+ * @brief Przygotowuje numery przekierowań.
+ * @param bench - wskaźnik na stan pomiarów.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool generateNumbers(struct Bench *bench) {
+    struct BenchConfig const *config = &bench->config;
+    size_t fanIn = config->fanIn > 0 ? config->fanIn : 1;
+    bench->targetsCount = config->rules / fanIn > 0 ? config->rules / fanIn : 1;
+    bench->sources = calloc(config->rules + 1, sizeof(char *));
+    bench->targets = calloc(bench->targetsCount, sizeof(char *));
+    bench->query = malloc(sizeof(char) * (config->maxLength + 8));
+    if (bench->sources == NULL || bench->targets == NULL || bench->query == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < bench->targetsCount; i++) {
+        if ((bench->targets[i] = randomNumber(bench)) == NULL) {
+            return false;
+        }
+    }
+    char *base = config->nested ? randomNumber(bench) : NULL;
+    if (config->nested && base == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < config->rules; i++) {
+        if (config->nested) {
+            // Kolejne prefiksy numeru base, od najdłuższego.
+            size_t length = strlen(base) > i ? strlen(base) - i : 1;
+            bench->sources[i] = malloc(sizeof(char) * (length + 1));
+            if (bench->sources[i] != NULL) {
+                memcpy(bench->sources[i], base, length);
+                bench->sources[i][length] = '\0';
+            }
+        } else {
+            bench->sources[i] = randomNumber(bench);
+        }
+        if (bench->sources[i] == NULL) {
+            free(base);
+            return false;
+        }
+        bench->sourcesCount++;
+    }
+    free(base);
+    return true;
+}
+
+
+/**
+ * @brief Dodaje przekierowanie z numeru o podanym indeksie na losowy numer z puli.
+ * @param bench - wskaźnik na stan pomiarów.
+ * @param index - indeks numeru "skąd".
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool benchAdd(struct Bench *bench, size_t index) {
+    char const *target = bench->targets[nextRandom(bench) % bench->targetsCount];
+    uint64_t start = now();
+    phfwdAdd(bench->pf, bench->sources[index], target);
+    return record(bench, BENCH_ADD, start);
+}
+
+
+/**
+ * @brief Wykonuje zapytanie o numer z prefiksem z puli i losowym końcem.
+ * @param bench - wskaźnik na stan pomiarów.
+ * @param operation - rodzaj zapytania.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool benchQuery(struct Bench *bench, enum BenchOperation operation) {
+    char const *prefix = operation == BENCH_GET
+                         ? bench->sources[nextRandom(bench) % bench->sourcesCount]
+                         : bench->targets[nextRandom(bench) % bench->targetsCount];
+    size_t length = strlen(prefix);
+    memcpy(bench->query, prefix, length);
+    randomDigits(bench, bench->query + length, randomBetween(bench, 0, 4));
+
+    uint64_t start = now();
+    PhoneNumbers *pnum = operation == BENCH_GET ? phfwdGet(bench->pf, bench->query)
+                         : operation == BENCH_REVERSE ? phfwdReverse(bench->pf, bench->query)
+                         : phfwdGetReverse(bench->pf, bench->query);
+    bool ok = pnum != NULL && record(bench, operation, start);
+    phnumDelete(pnum);
+    return ok;
+}
+
+
+/**
+ * @brief Usuwa przekierowania o numerze "skąd" o podanym indeksie.
+ * @param bench - wskaźnik na stan pomiarów.
+ * @param index - indeks numeru "skąd".
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool benchRemove(struct Bench *bench, size_t index) {
+    uint64_t start = now();
+    phfwdRemove(bench->pf, bench->sources[index]);
+    return record(bench, BENCH_REMOVE, start);
+}
+
+
+/**
+ * @brief Porównuje czasy (dla qsort).
+ * @param a - wskaźnik na pierwszy czas.
+ * @param b - wskaźnik na drugi czas.
+ * @return liczba ujemna, zero lub dodatnia.
+ */
+static int compareLatencies(void const *a, void const *b) {
+    uint64_t x = *(uint64_t const *) a, y = *(uint64_t const *) b;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Wyznacza percentyl posortowanych czasów.
+ * @param latencies - wskaźnik na posortowane czasy.
+ * @param permille - percentyl w promilach.
+ * @return czas operacji.
+ */
+static uint64_t percentile(struct Latencies const *latencies, unsigned permille) {
+    size_t index = (size_t) ((latencies->size - 1) * (uint64_t) permille / 1000);
+    return latencies->ns[index];
+}
+
+
+/**
+ * @brief Wypisuje wyniki pomiarów operacji każdego rodzaju.
+ * @param bench - wskaźnik na stan pomiarów.
+ */
+static void report(struct Bench *bench) {
+    for (int i = 0; i < BENCH_OPERATIONS; i++) {
+        struct Latencies *latencies = &bench->latencies[i];
+        if (latencies->size == 0) {
+            continue;
+        }
+        qsort(latencies->ns, latencies->size, sizeof(uint64_t), compareLatencies);
+        uint64_t total = 0;
+        for (size_t j = 0; j < latencies->size; j++) {
+            total += latencies->ns[j];
+        }
+        printf("{\"workload\":\"%s\",\"engine\":\"%s\",\"op\":\"%s\",\"count\":%zu,\"ops_per_sec\":%.0f,"
+               "\"p50_ns\":%" PRIu64 ",\"p90_ns\":%" PRIu64 ",\"p99_ns\":%" PRIu64
+               ",\"p999_ns\":%" PRIu64 ",\"max_ns\":%" PRIu64 "}\n",
+               bench->config.workload, phfwdEngineOf(bench->pf)->name, operationNames[i], latencies->size,
+               total > 0 ? latencies->size * 1e9 / (double) total : 0.0,
+               percentile(latencies, 500), percentile(latencies, 900), percentile(latencies, 990),
+               percentile(latencies, 999), latencies->ns[latencies->size - 1]);
+    }
+}
+
+
+/**
+ * @brief Wypisuje zużycie pamięci przez każdy rodzaj bloków.
+ * @param workload - nazwa obciążenia.
+ * @param engine - nazwa silnika.
+ * @param loaded - stan pamięci po dodaniu przekierowań.
+ * @param memory - stan pamięci po zakończeniu obciążenia.
+ */
+static void reportMemory(char const *workload, char const *engine, PhoneForwardMemory const *loaded,
+                         PhoneForwardMemory const *memory) {
+    for (int i = 0; i < MEMORY_CATEGORIES; i++) {
+        printf("{\"workload\":\"%s\",\"engine\":\"%s\",\"memory\":\"%s\",\"loaded_bytes\":%zu,\"loaded_blocks\":%zu,"
+               "\"peak_bytes\":%zu,\"allocations\":%zu}\n",
+               workload, engine, categoryNames[i], loaded->bytes[i], loaded->blocks[i],
+               memory->peakBytes[i], memory->allocations[i]);
+    }
+    printf("{\"workload\":\"%s\",\"engine\":\"%s\",\"memory\":\"total\",\"loaded_bytes\":%zu,"
+           "\"peak_bytes\":%zu}\n",
+           workload, engine, loaded->totalBytes, memory->peakTotalBytes);
+}
+
+
+/**
+ * @brief Wykonuje obciążenie: dodanie przekierowań, fazę mieszaną i usunięcie.
+ * @param bench - wskaźnik na stan pomiarów.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool run(struct Bench *bench) {
+    struct BenchConfig const *config = &bench->config;
+    bool ok = true;
+    for (size_t i = 0; ok && i < bench->sourcesCount; i++) {
+        ok = benchAdd(bench, i);
+    }
+    PhoneForwardStats stats;
+    phfwdStats(bench->pf, &stats);
+    PhoneForwardMemory loaded;
+    bool accounted = phfwdMemory(&loaded);
+
+    for (size_t i = 0; ok && i < config->ops && bench->sourcesCount > 0; i++) {
+        if (nextRandom(bench) % 100 < config->reads) {
+            ok = benchQuery(bench, (enum BenchOperation) (BENCH_GET + nextRandom(bench) % 3));
+        } else if (nextRandom(bench) % 2 == 0) {
+            ok = benchAdd(bench, nextRandom(bench) % bench->sourcesCount);
+        } else {
+            ok = benchRemove(bench, nextRandom(bench) % bench->sourcesCount);
+        }
+    }
+    // Usuwam wszystkie przekierowania (przy numerach zagnieżdżonych
+    // pierwsze usunięcie najkrótszego prefiksu usuwa całe drzewo).
+    for (size_t i = bench->sourcesCount; ok && i > 0; i--) {
+        ok = benchRemove(bench, i - 1);
+    }
+    if (ok) {
+        report(bench);
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        printf("{\"workload\":\"%s\",\"engine\":\"%s\",\"rules\":%zu,\"forward_nodes\":%zu,\"reverse_nodes\":%zu,"
+               "\"bytes_allocated\":%zu,\"peak_rss_kb\":%ld}\n",
+               config->workload, phfwdEngineOf(bench->pf)->name, stats.rules, stats.forwardNodes, stats.reverseNodes,
+               stats.bytesAllocated, usage.ru_maxrss);
+        PhoneForwardMemory memory;
+        if (accounted && phfwdMemory(&memory)) {
+            reportMemory(config->workload, phfwdEngineOf(bench->pf)->name, &loaded, &memory);
+        }
+    }
+    return ok;
+}
+
+
+/**
+ * @brief Zwalnia pamięć przebiegu pomiarów.
+ * @param bench - wskaźnik na stan pomiarów.
+ */
+static void benchFree(struct Bench *bench) {
+    for (size_t i = 0; i < bench->sourcesCount; i++) {
+        free(bench->sources[i]);
+    }
+    for (size_t i = 0; bench->targets != NULL && i < bench->targetsCount; i++) {
+        free(bench->targets[i]);
+    }
+    for (int i = 0; i < BENCH_OPERATIONS; i++) {
+        free(bench->latencies[i].ns);
+    }
+    free(bench->sources);
+    free(bench->targets);
+    free(bench->query);
+    phfwdDelete(bench->pf);
+}
+
+
+/** @brief Funkcja malloc biblioteki standardowej. */
+void *__real_malloc(size_t size);
+/** @brief Funkcja calloc biblioteki standardowej. */
+void *__real_calloc(size_t nmemb, size_t size);
+/** @brief Funkcja realloc biblioteki standardowej. */
+void *__real_realloc(void *ptr, size_t size);
+/** @brief Funkcja reallocarray biblioteki standardowej. */
+void *__real_reallocarray(void *ptr, size_t nmemb, size_t size);
+/** @brief Funkcja strdup biblioteki standardowej. */
+char *__real_strdup(const char *s);
+/** @brief Funkcja strndup biblioteki standardowej. */
+char *__real_strndup(const char *s, size_t size);
+/** @brief Funkcja free biblioteki standardowej. */
+void __real_free(void *ptr);
+
+
+/**
+ * @brief Rozlicza wynik alokacji.
+ * @param old - realokowany blok lub NULL.
+ * @param ptr - wynik alokacji.
+ * @param size - rozmiar bloku.
+ * @return wynik alokacji @p ptr.
+ */
+static void *accounted(void *old, void *ptr, size_t size) {
+    if (ptr != NULL) {
+        memoryAllocated(old, ptr, size);
+    } else if (old != NULL && size == 0) {
+        memoryFreed(old);
+    }
+    return ptr;
+}
+
+
+/** @brief Przechwytuje malloc. */
+void *__wrap_malloc(size_t size) {
+    return accounted(NULL, __real_malloc(size), size);
+}
+
+
+/** @brief Przechwytuje calloc. */
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    return accounted(NULL, __real_calloc(nmemb, size), nmemb * size);
+}
+
+
+/** @brief Przechwytuje realloc. */
+void *__wrap_realloc(void *ptr, size_t size) {
+    return accounted(ptr, __real_realloc(ptr, size), size);
+}
+
+
+/** @brief Przechwytuje reallocarray. */
+void *__wrap_reallocarray(void *ptr, size_t nmemb, size_t size) {
+    return accounted(ptr, __real_reallocarray(ptr, nmemb, size), nmemb * size);
+}
+
+
+/** @brief Przechwytuje strdup. */
+char *__wrap_strdup(const char *s) {
+    return accounted(NULL, __real_strdup(s), strlen(s) + 1);
+}
+
+
+/** @brief Przechwytuje strndup. */
+char *__wrap_strndup(const char *s, size_t size) {
+    return accounted(NULL, __real_strndup(s, size), strnlen(s, size) + 1);
+}
+
+
+/** @brief Przechwytuje free. */
+void __wrap_free(void *ptr) {
+    memoryFreed(ptr);
+    __real_free(ptr);
+}
+
+
+/**
+ * @brief Ustawia parametr obciążenia z argumentu nazwa=wartość.
+ * @param config - wskaźnik na parametry.
+ * @param argument - argument programu.
+ * @return Wartość @p false, jeśli argument jest niepoprawny.
+ */
+static bool parseArgument(struct BenchConfig *config, char const *argument) {
+    char const *value = strchr(argument, '=');
+    if (value == NULL) {
+        return false;
+    }
+    size_t nameLength = (size_t) (value - argument);
+    value++;
+    if (nameLength == 6 && strncmp(argument, "preset", nameLength) == 0) {
+        for (size_t i = 0; i < sizeof(presets) / sizeof(presets[0]); i++) {
+            if (strcmp(presets[i].workload, value) == 0) {
+                PhoneForwardEngine const *engine = config->engine;
+                *config = presets[i];
+                config->engine = engine;
+                return true;
+            }
+        }
+        return false;
+    }
+    if (nameLength == 8 && strncmp(argument, "workload", nameLength) == 0) {
+        config->workload = value;
+        return true;
+    }
+    if (nameLength == 6 && strncmp(argument, "engine", nameLength) == 0) {
+        config->engine = phfwdEngine(value);
+        return config->engine != NULL || strcmp(value, "all") == 0;
+    }
+    char *end;
+    unsigned long long number = strtoull(value, &end, 10);
+    if (*value == '\0' || *end != '\0') {
+        return false;
+    }
+    struct {
+        char const *name;
+        size_t *field;
+    } const fields[] = {
+            {"rules", &config->rules}, {"ops", &config->ops}, {"min_length", &config->minLength},
+            {"max_length", &config->maxLength}, {"fan_in", &config->fanIn},
+    };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (strlen(fields[i].name) == nameLength && strncmp(argument, fields[i].name, nameLength) == 0) {
+            *fields[i].field = (size_t) number;
+            return true;
+        }
+    }
+    if (nameLength == 5 && strncmp(argument, "reads", nameLength) == 0 && number <= 100) {
+        config->reads = (unsigned) number;
+    } else if (nameLength == 6 && strncmp(argument, "nested", nameLength) == 0 && number <= 1) {
+        config->nested = number == 1;
+    } else if (nameLength == 4 && strncmp(argument, "seed", nameLength) == 0 && number > 0) {
+        config->seed = number;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Uruchamia pomiary.
+ * Argumenty (nazwa=wartość, przetwarzane kolejno): preset (many_ops,
+ * very_long, many_remove), workload (nazwa w wynikach), rules, ops,
+ * min_length, max_length, fan_in, reads (procent), nested (0 lub 1), seed,
+ * engine (nazwa silnika lub all).
+ * @param argc - liczba argumentów.
+ * @param argv - argumenty.
+ * @return 0, jeśli pomiary sie udały, 1 - jeśli argumenty sa niepoprawne,
+ *         2 - jeśli zabrakło pamięci.
+ */
+int main(int argc, char *argv[]) {
+    struct BenchConfig config = presets[0];
+    config.engine = defaultEngine();
+    for (int i = 1; i < argc; i++) {
+        if (!parseArgument(&config, argv[i])) {
+            fprintf(stderr, "usage: %s [preset=many_ops|very_long|many_remove] [rules=N] [ops=N]\n"
+                            "       [min_length=N] [max_length=N] [fan_in=N] [reads=PERCENT]\n"
+                            "       [nested=0|1] [seed=N] [workload=NAME] [engine=NAME|all]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (config.minLength == 0 || config.minLength > config.maxLength) {
+        fprintf(stderr, "%s: invalid number lengths\n", argv[0]);
+        return 1;
+    }
+    bool ok = true;
+    for (size_t i = 0; ok && (config.engine != NULL ? i == 0 : phfwdEngineAt(i) != NULL); i++) {
+        // Każdy silnik dostaje te same numery i operacje (to samo ziarno).
+        struct Bench bench;
+        memset(&bench, 0, sizeof(bench));
+        bench.config = config;
+        bench.random = config.seed;
+        phfwdMemoryStart();
+        bench.pf = phfwdNewEngine(config.engine != NULL ? config.engine : phfwdEngineAt(i));
+        ok = bench.pf != NULL && generateNumbers(&bench) && run(&bench);
+        benchFree(&bench);
+        phfwdMemoryStop();
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 2;
+    }
+    return 0;
+}
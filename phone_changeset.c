@@ -0,0 +1,169 @@
+/** @file
+ * Implementacja zestawu zmian przekierowań numerów telefonicznych.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#include "phone_changeset.h"
+#include "phone_forward.h"
+#include "list_of_numbers.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+
+
+PhoneForwardChangeset *phfwdChangesetNew(void) {
+    PhoneForwardChangeset *cs = (PhoneForwardChangeset *) malloc(sizeof(PhoneForwardChangeset));
+    if (cs != NULL) {
+        cs->operations = NULL;
+        cs->size = 0;
+        cs->capacity = 0;
+    }
+    return cs;
+}
+
+
+void phfwdChangesetDelete(PhoneForwardChangeset *cs) {
+    if (cs != NULL) {
+        for (size_t i = 0; i < cs->size; i++) {
+            free(cs->operations[i].num1);
+            free(cs->operations[i].num2);
+        }
+        free(cs->operations);
+        free(cs);
+    }
+}
+
+
+/**
+ * @brief Tworzy kopię napisu.
+ * @param str - wskaźnik na napis.
+ * @return wskaźnik na kopię lub NULL, gdy nie udało sie alokować pamięci.
+ */
+static char *copyString(char const *str) {
+    char *copy = malloc(sizeof(char) * (strlen(str) + 1));
+    if (copy != NULL) {
+        strcpy(copy, str);
+    }
+    return copy;
+}
+
+
+/**
+ * @brief Dopisuje operację na koniec zestawu.
+ * @param cs - wskaźnik na zestaw zmian.
+ * @param num1 - pierwszy numer operacji.
+ * @param num2 - drugi numer operacji lub NULL przy usuwaniu.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool appendOperation(PhoneForwardChangeset *cs, char const *num1, char const *num2) {
+    if (cs->size == cs->capacity) {
+        size_t newCapacity = cs->capacity ? 2 * cs->capacity : 16;
+        struct ChangesetOperation *newOperations =
+                realloc(cs->operations, sizeof(struct ChangesetOperation) * newCapacity);
+        if (newOperations == NULL) {
+            return false;
+        }
+        cs->operations = newOperations;
+        cs->capacity = newCapacity;
+    }
+    char *copy1 = copyString(num1);
+    char *copy2 = num2 != NULL ? copyString(num2) : NULL;
+    if (copy1 == NULL || (num2 != NULL && copy2 == NULL)) {
+        free(copy1);
+        free(copy2);
+        return false;
+    }
+    cs->operations[cs->size].num1 = copy1;
+    cs->operations[cs->size].num2 = copy2;
+    cs->size++;
+    return true;
+}
+
+
+bool phfwdChangesetAdd(PhoneForwardChangeset *cs, char const *num1, char const *num2) {
+    if (cs == NULL || !isStringAPhoneNumber(num1) || !isStringAPhoneNumber(num2)
+        || strcmp(num1, num2) == 0) {
+        return false;
+    }
+    return appendOperation(cs, num1, num2);
+}
+
+
+bool phfwdChangesetRemove(PhoneForwardChangeset *cs, char const *num) {
+    if (cs == NULL || !isStringAPhoneNumber(num)) {
+        return false;
+    }
+    return appendOperation(cs, num, NULL);
+}
+
+
+/**
+ * @brief Sprawdza, czy któryś prefiks numeru należy do listy.
+ * @param list - lista prefiksów.
+ * @param num - wskaźnik na numer.
+ * @return Wartość @p true, jeśli numer zaczyna sie którymś prefiksem z listy.
+ */
+static bool hasPrefixInList(List const *list, char const *num) {
+    if (listSize(list) == 0) {
+        return false;
+    }
+    for (size_t length = 1; num[length - 1] != '\0'; length++) {
+        if (listContains(list, num, length)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @brief Porównuje przekierowania według numeru "skąd" (dla qsort).
+ * @param first - wskaźnik na pierwsze przekierowanie.
+ * @param second - wskaźnik na drugie przekierowanie.
+ * @return int - liczba dodatnia/ujemna/zero w zależności od wyniku porównania
+ */
+static int compareRules(void const *first, void const *second) {
+    return compareNumbers(((PhoneForwardRule const *) first)->from,
+                          ((PhoneForwardRule const *) second)->from);
+}
+
+
+bool phfwdChangesetApply(PhoneForward *pf, PhoneForwardChangeset const *cs) {
+    if (pf == NULL || cs == NULL) {
+        return false;
+    }
+    List *removes = NULL;    // Usunięcia późniejsze od przeglądanej operacji.
+    List *laterAdds = NULL;  // Numery "skąd" późniejszych dodań.
+    PhoneForwardRule *adds = malloc(sizeof(PhoneForwardRule) * (cs->size + 1));
+    size_t count = 0;
+    bool ok = (adds != NULL);
+
+    // Przeglądam operacje od końca: dodanie jest zbędne, jeśli później
+    // to samo przekierowanie zostaje zastąpione lub usunięte.
+    for (size_t i = cs->size; ok && i > 0; i--) {
+        struct ChangesetOperation const *op = &cs->operations[i - 1];
+        if (op->num2 == NULL) {
+            ok = insertToList(&removes, op->num1);
+        } else if (!hasPrefixInList(removes, op->num1)
+                   && !listContains(laterAdds, op->num1, strlen(op->num1))) {
+            ok = insertToList(&laterAdds, op->num1);
+            adds[count].from = op->num1;
+            adds[count].to = op->num2;
+            count++;
+        }
+    }
+    if (ok) {
+        // Usunięcia wykonuję przed dodaniami: pozostawione dodania nie leżą
+        // pod żadnym późniejszym usunięciem.
+        qsort(adds, count, sizeof(PhoneForwardRule), compareRules);
+        ok = phfwdApplyBatch(pf, removes, adds, count);
+    }
+    listDelete(removes);
+    listDelete(laterAdds);
+    free(adds);
+    return ok;
+}
@@ -0,0 +1,102 @@
+/** @file
+ * Interfejs zestawu zmian przekierowań numerów telefonicznych,
+ * stosowanego atomowo do struktury PhoneForward.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_CHANGESET_H
+#define PHONE_CHANGESET_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "phone_forward.h"
+
+
+
+/**
+ * @brief Pojedyncza operacja zestawu zmian.
+ * Dodanie przekierowania z @p num1 na @p num2 albo (gdy @p num2 ma wartość
+ * NULL) usunięcie przekierowań o prefiksie @p num1.
+ */
+struct ChangesetOperation {
+    char *num1;  ///<prefiks numerów przekierowywanych lub usuwanych.
+    char *num2;  ///<prefiks, na który jest przekierowanie, lub NULL przy usuwaniu.
+};
+
+
+/**
+ * @brief Zestaw zmian.
+ * Przechowuje operacje w kolejności ich dodawania.
+ */
+struct PhoneForwardChangeset {
+    struct ChangesetOperation *operations;  ///<tablica operacji.
+    size_t size;  ///<liczba operacji.
+    size_t capacity;  ///<rozmiar zaalokowanej tablicy.
+};
+/**
+ * @brief To jest typ PhoneForwardChangeset.
+ *
+ */
+typedef struct PhoneForwardChangeset PhoneForwardChangeset;
+
+
+/** @brief Tworzy nowy, pusty zestaw zmian.
+ * @return Wskaźnik na utworzona strukturę lub NULL, gdy nie udało sie
+ *         alokować pamięci.
+ */
+PhoneForwardChangeset *phfwdChangesetNew(void);
+
+
+/** @brief Usuwa zestaw zmian.
+ * Nic nie robi, jeśli wskaźnik @p cs ma wartość NULL.
+ * @param[in] cs - wskaźnik na usuwana strukturę.
+ */
+void phfwdChangesetDelete(PhoneForwardChangeset *cs);
+
+
+/** @brief Dodaje do zestawu dodanie przekierowania.
+ * Przekierowanie zostanie dodane przy zastosowaniu zestawu tak jak przez
+ * @ref phfwdAdd.
+ * @param[in,out] cs - wskaźnik na zestaw zmian;
+ * @param[in] num1   - wskaźnik na napis reprezentujący prefiks numerów
+ *                     przekierowywanych;
+ * @param[in] num2   - wskaźnik na napis reprezentujący prefiks numerów,
+ *                     na które jest wykonywane przekierowanie.
+ * @return Wartość @p true, jeśli operacja została dodana.
+ *         Wartość @p false, jeśli dane sa niepoprawne (jak w @ref phfwdAdd)
+ *         lub nie udało sie alokować pamięci.
+ */
+bool phfwdChangesetAdd(PhoneForwardChangeset *cs, char const *num1, char const *num2);
+
+
+/** @brief Dodaje do zestawu usunięcie przekierowań.
+ * Przekierowania zostaną usunięte przy zastosowaniu zestawu tak jak przez
+ * @ref phfwdRemove.
+ * @param[in,out] cs - wskaźnik na zestaw zmian;
+ * @param[in] num    - wskaźnik na napis reprezentujący prefiks usuwanych numerów.
+ * @return Wartość @p true, jeśli operacja została dodana.
+ *         Wartość @p false, jeśli napis nie reprezentuje numeru lub nie udało
+ *         sie alokować pamięci.
+ */
+bool phfwdChangesetRemove(PhoneForwardChangeset *cs, char const *num);
+
+
+/** @brief Atomowo stosuje zestaw zmian.
+ * Wynik jest taki sam, jak przy wykonaniu operacji zestawu po kolei, ale
+ * zbędne operacje (dodanie przekierowania, które później zostaje zastąpione
+ * lub usunięte) sa pomijane, usunięcia przechodzą każde poddrzewo raz,
+ * a dodawanie odbywa sie w porządku leksykograficznym. Zestaw pozostaje
+ * niezmieniony.
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] cs     - wskaźnik na zestaw zmian.
+ * @return Wartość @p true, jeśli zestaw został zastosowany w całości.
+ *         Wartość @p false, jeśli któryś wskaźnik ma wartość NULL lub nie
+ *         udało sie alokować pamięci (struktura @p pf pozostaje wtedy
+ *         niezmieniona).
+ */
+bool phfwdChangesetApply(PhoneForward *pf, PhoneForwardChangeset const *cs);
+
+
+#endif //PHONE_CHANGESET_H
@@ -0,0 +1,165 @@
+/** @file
+ * Implementacja zwartego, binarnego kodowania numerów telefonicznych.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#include "phone_codec.h"
+#include "phone_forward.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+void bufferInit(ByteBuffer *buffer) {
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+}
+
+
+void bufferFree(ByteBuffer *buffer) {
+    free(buffer->data);
+    bufferInit(buffer);
+}
+
+
+bool bufferReserve(ByteBuffer *buffer, size_t extra) {
+    if (buffer->capacity - buffer->size >= extra) {
+        return true;
+    }
+    size_t newCapacity = buffer->capacity ? buffer->capacity : 64;
+    while (newCapacity - buffer->size < extra) {
+        newCapacity *= 2;
+    }
+    uint8_t *newData = realloc(buffer->data, newCapacity);
+    if (newData == NULL) {
+        return false;
+    }
+    buffer->data = newData;
+    buffer->capacity = newCapacity;
+    return true;
+}
+
+
+bool bufferPut(ByteBuffer *buffer, void const *bytes, size_t count) {
+    if (!bufferReserve(buffer, count)) {
+        return false;
+    }
+    memcpy(buffer->data + buffer->size, bytes, count);
+    buffer->size += count;
+    return true;
+}
+
+
+bool bufferPutVarint(ByteBuffer *buffer, uint64_t value) {
+    uint8_t bytes[10];
+    size_t count = 0;
+    do {
+        bytes[count] = value & 0x7f;
+        value >>= 7;
+        if (value != 0) {
+            bytes[count] |= 0x80;
+        }
+        count++;
+    } while (value != 0);
+    return bufferPut(buffer, bytes, count);
+}
+
+
+bool bufferPutNumber(ByteBuffer *buffer, char const *num) {
+    size_t length = strlen(num);
+    if (!bufferPutVarint(buffer, length) || !bufferReserve(buffer, (length + 1) / 2)) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i += 2) {
+        uint8_t high = (uint8_t) get_digit(num[i]);
+        uint8_t low = i + 1 < length ? (uint8_t) get_digit(num[i + 1]) : 0;
+        buffer->data[buffer->size++] = (uint8_t) (high << 4 | low);
+    }
+    return true;
+}
+
+
+bool bufferWrite(ByteBuffer const *buffer, int fd) {
+    size_t written = 0;
+    while (written < buffer->size) {
+        ssize_t result = write(fd, buffer->data + written, buffer->size - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += (size_t) result;
+    }
+    return true;
+}
+
+
+bool bufferReadAll(ByteBuffer *buffer, int fd) {
+    while (true) {
+        if (!bufferReserve(buffer, 1 << 16)) {
+            return false;
+        }
+        ssize_t result = read(fd, buffer->data + buffer->size, buffer->capacity - buffer->size);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (result == 0) {
+            return true;
+        }
+        buffer->size += (size_t) result;
+    }
+}
+
+
+bool readerGetVarint(ByteReader *reader, uint64_t *value) {
+    *value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (reader->pos == reader->end) {
+            return false;
+        }
+        uint8_t byte = *reader->pos++;
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool readerGetNumber(ByteReader *reader, ByteBuffer *scratch) {
+    static char const digits[] = "0123456789*#";
+    uint64_t length;
+    // Porównuję bez liczenia length + 1, które przepełnia sie dla
+    // length == UINT64_MAX.
+    if (!readerGetVarint(reader, &length) || length == 0
+        || length > 2 * (uint64_t) (reader->end - reader->pos)) {
+        return false;
+    }
+    scratch->size = 0;
+    if (!bufferReserve(scratch, length + 1)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < length; i++) {
+        uint8_t byte = reader->pos[i / 2];
+        uint8_t digit = (i % 2 == 0) ? byte >> 4 : byte & 0x0f;
+        if (digit > 11) {
+            return false;
+        }
+        scratch->data[i] = (uint8_t) digits[digit];
+    }
+    scratch->data[length] = '\0';
+    scratch->size = length + 1;
+    reader->pos += (length + 1) / 2;
+    return true;
+}
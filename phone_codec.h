@@ -0,0 +1,152 @@
+/** @file
+ * Interfejs zwartego, binarnego kodowania numerów telefonicznych
+ * (używanego przez dziennik i zrzuty przekierowań).
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_CODEC_H
+#define PHONE_CODEC_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+/**
+ * @brief Operacje na przekierowaniach.
+ * Ich numery sa zapisywane w śladach wywołań i ramkach zapytań serwera;
+ * dla nich sa też zbierane liczniki operacji.
+ */
+typedef enum PhoneForwardOperation {
+    OPERATION_GET,  ///<phfwdGet.
+    OPERATION_REVERSE,  ///<phfwdReverse.
+    OPERATION_GET_REVERSE,  ///<phfwdGetReverse.
+    OPERATION_ADD,  ///<phfwdAdd.
+    OPERATION_REMOVE,  ///<phfwdRemove.
+    OPERATIONS_COUNT  ///<liczba operacji.
+} PhoneForwardOperation;
+
+
+/**
+ * @brief Bufor bajtów powiększany w miarę potrzeby.
+ */
+struct ByteBuffer {
+    uint8_t *data;  ///<zawartość bufora.
+    size_t size;  ///<liczba zapisanych bajtów.
+    size_t capacity;  ///<rozmiar zaalokowanej pamięci.
+};
+/**
+ * @brief To jest typ ByteBuffer.
+ *
+ */
+typedef struct ByteBuffer ByteBuffer;
+
+
+/**
+ * @brief Czytnik bajtów z ciągłego obszaru pamięci.
+ */
+struct ByteReader {
+    uint8_t const *pos;  ///<następny bajt do przeczytania.
+    uint8_t const *end;  ///<koniec obszaru.
+};
+/**
+ * @brief To jest typ ByteReader.
+ *
+ */
+typedef struct ByteReader ByteReader;
+
+
+/**
+ * @brief Inicjuje pusty bufor.
+ * @param buffer - wskaźnik na bufor.
+ */
+void bufferInit(ByteBuffer *buffer);
+
+
+/**
+ * @brief Zwalnia pamięć bufora (bufor staje sie pusty).
+ * @param buffer - wskaźnik na bufor.
+ */
+void bufferFree(ByteBuffer *buffer);
+
+
+/**
+ * @brief Zapewnia w buforze miejsce na co najmniej @p extra kolejnych bajtów.
+ * @param buffer - wskaźnik na bufor.
+ * @param extra - liczba bajtów.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+bool bufferReserve(ByteBuffer *buffer, size_t extra);
+
+
+/**
+ * @brief Dopisuje bajty na koniec bufora.
+ * @param buffer - wskaźnik na bufor.
+ * @param bytes - wskaźnik na dopisywane bajty.
+ * @param count - liczba bajtów.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+bool bufferPut(ByteBuffer *buffer, void const *bytes, size_t count);
+
+
+/**
+ * @brief Dopisuje liczbę w kodowaniu o zmiennej długości (7 bitów na bajt).
+ * @param buffer - wskaźnik na bufor.
+ * @param value - liczba.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+bool bufferPutVarint(ByteBuffer *buffer, uint64_t value);
+
+
+/**
+ * @brief Dopisuje numer: długość, a następnie cyfry po dwie w bajcie.
+ * @param buffer - wskaźnik na bufor.
+ * @param num - wskaźnik na poprawny numer.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+bool bufferPutNumber(ByteBuffer *buffer, char const *num);
+
+
+/**
+ * @brief Zapisuje cały bufor do deskryptora pliku.
+ * @param buffer - wskaźnik na bufor.
+ * @param fd - deskryptor pliku.
+ * @return Wartość @p false, jeśli zapis sie nie udał.
+ */
+bool bufferWrite(ByteBuffer const *buffer, int fd);
+
+
+/**
+ * @brief Wczytuje do bufora zawartość deskryptora od bieżącej pozycji do końca.
+ * @param buffer - wskaźnik na bufor (dane sa dopisywane na koniec).
+ * @param fd - deskryptor pliku.
+ * @return Wartość @p false, jeśli odczyt lub alokacja pamięci sie nie udała.
+ */
+bool bufferReadAll(ByteBuffer *buffer, int fd);
+
+
+/**
+ * @brief Czyta liczbę zapisana przez @ref bufferPutVarint.
+ * @param reader - wskaźnik na czytnik.
+ * @param value - wskaźnik na wynik.
+ * @return Wartość @p false, jeśli dane sa niepełne lub niepoprawne.
+ */
+bool readerGetVarint(ByteReader *reader, uint64_t *value);
+
+
+/**
+ * @brief Czyta numer zapisany przez @ref bufferPutNumber.
+ * Numer (zakończony znakiem '\0') trafia do bufora @p scratch, który jest
+ * w razie potrzeby powiększany.
+ * @param reader - wskaźnik na czytnik.
+ * @param scratch - wskaźnik na bufor na numer.
+ * @return Wartość @p false, jeśli dane sa niepełne, niepoprawne lub nie udało
+ *         sie alokować pamięci.
+ */
+bool readerGetNumber(ByteReader *reader, ByteBuffer *scratch);
+
+
+#endif //PHONE_CODEC_H
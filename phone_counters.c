@@ -0,0 +1,147 @@
+/** @file
+ * Implementacja liczników operacji na przekierowaniach numerów
+ * telefonicznych.
+ * Każdy wątek zapisuje liczniki we własnej pamięci wątku, więc ich
+ * zwiększanie nie wymaga synchronizacji. Przy pierwszej operacji wątek
+ * dopisuje sie do listy wątków, a przy zakończeniu przenosi swoje liczniki
+ * do sumy liczników zakończonych wątków.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#include "phone_counters.h"
+#include <stddef.h>
+
+#ifdef PHFWD_COUNTERS
+#include <pthread.h>
+
+_Thread_local struct ThreadCounters threadCounters;
+
+/** @brief Chroni listę wątków i liczniki zakończonych wątków. */
+static pthread_mutex_t registryMutex = PTHREAD_MUTEX_INITIALIZER;
+/** @brief Lista wątków, które wykonały operację. */
+static struct ThreadCounters *registry = NULL;
+/** @brief Suma liczników zakończonych wątków. */
+static uint64_t retired[OPERATIONS_COUNT][COUNTERS_COUNT];
+/** @brief Klucz, którego destruktor wyrejestrowuje kończący sie wątek. */
+static pthread_key_t exitKey;
+/** @brief Zapewnia jednokrotne utworzenie klucza exitKey. */
+static pthread_once_t exitKeyOnce = PTHREAD_ONCE_INIT;
+
+
+/**
+ * @brief Przenosi liczniki kończącego sie wątku do sumy i usuwa go z listy.
+ * @param data - wskaźnik na liczniki wątku.
+ */
+static void unregisterThread(void *data) {
+    struct ThreadCounters *thread = data;
+    pthread_mutex_lock(&registryMutex);
+    for (int i = 0; i < OPERATIONS_COUNT; i++) {
+        for (int j = 0; j < COUNTERS_COUNT; j++) {
+            retired[i][j] += atomic_load_explicit(&thread->values[i][j], memory_order_relaxed);
+        }
+    }
+    if (thread->prev != NULL) {
+        thread->prev->next = thread->next;
+    } else {
+        registry = thread->next;
+    }
+    if (thread->next != NULL) {
+        thread->next->prev = thread->prev;
+    }
+    thread->registered = false;
+    pthread_mutex_unlock(&registryMutex);
+}
+
+
+/**
+ * @brief Tworzy klucz exitKey.
+ */
+static void createExitKey(void) {
+    pthread_key_create(&exitKey, unregisterThread);
+}
+
+
+int countersEnter(PhoneForwardOperation operation) {
+    struct ThreadCounters *thread = &threadCounters;
+    if (!thread->registered) {
+        pthread_once(&exitKeyOnce, createExitKey);
+        pthread_setspecific(exitKey, thread);
+        pthread_mutex_lock(&registryMutex);
+        thread->prev = NULL;
+        thread->next = registry;
+        if (registry != NULL) {
+            registry->prev = thread;
+        }
+        registry = thread;
+        thread->registered = true;
+        pthread_mutex_unlock(&registryMutex);
+    }
+    int previous = thread->operation;
+    thread->operation = (int) operation + 1;
+    countersAdd(COUNTER_CALLS, 1);
+    return previous;
+}
+#endif
+
+
+/**
+ * @brief Przepisuje liczniki z tablicy do struktury.
+ * @param values - liczniki w kolejności @ref CounterKind.
+ * @param counters - wskaźnik na wypełniane liczniki.
+ */
+static void fillCounters(uint64_t const values[COUNTERS_COUNT], PhoneForwardCounters *counters) {
+    counters->calls = values[COUNTER_CALLS];
+    counters->nodes = values[COUNTER_NODES];
+    counters->scanned = values[COUNTER_SCANNED];
+    counters->compares = values[COUNTER_COMPARES];
+    counters->allocations = values[COUNTER_ALLOCATIONS];
+}
+
+
+bool phfwdCountersEnabled(void) {
+#ifdef PHFWD_COUNTERS
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+bool phfwdCounters(PhoneForwardOperation operation, PhoneForwardCounters *counters) {
+    if ((unsigned) operation >= OPERATIONS_COUNT || counters == NULL) {
+        return false;
+    }
+    uint64_t values[COUNTERS_COUNT] = {0};
+#ifdef PHFWD_COUNTERS
+    pthread_mutex_lock(&registryMutex);
+    for (int j = 0; j < COUNTERS_COUNT; j++) {
+        values[j] = retired[operation][j];
+    }
+    for (struct ThreadCounters *thread = registry; thread != NULL; thread = thread->next) {
+        for (int j = 0; j < COUNTERS_COUNT; j++) {
+            values[j] += atomic_load_explicit(&thread->values[operation][j], memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&registryMutex);
+#endif
+    fillCounters(values, counters);
+    return true;
+}
+
+
+bool phfwdThreadCounters(PhoneForwardOperation operation, PhoneForwardCounters *counters) {
+    if ((unsigned) operation >= OPERATIONS_COUNT || counters == NULL) {
+        return false;
+    }
+    uint64_t values[COUNTERS_COUNT] = {0};
+#ifdef PHFWD_COUNTERS
+    for (int j = 0; j < COUNTERS_COUNT; j++) {
+        values[j] = atomic_load_explicit(&threadCounters.values[operation][j], memory_order_relaxed);
+    }
+#endif
+    fillCounters(values, counters);
+    return true;
+}
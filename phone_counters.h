@@ -0,0 +1,138 @@
+/** @file
+ * Interfejs liczników operacji na przekierowaniach numerów telefonicznych.
+ * Liczniki sa wkompilowane tylko wtedy, gdy zdefiniowane jest makro
+ * PHFWD_COUNTERS (opcja PHFWD_COUNTERS w CMake); w przeciwnym razie makra
+ * COUNTERS_* nic nie robią, a funkcje odczytu zwracają zera.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_COUNTERS_H
+#define PHONE_COUNTERS_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "phone_codec.h"
+
+
+
+/**
+ * @brief Rodzaje zliczanych zdarzeń.
+ */
+enum CounterKind {
+    COUNTER_CALLS,  ///<wywołania.
+    COUNTER_NODES,  ///<odwiedzone wierzchołki drzew.
+    COUNTER_SCANNED,  ///<przejrzane elementy list drzewa odwróconego.
+    COUNTER_COMPARES,  ///<porównania numerów.
+    COUNTER_ALLOCATIONS,  ///<alokacje pamięci.
+    COUNTERS_COUNT  ///<liczba rodzajów zdarzeń.
+};
+
+
+/**
+ * @brief Liczniki jednej operacji.
+ */
+struct PhoneForwardCounters {
+    uint64_t calls;  ///<liczba wywołań.
+    uint64_t nodes;  ///<liczba odwiedzonych wierzchołków drzew.
+    uint64_t scanned;  ///<liczba przejrzanych elementów list drzewa odwróconego.
+    uint64_t compares;  ///<liczba porównań numerów.
+    uint64_t allocations;  ///<liczba alokacji pamięci.
+};
+/**
+ * @brief To jest typ PhoneForwardCounters.
+ *
+ */
+typedef struct PhoneForwardCounters PhoneForwardCounters;
+
+
+/** @brief Sprawdza, czy liczniki sa wkompilowane.
+ * @return Wartość @p true, jeśli biblioteka została skompilowana z PHFWD_COUNTERS.
+ */
+bool phfwdCountersEnabled(void);
+
+
+/** @brief Podaje liczniki operacji zsumowane po wszystkich wątkach.
+ * Obejmuje także wątki, które już sie zakończyły. Liczniki tylko rosną,
+ * więc koszt fragmentu obciążenia to różnica dwóch odczytów.
+ * @param[in] operation - operacja;
+ * @param[out] counters - wskaźnik na wypełniane liczniki.
+ * @return Wartość @p false, jeśli argumenty sa niepoprawne.
+ */
+bool phfwdCounters(PhoneForwardOperation operation, PhoneForwardCounters *counters);
+
+
+/** @brief Podaje liczniki operacji bieżącego wątku.
+ * Różnica odczytów przed i po wywołaniu daje koszt tego wywołania.
+ * @param[in] operation - operacja;
+ * @param[out] counters - wskaźnik na wypełniane liczniki.
+ * @return Wartość @p false, jeśli argumenty sa niepoprawne.
+ */
+bool phfwdThreadCounters(PhoneForwardOperation operation, PhoneForwardCounters *counters);
+
+
+#ifdef PHFWD_COUNTERS
+#include <stdatomic.h>
+
+/**
+ * @brief Liczniki jednego wątku.
+ * Zmienia je tylko wątek właściciel (bez instrukcji atomowych typu
+ * read-modify-write), a inne wątki jedynie je odczytują.
+ */
+struct ThreadCounters {
+    _Atomic uint64_t values[OPERATIONS_COUNT][COUNTERS_COUNT];  ///<liczniki.
+    int operation;  ///<bieżąca operacja powiększona o 1 (0 - żadna).
+    bool registered;  ///<czy wątek jest na liście wątków.
+    struct ThreadCounters *prev;  ///<poprzedni wątek na liście.
+    struct ThreadCounters *next;  ///<następny wątek na liście.
+};
+
+/** @brief Liczniki bieżącego wątku. */
+extern _Thread_local struct ThreadCounters threadCounters;
+
+
+/** @brief Rozpoczyna operację w bieżącym wątku i zlicza jej wywołanie.
+ * @param operation - operacja.
+ * @return poprzednia operacja (do przywrócenia przez countersLeave).
+ */
+int countersEnter(PhoneForwardOperation operation);
+
+
+/** @brief Dolicza zdarzenia do bieżącej operacji bieżącego wątku.
+ * @param counter - rodzaj zdarzenia.
+ * @param n - liczba zdarzeń.
+ */
+static inline void countersAdd(enum CounterKind counter, uint64_t n) {
+    if (threadCounters.operation > 0) {
+        _Atomic uint64_t *value = &threadCounters.values[threadCounters.operation - 1][counter];
+        atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + n,
+                              memory_order_relaxed);
+    }
+}
+
+
+/** @brief Kończy operację w bieżącym wątku.
+ * @param previous - operacja zwrócona przez countersEnter.
+ */
+static inline void countersLeave(int previous) {
+    threadCounters.operation = previous;
+}
+
+/** @brief Rozpoczyna zliczanie operacji (na początku bloku funkcji). */
+#define COUNTERS_ENTER(operation) int countersPrevious = countersEnter(operation)
+/** @brief Kończy zliczanie operacji (przed każdym wyjściem z funkcji). */
+#define COUNTERS_LEAVE() countersLeave(countersPrevious)
+/** @brief Dolicza @p n zdarzeń rodzaju @p counter do bieżącej operacji. */
+#define COUNTERS_ADD(counter, n) countersAdd(counter, n)
+#else
+/** @brief Rozpoczyna zliczanie operacji (na początku bloku funkcji). */
+#define COUNTERS_ENTER(operation) ((void) 0)
+/** @brief Kończy zliczanie operacji (przed każdym wyjściem z funkcji). */
+#define COUNTERS_LEAVE() ((void) 0)
+/** @brief Dolicza @p n zdarzeń rodzaju @p counter do bieżącej operacji. */
+#define COUNTERS_ADD(counter, n) ((void) 0)
+#endif
+
+
+#endif //PHONE_COUNTERS_H
@@ -0,0 +1,99 @@
+/** @file
+ * Program odpowiadający na zapytania o przekierowania przez gniazdo domeny
+ * uniksowej (phone_server.h). Przekierowania sa wczytywane ze zrzutu
+ * (@ref phfwdLoad), wiec wszystkie procesy pytające serwer korzystają
+ * z jednej kopii danych. Program kończy sie po otrzymaniu sygnału SIGINT
+ * lub SIGTERM.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "phone_forward.h"
+#include "phone_server.h"
+#include "phone_snapshot.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+/** @brief Serwer zatrzymywany przez funkcję obsługi sygnałów. */
+static PhoneForwardServer *runningServer;
+
+
+/**
+ * @brief Zatrzymuje serwer po otrzymaniu sygnału.
+ * @param signal - numer sygnału.
+ */
+static void stopServer(int signal) {
+    (void) signal;
+    phfwdServerStop(runningServer);
+}
+
+
+/**
+ * @brief Wczytuje przekierowania ze zrzutu.
+ * @param snapshot - ścieżka zrzutu.
+ * @return Wskaźnik na strukturę lub NULL, gdy nie udało sie wczytać zrzutu
+ *         lub alokować pamięci.
+ */
+static PhoneForward *load(char const *snapshot) {
+    int fd = open(snapshot, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    PhoneForward *pf = phfwdLoad(fd);
+    close(fd);
+    return pf;
+}
+
+
+/**
+ * @brief Uruchamia serwer.
+ * @param argc - liczba argumentów.
+ * @param argv - argumenty: ścieżka gniazda, plik zrzutu i opcjonalnie liczba
+ *               wątków roboczych (domyślnie liczba procesorów).
+ * @return 0, jeśli serwer zakończył sie po sygnale, 1 - jeśli argumenty sa
+ *         niepoprawne, 2 - jeśli nie udało sie wczytać zrzutu, utworzyć
+ *         gniazda lub alokować pamięci.
+ */
+int main(int argc, char *argv[]) {
+    char *end = NULL;
+    unsigned long workers = argc == 4 ? strtoul(argv[3], &end, 10) : 0;
+    if (argc < 3 || argc > 4 || (end != NULL && (*argv[3] == '\0' || *end != '\0'))) {
+        fprintf(stderr, "usage: %s SOCKET SNAPSHOT [WORKERS]\n", argv[0]);
+        return 1;
+    }
+    PhoneForward *pf = load(argv[2]);
+    if (pf == NULL) {
+        fprintf(stderr, "%s: cannot load snapshot\n", argv[0]);
+        return 2;
+    }
+    runningServer = phfwdServerNew(pf, argv[1], workers);
+    if (runningServer == NULL) {
+        fprintf(stderr, "%s: cannot listen on %s\n", argv[0], argv[1]);
+        phfwdDelete(pf);
+        return 2;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServer;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    bool ok = phfwdServerRun(runningServer);
+    phfwdServerDelete(runningServer);
+    phfwdDelete(pf);
+    if (!ok) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+/** @file
+ * Implementacja porównywania dwóch struktur przekierowań numerów
+ * telefonicznych.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#include "phone_diff.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+/**
+ * @brief Stan porównywania: funkcja zgłaszająca różnice i bieżący numer.
+ */
+struct DiffWalk {
+    PhoneForwardDiffVisitor visit;  ///<funkcja zgłaszająca różnice.
+    void *data;  ///<wskaźnik przekazywany funkcji visit.
+    char *path;  ///<numer bieżącego wierzchołka.
+    size_t capacity;  ///<rozmiar bufora path.
+};
+
+
+/**
+ * @brief Miesza bity liczby (funkcja kończąca splitmix64).
+ * @param x - liczba.
+ * @return wymieszana liczba.
+ */
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+
+/**
+ * @brief Wylicza skrót zawartości wierzchołka, którego dzieci maja aktualne
+ * skróty.
+ * Puste poddrzewo ma skrót 0, a niepuste - różny od zera.
+ * @param node - wskaźnik na wierzchołek.
+ */
+static void computeHash(PhoneForward *node) {
+    uint64_t hash = 0;
+    bool empty = (node->forwarding == NULL);
+    if (node->forwarding != NULL) {
+        hash = 0xcbf29ce484222325ULL;   // FNV-1a.
+        for (char const *c = node->forwarding; *c != '\0'; c++) {
+            hash = (hash ^ (unsigned char) *c) * 0x100000001b3ULL;
+        }
+        hash = mix(hash);
+    }
+    for (int i = 0; i < CHILDREN_NUMB; i++) {
+        uint64_t child = node->children[i] != NULL ? node->children[i]->hash : 0;
+        if (child != 0) {
+            empty = false;
+            hash = mix(hash + (uint64_t) (i + 1) * 0x9e3779b97f4a7c15ULL + child);
+        }
+    }
+    if (hash == 0 && !empty) {
+        hash = 1;
+    }
+    node->hash = hash;
+    node->hashValid = true;
+}
+
+
+/**
+ * @brief Wylicza skrót zawartości poddrzewa.
+ * Puste poddrzewo (także NULL) ma skrót 0, a niepuste - różny od zera.
+ * Aktualny skrót pamięta w wierzchołku i wylicza ponownie tylko
+ * nieaktualne skróty, przechodząc je iteracyjnie w porządku postorder.
+ * @param node - wskaźnik na korzeń poddrzewa (może byc NULL).
+ * @return skrót zawartości.
+ */
+static uint64_t subtreeHash(PhoneForward *node) {
+    if (node == NULL) {
+        return 0;
+    }
+    PhoneForward *curr = node;
+    int next = 0; // Indeks następnego dziecka do sprawdzenia w curr.
+    while (!node->hashValid) {
+        while (next < CHILDREN_NUMB
+               && (curr->children[next] == NULL || curr->children[next]->hashValid)) {
+            next++;
+        }
+        if (next < CHILDREN_NUMB) {     // Najpierw dzieci z nieaktualnym skrótem.
+            curr = curr->children[next];
+            next = 0;
+            continue;
+        }
+        computeHash(curr);
+        if (curr != node) {
+            PhoneForward *parent = curr->parent;
+            for (next = 0; parent->children[next] != curr; next++);
+            next++;
+            curr = parent;
+        }
+    }
+    return node->hash;
+}
+
+
+/**
+ * @brief Zgłasza różnicę przekierowań wierzchołków tego samego numeru.
+ * @param walk - wskaźnik na stan porównywania (numer w walk->path).
+ * @param a - wskaźnik na wierzchołek struktury "przed" (może byc NULL).
+ * @param b - wskaźnik na wierzchołek struktury "po" (może byc NULL).
+ * @param depth - długość numeru wierzchołków.
+ * @return Wartość @p false, jeśli porównywanie zostało przerwane.
+ */
+static bool reportForwarding(struct DiffWalk *walk, PhoneForward const *a, PhoneForward const *b,
+                             size_t depth) {
+    char const *before = a != NULL ? a->forwarding : NULL;
+    char const *after = b != NULL ? b->forwarding : NULL;
+    if ((before != NULL || after != NULL)
+        && (before == NULL || after == NULL || strcmp(before, after) != 0)) {
+        walk->path[depth] = '\0';
+        return walk->visit(walk->data, walk->path, before, after);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Porównuje drzewa obu struktur.
+ * Przechodzi iteracyjnie w porządku preorder pary wierzchołków tego samego
+ * numeru, pomijając poddrzewa o równych skrótach. Pod wierzchołkiem, którego
+ * brakuje w jednej ze struktur, liczniki belowA i belowB liczą poziomy
+ * poniżej ostatniego istniejącego wierzchołka tej struktury.
+ * @param walk - wskaźnik na stan porównywania.
+ * @param a - wskaźnik na korzeń struktury "przed".
+ * @param b - wskaźnik na korzeń struktury "po".
+ * @return Wartość @p false, jeśli porównywanie zostało przerwane.
+ */
+static bool diffSubtrees(struct DiffWalk *walk, PhoneForward *a, PhoneForward *b) {
+    if (subtreeHash(a) == subtreeHash(b)) {
+        return true;
+    }
+    size_t depth = 0, belowA = 0, belowB = 0;
+    int next = 0; // Indeks następnej pary dzieci do porównania.
+    if (!reportForwarding(walk, a, b, 0)) {
+        return false;
+    }
+    while (true) {
+        PhoneForward *currA = belowA == 0 ? a : NULL, *currB = belowB == 0 ? b : NULL;
+        PhoneForward *childA = NULL, *childB = NULL;
+        for (; next < CHILDREN_NUMB; next++) {
+            childA = currA != NULL ? currA->children[next] : NULL;
+            childB = currB != NULL ? currB->children[next] : NULL;
+            if (subtreeHash(childA) != subtreeHash(childB)) {
+                break;
+            }
+        }
+        if (next < CHILDREN_NUMB) {     // Schodzę do różniących sie dzieci.
+            if (depth + 2 > walk->capacity) {
+                char *newPath = realloc(walk->path, sizeof(char) * 2 * walk->capacity);
+                if (newPath == NULL) {
+                    return false;
+                }
+                walk->path = newPath;
+                walk->capacity *= 2;
+            }
+            walk->path[depth++] = "0123456789*#"[next];
+            next = 0;
+            a = childA != NULL ? childA : a;
+            belowA += childA != NULL ? 0 : 1;
+            b = childB != NULL ? childB : b;
+            belowB += childB != NULL ? 0 : 1;
+            if (!reportForwarding(walk, childA, childB, depth)) {
+                return false;
+            }
+            continue;
+        }
+        if (depth == 0) {
+            return true;
+        }
+        next = get_digit(walk->path[--depth]) + 1;   // Wracam do rodziców.
+        if (belowA > 0) {
+            belowA--;
+        } else {
+            a = a->parent;
+        }
+        if (belowB > 0) {
+            belowB--;
+        } else {
+            b = b->parent;
+        }
+    }
+}
+
+
+bool phfwdDiff(PhoneForward const *a, PhoneForward const *b, PhoneForwardDiffVisitor visit,
+               void *data) {
+    if (a == NULL || b == NULL || visit == NULL) {
+        return false;
+    }
+    struct DiffWalk walk = {visit, data, malloc(sizeof(char) * 16), 16};
+    if (walk.path == NULL) {
+        return false;
+    }
+    bool ok = diffSubtrees(&walk, (PhoneForward *) a, (PhoneForward *) b);
+    free(walk.path);
+    return ok;
+}
@@ -0,0 +1,47 @@
+/** @file
+ * Interfejs porównywania dwóch struktur przekierowań numerów telefonicznych.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_DIFF_H
+#define PHONE_DIFF_H
+#include <stdbool.h>
+#include "phone_forward.h"
+
+
+
+/**
+ * @brief Funkcja wywoływana dla kolejnych różnic przez @ref phfwdDiff.
+ * Dla przekierowania dodanego @p before ma wartość NULL, dla usuniętego
+ * @p after ma wartość NULL, a dla zmienionego oba wskaźniki sa niepuste.
+ * Napisy sa ważne tylko do powrotu z funkcji. Zwrócenie @p false przerywa
+ * porównywanie.
+ */
+typedef bool (*PhoneForwardDiffVisitor)(void *data, char const *num, char const *before,
+                                        char const *after);
+
+
+/** @brief Porównuje dwie struktury przekierowań.
+ * Przechodzi oba drzewa jednocześnie i pomija poddrzewa o jednakowym skrócie
+ * zawartości, więc dla struktur różniących sie niewieloma przekierowaniami
+ * działa w czasie proporcjonalnym do liczby różnic. Skróty sa pamiętane
+ * w wierzchołkach i przeliczane tylko w poddrzewach zmienionych od
+ * poprzedniego porównania (funkcja może je uaktualnić mimo modyfikatora
+ * const). Różnice sa zgłaszane w porządku leksykograficznym numerów.
+ * @param[in] a     - wskaźnik na strukturę "przed";
+ * @param[in] b     - wskaźnik na strukturę "po";
+ * @param[in] visit - funkcja wywoływana dla każdego przekierowania dodanego,
+ *                    usuniętego lub zmienionego w @p b względem @p a;
+ * @param[in] data  - wskaźnik przekazywany funkcji @p visit.
+ * @return Wartość @p true, jeśli zgłoszono wszystkie różnice.
+ *         Wartość @p false, jeśli któryś wskaźnik ma wartość NULL, funkcja
+ *         @p visit zwróciła @p false lub nie udało sie alokować pamięci.
+ */
+bool phfwdDiff(PhoneForward const *a, PhoneForward const *b, PhoneForwardDiffVisitor visit,
+               void *data);
+
+
+#endif //PHONE_DIFF_H
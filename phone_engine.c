@@ -0,0 +1,126 @@
+/** @file
+ * Implementacja wyboru silnika i funkcji przekierowań zapisujących ślad.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#include "phone_engine.h"
+#include "phone_trace.h"
+#include <string.h>
+
+
+
+/** @brief Dostępne silniki (silnik wzorcowy jest pierwszy). */
+static PhoneForwardEngine const engines[] = {
+        {"trie", false},
+        {"lazy_reverse", true},
+};
+
+/** @brief Silnik struktur tworzonych przez @ref phfwdNew. */
+static PhoneForwardEngine const *currentDefault = &engines[0];
+
+
+
+PhoneForwardEngine const *phfwdEngine(char const *name) {
+    if (name == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (strcmp(engines[i].name, name) == 0) {
+            return &engines[i];
+        }
+    }
+    return NULL;
+}
+
+
+PhoneForwardEngine const *phfwdEngineAt(size_t index) {
+    return index < sizeof(engines) / sizeof(engines[0]) ? &engines[index] : NULL;
+}
+
+
+void phfwdSetDefaultEngine(PhoneForwardEngine const *engine) {
+    currentDefault = engine != NULL ? engine : &engines[0];
+}
+
+
+PhoneForwardEngine const *defaultEngine(void) {
+    return currentDefault;
+}
+
+
+PhoneForward *phfwdNewEngine(PhoneForwardEngine const *engine) {
+    PhoneForward *pf = trieNew();
+    if (pf != NULL) {
+        phfwdRootOf(pf)->engine = engine != NULL ? engine : currentDefault;
+        phfwdSetReverseDeferred(pf, phfwdRootOf(pf)->engine->reverseDeferred);
+    }
+    return pf;
+}
+
+
+PhoneForward *phfwdNew(void) {
+    return phfwdNewEngine(NULL);
+}
+
+
+PhoneForwardEngine const *phfwdEngineOf(PhoneForward const *pf) {
+    return pf != NULL ? phfwdRootOf(pf)->engine : NULL;
+}
+
+
+bool phfwdAdd(PhoneForward *pf, char const *num1, char const *num2) {
+    if (pf == NULL) {
+        return false;
+    }
+    if (phfwdRootOf(pf)->trace != NULL) {
+        traceRecord(phfwdRootOf(pf)->trace, OPERATION_ADD, num1, num2);
+    }
+    return trieAdd(pf, num1, num2);
+}
+
+
+void phfwdRemove(PhoneForward *pf, char const *num) {
+    if (pf == NULL) {
+        return;
+    }
+    if (phfwdRootOf(pf)->trace != NULL) {
+        traceRecord(phfwdRootOf(pf)->trace, OPERATION_REMOVE, num, NULL);
+    }
+    trieRemove(pf, num);
+}
+
+
+PhoneNumbers *phfwdGet(PhoneForward const *pf, char const *num) {
+    if (pf == NULL) {
+        return NULL;
+    }
+    if (phfwdRootOf(pf)->trace != NULL) {
+        traceRecord(phfwdRootOf(pf)->trace, OPERATION_GET, num, NULL);
+    }
+    return trieGet(pf, num);
+}
+
+
+PhoneNumbers *phfwdReverse(PhoneForward const *pf, char const *num) {
+    if (pf == NULL) {
+        return NULL;
+    }
+    if (phfwdRootOf(pf)->trace != NULL) {
+        traceRecord(phfwdRootOf(pf)->trace, OPERATION_REVERSE, num, NULL);
+    }
+    return trieReverse(pf, num);
+}
+
+
+PhoneNumbers *phfwdGetReverse(PhoneForward const *pf, char const *num) {
+    if (pf == NULL) {
+        return NULL;
+    }
+    if (phfwdRootOf(pf)->trace != NULL) {
+        traceRecord(phfwdRootOf(pf)->trace, OPERATION_GET_REVERSE, num, NULL);
+    }
+    return trieGetReverse(pf, num);
+}
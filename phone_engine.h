@@ -0,0 +1,135 @@
+/** @file
+ * Interfejs silników (trybów pracy) struktur przekierowań numerów
+ * telefonicznych.
+ * Wszystkie operacje wykonuje drzewo 12-arne z drzewem odwróconym
+ * (@ref PhoneReverse). Silnik to nazwany zestaw ustawień nadawanych
+ * strukturze przy tworzeniu (@ref phfwdNewEngine), a nie osobna
+ * implementacja operacji; nazwy pozwalają uruchomić testy i pomiary dla
+ * każdego trybu (zmienna PHFWD_ENGINE, program phfwd_bench).
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_ENGINE_H
+#define PHONE_ENGINE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "phone_forward.h"
+#include "phnum.h"
+
+
+
+/**
+ * @brief Silnik przekierowań: nazwa i ustawienia nowej struktury.
+ */
+struct PhoneForwardEngine {
+    char const *name;  ///<nazwa silnika (np. w argumentach programów).
+    bool reverseDeferred;  ///<czy drzewo odwrócone jest odroczone (@ref phfwdSetReverseDeferred).
+};
+/**
+ * @brief To jest typ PhoneForwardEngine.
+ *
+ */
+typedef struct PhoneForwardEngine PhoneForwardEngine;
+
+
+/** @brief Zwraca silnik o podanej nazwie.
+ * Dostępne sa silniki "trie" (wzorcowy: drzewo odwrócone jest aktualizowane
+ * przy każdej zmianie) i "lazy_reverse" (drzewo odwrócone jest odbudowywane
+ * w jednym przejściu przy pierwszym zapytaniu po zmianach, czyli struktura
+ * jest tworzona z włączonym @ref phfwdSetReverseDeferred).
+ * @param[in] name - nazwa silnika.
+ * @return Wskaźnik na silnik lub NULL, jeśli nie ma silnika o tej nazwie.
+ */
+PhoneForwardEngine const *phfwdEngine(char const *name);
+
+
+/** @brief Zwraca silnik o podanym numerze.
+ * Pozwala przejrzeć wszystkie silniki; silnik wzorcowy ma numer 0.
+ * @param[in] index - numer silnika.
+ * @return Wskaźnik na silnik lub NULL, jeśli @p index jest za duży.
+ */
+PhoneForwardEngine const *phfwdEngineAt(size_t index);
+
+
+/** @brief Ustawia silnik struktur tworzonych przez @ref phfwdNew.
+ * Nie zmienia struktur już utworzonych. Nie powinna być wywoływana
+ * jednocześnie z tworzeniem struktur w innych wątkach.
+ * @param[in] engine - wskaźnik na silnik (NULL oznacza silnik wzorcowy).
+ */
+void phfwdSetDefaultEngine(PhoneForwardEngine const *engine);
+
+
+/** @brief Tworzy nowa strukturę z ustawieniami podanego silnika.
+ * Ustawienia można potem zmienić (np. przez @ref phfwdSetReverseDeferred).
+ * @param[in] engine - wskaźnik na silnik (NULL oznacza silnik ustawiony
+ *                     przez @ref phfwdSetDefaultEngine).
+ * @return Wskaźnik na utworzona strukturę lub NULL, gdy nie udało sie
+ *         alokować pamięci.
+ */
+PhoneForward *phfwdNewEngine(PhoneForwardEngine const *engine);
+
+
+/** @brief Zwraca silnik, z którym utworzono strukturę.
+ * @param[in] pf - wskaźnik na strukturę przechowująca przekierowania.
+ * @return Wskaźnik na silnik lub NULL, jeśli @p pf ma wartość NULL.
+ */
+PhoneForwardEngine const *phfwdEngineOf(PhoneForward const *pf);
+
+
+/** @brief Zwraca silnik tworzony przez @ref phfwdNew.
+ * @return Wskaźnik na silnik.
+ */
+PhoneForwardEngine const *defaultEngine(void);
+
+
+/** @brief Tworzy pusty korzeń drzewa bez przypisanego silnika.
+ * Używana przez @ref phfwdNewEngine, która ustawia silnik.
+ * @return Wskaźnik na korzeń lub NULL, gdy nie udało sie alokować pamięci.
+ */
+PhoneForward *trieNew(void);
+
+
+/** @brief Dodaje przekierowanie w drzewie (@ref phfwdAdd bez zapisu śladu).
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] num1   - prefiks numerów przekierowywanych;
+ * @param[in] num2   - prefiks numerów, na które jest wykonywane przekierowanie.
+ * @return Wynik jak w @ref phfwdAdd.
+ */
+bool trieAdd(PhoneForward *pf, char const *num1, char const *num2);
+
+
+/** @brief Usuwa przekierowania z drzewa (@ref phfwdRemove bez zapisu śladu).
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] num    - prefiks usuwanych przekierowań.
+ */
+void trieRemove(PhoneForward *pf, char const *num);
+
+
+/** @brief Wyznacza przekierowanie numeru (@ref phfwdGet bez zapisu śladu).
+ * @param[in] pf  - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] num - numer.
+ * @return Wynik jak w @ref phfwdGet.
+ */
+PhoneNumbers *trieGet(PhoneForward const *pf, char const *num);
+
+
+/** @brief Wyznacza przekierowania na numer (@ref phfwdReverse bez zapisu śladu).
+ * @param[in] pf  - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] num - numer.
+ * @return Wynik jak w @ref phfwdReverse.
+ */
+PhoneNumbers *trieReverse(PhoneForward const *pf, char const *num);
+
+
+/** @brief Wyznacza przeciwobraz numeru (@ref phfwdGetReverse bez zapisu śladu).
+ * @param[in] pf  - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] num - numer.
+ * @return Wynik jak w @ref phfwdGetReverse.
+ */
+PhoneNumbers *trieGetReverse(PhoneForward const *pf, char const *num);
+
+
+#endif //PHONE_ENGINE_H
@@ -9,33 +9,58 @@
  */
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
-#include <ctype.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "phone_forward.h"
 #include "phone_reverse.h"
-#include "../../../../Pobrane/Telegram Desktop/duże/src/list_of_numbers.h"
+#include "list_of_numbers.h"
 #include "phnum.h"
+#include "phone_counters.h"
+#include "phone_engine.h"
+#include "phone_memory.h"
+#include "phone_resolve.h"
+#include "phone_trace.h"
 #define CHILDREN_NUMB 12 ///<Rozmiar drzewa
 
 
 
-PhoneForward *phfwdNew(void) {
-    PhoneForward *pf = (PhoneForward *) malloc(sizeof(PhoneForward));
+PhoneForward *trieNew(void) {
+    MEMORY_ENTER(MEMORY_FORWARD_NODES);
+    struct PhoneForwardRoot *root = malloc(sizeof(struct PhoneForwardRoot));
+    MEMORY_LEAVE();
 
-    if (pf != NULL) {
+    if (root != NULL) {
+        PhoneForward *pf = &root->node;
         for (int i = 0; i < CHILDREN_NUMB; i++) {
             pf->children[i] = NULL;
         }
         pf->parent = NULL;
         pf->forwarding = NULL;
-        pf->pfRev = phrevNew();
-        if (pf->pfRev == NULL) {
-            free(pf);
-            pf = NULL;
+        pf->stamp = 0;
+        pf->hash = 0;
+        pf->hashValid = true;
+        root->reverseDeferred = false;
+        root->reverseStale = false;
+        root->arena = NULL;
+        root->arenaSize = 0;
+        root->history = NULL;
+        root->resolveCache = NULL;
+        root->trace = NULL;
+        root->engine = NULL;
+        root->pfRev = phrevNew();
+        root->stats = calloc(1, sizeof(PhoneForwardStats));
+        if (root->pfRev == NULL || root->stats == NULL) {
+            deleteReverseTree(root->pfRev);
+            free(root->stats);
+            free(root);
+            return NULL;
         }
+        root->stats->forwardNodes = 1;
     }
-    return pf;
+    return root != NULL ? &root->node : NULL;
 }
 
 
@@ -45,7 +70,10 @@ PhoneForward *phfwdNew(void) {
  * @return PhoneForward* nowy wierzchołek.
  */
 static PhoneForward *newNode() {
+    COUNTERS_ADD(COUNTER_ALLOCATIONS, 1);
+    MEMORY_ENTER(MEMORY_FORWARD_NODES);
     PhoneForward *node = (struct PhoneForward *) malloc(sizeof(PhoneForward));
+    MEMORY_LEAVE();
     if (node == NULL) {
         return node;
     }
@@ -53,6 +81,9 @@ static PhoneForward *newNode() {
     for (int i = 0; i < CHILDREN_NUMB; i++) {
         node->children[i] = NULL;
     }
+    node->stamp = 0;
+    node->hash = 0;     // Skrót pustego poddrzewa.
+    node->hashValid = true;
     return node;
 }
 
@@ -72,7 +103,7 @@ bool isStringAPhoneNumber(const char *num) {
     }
 
     while (num[length] != '\0') {
-        if (isdigit(num[length]) || (get_digit(num[length]) == 10) || (get_digit(num[length]) == 11)) {
+        if (isNumberChar(num[length])) {
             length++;
         } else {          // Natrafiliśmy na znak różny od cyfry
             return false;
@@ -83,140 +114,282 @@ bool isStringAPhoneNumber(const char *num) {
 
 
 /**
- * @brief Funkcja usuwa rekurencyjnie przekierowanie z drzewa zwykłego.
- * @param pf –  wskaźnik na drzewo.
- * @param pfRev – wskaźnik na drzewo odwrócone.
+ * @brief Sprawdza, czy operacje na drzewie maja aktualizować drzewo odwrócone.
+ * Jeśli nie, oznacza drzewo odwrócone jako nieaktualne.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @return Wartość @p true, jeśli drzewo odwrócone jest utrzymywane na bieżąco.
+ */
+static bool keepReverseUpToDate(PhoneForward *pf) {
+    if (phfwdRootOf(pf)->reverseDeferred || phfwdRootOf(pf)->reverseStale) {
+        phfwdRootOf(pf)->reverseStale = true;
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Zwalnia pamięć wierzchołka lub przekierowania.
+ * Pamięć należąca do bloku wczytanego ze zrzutu (patrz phfwdLoad) jest
+ * zwalniana dopiero razem z całą strukturą.
+ * @param root - wskaźnik na korzeń drzewa.
+ * @param ptr - wskaźnik na zwalniana pamięć.
+ */
+static void releaseMemory(PhoneForward const *root, void *ptr) {
+    uintptr_t begin = (uintptr_t) phfwdRootOf(root)->arena, address = (uintptr_t) ptr;
+    if (phfwdRootOf(root)->arena == NULL || address < begin || address >= begin + phfwdRootOf(root)->arenaSize) {
+        free(ptr);
+    }
+}
+
+
+/**
+ * @brief Uwzględnia w podanych statystykach dodanie lub usunięcie
+ * przekierowania.
+ * @param stats - wskaźnik na statystyki.
+ * @param depth - długość numeru "skąd".
+ * @param forwarding - przekierowanie "dokąd".
+ * @param added - czy przekierowanie zostało dodane (@p false - usunięte).
+ */
+static void countRuleIn(PhoneForwardStats *stats, size_t depth, char const *forwarding, bool added) {
+    size_t bytes = strlen(forwarding) + 1;
+    depth = depth < STATS_DEPTHS ? depth : STATS_DEPTHS - 1;
+    if (added) {
+        stats->rules++;
+        stats->stringBytes += bytes;
+        stats->depths[depth]++;
+    } else {
+        stats->rules--;
+        stats->stringBytes -= bytes;
+        stats->depths[depth]--;
+    }
+}
+
+
+/**
+ * @brief Uwzględnia w statystykach dodanie lub usunięcie przekierowania.
+ * @param root - wskaźnik na korzeń drzewa.
+ * @param depth - długość numeru "skąd".
+ * @param forwarding - przekierowanie "dokąd".
+ * @param added - czy przekierowanie zostało dodane (@p false - usunięte).
+ */
+static void countRule(PhoneForward const *root, size_t depth, char const *forwarding, bool added) {
+    countRuleIn(phfwdRootOf(root)->stats, depth, forwarding, added);
+}
+
+
+/**
+ * @brief Rozpoczyna nowa wersję struktury (jeśli zmiany sa śledzone).
+ * Unieważnia zapamiętane rozwinięcia przekierowań.
+ * @param root - wskaźnik na korzeń drzewa.
+ * @return numer nowej wersji lub 0, jeśli zmiany nie sa śledzone.
+ */
+static uint64_t beginChange(PhoneForward *root) {
+    if (phfwdRootOf(root)->resolveCache != NULL) {
+        phfwdRootOf(root)->resolveCache->stale = true;
+    }
+    return phfwdRootOf(root)->history != NULL ? ++phfwdRootOf(root)->history->version : 0;
+}
+
+
+/**
+ * @brief Oznacza zmianę w wierzchołku i wszystkich jego przodkach.
+ * Ustawia wersję zmiany i unieważnia skróty zawartości; zatrzymuje sie na
+ * przodku, który jest już tak oznaczony.
+ * @param node - wskaźnik na zmieniony wierzchołek.
+ * @param version - numer wersji (0, jeśli zmiany nie sa śledzone).
+ */
+static void markChanged(PhoneForward *node, uint64_t version) {
+    while (node != NULL && (node->stamp < version || node->hashValid)) {
+        node->stamp = node->stamp < version ? version : node->stamp;
+        node->hashValid = false;
+        node = node->parent;
+    }
+}
+
+
+/**
+ * @brief Zapamiętuje w historii usunięcie prefiksu.
+ * Jeśli nie uda sie alokować pamięci, zapomina wcześniejsza historię,
+ * bo zmian od wcześniejszych wersji nie da sie już wyznaczyć.
+ * @param root - wskaźnik na korzeń drzewa.
+ * @param num - usunięty prefiks.
+ * @param version - numer wersji.
+ */
+static void recordRemoval(PhoneForward *root, char const *num, uint64_t version) {
+    PhoneForwardHistory *history = phfwdRootOf(root)->history;
+    if (history->size == history->capacity) {
+        size_t newCapacity = history->capacity ? 2 * history->capacity : 4;
+        struct PhoneForwardRemoval *newRemovals =
+                realloc(history->removals, sizeof(struct PhoneForwardRemoval) * newCapacity);
+        if (newRemovals == NULL) {
+            phfwdTrimChanges(root, version);
+            return;
+        }
+        history->removals = newRemovals;
+        history->capacity = newCapacity;
+    }
+    char *prefix = malloc(sizeof(char) * (strlen(num) + 1));
+    if (prefix == NULL) {
+        phfwdTrimChanges(root, version);
+        return;
+    }
+    strcpy(prefix, num);
+    history->removals[history->size].version = version;
+    history->removals[history->size].prefix = prefix;
+    history->size++;
+}
+
+
+/**
+ * @brief Dopisuje wierzchołek drzewa odwróconego do tablicy celów.
+ * @param targets - wskaźnik na tablicę celów.
+ * @param size - wskaźnik na liczbę elementów tablicy.
+ * @param capacity - wskaźnik na pojemność tablicy.
+ * @param node - dopisywany wierzchołek.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool pushTarget(PhoneReverse ***targets, size_t *size, size_t *capacity,
+                       PhoneReverse *node) {
+    if (*size == *capacity) {
+        size_t newCapacity = *capacity == 0 ? 16 : 2 * *capacity;
+        PhoneReverse **newTargets = realloc(*targets, newCapacity * sizeof(PhoneReverse *));
+        if (newTargets == NULL) {
+            return false;
+        }
+        *targets = newTargets;
+        *capacity = newCapacity;
+    }
+    (*targets)[(*size)++] = node;
+    return true;
+}
+
+
+/**
+ * @brief Usuwa poddrzewo drzewa zwykłego razem z jego przekierowaniami.
+ * Przechodzi poddrzewo iteracyjnie (w porządku postorder), odwiedzając każdy
+ * wierzchołek raz, i zbiera wierzchołki drzewa odwróconego numerów "dokąd".
+ * Wszystkie usuwane przekierowania zaczynają sie prefiksem @p num, więc
+ * na koniec z listy każdego z zebranych wierzchołków wystarczy raz wyciąć
+ * przedział numerów zaczynających sie tym prefiksem. Gdy nie uda sie
+ * powiększyć tablicy celów, lista jest przetwarzana od razu.
+ * @param root – wskaźnik na korzeń drzewa.
+ * @param node – wskaźnik na korzeń usuwanego poddrzewa.
+ * @param pfRev – wskaźnik na drzewo odwrócone (NULL, jeśli nie jest aktualizowane).
  * @param num - prefiks, numery zaczynające sie na ten prefiks beda usunięte.
- * @param listOfRemoves - lista przekierowań.
  */
-static void phfwdRemoveRek(PhoneForward *pf, PhoneReverse *pfRev, char const *num, List **listOfRemoves) {
-    if (pf != NULL) {
-        for (int i = 0; i < CHILDREN_NUMB; i++) {
-            if (pf->children[i]) {
-                phfwdRemoveRek(pf->children[i], pfRev, num, listOfRemoves);
-            }
-            if (pf->forwarding != NULL) {
-                phrevRemoveNumStartsWithPref(pfRev, pf->forwarding, num);
-                free(pf->forwarding);
-                pf->forwarding = NULL;
+static void removeSubtree(PhoneForward const *root, PhoneForward *node, PhoneReverse *pfRev,
+                          char const *num) {
+    PhoneReverse **targets = NULL;
+    size_t targetsSize = 0;
+    size_t targetsCapacity = 0;
+    PhoneForward *curr = node;
+    size_t depth = strlen(num);
+    while (true) {
+        int i = 0;
+        while (i < CHILDREN_NUMB && curr->children[i] == NULL) {
+            i++;
+        }
+        if (i < CHILDREN_NUMB) {      // Najpierw usuwam dzieci.
+            curr = curr->children[i];
+            depth++;
+            continue;
+        }
+        if (curr->forwarding != NULL) {
+            PhoneReverse *target = pfRev == NULL ? NULL : phrevFind(pfRev, curr->forwarding);
+            if (target != NULL
+                && !pushTarget(&targets, &targetsSize, &targetsCapacity, target)) {
+                phrevRemoveStartsWithPref(pfRev, &target, 1, num);
             }
+            countRule(root, depth, curr->forwarding, false);
+            releaseMemory(root, curr->forwarding);
+            curr->forwarding = NULL;
+        }
+        phfwdRootOf(root)->stats->forwardNodes--;
+        COUNTERS_ADD(COUNTER_NODES, 1);
+        if (curr == node) {
+            releaseMemory(root, curr);
+            break;
         }
+        PhoneForward *parent = curr->parent;
+        for (i = 0; parent->children[i] != curr; i++);
+        parent->children[i] = NULL;
+        releaseMemory(root, curr);
+        curr = parent;
+        depth--;
+    }
+    if (targetsSize > 0) {
+        phrevRemoveStartsWithPref(pfRev, targets, targetsSize, num);
     }
+    free(targets);
 }
 
 
-void phfwdRemove(PhoneForward *pf, char const *num) {
+void trieRemove(PhoneForward *pf, char const *num) {
     if ((pf != NULL) && (num != NULL) && isStringAPhoneNumber(num)) {
+        COUNTERS_ENTER(OPERATION_REMOVE);
         PhoneForward *curr = pf;
         char *tempNum = (char *) num;
         size_t numberLength = strlen(tempNum);
+        int digit = 0;  // Ostatnia cyfra numeru, czyli pozycja curr u rodzica.
         for (size_t i = 0; i < numberLength; i++) {
-            if (!curr->children[get_digit(*tempNum)]) {
+            digit = get_digit(*tempNum);
+            if (!curr->children[digit]) {
+                COUNTERS_LEAVE();
                 return;
             }
-            curr = curr->children[get_digit(*tempNum)];
+            curr = curr->children[digit];
+            COUNTERS_ADD(COUNTER_NODES, 1);
             tempNum++;
         }
-        List *listOfRemoves = NULL;
+        PhoneReverse *pfRev = keepReverseUpToDate(pf) ? phfwdRootOf(pf)->pfRev : NULL;
 
-        for (int i = 0; i < CHILDREN_NUMB; i++) {
-            if (curr->children[i] != NULL && curr->children[i]->forwarding != NULL) {
-                phrevRemoveNumStartsWithPref(pf->pfRev, curr->children[i]->forwarding, num);
-                free(curr->children[i]->forwarding);
-                curr->children[i]->forwarding = NULL;
-            }
+        // Odłączam poddrzewo od rodzica i usuwam je w całości.
+        curr->parent->children[digit] = NULL;
+        PhoneForward *parent = curr->parent;
+        removeSubtree(pf, curr, pfRev, num);
+        uint64_t version = beginChange(pf);
+        markChanged(parent, version);
+        if (phfwdRootOf(pf)->history != NULL) {
+            recordRemoval(pf, num, version);
         }
-        phfwdRemoveRek(curr, pf->pfRev, num, &listOfRemoves);
-        listDelete(listOfRemoves);
+        COUNTERS_LEAVE();
     }
 }
 
 
-void createAForward(char *const *firstPart, char **secondPart, char **lastForward) {
-    size_t length;
-    const char *lastSign = "\0";
-
-    if (!*secondPart) {
-        length = strlen(*firstPart) + 1;
-    } else {
-        length = strlen(*secondPart) + strlen(*firstPart) + 1;
-    }
-    free(*lastForward);
-    *lastForward = (char *) malloc(sizeof(char) * length);
-
-    if (*lastForward) {
-        memcpy(*lastForward, *firstPart, strlen(*firstPart) * sizeof(char));
-    }
-    if (*secondPart && *lastForward) {
-        memcpy(*lastForward + strlen(*firstPart), *secondPart, strlen(*secondPart) * sizeof(char));
-    }
-    if (*lastForward) memcpy(*lastForward + length - 1, lastSign, sizeof(char));
-}
-
-
-PhoneNumbers *phfwdGet(PhoneForward const *pf, char const *num) {
-    PhoneNumbers *pnum = (PhoneNumbers *) malloc(sizeof(PhoneNumbers));
-    if (pnum == NULL) return NULL;
-    pnum->allNumbers = NULL;
-
+PhoneNumbers *trieGet(PhoneForward const *pf, char const *num) {
     if (pf == NULL) {
-        free(pnum);
         return NULL;
     }
+    COUNTERS_ENTER(OPERATION_GET);
     if (isStringAPhoneNumber(num) == false) {   // Podany napis nie reprezentuje numeru.
+        PhoneNumbers *pnum = phnumNew(NULL);
+        COUNTERS_LEAVE();
         return pnum;
     }
 
-    // Postępuje analogicznie jak w phfwdReverse (tam jest krótko opisana metoda szukania przekierowania).
+    // Szukam najgłębszego wierzchołka z przekierowaniem na ścieżce numeru.
+    // Wynik (przekierowanie i reszta numeru) składam dopiero w bloku wyniku,
+    // więc zapytanie wykonuje jedna alokację niezależnie od długości numeru.
     PhoneForward const *curr = pf;
-    char *lastForward = NULL; // Ostatnie znalezione przekierowanie.
-    char *maxForward = NULL; // Najdłuższe dotychczasowe przekierowanie/
-    char *secondPart = NULL;
-    size_t length;
-    const char *lastSign = "\0";
-    char const *numCopy = num;
-
-    maxForward = (char *) malloc(sizeof(char));
-    if (maxForward) {
-        memcpy(maxForward, "\0", sizeof(char));
-    }
-
-    while (*num != '\0') {
-        curr = curr->children[get_digit(*num)];  // Ide do następnego wierzchołka
+    PhoneForward const *found = NULL;
+    size_t foundDepth = 0;
+    for (size_t depth = 0; num[depth] != '\0'; depth++) {
+        curr = curr->children[get_digit(num[depth])];
         if (curr == NULL) {
             break;
         }
-        num++;                       // Przesuwam się do innego znaku
-        length = strlen(num) + 1;
-        secondPart = realloc(secondPart, (sizeof(char) * length));
-
-        if (secondPart) {
-            memcpy(secondPart, (char *) num, sizeof(char) * (length - 1));
-            memcpy(secondPart + length - 1, lastSign, sizeof(char));
-        }
-
-        if (curr->forwarding) {
-            createAForward(&curr->forwarding, &secondPart, &lastForward);
+        COUNTERS_ADD(COUNTER_NODES, 1);
+        if (curr->forwarding != NULL) {
+            found = curr;
+            foundDepth = depth + 1;
         }
-        if (lastForward != NULL && maxForward != NULL) {
-            if (strlen(lastForward) >= strlen(maxForward)) {
-                length = strlen(lastForward) + 1;
-                free(maxForward);
-                maxForward = malloc(sizeof(char) * length);
-                if (maxForward) memcpy(maxForward, lastForward, length);
-            }
-        }
-    }
-    // Wstawiam do listy wynikowej
-    if (lastForward != NULL) {
-        pnum->allNumbers = insertToList(pnum->allNumbers, lastForward);
-    } else {
-        pnum->allNumbers = insertToList(pnum->allNumbers, numCopy);
     }
-    if (secondPart) free(secondPart);
-    if (lastForward) free(lastForward);
-    if (maxForward) free(maxForward);
+    PhoneNumbers *pnum = found != NULL ? phnumNewJoined(found->forwarding, num + foundDepth)
+                                       : phnumNewJoined(num, "");
 
+    COUNTERS_LEAVE();
     return pnum;
 }
 
@@ -247,75 +420,949 @@ static bool isPhfwdAddCorrectInput(PhoneForward *pf, char const *num1, char cons
 }
 
 
-bool phfwdAdd(PhoneForward *pf, char const *num1, char const *num2) {
+/**
+ * @brief Zwraca dziecko wierzchołka, tworząc je, jeśli nie istnieje.
+ * @param root - wskaźnik na korzeń drzewa.
+ * @param node - wskaźnik na wierzchołek.
+ * @param code - numer dziecka.
+ * @return wskaźnik na dziecko lub NULL, gdy nie udało sie alokować pamięci.
+ */
+static PhoneForward *getOrCreateChild(PhoneForward *root, PhoneForward *node, int code) {
+    // Tworzę nowy węzeł, jeśli ścieżka nie istnieje.
+    if (node->children[code] == NULL) {
+        node->children[code] = newNode();
+        if (node->children[code] == NULL) {
+            return NULL;
+        }
+        node->children[code]->forwarding = NULL;
+        node->children[code]->parent = node;
+        phfwdRootOf(root)->stats->forwardNodes++;
+    }
+    return node->children[code];
+}
+
+
+/**
+ * @brief Ustawia przekierowanie w wierzchołku numeru @p num1.
+ * Zastępuje poprzednie przekierowanie i (jeśli trzeba) aktualizuje drzewo
+ * odwrócone.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @param node - wskaźnik na wierzchołek odpowiadający @p num1.
+ * @param num1 - numer "skąd".
+ * @param num2 - numer "dokąd".
+ * @param updateReverse - czy aktualizować drzewo odwrócone.
+ * @return Wartość @p true, jeśli przekierowanie zostało ustawione.
+ *         Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool setForwarding(PhoneForward *pf, PhoneForward *node, char const *num1, char const *num2,
+                          bool updateReverse) {
+    // Alokuję nowe przekierowanie przed usunięciem starego, żeby w razie
+    // braku pamięci stare przekierowanie pozostało.
+    COUNTERS_ADD(COUNTER_ALLOCATIONS, 1);
+    MEMORY_ENTER(MEMORY_FORWARDINGS);
+    char *forwarding = (char *) malloc(sizeof(char) * (strlen(num2) + 1));
+    MEMORY_LEAVE();
+    if (forwarding == NULL) {
+        return false;
+    }
+    strcpy(forwarding, num2);
+    size_t depth = strlen(num1);
+    if (node->forwarding) {
+        if (updateReverse) {
+            phrevRemove(phfwdRootOf(pf)->pfRev, node->forwarding, num1);
+        }
+        countRule(pf, depth, node->forwarding, false);
+        releaseMemory(pf, node->forwarding);
+    }
+    node->forwarding = forwarding;
+    countRule(pf, depth, forwarding, true);
+    markChanged(node, beginChange(pf));
+    if (!updateReverse) {
+        return true;
+    }
+    // Dodaje przekierowania do drzewa przekierowań forwarding ("odwróconego").
+    return phrevAdd(phfwdRootOf(pf)->pfRev, num1, num2);
+}
+
+
+bool trieAdd(PhoneForward *pf, char const *num1, char const *num2) {
     if (!isPhfwdAddCorrectInput(pf, num1, num2)) return false;
 
+    COUNTERS_ENTER(OPERATION_ADD);
     struct PhoneForward *temp = pf;
     char const *copyNum1 = num1;
 
     while (*num1) {
-        int code = get_digit(*num1);
-        // Tworzę nowy węzeł, jeśli ścieżka nie istnieje.
-        if (temp->children[code] == NULL) {
-            temp->children[code] = newNode();
-            if (temp->children[code] == NULL) {
+        // Przesuwam się do następnego węzła.
+        temp = getOrCreateChild(pf, temp, get_digit(*num1));
+        if (temp == NULL) {
+            COUNTERS_LEAVE();
+            return false;
+        }
+        COUNTERS_ADD(COUNTER_NODES, 1);
+        //  Przesuwam się do następnego węzła.
+        num1++;
+    }
+
+    bool ok = setForwarding(pf, temp, copyNum1, num2, keepReverseUpToDate(pf));
+    COUNTERS_LEAVE();
+    return ok;
+}
+
+
+bool phfwdBulkLoad(PhoneForward *pf, PhoneForwardRule const *rules, size_t count) {
+    if (pf == NULL || (rules == NULL && count > 0)) {
+        return false;
+    }
+    bool updateReverse = keepReverseUpToDate(pf);
+    PhoneForward *curr = pf;    // Wierzchołek ostatnio dodanego numeru.
+    char const *prev = "";      // Ostatnio dodany numer.
+    size_t depth = 0;           // Głębokość wierzchołka curr.
+
+    for (size_t r = 0; r < count; r++) {
+        char const *num1 = rules[r].from;
+        char const *num2 = rules[r].to;
+        if (phfwdRootOf(pf)->trace != NULL) {   // Ślad zapisuje przekierowania jak phfwdAdd.
+            traceRecord(phfwdRootOf(pf)->trace, OPERATION_ADD, num1, num2);
+        }
+        if (!isPhfwdAddCorrectInput(pf, num1, num2)) {
+            return false;
+        }
+        // Cofam się tylko do wspólnego prefiksu z poprzednim numerem.
+        size_t common = 0;
+        while (common < depth && prev[common] == num1[common]) {
+            common++;
+        }
+        for (; depth > common; depth--) {
+            curr = curr->parent;
+        }
+        for (; num1[depth] != '\0'; depth++) {
+            PhoneForward *child = getOrCreateChild(pf, curr, get_digit(num1[depth]));
+            if (child == NULL) {
                 return false;
             }
-            temp->children[code]->forwarding = NULL;
-            temp->children[code]->parent = temp;
+            curr = child;
         }
-        // Przesuwam się do następnego węzła.
-        temp = temp->children[code];
+        prev = num1;
+        if (!setForwarding(pf, curr, num1, num2, updateReverse)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-        //  Przesuwam się do następnego węzła.
-        num1++;
+
+/**
+ * @brief Zwraca znak odpowiadający cyfrze (odwrotność get_digit).
+ * @param digit - cyfra od 0 do CHILDREN_NUMB - 1.
+ * @return znak cyfry.
+ */
+static char digitToChar(int digit) {
+    return "0123456789*#"[digit];
+}
+
+
+/**
+ * @brief Odwiedza przekierowania poddrzew zmienionych nie wcześniej niż
+ *        w wersji @p minStamp.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @param minStamp - najstarsza odwiedzana wersja (0 - wszystkie poddrzewa).
+ * @param visit - funkcja wywoływana dla każdego przekierowania.
+ * @param data - wskaźnik przekazywany funkcji @p visit.
+ * @return Wartość jak w phfwdForEach.
+ */
+static bool forEachSince(PhoneForward const *pf, uint64_t minStamp, PhoneForwardVisitor visit,
+                         void *data) {
+    if (pf == NULL || visit == NULL) {
+        return false;
+    }
+    size_t capacity = 16, depth = 0;
+    char *path = malloc(sizeof(char) * capacity);
+    if (path == NULL) {
+        return false;
     }
+    PhoneForward const *curr = pf;
+    int next = 0; // Indeks następnego dziecka do odwiedzenia w curr.
+    bool ok = true;
 
-    if (temp->forwarding) {
-        phrevRemove(pf->pfRev, temp->forwarding, copyNum1);
-        free(temp->forwarding);
-        temp->forwarding = NULL;
+    while (ok) {
+        while (next < CHILDREN_NUMB
+               && (curr->children[next] == NULL || curr->children[next]->stamp < minStamp)) {
+            next++;
+        }
+        if (next < CHILDREN_NUMB) {     // Schodzę do dziecka.
+            if (depth + 1 == capacity) {
+                char *newPath = realloc(path, sizeof(char) * 2 * capacity);
+                if (newPath == NULL) {
+                    ok = false;
+                    break;
+                }
+                path = newPath;
+                capacity *= 2;
+            }
+            path[depth++] = digitToChar(next);
+            path[depth] = '\0';
+            curr = curr->children[next];
+            next = 0;
+            if (curr->forwarding != NULL) {
+                ok = visit(data, path, curr->forwarding);
+            }
+        } else {                        // Wracam do rodzica.
+            if (curr == pf) {
+                break;
+            }
+            next = get_digit(path[--depth]) + 1;
+            curr = curr->parent;
+        }
     }
-    temp->forwarding = (char *) malloc(sizeof(char) * (strlen(num2) + 1));
-    if (temp->forwarding == NULL) {
+    free(path);
+    return ok;
+}
+
+
+bool phfwdForEach(PhoneForward const *pf, PhoneForwardVisitor visit, void *data) {
+    return forEachSince(pf, 0, visit, data);
+}
+
+
+bool phfwdForEachChanged(PhoneForward const *pf, uint64_t since, PhoneForwardVisitor visit, void *data) {
+    return forEachSince(pf, since + 1, visit, data);
+}
+
+
+bool phfwdTrackChanges(PhoneForward *pf) {
+    if (pf == NULL) {
         return false;
     }
-    strcpy(temp->forwarding, num2);
-    // Dodaje przekierowania do drzewa przekierowań forwarding ("odwróconego").
-    bool ok = phrevAdd(pf->pfRev, copyNum1, num2);
+    struct PhoneForwardRoot *root = phfwdRootOf(pf);
+    if (root->history == NULL) {
+        root->history = malloc(sizeof(PhoneForwardHistory));
+        if (root->history == NULL) {
+            return false;
+        }
+        root->history->version = pf->stamp;
+        root->history->start = pf->stamp;
+        root->history->removals = NULL;
+        root->history->size = 0;
+        root->history->capacity = 0;
+    }
+    return true;
+}
+
 
+uint64_t phfwdVersion(PhoneForward const *pf) {
+    return (pf != NULL && phfwdRootOf(pf)->history != NULL) ? phfwdRootOf(pf)->history->version : 0;
+}
+
+
+void phfwdTrimChanges(PhoneForward *pf, uint64_t version) {
+    if (pf == NULL || phfwdRootOf(pf)->history == NULL) {
+        return;
+    }
+    PhoneForwardHistory *history = phfwdRootOf(pf)->history;
+    size_t trimmed = 0;
+    while (trimmed < history->size && history->removals[trimmed].version <= version) {
+        free(history->removals[trimmed].prefix);
+        trimmed++;
+    }
+    if (trimmed > 0) {
+        memmove(history->removals, history->removals + trimmed,
+                sizeof(struct PhoneForwardRemoval) * (history->size - trimmed));
+        history->size -= trimmed;
+    }
+    if (history->start < version) {
+        history->start = version < history->version ? version : history->version;
+    }
+}
+
+
+bool phfwdStats(PhoneForward const *pf, PhoneForwardStats *stats) {
+    if (pf == NULL || stats == NULL) {
+        return false;
+    }
+    *stats = *phfwdRootOf(pf)->stats;
+    stats->reverseStale = phfwdRootOf(pf)->reverseStale;
+    // Korzeń jest większy od pozostałych wierzchołków o dane struktury.
+    stats->bytesAllocated = sizeof(PhoneForwardStats) + stats->forwardNodes * sizeof(PhoneForward)
+                            + sizeof(struct PhoneForwardRoot) - sizeof(PhoneForward)
+                            + stats->stringBytes;
+    phrevStats(phfwdRootOf(pf)->pfRev, stats);
+    return true;
+}
+
+
+/**
+ * @brief Wstawia przekierowanie do drzewa odwróconego (dla @ref phfwdForEach).
+ * Drzewo jest przechodzone w porządku leksykograficznym numerów "skąd",
+ * więc każda lista drzewa odwróconego jest uzupełniana jedynie na końcu.
+ * @param data - wskaźnik na budowane drzewo odwrócone.
+ * @param num1 - wskaźnik na numer "skąd".
+ * @param num2 - wskaźnik na numer "dokąd".
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool addToReverseTree(void *data, char const *num1, char const *num2) {
+    return phrevAdd(data, num1, num2);
+}
+
+
+void phfwdSetReverseDeferred(PhoneForward *pf, bool deferred) {
+    if (pf != NULL) {
+        phfwdRootOf(pf)->reverseDeferred = deferred;
+    }
+}
+
+
+/** @brief Chroni odbudowę drzew odwróconych wywoływana przez zapytania. */
+static pthread_mutex_t rebuildMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+bool phfwdRebuildReverse(PhoneForward *pf) {
+    if (pf == NULL) {
+        return false;
+    }
+    struct PhoneForwardRoot *root = phfwdRootOf(pf);
+    // Wątek, który widzi aktualne drzewo, widzi też jego zawartość.
+    if (!atomic_load_explicit(&root->reverseStale, memory_order_acquire)) {
+        return true;
+    }
+    pthread_mutex_lock(&rebuildMutex);
+    bool ok = true;
+    if (atomic_load_explicit(&root->reverseStale, memory_order_relaxed)) {
+        PhoneReverse *pfRev = phrevNew();
+        ok = pfRev != NULL && phfwdForEach(pf, addToReverseTree, pfRev);
+        if (ok) {
+            deleteReverseTree(root->pfRev);
+            root->pfRev = pfRev;
+            atomic_store_explicit(&root->reverseStale, false, memory_order_release);
+        } else {
+            deleteReverseTree(pfRev);
+        }
+    }
+    pthread_mutex_unlock(&rebuildMutex);
+    return ok;
+}
+
+
+/**
+ * @brief Wyznacza głębokość, do której ścieżka numeru przetrwa usunięcia.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @param removes - lista usuwanych prefiksów.
+ * @param num - wskaźnik na numer.
+ * @return liczba początkowych znaków @p num, których wierzchołki istnieją
+ *         i nie zostaną usunięte.
+ */
+static size_t survivingDepth(PhoneForward const *pf, List const *removes, char const *num) {
+    size_t depth = 0;
+    while (num[depth] != '\0') {
+        pf = pf->children[get_digit(num[depth])];
+        if (pf == NULL || listContains(removes, num, depth + 1)) {
+            break;
+        }
+        depth++;
+    }
+    return depth;
+}
+
+
+/**
+ * @brief Zwalnia przygotowane wierzchołki i napisy (bez samych tablic).
+ * @param nodes - tablica wierzchołków.
+ * @param nodesCount - liczba wierzchołków.
+ * @param strings - tablica napisów.
+ * @param stringsCount - liczba napisów.
+ */
+static void freePrepared(PhoneForward **nodes, size_t nodesCount, char **strings, size_t stringsCount) {
+    for (size_t i = 0; i < nodesCount; i++) {
+        free(nodes[i]);
+    }
+    for (size_t i = 0; i < stringsCount; i++) {
+        free(strings[i]);
+    }
+}
+
+
+/**
+ * @brief Zapisuje w śladzie operacje zastosowane przez phfwdApplyBatch.
+ * Usunięcia i przekierowania sa zapisywane jak wywołania phfwdRemove
+ * i phfwdAdd, w kolejności, w której sa stosowane.
+ * @param pf - wskaźnik na korzeń drzewa (z zapisem śladu).
+ * @param removes - lista usuwanych prefiksów (może byc NULL).
+ * @param adds - tablica przekierowań.
+ * @param count - liczba przekierowań w tablicy.
+ */
+static void traceBatch(PhoneForward *pf, List const *removes, PhoneForwardRule const *adds,
+                       size_t count) {
+    for (size_t i = 0; i < listSize(removes); i++) {
+        traceRecord(phfwdRootOf(pf)->trace, OPERATION_REMOVE, listGet(removes, i), NULL);
+    }
+    for (size_t r = 0; r < count; r++) {
+        traceRecord(phfwdRootOf(pf)->trace, OPERATION_ADD, adds[r].from, adds[r].to);
+    }
+}
+
+
+bool phfwdApplyBatch(PhoneForward *pf, struct List const *removes,
+                     PhoneForwardRule const *adds, size_t count) {
+    if (pf == NULL) {
+        return false;
+    }
+    // Liczę wierzchołki do utworzenia: poza tymi, które przetrwają usunięcia,
+    // i tymi, które utworzę dla poprzedniego (mniejszego) numeru.
+    size_t needed = 0;
+    for (size_t r = 0; r < count; r++) {
+        size_t have = survivingDepth(pf, removes, adds[r].from);
+        if (r > 0) {
+            size_t common = 0;
+            while (adds[r - 1].from[common] != '\0' && adds[r - 1].from[common] == adds[r].from[common]) {
+                common++;
+            }
+            have = have > common ? have : common;
+        }
+        needed += strlen(adds[r].from) - have;
+    }
+
+    // Alokuję wszystko przed pierwsza zmiana.
+    PhoneForward **nodes = malloc(sizeof(PhoneForward *) * (needed + 1));
+    char **strings = malloc(sizeof(char *) * (count + 1));
+    size_t nodesCount = 0, stringsCount = 0;
+    bool ok = (nodes != NULL && strings != NULL);
+    for (; ok && nodesCount < needed; nodesCount++) {
+        nodes[nodesCount] = newNode();
+        ok = (nodes[nodesCount] != NULL);
+    }
+    MEMORY_ENTER(MEMORY_FORWARDINGS);
+    for (; ok && stringsCount < count; stringsCount++) {
+        strings[stringsCount] = malloc(sizeof(char) * (strlen(adds[stringsCount].to) + 1));
+        ok = (strings[stringsCount] != NULL);
+        if (ok) {
+            strcpy(strings[stringsCount], adds[stringsCount].to);
+        }
+    }
+    MEMORY_LEAVE();
     if (!ok) {
+        freePrepared(nodes, nodesCount, strings, stringsCount);
+        free(nodes);
+        free(strings);
         return false;
     }
+
+    // Od tego miejsca nic nie może sie nie udać w drzewie przekierowań.
+    if (phfwdRootOf(pf)->trace != NULL) {
+        traceBatch(pf, removes, adds, count);
+    }
+    for (size_t i = 0; i < listSize(removes); i++) {
+        trieRemove(pf, listGet(removes, i));
+    }
+    bool updateReverse = keepReverseUpToDate(pf);
+    uint64_t version = beginChange(pf);
+    size_t used = 0;
+    for (size_t r = 0; r < count; r++) {
+        PhoneForward *curr = pf;
+        for (char const *num = adds[r].from; *num != '\0'; num++) {
+            int code = get_digit(*num);
+            if (curr->children[code] == NULL) {
+                curr->children[code] = nodes[used++];
+                curr->children[code]->forwarding = NULL;
+                curr->children[code]->parent = curr;
+                phfwdRootOf(pf)->stats->forwardNodes++;
+            }
+            curr = curr->children[code];
+        }
+        size_t depth = strlen(adds[r].from);
+        if (curr->forwarding != NULL) {
+            if (updateReverse) {
+                phrevRemove(phfwdRootOf(pf)->pfRev, curr->forwarding, adds[r].from);
+            }
+            countRule(pf, depth, curr->forwarding, false);
+            releaseMemory(pf, curr->forwarding);
+        }
+        curr->forwarding = strings[r];
+        countRule(pf, depth, strings[r], true);
+        markChanged(curr, version);
+        if (updateReverse && !phrevAdd(phfwdRootOf(pf)->pfRev, adds[r].from, adds[r].to)) {
+            phfwdRootOf(pf)->reverseStale = true;    // Drzewo odwrócone zostanie odbudowane.
+            updateReverse = false;
+        }
+    }
+    freePrepared(nodes + used, nodesCount - used, NULL, 0);    // Nadmiarowe wierzchołki.
+    free(nodes);
+    free(strings);
     return true;
 }
 
 
 /**
- * @brief Rekurencyjne usuwanie struktury PhoneForward.
+ * @brief Usuwanie struktury PhoneForward.
  * (Funkcja pomocnicza)
- * Rekurencyjne usuwanie struktury PhoneForward nie usuwając
- * podstruktury drzewa odwróconego "PfRev".
+ * Usuwa poddrzewo struktury PhoneForward nie usuwając
+ * podstruktury drzewa odwróconego "PfRev". Przechodzi poddrzewo iteracyjnie
+ * (jak @ref removeSubtree), więc głębokość drzewa nie jest ograniczona
+ * rozmiarem stosu.
+ * @param root - wskaźnik na korzeń drzewa.
  * @param pf - wskaźnik na usuwana strukturę.
  */
-static void deleteRegularTree(PhoneForward *pf) {
-    for (int i = 0; i < CHILDREN_NUMB; i++) {
-        if (pf->children[i] != NULL) {
-            deleteRegularTree(pf->children[i]);
+static void deleteRegularTree(PhoneForward const *root, PhoneForward *pf) {
+    PhoneForward *curr = pf;
+    while (true) {
+        int i = 0;
+        while (i < CHILDREN_NUMB && curr->children[i] == NULL) {
+            i++;
         }
+        if (i < CHILDREN_NUMB) {      // Najpierw usuwam dzieci.
+            curr = curr->children[i];
+            continue;
+        }
+        if (curr->forwarding != NULL) {
+            releaseMemory(root, curr->forwarding);
+            curr->forwarding = NULL;
+        }
+        if (curr == pf) {
+            if (pf != root) {
+                releaseMemory(root, pf);
+            }
+            return;
+        }
+        PhoneForward *parent = curr->parent;
+        for (i = 0; parent->children[i] != curr; i++);
+        parent->children[i] = NULL;
+        releaseMemory(root, curr);
+        curr = parent;
     }
-    if (pf->forwarding != NULL) {
-        free(pf->forwarding);
-        pf->forwarding = NULL;
-    }
-    free(pf);
-    pf = NULL;
 }
 
 
 void phfwdDelete(PhoneForward *pf) {
     if (pf != NULL) {
-        deleteReverseTree(pf->pfRev);
-        deleteRegularTree(pf);
+        struct PhoneForwardRoot *root = phfwdRootOf(pf);
+        phfwdTraceStop(pf);
+        deleteReverseTree(root->pfRev);
+        deleteRegularTree(pf, pf);
+        if (root->history != NULL) {
+            phfwdTrimChanges(pf, root->history->version);
+            free(root->history->removals);
+            free(root->history);
+        }
+        resolveCacheDelete(root->resolveCache);
+        free(root->stats);
+        free(root->arena);
+        free(root);
     }
-}
\ No newline at end of file
+}
+
+
+/**
+ * @brief Stan scalania struktur.
+ * Przy kopiowaniu (źródło wczytane ze zrzutu) wierzchołki i przekierowania
+ * sa przygotowywane przed pierwsza zmiana i pobierane w kolejności
+ * przechodzenia drzew.
+ */
+struct MergeState {
+    PhoneForward *dst;  ///<korzeń struktury docelowej.
+    PhoneForwardMergePolicy policy;  ///<sposób rozstrzygania konfliktów.
+    uint64_t version;  ///<wersja struktury docelowej (0, gdy nie jest śledzona).
+    bool copy;  ///<czy poddrzewa sa kopiowane zamiast przepinane.
+    PhoneForward **nodes;  ///<przygotowane wierzchołki.
+    size_t nodesCount;  ///<liczba przygotowanych wierzchołków.
+    char **strings;  ///<przygotowane przekierowania.
+    size_t stringsCount;  ///<liczba przygotowanych przekierowań.
+    size_t stringsCapacity;  ///<rozmiar tablicy strings.
+    PhoneReverse *reverse;  ///<aktualizowane drzewo odwrócone struktury docelowej (lub NULL).
+    char *path;  ///<numer bieżącego wierzchołka części wspólnej (gdy reverse nie jest NULL).
+    size_t pathCapacity;  ///<rozmiar bufora path.
+};
+
+
+/**
+ * @brief Sprawdza, czy przekierowanie źródłowe trafia do struktury docelowej.
+ * @param state - wskaźnik na stan scalania.
+ * @param dst - wierzchołek docelowy.
+ * @param src - wierzchołek źródłowy.
+ * @return Wartość @p true, jeśli przekierowanie @p src zastąpi docelowe.
+ */
+static bool takesForwarding(struct MergeState const *state, PhoneForward const *dst,
+                            PhoneForward const *src) {
+    return src->forwarding != NULL
+           && (dst == NULL || dst->forwarding == NULL || state->policy == MERGE_SOURCE_WINS);
+}
+
+
+/**
+ * @brief Przygotowuje kopię przekierowania.
+ * @param state - wskaźnik na stan scalania.
+ * @param forwarding - kopiowane przekierowanie.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool prepareString(struct MergeState *state, char const *forwarding) {
+    if (state->stringsCount == state->stringsCapacity) {
+        size_t newCapacity = state->stringsCapacity ? 2 * state->stringsCapacity : 16;
+        char **newStrings = realloc(state->strings, sizeof(char *) * newCapacity);
+        if (newStrings == NULL) {
+            return false;
+        }
+        state->strings = newStrings;
+        state->stringsCapacity = newCapacity;
+    }
+    MEMORY_ENTER(MEMORY_FORWARDINGS);
+    char *copy = malloc(sizeof(char) * (strlen(forwarding) + 1));
+    MEMORY_LEAVE();
+    if (copy == NULL) {
+        return false;
+    }
+    strcpy(copy, forwarding);
+    state->strings[state->stringsCount++] = copy;
+    return true;
+}
+
+
+/**
+ * @brief Przygotowuje kopie przekierowań i liczy wierzchołki do skopiowania.
+ * Przechodzi drzewo źródłowe iteracyjnie w porządku preorder, czyli w tej
+ * samej kolejności co mergeNodes i graft. Pod wierzchołkiem, którego brakuje
+ * w strukturze docelowej, @p below liczy poziomy poniżej ostatniego
+ * istniejącego wierzchołka docelowego.
+ * @param state - wskaźnik na stan scalania.
+ * @param dst - korzeń struktury docelowej.
+ * @param src - korzeń struktury źródłowej.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool prepareMerge(struct MergeState *state, PhoneForward const *dst, PhoneForward const *src) {
+    PhoneForward const *curr = src;
+    size_t below = 0;
+    int next = 0;
+    if (takesForwarding(state, dst, src) && !prepareString(state, src->forwarding)) {
+        return false;
+    }
+    while (true) {
+        while (next < CHILDREN_NUMB && curr->children[next] == NULL) {
+            next++;
+        }
+        if (next < CHILDREN_NUMB) {
+            if (below > 0 || dst->children[next] == NULL) {
+                below++;
+            } else {
+                dst = dst->children[next];
+            }
+            curr = curr->children[next];
+            next = 0;
+            if (below > 0) {
+                state->nodesCount++;
+            }
+            if (takesForwarding(state, below > 0 ? NULL : dst, curr)
+                && !prepareString(state, curr->forwarding)) {
+                return false;
+            }
+            continue;
+        }
+        if (curr == src) {
+            return true;
+        }
+        PhoneForward const *parent = curr->parent;
+        for (next = 0; parent->children[next] != curr; next++);
+        next++;
+        curr = parent;
+        if (below > 0) {
+            below--;
+        } else {
+            dst = dst->parent;
+        }
+    }
+}
+
+
+/**
+ * @brief Pobiera przekierowanie wierzchołka źródłowego.
+ * @param state - wskaźnik na stan scalania.
+ * @param src - wierzchołek źródłowy.
+ * @return przekierowanie (przygotowana kopia lub odebrane źródłu).
+ */
+static char *takeForwarding(struct MergeState *state, PhoneForward *src) {
+    if (state->copy) {
+        return state->strings[state->stringsCount++];
+    }
+    char *forwarding = src->forwarding;
+    src->forwarding = NULL;
+    return forwarding;
+}
+
+
+/**
+ * @brief Przenosi jeden wierzchołek poddrzewa źródłowego (patrz graft).
+ * @param state - wskaźnik na stan scalania.
+ * @param src - wierzchołek źródłowy.
+ * @param parent - nowy rodzic wierzchołka.
+ * @return wierzchołek w strukturze docelowej.
+ */
+static PhoneForward *graftNode(struct MergeState *state, PhoneForward *src, PhoneForward *parent) {
+    PhoneForward *node = src;
+    if (state->copy) {
+        node = state->nodes[state->nodesCount++];
+        node->forwarding = src->forwarding != NULL ? takeForwarding(state, src) : NULL;
+        node->hash = src->hash;
+        node->hashValid = src->hashValid;
+    }
+    node->parent = parent;
+    node->stamp = state->version;
+    return node;
+}
+
+
+/**
+ * @brief Przenosi poddrzewo źródłowe do struktury docelowej.
+ * Przepina poddrzewo albo (przy kopiowaniu) odtwarza je z przygotowanych
+ * wierzchołków. Jeśli zmiany sa śledzone, oznacza wszystkie wierzchołki
+ * poddrzewa bieżącą wersją. Poddrzewo jest przechodzone iteracyjnie
+ * w porządku preorder, równolegle z jego odpowiednikiem w strukturze
+ * docelowej.
+ * @param state - wskaźnik na stan scalania.
+ * @param src - korzeń poddrzewa źródłowego.
+ * @param parent - nowy rodzic poddrzewa.
+ * @return korzeń poddrzewa w strukturze docelowej.
+ */
+static PhoneForward *graft(struct MergeState *state, PhoneForward *src, PhoneForward *parent) {
+    if (!state->copy && state->version == 0) {
+        src->parent = parent;
+        return src;
+    }
+    PhoneForward *top = graftNode(state, src, parent);
+    PhoneForward *srcCurr = src, *curr = top;
+    int next = 0;
+    while (true) {
+        while (next < CHILDREN_NUMB && srcCurr->children[next] == NULL) {
+            next++;
+        }
+        if (next < CHILDREN_NUMB) {
+            curr->children[next] = graftNode(state, srcCurr->children[next], curr);
+            srcCurr = srcCurr->children[next];
+            curr = curr->children[next];
+            next = 0;
+            continue;
+        }
+        if (srcCurr == src) {
+            return top;
+        }
+        PhoneForward *srcParent = srcCurr->parent;
+        for (next = 0; srcParent->children[next] != srcCurr; next++);
+        next++;
+        srcCurr = srcParent;
+        curr = curr->parent;
+    }
+}
+
+
+/**
+ * @brief Odlicza wierzchołek części wspólnej od statystyk przenoszonych
+ * poddrzew (patrz mergeNodes).
+ * @param grafted - wskaźnik na statystyki przenoszonych poddrzew.
+ * @param src - wierzchołek źródłowy części wspólnej (przed przejęciem
+ *              jego przekierowania).
+ * @param depth - głębokość wierzchołka @p src.
+ */
+static void skipOverlap(PhoneForwardStats *grafted, PhoneForward const *src, size_t depth) {
+    grafted->forwardNodes--;
+    if (src->forwarding != NULL) {
+        countRuleIn(grafted, depth, src->forwarding, false);
+    }
+}
+
+
+/**
+ * @brief Przejmuje przekierowanie źródłowe, jeśli wygrywa z docelowym.
+ * @param state - wskaźnik na stan scalania.
+ * @param dst - wierzchołek docelowy.
+ * @param src - wierzchołek źródłowy tego samego numeru.
+ * @param depth - głębokość scalanych wierzchołków.
+ */
+static void mergeForwarding(struct MergeState *state, PhoneForward *dst, PhoneForward *src, size_t depth) {
+    bool takes = takesForwarding(state, dst, src);
+    // Drzewo odwrócone zawiera już przekierowania obu struktur; usuwam
+    // z niego przekierowanie, które przegrało konflikt.
+    if (state->reverse != NULL && dst->forwarding != NULL && src->forwarding != NULL
+        && strcmp(dst->forwarding, src->forwarding) != 0) {
+        state->path[depth] = '\0';
+        phrevRemove(state->reverse, takes ? dst->forwarding : src->forwarding, state->path);
+    }
+    if (takes) {
+        char *forwarding = takeForwarding(state, src);
+        if (dst->forwarding != NULL) {
+            countRule(state->dst, depth, dst->forwarding, false);
+            releaseMemory(state->dst, dst->forwarding);
+        }
+        dst->forwarding = forwarding;
+        countRule(state->dst, depth, forwarding, true);
+        markChanged(dst, state->version);
+    }
+}
+
+
+/**
+ * @brief Dopisuje cyfrę do numeru bieżącego wierzchołka części wspólnej.
+ * Jeśli nie uda sie powiększyć bufora, drzewo odwrócone struktury docelowej
+ * zostanie odbudowane zamiast aktualizowania.
+ * @param state - wskaźnik na stan scalania.
+ * @param depth - głębokość wierzchołka, do którego prowadzi cyfra.
+ * @param digit - cyfra.
+ */
+static void extendPath(struct MergeState *state, size_t depth, int digit) {
+    if (state->reverse == NULL) {
+        return;
+    }
+    if (depth + 1 > state->pathCapacity) {
+        size_t newCapacity = state->pathCapacity ? 2 * state->pathCapacity : 16;
+        char *newPath = realloc(state->path, sizeof(char) * newCapacity);
+        if (newPath == NULL) {
+            phfwdRootOf(state->dst)->reverseStale = true;    // Drzewo odwrócone zostanie odbudowane.
+            state->reverse = NULL;
+            return;
+        }
+        state->path = newPath;
+        state->pathCapacity = newCapacity;
+    }
+    state->path[depth - 1] = digitToChar(digit);
+}
+
+
+/**
+ * @brief Scala drzewa obu struktur.
+ * Przechodzi iteracyjnie część wspólna drzew; poddrzewa, których brakuje
+ * w strukturze docelowej, przenosi funkcja graft.
+ * @param state - wskaźnik na stan scalania.
+ * @param dst - korzeń struktury docelowej.
+ * @param src - korzeń struktury źródłowej.
+ */
+static void mergeNodes(struct MergeState *state, PhoneForward *dst, PhoneForward *src) {
+    PhoneForward *srcCurr = src, *curr = dst;
+    size_t depth = 0;
+    int next = 0;
+    // Przenoszone poddrzewa to źródło bez części wspólnej, wiec ich
+    // statystyki wyznaczam bez przechodzenia ich.
+    PhoneForwardStats grafted = *phfwdRootOf(src)->stats;
+    skipOverlap(&grafted, src, 0);
+    mergeForwarding(state, dst, src, 0);
+    while (true) {
+        while (next < CHILDREN_NUMB && srcCurr->children[next] == NULL) {
+            next++;
+        }
+        if (next < CHILDREN_NUMB && curr->children[next] == NULL) {
+            curr->children[next] = graft(state, srcCurr->children[next], curr);
+            if (!state->copy) {
+                srcCurr->children[next] = NULL;
+            }
+            markChanged(curr, state->version);
+            next++;
+            continue;
+        }
+        if (next < CHILDREN_NUMB) {
+            srcCurr = srcCurr->children[next];
+            curr = curr->children[next];
+            depth++;
+            extendPath(state, depth, next);
+            next = 0;
+            skipOverlap(&grafted, srcCurr, depth);
+            mergeForwarding(state, curr, srcCurr, depth);
+            continue;
+        }
+        if (srcCurr == src) {
+            break;
+        }
+        PhoneForward *srcParent = srcCurr->parent;
+        for (next = 0; srcParent->children[next] != srcCurr; next++);
+        next++;
+        srcCurr = srcParent;
+        curr = curr->parent;
+        depth--;
+    }
+    PhoneForwardStats *stats = phfwdRootOf(state->dst)->stats;
+    stats->forwardNodes += grafted.forwardNodes;
+    stats->rules += grafted.rules;
+    stats->stringBytes += grafted.stringBytes;
+    for (size_t i = 0; i < STATS_DEPTHS; i++) {
+        stats->depths[i] += grafted.depths[i];
+    }
+}
+
+
+/**
+ * @brief Przenosi drzewo odwrócone struktury źródłowej do docelowej.
+ * Drzewo odwrócone struktury źródłowej jest najpierw (w razie potrzeby)
+ * odbudowywane. Jeśli któraś operacja sie nie uda, drzewo odwrócone
+ * struktury docelowej zostanie odbudowane przy pierwszym zapytaniu.
+ * @param dst - korzeń struktury docelowej.
+ * @param src - korzeń struktury źródłowej.
+ * @return drzewo odwrócone struktury docelowej zawierające przekierowania
+ *         obu struktur lub NULL, jeśli nie jest ono aktualizowane.
+ */
+static PhoneReverse *mergeReverse(PhoneForward *dst, PhoneForward *src) {
+    if (!keepReverseUpToDate(dst)) {
+        return NULL;
+    }
+    if (phfwdRebuildReverse(src) && phrevMerge(phfwdRootOf(dst)->pfRev, phfwdRootOf(src)->pfRev)) {
+        return phfwdRootOf(dst)->pfRev;
+    }
+    phfwdRootOf(dst)->reverseStale = true;   // Drzewo odwrócone zostanie odbudowane.
+    return NULL;
+}
+
+
+bool phfwdMerge(PhoneForward *dst, PhoneForward *src, PhoneForwardMergePolicy policy) {
+    // Scalania nie da sie zapisać w śladzie jako ciągu wywołań.
+    if (dst == NULL || src == NULL || dst == src || phfwdRootOf(dst)->trace != NULL || phfwdRootOf(src)->trace != NULL) {
+        return false;
+    }
+    struct MergeState state = {dst, policy, 0, phfwdRootOf(src)->arena != NULL, NULL, 0, NULL, 0, 0, NULL, NULL, 0};
+    if (state.copy) {
+        bool ok = prepareMerge(&state, dst, src);
+        size_t needed = state.nodesCount;
+        state.nodesCount = 0;
+        if (ok) {
+            state.nodes = malloc(sizeof(PhoneForward *) * (needed + 1));
+            ok = (state.nodes != NULL);
+        }
+        for (; ok && state.nodesCount < needed; state.nodesCount++) {
+            state.nodes[state.nodesCount] = newNode();
+            ok = (state.nodes[state.nodesCount] != NULL);
+        }
+        if (!ok) {
+            freePrepared(state.nodes, state.nodesCount, state.strings, state.stringsCount);
+            free(state.nodes);
+            free(state.strings);
+            return false;
+        }
+        state.nodesCount = 0;
+        state.stringsCount = 0;
+    }
+
+    // Od tego miejsca nic nie może sie nie udać.
+    bool changed = false;
+    for (int i = 0; i < CHILDREN_NUMB; i++) {
+        changed = changed || src->children[i] != NULL;
+    }
+    if (changed) {
+        state.version = beginChange(dst);
+        state.reverse = mergeReverse(dst, src);
+        mergeNodes(&state, dst, src);
+    }
+    free(state.nodes);
+    free(state.strings);
+    free(state.path);
+
+    // Usuwam z src to, co w nim zostało.
+    for (int i = 0; i < CHILDREN_NUMB; i++) {
+        if (src->children[i] != NULL) {
+            deleteRegularTree(src, src->children[i]);
+            src->children[i] = NULL;
+        }
+    }
+    if (changed) {
+        memset(phfwdRootOf(src)->stats, 0, sizeof(PhoneForwardStats));
+        phfwdRootOf(src)->stats->forwardNodes = 1;
+        phfwdRootOf(src)->reverseStale = true;
+        src->hash = 0;
+        src->hashValid = true;
+        if (phfwdRootOf(src)->history != NULL) {
+            uint64_t version = beginChange(src);
+            src->stamp = version;
+            phfwdTrimChanges(src, version);
+        }
+    }
+    return true;
+}
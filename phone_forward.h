@@ -10,10 +10,68 @@
 #define __PHONE_FORWARD_H__
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "phone_reverse.h"
 
 
 
+/**
+ * @brief Usunięcie prefiksu zapamiętane w historii zmian.
+ */
+struct PhoneForwardRemoval {
+    uint64_t version;  ///<wersja, w której nastąpiło usunięcie.
+    char *prefix;  ///<usunięty prefiks.
+};
+
+
+/**
+ * @brief Historia zmian struktury (dla zrzutów przyrostowych).
+ * Każda operacja zmieniająca przekierowania tworzy nowa wersję. Dodane
+ * przekierowania znajduje sie po polu stamp wierzchołków, a usunięcia sa
+ * zapamiętywane w tablicy @p removals.
+ */
+struct PhoneForwardHistory {
+    uint64_t version;  ///<numer bieżącej wersji.
+    uint64_t start;  ///<najstarsza wersja, od której można wyznaczyć zmiany.
+    struct PhoneForwardRemoval *removals;  ///<usunięcia w kolejności wersji.
+    size_t size;  ///<liczba usunięć.
+    size_t capacity;  ///<rozmiar tablicy usunięć.
+};
+/**
+ * @brief To jest typ PhoneForwardHistory.
+ *
+ */
+typedef struct PhoneForwardHistory PhoneForwardHistory;
+
+
+#define STATS_DEPTHS 32 ///<Liczba przedziałów histogramu długości prefiksów przekierowań
+
+
+/**
+ * @brief Statystyki rozmiaru i kształtu struktury (patrz @ref phfwdStats).
+ * Pola drzewa odwróconego opisują jego bieżący stan, więc gdy drzewo jest
+ * nieaktualne (@p reverseStale), nie odpowiadają przekierowaniom.
+ */
+struct PhoneForwardStats {
+    size_t forwardNodes;  ///<liczba wierzchołków drzewa przekierowań (z korzeniem).
+    size_t rules;  ///<liczba przekierowań.
+    size_t stringBytes;  ///<łączna długość przekierowań "dokąd" (wraz z '\0').
+    size_t depths[STATS_DEPTHS];  ///<liczba przekierowań z prefiksów długości i (ostatni przedział: dłuższych).
+    size_t reverseNodes;  ///<liczba wierzchołków drzewa odwróconego (z korzeniem).
+    size_t reverseLists;  ///<liczba niepustych list drzewa odwróconego.
+    size_t reverseEntries;  ///<łączna długość list drzewa odwróconego.
+    size_t reverseBytes;  ///<łączna długość numerów w listach (wraz z '\0').
+    size_t listLengths[STATS_LENGTHS];  ///<liczba list o długości z przedziału [2^i, 2^(i+1)).
+    bool reverseStale;  ///<czy drzewo odwrócone jest nieaktualne.
+    size_t bytesAllocated;  ///<pamięć wierzchołków, napisów, list i statystyk (bez narzutu alokatora).
+};
+/**
+ * @brief To jest typ PhoneForwardStats.
+ *
+ */
+typedef struct PhoneForwardStats PhoneForwardStats;
+
+
 /**
  * @brief Struktura do przechowywania przekierowań.
  *  Przechowuję przekierowania w drzewie tries.
@@ -21,13 +79,20 @@
  * a pozostałe cyferki sa sa odpowiednikami cyfr w numerze.
  * Przekierowanie 'dokąd' przechowuję w forwarding. (Znajduje sie w synie najmniej
  * znaczącej cyfry przekierowania 'skąd'.
- * W pfRev przechowuje drzewo przekierowań odwrotnych (Reverse).
+ * W stamp przechowuję najnowsza wersję (patrz @ref PhoneForwardHistory),
+ * w której zmieniło sie przekierowanie w poddrzewie wierzchołka, a w hash
+ * skrót zawartości poddrzewa wyliczany przy porównywaniu struktur.
+ * Jeśli skrót wierzchołka jest nieaktualny, to skróty jego przodków też.
+ * Dane całej struktury trzymam tylko przy korzeniu (patrz
+ * @ref PhoneForwardRoot).
  */
 struct PhoneForward {
     struct PhoneForward *children[CHILDREN_NUMB]; ///<"dzieci" wierzchołka drzewa.
     struct PhoneForward *parent;    ///<rodzic danego wierzchołka.
     char *forwarding;  ///<przekierowanie.
-    struct PhoneReverse *pfRev; ///<struktura przekierowań odwróconych (Reverse).
+    uint64_t stamp; ///<wersja ostatniej zmiany w poddrzewie.
+    uint64_t hash; ///<skrót zawartości poddrzewa (aktualny, gdy hashValid).
+    bool hashValid; ///<czy hash jest aktualny.
 };
 /**
  * @brief to jest typ PhoneForward
@@ -36,8 +101,40 @@ struct PhoneForward {
 typedef struct PhoneForward PhoneForward;
 
 
+/**
+ * @brief Dane całej struktury przekierowań.
+ * Korzeń drzewa jest pierwszym polem tej struktury, więc wskaźnik na
+ * strukturę przekierowań (korzeń) wskazuje też na jej dane; pozostałe
+ * wierzchołki nie maja tych pól. Dostęp daje @ref phfwdRootOf.
+ */
+struct PhoneForwardRoot {
+    struct PhoneForward node; ///<korzeń drzewa przekierowań.
+    struct PhoneReverse *pfRev; ///<struktura przekierowań odwróconych (Reverse).
+    bool reverseDeferred; ///<czy utrzymywanie pfRev jest odroczone.
+    _Atomic bool reverseStale; ///<czy pfRev jest nieaktualne i wymaga odbudowania.
+    void *arena; ///<blok wierzchołków i przekierowań wczytanych ze zrzutu (lub NULL).
+    size_t arenaSize; ///<rozmiar bloku arena w bajtach.
+    struct PhoneForwardHistory *history; ///<historia zmian (lub NULL, gdy nie jest śledzona).
+    struct ResolveCache *resolveCache; ///<pamięć rozwinięć phfwdResolve (lub NULL).
+    PhoneForwardStats *stats; ///<statystyki drzewa przekierowań (bez pól drzewa odwróconego).
+    struct PhoneForwardTrace *trace; ///<zapis śladu wywołań (lub NULL, gdy nie jest zapisywany).
+    struct PhoneForwardEngine const *engine; ///<silnik, z którym utworzono strukturę (patrz phone_engine.h).
+};
+
+
+/**
+ * @brief Zwraca dane struktury przekierowań.
+ * @param pf - wskaźnik na korzeń drzewa (nie na inny wierzchołek).
+ * @return wskaźnik na dane struktury.
+ */
+static inline struct PhoneForwardRoot *phfwdRootOf(PhoneForward const *pf) {
+    return (struct PhoneForwardRoot *) pf;
+}
+
+
 /** @brief Tworzy nowa strukturę.
- * Tworzy nowa strukturę niezawierająca żadnych przekierowań.
+ * Tworzy nowa strukturę niezawierająca żadnych przekierowań, z ustawieniami
+ * silnika wybranego funkcją phfwdSetDefaultEngine (patrz phone_engine.h).
  * @return Wskaźnik na utworzona strukturę lub NULL, gdy nie udało sie
  *         alokować pamięci.
  */
@@ -65,6 +162,90 @@ void phfwdDelete(PhoneForward *pf);
 bool phfwdAdd(PhoneForward *pf, char const *num1, char const *num2);
 
 
+/**
+ * @brief Przekierowanie wszystkich numerów o prefiksie @p from na prefiks @p to.
+ */
+typedef struct PhoneForwardRule {
+    char const *from;  ///<prefiks numerów przekierowywanych.
+    char const *to;    ///<prefiks numerów, na które jest wykonywane przekierowanie.
+} PhoneForwardRule;
+
+
+/** @brief Dodaje wiele przekierowań naraz.
+ * Działa jak kolejne wywołania @ref phfwdAdd dla przekierowań z tablicy
+ * @p rules, ale schodzi w drzewie jedynie od wspólnego prefiksu z poprzednio
+ * dodanym numerem. Dane posortowane leksykograficznie według pola @p from
+ * dodawane sa najszybciej, bo wtedy listy drzewa odwróconego sa jedynie
+ * uzupełniane na końcu.
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] rules  - tablica przekierowań;
+ * @param[in] count  - liczba przekierowań w tablicy.
+ * @return Wartość @p true, jeśli wszystkie przekierowania zostały dodane.
+ *         Wartość @p false, jeśli któreś przekierowanie jest niepoprawne
+ *         (jak w @ref phfwdAdd) lub nie udało sie alokować pamięci;
+ *         przekierowania poprzedzające błędne pozostają wtedy dodane.
+ */
+bool phfwdBulkLoad(PhoneForward *pf, PhoneForwardRule const *rules, size_t count);
+
+
+/** @brief Atomowo stosuje zestaw usunięć i przekierowań.
+ * Funkcja pomocnicza dla zestawów zmian (@ref PhoneForwardChangeset).
+ * Najpierw usuwa przekierowania o prefiksach z listy @p removes (jak
+ * @ref phfwdRemove), następnie dodaje przekierowania z tablicy @p adds
+ * (jak @ref phfwdAdd). Cała pamięć potrzebna w drzewie przekierowań jest
+ * alokowana przed pierwsza zmiana, więc albo zostają zastosowane wszystkie
+ * operacje, albo żadna. Jeśli nie uda sie zaktualizować drzewa odwróconego,
+ * jest ono oznaczane jako nieaktualne i odbudowywane przy pierwszym zapytaniu.
+ * @param[in,out] pf  - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] removes - posortowana lista poprawnych prefiksów do usunięcia
+ *                      (może byc NULL);
+ * @param[in] adds    - tablica poprawnych przekierowań posortowana
+ *                      leksykograficznie według pola @p from, bez powtórzeń;
+ * @param[in] count   - liczba przekierowań w tablicy @p adds.
+ * @return Wartość @p true, jeśli operacje zostały zastosowane.
+ *         Wartość @p false, jeśli @p pf ma wartość NULL lub nie udało sie
+ *         alokować pamięci (struktura pozostaje wtedy niezmieniona).
+ */
+bool phfwdApplyBatch(PhoneForward *pf, struct List const *removes,
+                     PhoneForwardRule const *adds, size_t count);
+
+
+/**
+ * @brief Sposób rozstrzygania konfliktów przy scalaniu struktur.
+ */
+typedef enum PhoneForwardMergePolicy {
+    MERGE_SOURCE_WINS,  ///<przekierowanie ze struktury źródłowej zastępuje docelowe.
+    MERGE_DESTINATION_WINS  ///<przekierowanie docelowe pozostaje.
+} PhoneForwardMergePolicy;
+
+
+/** @brief Scala strukturę @p src ze strukturą @p dst.
+ * Przenosi (nie kopiuje) do @p dst wszystkie przekierowania z @p src; przy
+ * przekierowaniach z tego samego numeru decyduje @p policy. Poddrzewa,
+ * których brakuje w @p dst, sa przenoszone w całości (przepinane), więc
+ * koszt zależy od części wspólnej drzew, a nie od ich rozmiaru. Poddrzewa
+ * struktury wczytanej ze zrzutu (@ref phfwdLoad) sa kopiowane, a jeśli w @p dst
+ * zmiany sa śledzone (@ref phfwdTrackChanges), wierzchołki przenoszonych
+ * poddrzew sa oznaczane; wtedy koszt zależy też od rozmiaru tych poddrzew.
+ * Drzewo odwrócone @p src jest przenoszone do @p dst w ten sam sposób,
+ * a z przekierowań kolidujących usuwane sa z niego tylko te, które przegrały;
+ * jeśli drzewo odwrócone @p src jest nieaktualne, jest najpierw odbudowywane.
+ *
+ * Scalanie zużywa strukturę @p src: po udanym scaleniu jest ona pusta
+ * (ale nadal trzeba ja usunąć przez @ref phfwdDelete). Aby zachować
+ * przekierowania @p src, należy scalić jej kopie (np. wczytana ze zrzutu).
+ * @param[in,out] dst - wskaźnik na strukturę docelowa;
+ * @param[in,out] src - wskaźnik na strukturę źródłowa, opróżniana przez scalanie;
+ * @param[in] policy  - sposób rozstrzygania konfliktów.
+ * @return Wartość @p true, jeśli struktury zostały scalone.
+ *         Wartość @p false, jeśli któryś wskaźnik ma wartość NULL, wskaźniki
+ *         sa równe, dla którejś struktury trwa zapis śladu (@ref phfwdTraceStart)
+ *         lub nie udało sie alokować pamięci (struktury pozostają wtedy
+ *         niezmienione).
+ */
+bool phfwdMerge(PhoneForward *dst, PhoneForward *src, PhoneForwardMergePolicy policy);
+
+
 /** @brief Usuwa przekierowania.
  * Usuwa wszystkie przekierowania, w których parametr @p num jest prefiksem
  * parametru @p num1 użytego przy dodawaniu. Jeśli nie ma takich przekierowań
@@ -109,6 +290,149 @@ PhoneNumbers * phfwdReverse(PhoneForward const *pf, char const *num);
 PhoneNumbers * phfwdGetReverse(PhoneForward const *pf, char const *num);
 
 
+/** @brief Wyznacza stronę kandydatów na przekierowania na dany numer.
+ * Wyznacza co najwyżej @p limit pierwszych numerów wyniku @ref phfwdReverse
+ * z numerem @p num, które sa leksykograficznie większe od @p afterKey.
+ * Kolejna stronę otrzymuje sie, podając jako @p afterKey ostatni numer
+ * poprzedniej strony. Alokuje strukturę @p PhoneNumbers, która musi byc
+ * zwolniona za pomocą funkcji @ref phnumDelete.
+ * @param[in] pf       - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] num      - wskaźnik na numer;
+ * @param[in] afterKey - wskaźnik na numer, po którym zaczyna sie strona, lub
+ *                       NULL dla pierwszej strony;
+ * @param[in] limit    - maksymalna liczba numerów na stronie.
+ * @return Wskaźnik na strukturę przechowująca ciąg numerów lub NULL, gdy nie
+ *         udało sie alokować pamięci. Jeśli @p num lub @p afterKey (różny od
+ *         NULL) nie reprezentuje numeru, wynikiem jest pusty ciąg.
+ */
+PhoneNumbers * phfwdReversePage(PhoneForward const *pf, char const *num,
+                                char const *afterKey, size_t limit);
+
+
+/** @brief Liczy kandydatów na przekierowania na dany numer.
+ * Wyznacza liczbę numerów w wyniku wywołania @ref phfwdReverse bez tworzenia
+ * tych numerów.
+ * @param[in] pf  - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] num - wskaźnik na numer.
+ * @return Liczba numerów. Wartość 0, jeśli @p pf ma wartość NULL, podany
+ *         napis nie reprezentuje numeru lub nie udało sie alokować pamięci.
+ */
+size_t phfwdReverseCount(PhoneForward const *pf, char const *num);
+
+
+/** @brief Liczy numery przechodzące na podany argument.
+ * Wyznacza liczbę numerów w wyniku wywołania @ref phfwdGetReverse bez
+ * tworzenia tych numerów.
+ * @param[in] pf  - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] num - wskaźnik na numer.
+ * @return Liczba numerów. Wartość 0, jeśli takich numerów nie ma, @p pf ma
+ *         wartość NULL, podany napis nie reprezentuje numeru lub nie udało sie
+ *         alokować pamięci.
+ */
+size_t phfwdGetReverseCount(PhoneForward const *pf, char const *num);
+
+
+/** @brief Włącza lub wyłącza odroczone utrzymywanie drzewa odwróconego.
+ * W trybie odroczonym funkcje @ref phfwdAdd i @ref phfwdRemove nie aktualizują
+ * drzewa przekierowań odwróconych. Drzewo jest odbudowywane w jednym przejściu
+ * po drzewie przekierowań przy pierwszym wywołaniu @ref phfwdReverse lub
+ * @ref phfwdGetReverse albo przy wywołaniu @ref phfwdRebuildReverse.
+ * Nic nie robi, jeśli wskaźnik @p pf ma wartość NULL.
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] deferred - @p true, aby włączyć tryb odroczony, @p false wpp.
+ */
+void phfwdSetReverseDeferred(PhoneForward *pf, bool deferred);
+
+
+/** @brief Odbudowuje drzewo przekierowań odwróconych.
+ * Jeśli drzewo odwrócone jest nieaktualne (np. po dodawaniu przekierowań
+ * w trybie odroczonym), buduje je od nowa na podstawie drzewa przekierowań.
+ * Zapytania (np. @ref phfwdReverse) moga byc wykonywane jednocześnie z wielu
+ * wątków także na strukturze z nieaktualnym drzewem odwróconym: odbudowę
+ * wykonuje jeden z nich, a pozostałe czekają na jej koniec. Zmiany struktury
+ * nie moga byc wykonywane jednocześnie z innymi wywołaniami.
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania.
+ * @return Wartość @p true, jeśli drzewo odwrócone jest aktualne.
+ *         Wartość @p false, jeśli @p pf ma wartość NULL lub nie udało sie
+ *         alokować pamięci (drzewo pozostaje wtedy nieaktualne).
+ */
+bool phfwdRebuildReverse(PhoneForward *pf);
+
+
+/**
+ * @brief Funkcja wywoływana dla kolejnych przekierowań przez @ref phfwdForEach.
+ * Napisy sa ważne tylko do powrotu z funkcji. Zwrócenie @p false przerywa
+ * przechodzenie.
+ */
+typedef bool (*PhoneForwardVisitor)(void *data, char const *num1, char const *num2);
+
+
+/** @brief Wywołuje funkcję dla każdego przekierowania.
+ * Przekierowania sa odwiedzane w porządku leksykograficznym numerów @p num1.
+ * Funkcja @p visit nie może modyfikować struktury @p pf.
+ * @param[in] pf    - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] visit - funkcja wywoływana dla każdego przekierowania;
+ * @param[in] data  - wskaźnik przekazywany funkcji @p visit.
+ * @return Wartość @p true, jeśli odwiedzono wszystkie przekierowania.
+ *         Wartość @p false, jeśli któryś wskaźnik ma wartość NULL, funkcja
+ *         @p visit zwróciła @p false lub nie udało sie alokować pamięci.
+ */
+bool phfwdForEach(PhoneForward const *pf, PhoneForwardVisitor visit, void *data);
+
+
+/** @brief Wywołuje funkcję dla przekierowań zmienionych po danej wersji.
+ * Odwiedza w porządku leksykograficznym numerów @p num1 przekierowania
+ * poddrzew, w których coś sie zmieniło po wersji @p since, co zajmuje czas
+ * proporcjonalny do liczby zmian. Oprócz zmienionych może odwiedzić też
+ * przekierowania leżące na ścieżkach do nich.
+ * @param[in] pf    - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] since - numer wersji (patrz @ref phfwdVersion);
+ * @param[in] visit - funkcja wywoływana dla każdego przekierowania;
+ * @param[in] data  - wskaźnik przekazywany funkcji @p visit.
+ * @return Wartość jak w @ref phfwdForEach.
+ */
+bool phfwdForEachChanged(PhoneForward const *pf, uint64_t since, PhoneForwardVisitor visit, void *data);
+
+
+/** @brief Włącza śledzenie zmian struktury.
+ * Od tej chwili każda operacja zmieniająca przekierowania tworzy nowa
+ * wersję, a usunięcia sa zapamiętywane, żeby można było wyznaczyć zmiany
+ * od dowolnej późniejszej wersji. Nic nie robi, jeśli śledzenie jest już
+ * włączone.
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania.
+ * @return Wartość @p true, jeśli zmiany sa śledzone.
+ *         Wartość @p false, jeśli @p pf ma wartość NULL lub nie udało sie
+ *         alokować pamięci.
+ */
+bool phfwdTrackChanges(PhoneForward *pf);
+
+
+/** @brief Zwraca numer bieżącej wersji struktury.
+ * @param[in] pf - wskaźnik na strukturę przechowująca przekierowania.
+ * @return Numer wersji lub 0, jeśli zmiany nie sa śledzone.
+ */
+uint64_t phfwdVersion(PhoneForward const *pf);
+
+
+/** @brief Zapomina usunięcia wykonane nie później niż w wersji @p version.
+ * Zwalnia pamięć historii; zmian nie będzie można odtąd wyznaczyć od wersji
+ * wcześniejszych niż @p version.
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] version - numer wersji.
+ */
+void phfwdTrimChanges(PhoneForward *pf, uint64_t version);
+
+
+/** @brief Podaje rozmiar i kształt struktury.
+ * Statystyki sa aktualizowane przy każdej zmianie przekierowań, więc
+ * zapytanie działa w czasie stałym.
+ * @param[in] pf     - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[out] stats - wskaźnik na wypełniane statystyki.
+ * @return Wartość @p false, jeśli któryś ze wskaźników ma wartość NULL.
+ */
+bool phfwdStats(PhoneForward const *pf, PhoneForwardStats *stats);
+
+
 /**
  * @brief Zwraca liczbowa postać znaku.
  *
@@ -128,14 +452,5 @@ int get_digit(char c);
 bool isStringAPhoneNumber(const char *num);
 
 
-/**
- * @brief Funkcja tworzy przekierowanie, kopiuję go zawartość do "lastForward"
- * @param firstPart – pierwsza część tworzonego przekierowania.
- * @param secondPart – druga część tworzonego przekierowania.
- * @param lastForward – ostatnie znalezione przekierowanie.
- */
-void createAForward(char *const *firstPart, char **secondPart, char **lastForward);
-
-
 
 #endif /* __PHONE_FORWARD_H__ */
\ No newline at end of file
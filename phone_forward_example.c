@@ -7,8 +7,21 @@
 // włączeniem.
 #include "phone_forward.h"
 #include "phone_forward.h"
+#include "phone_changeset.h"
+#include "phone_counters.h"
+#include "phone_diff.h"
+#include "phone_engine.h"
+#include "phone_import.h"
+#include "phone_journal.h"
+#include "phone_memory.h"
+#include "phone_resolve.h"
+#include "phone_server.h"
+#include "phone_shared.h"
+#include "phone_snapshot.h"
+#include "phone_trace.h"
 
 #include <malloc.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -16,6 +29,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/wait.h>
 
 // Gdzieś musi być zdefiniowany magiczny napis służący do spawdzania, czy
 // program w całości wykonał się poprawnie.
@@ -37,6 +51,12 @@ char quite_long_magic_string[] = "MAGIC";
   if (p == NULL)                \
     return FAIL
 
+// Początek testu zależnego od wewnętrznej budowy danego silnika
+#define INIT_ENGINE(p, name)                           \
+  PhoneForward *p = phfwdNewEngine(phfwdEngine(name)); \
+  if (p == NULL)                                       \
+    return FAIL
+
 // Utworzenie nowej bazy przekierowań
 #define REINIT(p)    \
   phfwdDelete(pf);   \
@@ -186,6 +206,26 @@ char quite_long_magic_string[] = "MAGIC";
     phnumDelete(_p);                         \
   } while (0)
 
+// Oczekiwana liczba numerów w wynikach phfwdReverse i phfwdGetReverse z A
+// zgodna z phfwdReverseCount, phfwdGetReverseCount i phnumSize
+#define COUNT(p, A)                                   \
+  do {                                                \
+    PhoneNumbers *_p;                                 \
+    size_t _n;                                        \
+    N(_p = phfwdReverse(p, A));                       \
+    for (_n = 0; phnumGet(_p, _n) != NULL; ++_n);     \
+    if (phnumSize(_p) != _n)                          \
+      return FAIL;                                    \
+    phnumDelete(_p);                                  \
+    if (phfwdReverseCount(p, A) != _n)                \
+      return FAIL;                                    \
+    N(_p = phfwdGetReverse(p, A));                    \
+    for (_n = 0; phnumGet(_p, _n) != NULL; ++_n);     \
+    phnumDelete(_p);                                  \
+    if (phfwdGetReverseCount(p, A) != _n)             \
+      return FAIL;                                    \
+  } while (0)
+
 /** WŁAŚCIWE TESTY **/
 
 // Tylko utworzenie i usunięcie struktury
@@ -887,6 +927,1346 @@ static int get_reverse(void) {
     CLEAN(pf);
 }
 
+// Testy odroczonego utrzymywania drzewa odwróconego
+static int deferred_reverse(void) {
+    INIT(pf);
+
+    T(phfwdAdd(pf, "431", "432"));
+    phfwdSetReverseDeferred(pf, true);
+    T(phfwdAdd(pf, "432", "433"));
+    T(phfwdAdd(pf, "123", "9"));
+    T(phfwdAdd(pf, "123456", "777777"));
+    T(phfwdAdd(pf, "124", "9"));
+    phfwdRemove(pf, "124");
+    GRCHK(pf, "432", "431");
+    GRCHK(pf, "433", "432", "433");
+    RCHCK(pf, "987654321", "12387654321", "987654321");
+
+    phfwdRemove(pf, "12");
+    T(phfwdAdd(pf, "5", "433"));
+    T(phfwdRebuildReverse(pf));
+    RCHCK(pf, "433", "432", "433", "5");
+    RCHCK(pf, "987654321", "987654321");
+
+    phfwdSetReverseDeferred(pf, false);
+    T(phfwdAdd(pf, "6", "433"));
+    phfwdRemove(pf, "5");
+    RCHCK(pf, "433", "432", "433", "6");
+    F(phfwdRebuildReverse(NULL));
+
+    CLEAN(pf);
+}
+
+// Testy funkcji phfwdReverseCount i phfwdGetReverseCount
+static int reverse_count(void) {
+    INIT(pf);
+
+    Z(phnumSize(NULL));
+    Z(phfwdReverseCount(NULL, "1"));
+    Z(phfwdReverseCount(pf, "1a"));
+    Z(phfwdGetReverseCount(pf, ""));
+    COUNT(pf, "1");
+
+    T(phfwdAdd(pf, "12", "4"));
+    T(phfwdAdd(pf, "123", "43"));
+    T(phfwdAdd(pf, "2", "4"));
+    T(phfwdAdd(pf, "23", "4"));
+    T(phfwdAdd(pf, "4", "5"));
+    COUNT(pf, "434");
+    COUNT(pf, "4");
+    COUNT(pf, "43");
+    COUNT(pf, "5");
+
+    T(phfwdAdd(pf, "027", "07"));
+    T(phfwdAdd(pf, "0*7", "07"));
+    T(phfwdAdd(pf, "0#", "0"));
+    T(phfwdAdd(pf, "0#7", "07"));
+    COUNT(pf, "07");
+    COUNT(pf, "0777");
+
+    phfwdRemove(pf, "0");
+    phfwdRemove(pf, "12");
+    COUNT(pf, "07");
+    COUNT(pf, "434");
+
+    CLEAN(pf);
+}
+
+// Sprawdzenie, czy kolejne strony phfwdReversePage składają się na wynik
+// phfwdReverse
+static int check_pages(PhoneForward *pf, char const *num, size_t limit) {
+    PhoneNumbers *all, *page;
+    char key[64];
+    char const *after = NULL;
+    size_t idx = 0;
+
+    N(all = phfwdReverse(pf, num));
+    do {
+        N(page = phfwdReversePage(pf, num, after, limit));
+        size_t k;
+        for (k = 0; phnumGet(page, k) != NULL; ++k, ++idx) {
+            if (phnumGet(all, idx) == NULL)
+                return FAIL;
+            C(phnumGet(page, k), phnumGet(all, idx));
+        }
+        if (k > limit)
+            return FAIL;
+        if (k > 0) {
+            COPY(key, phnumGet(page, k - 1));
+            after = key;
+        }
+        phnumDelete(page);
+        if (k < limit)
+            break;
+    } while (true);
+    Q(all, idx);
+    phnumDelete(all);
+    return PASS;
+}
+
+// Testy funkcji phfwdReversePage
+static int reverse_page(void) {
+    INIT(pf);
+
+    E(phfwdReversePage(pf, "12a", NULL, 5));
+    E(phfwdReversePage(pf, "12", "a", 5));
+    E(phfwdReversePage(pf, "12", NULL, 0));
+    Z(check_pages(pf, "12", 1));
+
+    T(phfwdAdd(pf, "1", "4"));
+    T(phfwdAdd(pf, "10", "4"));
+    T(phfwdAdd(pf, "100", "4"));
+    T(phfwdAdd(pf, "1000", "4"));
+    T(phfwdAdd(pf, "12", "4"));
+    T(phfwdAdd(pf, "123", "43"));
+    T(phfwdAdd(pf, "2", "4"));
+    T(phfwdAdd(pf, "23", "4"));
+    T(phfwdAdd(pf, "*", "43"));
+    T(phfwdAdd(pf, "#9", "434"));
+    T(phfwdAdd(pf, "5", "434"));
+    for (size_t limit = 1; limit <= 12; ++limit) {
+        Z(check_pages(pf, "434", limit));
+        Z(check_pages(pf, "43", limit));
+        Z(check_pages(pf, "4", limit));
+    }
+
+    PhoneNumbers *p;
+    N(p = phfwdReversePage(pf, "434", "2", 3));
+    R(p, 0, "2334");
+    R(p, 1, "234");
+    R(p, 2, "434");
+    Q(p, 3);
+    phnumDelete(p);
+
+    CLEAN(pf);
+}
+
+// Testy funkcji phfwdBulkLoad
+static int bulk_load(void) {
+    static const PhoneForwardRule rules[] = {
+        {"0*7", "07"}, {"007", "07"}, {"017", "07"}, {"12", "4"},
+        {"123", "9"}, {"123456", "777777"}, {"2", "4"}, {"23", "4"},
+        {"123", "43"}, {"0#7", "07"}, {"01", "5"},
+    };
+    static const PhoneForwardRule wrong[] = {
+        {"5", "6"}, {"6", "6"}, {"7", "8"},
+    };
+
+    INIT(pf);
+
+    F(phfwdBulkLoad(NULL, rules, SIZE(rules)));
+    F(phfwdBulkLoad(pf, NULL, 1));
+    T(phfwdBulkLoad(pf, NULL, 0));
+    T(phfwdBulkLoad(pf, rules, SIZE(rules)));
+    CHECK(pf, "1234", "434");
+    CHECK(pf, "1234567", "7777777");
+    CHECK(pf, "017", "07");
+    CHECK(pf, "0123", "523");
+    RCHCK(pf, "07", "007", "017", "07", "0*7", "0#7");
+    RCHCK(pf, "434", "1234", "2334", "234", "434");
+    GRCHK(pf, "434", "1234", "2334", "434");
+
+    F(phfwdBulkLoad(pf, wrong, SIZE(wrong)));
+    CHECK(pf, "51", "61");
+    CHECK(pf, "71", "71");
+
+    REINIT(pf);
+
+    phfwdSetReverseDeferred(pf, true);
+    T(phfwdBulkLoad(pf, rules, SIZE(rules)));
+    RCHCK(pf, "07", "007", "017", "07", "0*7", "0#7");
+    phfwdRemove(pf, "0");
+    RCHCK(pf, "07", "07");
+
+    CLEAN(pf);
+}
+
+// Testy zestawów zmian
+static int changeset(void) {
+    PhoneForwardChangeset *cs;
+
+    INIT(pf);
+    N(cs = phfwdChangesetNew());
+
+    F(phfwdChangesetAdd(NULL, "1", "2"));
+    F(phfwdChangesetAdd(cs, "1", "1"));
+    F(phfwdChangesetAdd(cs, "1", "2a"));
+    F(phfwdChangesetRemove(cs, ""));
+    F(phfwdChangesetApply(NULL, cs));
+    T(phfwdChangesetApply(pf, cs));
+
+    T(phfwdAdd(pf, "12", "7"));
+    T(phfwdAdd(pf, "34", "7"));
+    T(phfwdAdd(pf, "56", "7"));
+
+    T(phfwdChangesetAdd(cs, "123", "9"));
+    T(phfwdChangesetAdd(cs, "1234", "8"));
+    T(phfwdChangesetRemove(cs, "12"));
+    T(phfwdChangesetAdd(cs, "125", "4"));
+    T(phfwdChangesetAdd(cs, "3", "5"));
+    T(phfwdChangesetAdd(cs, "3", "6"));
+    T(phfwdChangesetRemove(cs, "5"));
+    T(phfwdChangesetAdd(cs, "5*", "6"));
+    T(phfwdChangesetAdd(cs, "#", "0"));
+
+    // Przed zastosowaniem struktura jest niezmieniona.
+    CHECK(pf, "123", "73");
+    T(phfwdChangesetApply(pf, cs));
+
+    CHECK(pf, "123", "123");
+    CHECK(pf, "12345", "12345");
+    CHECK(pf, "1256", "46");
+    CHECK(pf, "31", "61");
+    CHECK(pf, "341", "71");
+    CHECK(pf, "561", "561");
+    CHECK(pf, "5*1", "61");
+    CHECK(pf, "#1", "01");
+    RCHCK(pf, "7", "34", "7");
+    RCHCK(pf, "61", "31", "5*1", "61");
+    GRCHK(pf, "61", "31", "5*1", "61");
+
+    phfwdChangesetDelete(cs);
+    phfwdChangesetDelete(NULL);
+
+    REINIT(pf);
+
+    N(cs = phfwdChangesetNew());
+    phfwdSetReverseDeferred(pf, true);
+    T(phfwdAdd(pf, "0", "1"));
+    T(phfwdChangesetRemove(cs, "0"));
+    T(phfwdChangesetAdd(cs, "01", "2"));
+    T(phfwdChangesetApply(pf, cs));
+    CHECK(pf, "02", "02");
+    CHECK(pf, "013", "23");
+    RCHCK(pf, "23", "013", "23");
+    phfwdChangesetDelete(cs);
+
+    CLEAN(pf);
+}
+
+// Zapisuje zrzut struktury do pliku tymczasowego i wczytuje go.
+static PhoneForward *save_and_load(PhoneForward const *pf) {
+    FILE *file = tmpfile();
+    PhoneForward *loaded = NULL;
+    if (file != NULL && phfwdSave(pf, fileno(file))) {
+        lseek(fileno(file), 0, SEEK_SET);
+        loaded = phfwdLoad(fileno(file));
+    }
+    if (file != NULL)
+        fclose(file);
+    return loaded;
+}
+
+static int snapshot(void) {
+    PhoneForward *loaded;
+    FILE *file;
+    char num1[16], num2[16];
+
+    INIT(pf);
+    F(phfwdSave(NULL, 1));
+    N(loaded = save_and_load(pf));
+    CHECK(loaded, "123", "123");
+    RCHCK(loaded, "1", "1");
+    phfwdDelete(loaded);
+
+    T(phfwdAdd(pf, "12", "7"));
+    T(phfwdAdd(pf, "1234", "*#"));
+    T(phfwdAdd(pf, "34", "7"));
+    T(phfwdAdd(pf, "#*0", "0123456789*#"));
+    N(loaded = save_and_load(pf));
+    CHECK(loaded, "125", "75");
+    CHECK(loaded, "12345", "*#5");
+    CHECK(loaded, "#*01", "0123456789*#1");
+    RCHCK(loaded, "7", "12", "34", "7");
+    GRCHK(loaded, "75", "125", "345", "75");
+
+    // Wczytana struktura daje sie dalej modyfikować.
+    T(phfwdAdd(loaded, "12", "8"));
+    T(phfwdAdd(loaded, "3", "9"));
+    phfwdRemove(loaded, "123");
+    CHECK(loaded, "1234", "834");
+    CHECK(loaded, "31", "91");
+    RCHCK(loaded, "7", "34", "7");
+    phfwdDelete(loaded);
+
+    // Zrzut jest mniejszy niż dane i wiernie odtwarza wiele przekierowań.
+    REINIT(pf);
+    for (int i = 0; i < 2000; ++i) {
+        sprintf(num1, "%d", i * 7919 % 100003);
+        sprintf(num2, "%d", i * 104729 % 1000003 + 1000003);
+        T(phfwdAdd(pf, num1, num2));
+    }
+    N(loaded = save_and_load(pf));
+    for (int i = 0; i < 2000; ++i) {
+        PhoneNumbers *expected, *actual;
+        sprintf(num1, "%d1", i * 7919 % 100003);
+        N(expected = phfwdGet(pf, num1));
+        N(actual = phfwdGet(loaded, num1));
+        C(phnumGet(expected, 0), phnumGet(actual, 0));
+        phnumDelete(expected);
+        phnumDelete(actual);
+    }
+    T(phfwdReverseCount(loaded, "1000003") == phfwdReverseCount(pf, "1000003"));
+    phfwdDelete(loaded);
+
+    // Niepoprawne zrzuty.
+    N(file = tmpfile());
+    T(phfwdSave(pf, fileno(file)));
+    off_t size = lseek(fileno(file), 0, SEEK_CUR);
+    T(size < 2000 * 12);
+    T(ftruncate(fileno(file), size - 1) == 0);
+    lseek(fileno(file), 0, SEEK_SET);
+    Z(phfwdLoad(fileno(file)));
+    lseek(fileno(file), 0, SEEK_SET);
+    T(write(fileno(file), "PFS1", 4) == 4);
+    lseek(fileno(file), 0, SEEK_SET);
+    Z(phfwdLoad(fileno(file)));
+    fclose(file);
+
+    CLEAN(pf);
+}
+
+// Stosuje do struktury zrzut przyrostowy zapisany w pliku tymczasowym.
+static bool save_and_apply_delta(PhoneForward const *pf, uint64_t since, PhoneForward *dst) {
+    FILE *file = tmpfile();
+    bool ok = file != NULL && phfwdSaveDelta(pf, since, fileno(file));
+    if (ok) {
+        lseek(fileno(file), 0, SEEK_SET);
+        ok = phfwdApplyDelta(dst, fileno(file));
+    }
+    if (file != NULL)
+        fclose(file);
+    return ok;
+}
+
+static int delta_snapshot(void) {
+    PhoneForward *old;
+    uint64_t base;
+
+    INIT(pf);
+    F(save_and_apply_delta(pf, 0, pf));
+    T(phfwdVersion(pf) == 0);
+    T(phfwdTrackChanges(pf));
+    T(phfwdTrackChanges(pf));
+    F(phfwdTrackChanges(NULL));
+
+    T(phfwdAdd(pf, "12", "7"));
+    T(phfwdAdd(pf, "1234", "*#"));
+    T(phfwdAdd(pf, "34", "7"));
+    T(phfwdAdd(pf, "56", "7"));
+    base = phfwdVersion(pf);
+    T(base == 4);
+    N(old = save_and_load(pf));
+
+    T(phfwdAdd(pf, "12", "8"));
+    phfwdRemove(pf, "3");
+    T(phfwdAdd(pf, "345", "6"));
+    phfwdRemove(pf, "9");
+    phfwdRemove(pf, "56");
+    T(phfwdAdd(pf, "#", "0"));
+    T(phfwdVersion(pf) == 9);
+    F(save_and_apply_delta(pf, 10, old));
+
+    T(save_and_apply_delta(pf, base, old));
+    CHECK(old, "125", "85");
+    CHECK(old, "12345", "*#5");
+    CHECK(old, "341", "341");
+    CHECK(old, "3456", "66");
+    CHECK(old, "561", "561");
+    CHECK(old, "#1", "01");
+    RCHCK(old, "7", "7");
+    RCHCK(old, "85", "125", "85");
+
+    // Zrzut od bieżącej wersji jest pusty.
+    T(phfwdVersion(old) == phfwdVersion(pf));
+    T(save_and_apply_delta(pf, phfwdVersion(pf), old));
+    CHECK(old, "125", "85");
+
+    // Zrzut od innej wersji niż wersja struktury jest odrzucany, także gdy
+    // był już zastosowany.
+    F(save_and_apply_delta(pf, base, old));
+    CHECK(old, "341", "341");
+    T(phfwdAdd(pf, "7", "1"));
+    T(save_and_apply_delta(pf, phfwdVersion(old), old));
+    CHECK(old, "71", "11");
+    F(save_and_apply_delta(pf, phfwdVersion(old) - 1, old));
+    T(phfwdVersion(old) == phfwdVersion(pf));
+
+    // Po zapomnieniu historii nie można wyznaczyć zmian od wcześniejszej wersji.
+    phfwdTrimChanges(pf, base + 2);
+    F(save_and_apply_delta(pf, base, old));
+    T(save_and_apply_delta(pf, phfwdVersion(old), old));
+    phfwdDelete(old);
+
+    CLEAN(pf);
+}
+
+// Wczytuje przekierowania z tekstu zapisanego w pliku tymczasowym.
+static bool import_text(PhoneForward *pf, char const *text, unsigned threads, size_t *badLine) {
+    FILE *file = tmpfile();
+    bool ok = file != NULL && fputs(text, file) >= 0 && fflush(file) == 0 &&
+              phfwdImportText(pf, fileno(file), threads, badLine);
+    if (file != NULL)
+        fclose(file);
+    return ok;
+}
+
+static int import(void) {
+    size_t badLine;
+    char *text;
+
+    INIT(pf);
+    F(import_text(NULL, "1 2\n", 1, &badLine));
+    T(import_text(pf, "", 4, &badLine));
+    T(badLine == 0);
+
+    T(import_text(pf, "12 7\n\n  1234\t*#  \r\n34 7\n12 8\n#*0 0123456789*#", 3, &badLine));
+    T(badLine == 0);
+    CHECK(pf, "125", "85");
+    CHECK(pf, "12345", "*#5");
+    CHECK(pf, "341", "71");
+    CHECK(pf, "#*01", "0123456789*#1");
+    RCHCK(pf, "7", "34", "7");
+
+    // Niepoprawny wiersz: nic nie jest dodawane.
+    F(import_text(pf, "5 6\n6 7\n7 7\n8 9\n", 2, &badLine));
+    T(badLine == 3);
+    F(import_text(pf, "5 6\n6 7\n8 9 0\n", 0, &badLine));
+    T(badLine == 3);
+    F(import_text(pf, "5 6\n6\n", 1, &badLine));
+    T(badLine == 2);
+    F(import_text(pf, "5 6\n6 a\n", 1, NULL));
+    F(import_text(pf, "56\n", 8, &badLine));
+    T(badLine == 1);
+    CHECK(pf, "51", "51");
+
+    // Wiele wierszy dzielonych na fragmenty; ostatni wiersz wygrywa.
+    N(text = malloc(20 * 3000 + 1));
+    text[0] = '\0';
+    for (int i = 0, len = 0; i < 3000; ++i)
+        len += sprintf(text + len, "%d %d\n", i % 1000 + 1000, i + 10000);
+    REINIT(pf);
+    T(import_text(pf, text, 7, &badLine));
+    CHECK(pf, "10001", "120001");
+    CHECK(pf, "19995", "129995");
+    RCHCK(pf, "12999", "12999", "1999");
+    free(text);
+
+    // Potok jest czytany do końca, a nie odwzorowywany w pamięci.
+    int fds[2];
+    Z(pipe(fds));
+    T(write(fds[1], "61 2\n62 3\n", 10) == 10);
+    close(fds[1]);
+    T(phfwdImportText(pf, fds[0], 2, &badLine));
+    close(fds[0]);
+    CHECK(pf, "615", "25");
+    CHECK(pf, "62", "3");
+    Z(pipe(fds));
+    T(write(fds[1], "61 2\n7\n", 7) == 7);
+    close(fds[1]);
+    F(phfwdImportText(pf, fds[0], 2, &badLine));
+    T(badLine == 2);
+    close(fds[0]);
+
+    CLEAN(pf);
+}
+
+// Dopisuje różnicę do napisu w postaci "num:przed>po;".
+static bool print_diff(void *data, char const *num, char const *before, char const *after) {
+    char *out = data;
+    sprintf(out + strlen(out), "%s:%s>%s;", num, before ? before : "-", after ? after : "-");
+    return true;
+}
+
+// Przerywa porównywanie po pierwszej różnicy.
+static bool stop_diff(void *data, char const *num, char const *before, char const *after) {
+    (void)num; (void)before; (void)after;
+    ++*(int *)data;
+    return false;
+}
+
+static int diff(void) {
+    PhoneForward *other;
+    char out[256];
+    char num1[16], num2[16];
+    int count = 0;
+
+    INIT(pf);
+    N(other = phfwdNew());
+    out[0] = '\0';
+    F(phfwdDiff(NULL, other, print_diff, out));
+    F(phfwdDiff(pf, other, NULL, out));
+    T(phfwdDiff(pf, other, print_diff, out));
+    C(out, "");
+
+    for (int i = 0; i < 1000; ++i) {
+        sprintf(num1, "%d", i * 7919 % 100003);
+        sprintf(num2, "%d", i + 200000);
+        T(phfwdAdd(pf, num1, num2));
+        sprintf(num1, "%d", (999 - i) * 7919 % 100003);
+        sprintf(num2, "%d", 999 - i + 200000);
+        T(phfwdAdd(other, num1, num2));
+    }
+    // Dodane i usunięte puste poddrzewa nie sa różnicą.
+    T(phfwdAdd(other, "99999999", "1"));
+    phfwdRemove(other, "9999999");
+    T(phfwdDiff(pf, other, print_diff, out));
+    C(out, "");
+
+    T(phfwdAdd(other, "123456", "7"));
+    T(phfwdAdd(other, "0", "8"));
+    phfwdRemove(other, "7919");
+    T(phfwdAdd(pf, "#", "1"));
+    T(phfwdAdd(other, "#", "2"));
+    T(phfwdAdd(pf, "*", "3"));
+    T(phfwdDiff(pf, other, print_diff, out));
+    C(out, "0:200000>8;123456:->7;7919:200001>-;79190:200010>-;*:3>-;#:1>2;");
+
+    // Po zmianie skróty sa przeliczane tylko na zmienionej ścieżce.
+    out[0] = '\0';
+    T(phfwdAdd(pf, "0", "8"));
+    T(phfwdDiff(pf, other, print_diff, out));
+    C(out, "123456:->7;7919:200001>-;79190:200010>-;*:3>-;#:1>2;");
+
+    // Porównanie wczytanego zrzutu ze strukturą.
+    phfwdDelete(other);
+    N(other = save_and_load(pf));
+    out[0] = '\0';
+    T(phfwdDiff(other, pf, print_diff, out));
+    C(out, "");
+    T(phfwdDiff(other, pf, stop_diff, &count));
+    T(count == 0);
+    phfwdRemove(other, "*");
+    F(phfwdDiff(other, pf, stop_diff, &count));
+    T(count == 1);
+    phfwdDelete(other);
+
+    CLEAN(pf);
+}
+
+// Sumuje długości numerów zgłoszonych różnic.
+static bool sum_diff(void *data, char const *num, char const *before, char const *after) {
+    (void)before; (void)after;
+    *(size_t *)data += strlen(num);
+    return true;
+}
+
+// Porównywanie struktur z bardzo długimi numerami
+static int deep_diff(void) {
+#define LONG_LEN 250000
+
+    PhoneForward *other;
+    size_t length = 0;
+    char *base;
+
+    INIT(pf);
+    N(other = phfwdNew());
+    N(base = malloc(sizeof(char) * (LONG_LEN + 1)));
+    for (int i = 0; i < LONG_LEN; ++i)
+        base[i] = '0' + i % 10;
+    base[LONG_LEN] = '\0';
+
+    T(phfwdAdd(pf, base, "1"));
+    T(phfwdDiff(other, pf, sum_diff, &length));
+    T(length == LONG_LEN);
+    length = 0;
+    T(phfwdDiff(pf, other, sum_diff, &length));
+    T(length == LONG_LEN);
+
+    // Wspólna długa gałąź i różnica na jej końcu.
+    T(phfwdAdd(other, base, "1"));
+    length = 0;
+    T(phfwdDiff(pf, other, sum_diff, &length));
+    T(length == 0);
+    T(phfwdAdd(other, base, "2"));
+    base[LONG_LEN / 2] = '\0';
+    T(phfwdAdd(pf, base, "3"));
+    length = 0;
+    T(phfwdDiff(pf, other, sum_diff, &length));
+    T(length == LONG_LEN + LONG_LEN / 2);
+
+    phfwdDelete(other);
+    free(base);
+    CLEAN(pf);
+
+#undef LONG_LEN
+}
+
+// Tworzy strukturę źródłowa do testów scalania.
+static PhoneForward *merge_source(void) {
+    PhoneForward *src = phfwdNew();
+    if (src != NULL && phfwdAdd(src, "12", "8") && phfwdAdd(src, "345", "9") &&
+        phfwdAdd(src, "6", "2") && phfwdAdd(src, "61", "5") && phfwdAdd(src, "7", "3"))
+        return src;
+    phfwdDelete(src);
+    return NULL;
+}
+
+static int merge(void) {
+    PhoneForward *src, *old, *loaded;
+    char out[256];
+
+    INIT(pf);
+    N(src = merge_source());
+    F(phfwdMerge(NULL, src, MERGE_SOURCE_WINS));
+    F(phfwdMerge(pf, NULL, MERGE_SOURCE_WINS));
+    F(phfwdMerge(pf, pf, MERGE_SOURCE_WINS));
+
+    T(phfwdAdd(pf, "12", "7"));
+    T(phfwdAdd(pf, "34", "7"));
+    T(phfwdAdd(pf, "5", "1"));
+    T(phfwdTrackChanges(pf));
+    N(old = save_and_load(pf));
+    uint64_t base = phfwdVersion(pf);
+
+    T(phfwdMerge(pf, src, MERGE_SOURCE_WINS));
+    CHECK(pf, "123", "83");
+    CHECK(pf, "341", "71");
+    CHECK(pf, "3456", "96");
+    CHECK(pf, "51", "11");
+    CHECK(pf, "612", "52");
+    CHECK(pf, "62", "22");
+    CHECK(pf, "7", "3");
+    RCHCK(pf, "7", "34", "7");
+    RCHCK(pf, "5", "5", "61");
+    // Struktura źródłowa jest pusta.
+    CHECK(src, "123", "123");
+    RCHCK(src, "8", "8");
+    T(phfwdMerge(pf, src, MERGE_SOURCE_WINS));
+    T(phfwdAdd(src, "1", "2"));
+    CHECK(src, "13", "23");
+
+    // Przeniesione poddrzewa trafiają do zrzutów przyrostowych i porównań.
+    T(save_and_apply_delta(pf, base, old));
+    out[0] = '\0';
+    T(phfwdDiff(old, pf, print_diff, out));
+    C(out, "");
+    phfwdDelete(src);
+
+    // Przy konflikcie pozostaje przekierowanie docelowe.
+    N(src = merge_source());
+    REINIT(pf);
+    T(phfwdAdd(pf, "12", "7"));
+    T(phfwdAdd(pf, "6", "0"));
+    T(phfwdMerge(pf, src, MERGE_DESTINATION_WINS));
+    CHECK(pf, "123", "73");
+    CHECK(pf, "62", "02");
+    RCHCK(pf, "8", "8");
+    RCHCK(pf, "73", "123", "73");
+    CHECK(pf, "612", "52");
+    CHECK(pf, "3456", "96");
+    phfwdDelete(src);
+
+    // Struktura wczytana ze zrzutu jest kopiowana.
+    N(src = merge_source());
+    N(loaded = save_and_load(src));
+    REINIT(pf);
+    T(phfwdAdd(pf, "12", "7"));
+    T(phfwdMerge(pf, loaded, MERGE_SOURCE_WINS));
+    CHECK(loaded, "123", "123");
+    out[0] = '\0';
+    T(phfwdDiff(src, pf, print_diff, out));
+    C(out, "");
+    phfwdDelete(loaded);
+    CHECK(pf, "7", "3");
+    phfwdRemove(pf, "6");
+    RCHCK(pf, "5", "5");
+
+    phfwdDelete(src);
+    phfwdDelete(old);
+    CLEAN(pf);
+}
+
+// Scalanie struktur z bardzo długimi numerami
+static int deep_merge(void) {
+#define LONG_LEN 250000
+
+    PhoneForward *src, *loaded;
+    PhoneForwardStats stats;
+    char *base;
+
+    INIT(pf);
+    N(base = malloc(sizeof(char) * (LONG_LEN + 1)));
+    for (int i = 0; i < LONG_LEN; ++i)
+        base[i] = '0' + i % 10;
+    base[LONG_LEN] = '\0';
+
+    // Przepięcie długiej gałęzi i scalenie jej z taka sama gałęzią.
+    N(src = phfwdNew());
+    T(phfwdAdd(src, base, "1"));
+    T(phfwdMerge(pf, src, MERGE_SOURCE_WINS));
+    CHECK(pf, base, "1");
+    T(phfwdAdd(src, base, "2"));
+    T(phfwdMerge(pf, src, MERGE_SOURCE_WINS));
+    CHECK(pf, base, "2");
+    T(phfwdStats(pf, &stats));
+    T(stats.forwardNodes == LONG_LEN + 1);
+    T(stats.rules == 1);
+
+    // Oznaczanie przeniesionej gałęzi przy śledzeniu zmian.
+    REINIT(pf);
+    T(phfwdTrackChanges(pf));
+    T(phfwdAdd(src, base, "3"));
+    T(phfwdMerge(pf, src, MERGE_SOURCE_WINS));
+    CHECK(pf, base, "3");
+
+    // Kopiowanie gałęzi struktury wczytanej ze zrzutu.
+    REINIT(pf);
+    T(phfwdAdd(src, base, "4"));
+    N(loaded = save_and_load(src));
+    T(phfwdMerge(pf, loaded, MERGE_DESTINATION_WINS));
+    CHECK(pf, base, "4");
+    T(phfwdStats(pf, &stats));
+    T(stats.forwardNodes == LONG_LEN + 1);
+    phfwdDelete(loaded);
+
+    phfwdDelete(src);
+    free(base);
+    CLEAN(pf);
+
+#undef LONG_LEN
+}
+
+// Oczekiwane przechodnie rozwinięcie A na B w co najwyżej H krokach
+#define RESOLVE(p, A, H, B)        \
+  do {                             \
+    PhoneNumbers *_p;              \
+    N(_p = phfwdResolve(p, A, H)); \
+    R(_p, 0, B);                   \
+    Q(_p, 1);                      \
+    phnumDelete(_p);               \
+  } while (0)
+
+static int resolve(void) {
+    INIT(pf);
+    Z(phfwdResolve(NULL, "1", 1));
+    E(phfwdResolve(pf, "12a", 1));
+    E(phfwdResolve(pf, NULL, 1));
+    RESOLVE(pf, "123", 0, "123");
+
+    T(phfwdAdd(pf, "1", "2"));
+    T(phfwdAdd(pf, "2", "3"));
+    T(phfwdAdd(pf, "3", "4"));
+    E(phfwdResolve(pf, "15", 2));
+    RESOLVE(pf, "15", 3, "45");
+    // Zapamiętane rozwinięcie nie jest używane ponad limit kroków.
+    RESOLVE(pf, "17", SIZE_MAX, "47");
+    E(phfwdResolve(pf, "17", 2));
+    RESOLVE(pf, "2", 2, "4");
+    T(phfwdAdd(pf, "8", "1"));
+    RESOLVE(pf, "85", 4, "45");
+    E(phfwdResolve(pf, "85", 3));
+
+    // Zmiany unieważniają zapamiętane rozwinięcia.
+    T(phfwdAdd(pf, "4", "5"));
+    RESOLVE(pf, "17", 4, "57");
+    phfwdRemove(pf, "3");
+    RESOLVE(pf, "17", 4, "37");
+    T(phfwdAdd(pf, "22", "9"));
+    RESOLVE(pf, "17", 4, "37");
+    RESOLVE(pf, "12", 4, "9");
+    RESOLVE(pf, "121", 4, "91");
+    RESOLVE(pf, "13", 4, "33");
+
+    // Wynik zależy od cyfr za prefiksem przekierowania.
+    REINIT(pf);
+    T(phfwdAdd(pf, "1", "2"));
+    T(phfwdAdd(pf, "25", "9"));
+    RESOLVE(pf, "15", 5, "9");
+    RESOLVE(pf, "16", 5, "26");
+    RESOLVE(pf, "153", 5, "93");
+    RESOLVE(pf, "1", 5, "2");
+
+    // Cykle.
+    T(phfwdAdd(pf, "5", "6"));
+    T(phfwdAdd(pf, "6", "5"));
+    E(phfwdResolve(pf, "51", SIZE_MAX));
+    E(phfwdResolve(pf, "6", SIZE_MAX));
+    T(phfwdAdd(pf, "7", "*7"));
+    T(phfwdAdd(pf, "*7", "#"));
+    T(phfwdAdd(pf, "#", "7"));
+    E(phfwdResolve(pf, "70", SIZE_MAX));
+    E(phfwdResolve(pf, "*70", 2));
+    T(phfwdAdd(pf, "3", "33"));
+    E(phfwdResolve(pf, "3", 100));
+
+    // Długi łańcuch rozwija sie tak jak kolejne wywołania phfwdGet.
+    REINIT(pf);
+    char num1[16], num2[16];
+    for (int i = 0; i < 999; ++i) {
+        sprintf(num1, "%03d", i);
+        sprintf(num2, "%03d", i + 1);
+        T(phfwdAdd(pf, num1, num2));
+    }
+    RESOLVE(pf, "998", 1, "999");
+    RESOLVE(pf, "000#", SIZE_MAX, "999#");
+    RESOLVE(pf, "500", 499, "999");
+    RESOLVE(pf, "000", 999, "999");
+    E(phfwdResolve(pf, "000", 998));
+    for (int i = 0; i < 999; ++i) {
+        sprintf(num1, "%03d*", i);
+        RESOLVE(pf, num1, SIZE_MAX, "999*");
+    }
+
+    CLEAN(pf);
+}
+
+// Rozwija w osobnym wątku numery łańcucha przekierowań; zwraca liczbę błędów.
+static void *resolve_chain(void *pf) {
+    char num[16];
+    size_t errors = 0;
+    for (int round = 0; round < 50; ++round) {
+        for (int k = 0; k < 50; ++k) {
+            sprintf(num, "%d9", 100 + k);
+            PhoneNumbers *pnum = phfwdResolve(pf, num, SIZE_MAX);
+            if (pnum == NULL || phnumGet(pnum, 0) == NULL || strcmp(phnumGet(pnum, 0), "1509") != 0)
+                errors++;
+            phnumDelete(pnum);
+        }
+    }
+    return (void *)errors;
+}
+
+// Rozwijanie przekierowań przez wiele wątków
+static int concurrent_resolve(void) {
+    pthread_t threads[4];
+    char num1[16], num2[16];
+
+    INIT(pf);
+    for (int i = 0; i < 50; ++i) {
+        sprintf(num1, "%d", 100 + i);
+        sprintf(num2, "%d", 101 + i);
+        T(phfwdAdd(pf, num1, num2));
+    }
+    for (int i = 0; i < 4; ++i)
+        Z(pthread_create(&threads[i], NULL, resolve_chain, pf));
+    for (int i = 0; i < 4; ++i) {
+        void *errors;
+        Z(pthread_join(threads[i], &errors));
+        Z(errors);
+    }
+    CLEAN(pf);
+}
+
+// Zlicza przekierowanie w statystykach wyliczanych od nowa.
+static bool count_rule(void *data, char const *num1, char const *num2) {
+    PhoneForwardStats *stats = data;
+    size_t depth = strlen(num1);
+    stats->rules++;
+    stats->stringBytes += strlen(num2) + 1;
+    stats->depths[depth < STATS_DEPTHS ? depth : STATS_DEPTHS - 1]++;
+    stats->reverseBytes += depth + 1;
+    return true;
+}
+
+// Zlicza wierzchołki poddrzewa.
+static size_t count_nodes(PhoneForward const *pf) {
+    size_t count = 1;
+    for (int i = 0; i < CHILDREN_NUMB; ++i)
+        if (pf->children[i] != NULL)
+            count += count_nodes(pf->children[i]);
+    return count;
+}
+
+// Sprawdza, czy statystyki zgadzają się z wyliczonymi od nowa.
+static bool stats_match(PhoneForward const *pf) {
+    PhoneForwardStats stats, expected;
+    memset(&expected, 0, sizeof(expected));
+    if (!phfwdStats(pf, &stats) || !phfwdForEach(pf, count_rule, &expected))
+        return false;
+    size_t lists = 0;
+    for (size_t i = 0; i < STATS_LENGTHS; ++i)
+        lists += stats.listLengths[i];
+    return stats.forwardNodes == count_nodes(pf) && stats.rules == expected.rules &&
+           stats.stringBytes == expected.stringBytes &&
+           memcmp(stats.depths, expected.depths, sizeof(expected.depths)) == 0 &&
+           lists == stats.reverseLists && stats.reverseLists <= stats.reverseEntries &&
+           (stats.reverseStale || (stats.reverseEntries == expected.rules &&
+                                   stats.reverseBytes == expected.reverseBytes));
+}
+
+static int stats(void) {
+    PhoneForwardStats stats;
+    PhoneForward *src, *loaded;
+
+    INIT_ENGINE(pf, "trie");
+    F(phfwdStats(NULL, &stats));
+    F(phfwdStats(pf, NULL));
+    T(phfwdStats(pf, &stats));
+    T(stats.forwardNodes == 1);
+    Z(stats.rules);
+    Z(stats.reverseEntries);
+    T(stats.reverseNodes == 1);
+
+    T(phfwdAdd(pf, "12", "3"));
+    T(phfwdAdd(pf, "1", "3"));
+    T(phfwdAdd(pf, "45", "6"));
+    T(phfwdStats(pf, &stats));
+    T(stats.forwardNodes == 5);
+    T(stats.rules == 3);
+    T(stats.stringBytes == 6);
+    T(stats.depths[1] == 1 && stats.depths[2] == 2);
+    T(stats.reverseNodes == 3);
+    T(stats.reverseLists == 2);
+    T(stats.reverseEntries == 3);
+    T(stats.reverseBytes == 8);
+    T(stats.listLengths[0] == 1 && stats.listLengths[1] == 1);
+    F(stats.reverseStale);
+    T(stats.bytesAllocated >= 5 * sizeof(PhoneForward) + 3 * sizeof(PhoneReverse) + 14);
+
+    // Zastąpienie i usunięcie przekierowań.
+    T(phfwdAdd(pf, "12", "789"));
+    T(stats_match(pf));
+    phfwdRemove(pf, "1");
+    T(phfwdStats(pf, &stats));
+    T(stats.forwardNodes == 3);
+    T(stats.rules == 1);
+    T(stats.stringBytes == 2);
+    T(stats.reverseEntries == 1);
+    T(stats.reverseLists == 1);
+    T(stats_match(pf));
+
+    // Długie prefiksy trafiają do ostatniego przedziału.
+    char num[64];
+    FILL(num, 0, 40, '7');
+    T(phfwdAdd(pf, num, "1"));
+    T(phfwdStats(pf, &stats));
+    T(stats.depths[STATS_DEPTHS - 1] == 1);
+    for (int i = 0; i < 100; ++i) {
+        sprintf(num, "8%d", i);
+        T(phfwdAdd(pf, num, "5"));
+    }
+    T(phfwdStats(pf, &stats));
+    T(stats.listLengths[6] == 1);
+    T(stats_match(pf));
+    phfwdRemove(pf, "81");
+    T(stats_match(pf));
+
+    // Odroczone drzewo odwrócone, zbiorcze zmiany, scalanie i zrzuty.
+    phfwdSetReverseDeferred(pf, true);
+    T(phfwdAdd(pf, "90", "1"));
+    T(phfwdStats(pf, &stats));
+    T(stats.reverseStale);
+    T(stats_match(pf));
+    phfwdSetReverseDeferred(pf, false);
+    T(phfwdRebuildReverse(pf));
+    T(stats_match(pf));
+    PhoneForwardRule rules[] = {{"123", "4"}, {"7", "8"}, {"90", "2"}};
+    T(phfwdBulkLoad(pf, rules, SIZE(rules)));
+    T(stats_match(pf));
+    N(src = merge_source());
+    T(phfwdMerge(pf, src, MERGE_SOURCE_WINS));
+    // Drzewo odwrócone jest scalane, a nie odbudowywane.
+    T(phfwdStats(pf, &stats));
+    F(stats.reverseStale);
+    T(stats_match(pf));
+    T(stats_match(src));
+    T(phfwdStats(src, &stats));
+    T(stats.forwardNodes == 1);
+    Z(stats.rules);
+    T(phfwdRebuildReverse(pf));
+    T(stats_match(pf));
+    N(loaded = save_and_load(pf));
+    T(stats_match(loaded));
+    T(phfwdStats(loaded, &stats));
+    T(stats.rules == 98);
+    T(phfwdRebuildReverse(loaded));
+    T(stats_match(loaded));
+    phfwdRemove(loaded, "8");
+    T(phfwdAdd(loaded, "61", "1"));
+    T(stats_match(loaded));
+    phfwdDelete(src);
+    N(src = merge_source());
+    T(phfwdMerge(src, loaded, MERGE_DESTINATION_WINS));
+    T(stats_match(src));
+    T(stats_match(loaded));
+    phfwdDelete(loaded);
+    phfwdDelete(src);
+
+    CLEAN(pf);
+}
+
+// Wykonuje kilka wywołań phfwdGet w osobnym wątku.
+static void *counted_gets(void *arg) {
+    PhoneForward const *pf = arg;
+    for (int i = 0; i < 10; ++i) {
+        PhoneNumbers *pnum = phfwdGet(pf, "12345");
+        if (pnum == NULL)
+            return NULL;
+        phnumDelete(pnum);
+    }
+    return arg;
+}
+
+static int counters(void) {
+    PhoneForwardCounters before, after, total;
+    PhoneNumbers *pnum;
+    pthread_t thread;
+    void *result;
+
+    F(phfwdCounters(OPERATIONS_COUNT, &before));
+    F(phfwdCounters(OPERATION_GET, NULL));
+    F(phfwdThreadCounters(OPERATIONS_COUNT, &before));
+
+    INIT(pf);
+    T(phfwdAdd(pf, "123", "9"));
+    T(phfwdAdd(pf, "4", "9"));
+    T(phfwdThreadCounters(OPERATION_GET, &before));
+    N(pnum = phfwdGet(pf, "12345"));
+    phnumDelete(pnum);
+    T(phfwdThreadCounters(OPERATION_GET, &after));
+    if (phfwdCountersEnabled()) {
+        T(after.calls == before.calls + 1);
+        T(after.nodes == before.nodes + 3);
+        T(after.allocations > before.allocations);
+    } else {
+        Z(after.calls);
+        Z(after.allocations);
+    }
+
+    T(phfwdThreadCounters(OPERATION_REVERSE, &before));
+    N(pnum = phfwdReverse(pf, "91"));
+    phnumDelete(pnum);
+    T(phfwdThreadCounters(OPERATION_REVERSE, &after));
+    if (phfwdCountersEnabled()) {
+        T(after.calls == before.calls + 1);
+        T(after.scanned == before.scanned + 2);
+        T(after.compares > before.compares);
+    }
+
+    // Liczniki zakończonego wątku trafiają do sumy.
+    T(phfwdCounters(OPERATION_GET, &before));
+    Z(pthread_create(&thread, NULL, counted_gets, pf));
+    Z(pthread_join(thread, &result));
+    N(result);
+    T(phfwdCounters(OPERATION_GET, &total));
+    T(phfwdThreadCounters(OPERATION_GET, &after));
+    if (phfwdCountersEnabled()) {
+        T(total.calls == before.calls + 10);
+        T(total.calls >= after.calls + 10);
+    } else {
+        Z(total.calls);
+    }
+
+    CLEAN(pf);
+}
+
+// Dopisuje wywołanie ze śladu do napisu w postaci "operacja:num1[,num2];".
+static bool print_call(void *data, PhoneForwardOperation operation, char const *num1, char const *num2) {
+    char *out = data;
+    sprintf(out + strlen(out), "%d:%s", operation, num1 ? num1 : "-");
+    if (operation == OPERATION_ADD)
+        sprintf(out + strlen(out), ",%s", num2 ? num2 : "-");
+    strcat(out, ";");
+    return true;
+}
+
+// Wykonuje wywołanie ze śladu na strukturze.
+static bool replay_call(void *data, PhoneForwardOperation operation, char const *num1, char const *num2) {
+    PhoneForward *pf = data;
+    if (operation == OPERATION_ADD)
+        phfwdAdd(pf, num1, num2);
+    else if (operation == OPERATION_REMOVE)
+        phfwdRemove(pf, num1);
+    else
+        phnumDelete(operation == OPERATION_GET ? phfwdGet(pf, num1)
+                    : operation == OPERATION_REVERSE ? phfwdReverse(pf, num1) : phfwdGetReverse(pf, num1));
+    return true;
+}
+
+// Przerywa odczyt śladu po pierwszym wywołaniu.
+static bool stop_call(void *data, PhoneForwardOperation operation, char const *num1, char const *num2) {
+    (void)operation; (void)num1; (void)num2;
+    ++*(int *)data;
+    return false;
+}
+
+static int trace(void) {
+    PhoneForward *traced, *replayed;
+    PhoneNumbers *pnum;
+    FILE *file;
+    char out[256];
+    char num1[16], num2[16];
+    int count = 0;
+
+    INIT(pf);
+    F(phfwdTraceStart(NULL, 0));
+    F(phfwdTraceStop(pf));
+    N(file = tmpfile());
+    T(phfwdTraceStart(pf, fileno(file)));
+    F(phfwdTraceStart(pf, fileno(file)));
+    T(phfwdAdd(pf, "123", "9"));
+    F(phfwdAdd(pf, "12a", "9"));
+    F(phfwdAdd(pf, "1", NULL));
+    N(pnum = phfwdGet(pf, "12345"));
+    phnumDelete(pnum);
+    N(pnum = phfwdReverse(pf, "9*"));
+    phnumDelete(pnum);
+    N(pnum = phfwdGetReverse(pf, "945"));
+    phnumDelete(pnum);
+    N(pnum = phfwdGet(pf, ""));
+    phnumDelete(pnum);
+    phfwdRemove(pf, "12");
+    phfwdRemove(pf, NULL);
+    T(phfwdTraceStop(pf));
+    // Wywołania po zakończeniu zapisu nie trafiają do śladu.
+    T(phfwdAdd(pf, "5", "6"));
+    lseek(fileno(file), 0, SEEK_SET);
+    out[0] = '\0';
+    T(phfwdTraceRead(fileno(file), print_call, out));
+    C(out, "3:123,9;3:12a,9;3:1,-;0:12345;1:9*;2:945;0:;4:12;4:-;");
+
+    // Niepełny ostatni zapis jest pomijany.
+    off_t size = lseek(fileno(file), 0, SEEK_END);
+    T(ftruncate(fileno(file), size - 1) == 0);
+    lseek(fileno(file), 0, SEEK_SET);
+    out[0] = '\0';
+    T(phfwdTraceRead(fileno(file), print_call, out));
+    C(out, "3:123,9;3:12a,9;3:1,-;0:12345;1:9*;2:945;0:;4:12;");
+    lseek(fileno(file), 0, SEEK_SET);
+    F(phfwdTraceRead(fileno(file), stop_call, &count));
+    T(count == 1);
+    lseek(fileno(file), 0, SEEK_SET);
+    T(write(fileno(file), "PFT2", 4) == 4);
+    lseek(fileno(file), 0, SEEK_SET);
+    F(phfwdTraceRead(fileno(file), print_call, out));
+    fclose(file);
+
+    // Zmiany zbiorcze trafiają do śladu jak pojedyncze wywołania, a scalanie
+    // struktury ze śladem jest odrzucane.
+    PhoneForwardChangeset *cs;
+    N(file = tmpfile());
+    REINIT(pf);
+    T(phfwdTraceStart(pf, fileno(file)));
+    PhoneForwardRule rules[] = {{"7", "8"}, {"70", "1"}};
+    T(phfwdBulkLoad(pf, rules, SIZE(rules)));
+    N(cs = phfwdChangesetNew());
+    T(phfwdChangesetRemove(cs, "70"));
+    T(phfwdChangesetAdd(cs, "5", "6"));
+    T(phfwdChangesetApply(pf, cs));
+    phfwdChangesetDelete(cs);
+    N(traced = phfwdNew());
+    F(phfwdMerge(pf, traced, MERGE_SOURCE_WINS));
+    F(phfwdMerge(traced, pf, MERGE_SOURCE_WINS));
+    phfwdDelete(traced);
+    T(phfwdTraceStop(pf));
+    lseek(fileno(file), 0, SEEK_SET);
+    out[0] = '\0';
+    T(phfwdTraceRead(fileno(file), print_call, out));
+    C(out, "3:7,8;3:70,1;4:70;3:5,6;");
+    fclose(file);
+
+    // Ślad dłuższy niż bufor, zapisany do końca przez phfwdDelete, odtwarza
+    // te sama strukturę.
+    REINIT(pf);
+    N(traced = phfwdNew());
+    N(file = tmpfile());
+    T(phfwdTraceStart(traced, fileno(file)));
+    for (int i = 0; i < 10000; ++i) {
+        sprintf(num1, "%d", i * 7919 % 100003);
+        sprintf(num2, "%d", i + 200000);
+        T(phfwdAdd(pf, num1, num2));
+        T(phfwdAdd(traced, num1, num2));
+        if (i % 10 == 0) {
+            sprintf(num1, "%d", i * 31 % 1000);
+            phfwdRemove(pf, num1);
+            phfwdRemove(traced, num1);
+        }
+    }
+    N(pnum = phfwdReverse(traced, "200001"));
+    phnumDelete(pnum);
+    phfwdDelete(traced);
+    T(lseek(fileno(file), 0, SEEK_CUR) > 64 * 1024);
+    lseek(fileno(file), 0, SEEK_SET);
+    N(replayed = phfwdNew());
+    T(phfwdTraceRead(fileno(file), replay_call, replayed));
+    count = 0;
+    T(phfwdDiff(pf, replayed, stop_diff, &count));
+    Z(count);
+    phfwdDelete(replayed);
+    fclose(file);
+
+    CLEAN(pf);
+}
+
+// Dodaje przekierowania z kilku wątków naraz przez wspólny dziennik.
+static void *journal_writer(void *arg) {
+    PhoneForwardJournal *journal = *(PhoneForwardJournal **)arg;
+    char num1[32], num2[32];
+    long id = (long)((PhoneForwardJournal **)arg)[1];
+    bool ok = true;
+    for (int i = 0; i < 50; ++i) {
+        sprintf(num1, "%ld%02d", id, i);
+        sprintf(num2, "9%ld%02d", id, i);
+        ok = ok && phfwdJournalAdd(journal, num1, num2);
+    }
+    return ok ? arg : NULL;
+}
+
+static int write_ahead_log(void) {
+    FILE *log, *snapshot;
+    PhoneForwardJournal *journal;
+
+    N(log = tmpfile());
+    N(snapshot = tmpfile());
+    INIT(pf);
+    N(journal = phfwdJournalNew(pf, fileno(log)));
+    Z(phfwdJournalNew(NULL, fileno(log)));
+
+    F(phfwdJournalAdd(NULL, "1", "2"));
+    F(phfwdJournalAdd(journal, "1", "1"));
+    F(phfwdJournalAdd(journal, "1", "2a"));
+    F(phfwdJournalRemove(journal, ""));
+    T(phfwdJournalAdd(journal, "12", "7"));
+    T(phfwdJournalAdd(journal, "34", "7"));
+    T(phfwdJournalAdd(journal, "1234", "*#"));
+    T(phfwdJournalRemove(journal, "3"));
+    T(phfwdJournalAdd(journal, "3", "12"));
+    phfwdJournalDelete(journal);
+    phfwdJournalDelete(NULL);
+
+    // Odtworzenie dziennika daje te same przekierowania.
+    REINIT(pf);
+    lseek(fileno(log), 0, SEEK_SET);
+    N(journal = phfwdJournalNew(pf, fileno(log)));
+    CHECK(pf, "125", "75");
+    CHECK(pf, "12345", "*#5");
+    CHECK(pf, "341", "1241");
+    RCHCK(pf, "7", "12", "7");
+
+    // Zapisy wielu wątków, utrwalane grupami.
+    void *args[4][2];
+    pthread_t threads[4];
+    for (long i = 0; i < 4; ++i) {
+        args[i][0] = journal;
+        args[i][1] = (void *)(i + 5);
+        Z(pthread_create(&threads[i], NULL, journal_writer, args[i]));
+    }
+    for (int i = 0; i < 4; ++i) {
+        void *result;
+        Z(pthread_join(threads[i], &result));
+        N(result);
+    }
+    CHECK(pf, "5491", "95491");
+
+    // Po zrzucie dziennik jest pusty, a zrzut i dziennik odtwarzają stan.
+    T(phfwdJournalCheckpoint(journal, fileno(snapshot)));
+    Z(lseek(fileno(log), 0, SEEK_END));
+    T(phfwdJournalRemove(journal, "12"));
+    phfwdJournalDelete(journal);
+
+    phfwdDelete(pf);
+    lseek(fileno(snapshot), 0, SEEK_SET);
+    N(pf = phfwdLoad(fileno(snapshot)));
+    CHECK(pf, "125", "75");
+    lseek(fileno(log), 0, SEEK_SET);
+    N(journal = phfwdJournalNew(pf, fileno(log)));
+    CHECK(pf, "125", "125");
+    CHECK(pf, "341", "1241");
+    CHECK(pf, "8011", "98011");
+    phfwdJournalDelete(journal);
+
+    // Niepełny ostatni zapis jest pomijany i odcinany.
+    off_t size = lseek(fileno(log), 0, SEEK_END);
+    T(write(fileno(log), "\1\4", 2) == 2);
+    REINIT(pf);
+    lseek(fileno(log), 0, SEEK_SET);
+    N(journal = phfwdJournalNew(pf, fileno(log)));
+    T(lseek(fileno(log), 0, SEEK_CUR) == size);
+    T(phfwdJournalAdd(journal, "0", "1"));
+    phfwdJournalDelete(journal);
+    REINIT(pf);
+    lseek(fileno(log), 0, SEEK_SET);
+    T(phfwdJournalReplay(pf, fileno(log)));
+    CHECK(pf, "00", "10");
+    CHECK(pf, "125", "125");
+
+    // W trybie odroczonym zapisy trafiają do pliku dopiero przy utrwaleniu.
+    REINIT(pf);
+    lseek(fileno(log), 0, SEEK_SET);
+    N(journal = phfwdJournalNew(pf, fileno(log)));
+    F(phfwdJournalSetDeferred(NULL, true));
+    F(phfwdJournalSync(NULL));
+    T(phfwdJournalSetDeferred(journal, true));
+    size = lseek(fileno(log), 0, SEEK_END);
+    T(phfwdJournalAdd(journal, "44", "5"));
+    T(phfwdJournalRemove(journal, "0"));
+    CHECK(pf, "441", "51");
+    T(lseek(fileno(log), 0, SEEK_END) == size);
+    T(phfwdJournalSync(journal));
+    T(lseek(fileno(log), 0, SEEK_END) > size);
+    T(phfwdJournalSync(journal));
+    size = lseek(fileno(log), 0, SEEK_END);
+    T(phfwdJournalAdd(journal, "45", "6"));
+    T(phfwdJournalSetDeferred(journal, false));
+    T(lseek(fileno(log), 0, SEEK_END) > size);
+    phfwdJournalDelete(journal);
+    REINIT(pf);
+    lseek(fileno(log), 0, SEEK_SET);
+    T(phfwdJournalReplay(pf, fileno(log)));
+    CHECK(pf, "441", "51");
+    CHECK(pf, "451", "61");
+    CHECK(pf, "00", "00");
+
+    // Po błędzie zapisu operacja zostaje w pamięci, a dziennik odrzuca kolejne
+    // operacje do udanego zrzutu.
+    FILE *readOnly;
+    N(readOnly = fopen("/dev/null", "r"));
+    int fd = dup(fileno(log));
+    T(fd >= 0);
+    N(journal = phfwdJournalNew(pf, fd));
+    F(phfwdJournalFailed(journal));
+    F(phfwdJournalFailed(NULL));
+    T(dup2(fileno(readOnly), fd) == fd);
+    F(phfwdJournalAdd(journal, "46", "7"));
+    T(phfwdJournalFailed(journal));
+    CHECK(pf, "461", "71");
+    F(phfwdJournalRemove(journal, "46"));
+    F(phfwdJournalAdd(journal, "47", "8"));
+    CHECK(pf, "461", "71");
+    CHECK(pf, "471", "471");
+    T(dup2(fileno(log), fd) == fd);
+    T(ftruncate(fileno(snapshot), 0) == 0);
+    lseek(fileno(snapshot), 0, SEEK_SET);
+    T(phfwdJournalCheckpoint(journal, fileno(snapshot)));
+    F(phfwdJournalFailed(journal));
+    T(phfwdJournalAdd(journal, "47", "8"));
+    phfwdJournalDelete(journal);
+    close(fd);
+    fclose(readOnly);
+    phfwdDelete(pf);
+    lseek(fileno(snapshot), 0, SEEK_SET);
+    N(pf = phfwdLoad(fileno(snapshot)));
+    lseek(fileno(log), 0, SEEK_SET);
+    T(phfwdJournalReplay(pf, fileno(log)));
+    CHECK(pf, "461", "71");
+    CHECK(pf, "471", "81");
+
+    fclose(log);
+    fclose(snapshot);
+    CLEAN(pf);
+}
+
 /** TESTY ALOKACJI PAMIĘCI
     Te testy muszą być linkowane z opcjami
     -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
@@ -924,19 +2304,21 @@ static bool can_fail(void const *old_ptr, size_t new_size) {
         return new_size > malloc_usable_size((void *)old_ptr);
 }
 
-// Symulujemy brak pamięci.
+// Symulujemy brak pamięci. Udane alokacje rozliczamy (phone_memory.h).
 #define UNRELIABLE_ALLOC(ptr, size, fun, name) \
   do { \
     wrap_flag = true; \
     if (ptr != NULL && size == 0) { \
       /* Takie wywołanie realloc jest równoważne wywołaniu free(ptr). */ \
       ++free_counter; \
+      memoryFreed(ptr); \
       return fun; \
     } \
     void *p = can_fail(ptr, size) && should_fail() ? NULL : (fun); \
     if (p) { \
       alloc_counter += ptr != p; \
       free_counter += ptr != p && ptr != NULL; \
+      memoryAllocated(ptr, p, size); \
     } \
     else { \
       function_name = name; \
@@ -961,20 +2343,491 @@ void *__wrap_reallocarray(void *ptr, size_t nmemb, size_t size) {
 }
 
 char *__wrap_strdup(const char *s) {
-    UNRELIABLE_ALLOC(NULL, 0, __real_strdup(s), "strdup");
+    UNRELIABLE_ALLOC(NULL, strlen(s) + 1, __real_strdup(s), "strdup");
 }
 
 char *__wrap_strndup(const char *s, size_t size) {
-    UNRELIABLE_ALLOC(NULL, 0, __real_strndup(s, size), "strndup");
+    UNRELIABLE_ALLOC(NULL, strnlen(s, size) + 1, __real_strndup(s, size), "strndup");
 }
 
 // Zwalnianie pamięci zawsze się udaje. Odnotowujemy jedynie fakt zwolnienia.
 void __wrap_free(void *ptr) {
+    memoryFreed(ptr);
     __real_free(ptr);
     if (ptr)
         ++free_counter;
 }
 
+// Rozliczanie pamięci działa tylko z funkcjami przechwytującymi alokacje.
+static int memory(void) {
+    PhoneForwardMemory before, after;
+    PhoneForwardStats stats;
+    PhoneNumbers *pnum;
+    char num1[16], num2[16];
+
+    F(phfwdMemory(&before));
+    T(phfwdMemoryStart());
+    F(phfwdMemoryStart());
+    F(phfwdMemory(NULL));
+    INIT_ENGINE(pf, "trie");
+    T(phfwdMemory(&before));
+    if (!wrap_flag) {
+        Z(before.totalBytes);
+        phfwdMemoryStop();
+        CLEAN(pf);
+    }
+    T(before.blocks[MEMORY_FORWARD_NODES] == 1);
+    T(before.bytes[MEMORY_FORWARD_NODES] == sizeof(struct PhoneForwardRoot));
+    T(before.blocks[MEMORY_REVERSE_NODES] == 1);
+
+    for (int i = 0; i < 1000; ++i) {
+        sprintf(num1, "%d", i * 7919 % 100003);
+        sprintf(num2, "%d", i % 10 + 500);
+        T(phfwdAdd(pf, num1, num2));
+    }
+    phfwdRemove(pf, "7");
+    T(phfwdMemory(&after));
+    T(phfwdStats(pf, &stats));
+    T(after.blocks[MEMORY_FORWARD_NODES] == stats.forwardNodes);
+    T(after.bytes[MEMORY_FORWARD_NODES]
+      == (stats.forwardNodes - 1) * sizeof(PhoneForward) + sizeof(struct PhoneForwardRoot));
+    T(after.blocks[MEMORY_FORWARDINGS] == stats.rules);
+    T(after.bytes[MEMORY_FORWARDINGS] == stats.stringBytes);
+    T(after.blocks[MEMORY_REVERSE_NODES] == stats.reverseNodes);
+    T(after.bytes[MEMORY_REVERSE_LISTS] > stats.reverseBytes);
+    Z(after.bytes[MEMORY_RESULTS]);
+    T(after.peakBytes[MEMORY_FORWARD_NODES] >= after.bytes[MEMORY_FORWARD_NODES]);
+
+    // Wynik zapytania jest rozliczany do chwili zwolnienia.
+    phfwdMemoryResetPeaks();
+    N(pnum = phfwdReverse(pf, "503"));
+    T(phfwdMemory(&after));
+    T(after.blocks[MEMORY_RESULTS] == 1);
+    phnumDelete(pnum);
+    T(phfwdMemory(&after));
+    Z(after.blocks[MEMORY_RESULTS]);
+    Z(after.bytes[MEMORY_RESULTS]);
+    T(after.peakBytes[MEMORY_RESULTS] > 0);
+    T(after.allocations[MEMORY_RESULTS] == 1);
+
+    // Po usunięciu struktury nie zostaje żaden rozliczany blok.
+    phfwdDelete(pf);
+    pf = NULL;
+    T(phfwdMemory(&after));
+    for (int i = 0; i < MEMORY_CATEGORIES; ++i)
+        Z(after.blocks[i]);
+    Z(after.totalBytes);
+    T(after.peakTotalBytes > 0);
+    phfwdMemoryStop();
+    F(phfwdMemory(&after));
+    CLEAN(pf);
+}
+
+// Liczba prób alokacji wykonanych przez wyrażenie.
+#define ALLOCS(expr, count) \
+  do {                      \
+    unsigned before_ = call_counter; \
+    expr;                   \
+    count = call_counter - before_; \
+  } while (0)
+
+// Ograniczenia liczby alokacji na zapytanie (sprawdzane tylko z funkcjami
+// przechwytującymi alokacje): phfwdGet alokuje jedynie wynik, a phfwdReverse
+// i phfwdGetReverse stała liczbę bloków pomocniczych i po dwa bloki na
+// numer wyniku (kopia na liście i jej powiększanie), niezależnie od długości
+// numeru.
+static int allocation_budget(void) {
+    PhoneNumbers *pnum;
+    unsigned count;
+    char *base;
+    char num[16];
+
+    INIT_ENGINE(pf, "trie");
+    if (!wrap_flag) {
+        CLEAN(pf);
+    }
+    fail_counter = 0;
+    N(base = malloc(sizeof(char) * 1001));
+    FILL(base, 0, 1000, '7');
+
+    T(phfwdAdd(pf, "12", "3"));
+    T(phfwdAdd(pf, "1234", "5"));
+    T(phfwdAdd(pf, base, "9"));
+    for (int i = 0; i < 100; ++i) {
+        sprintf(num, "8%d", i);
+        T(phfwdAdd(pf, num, "45"));
+    }
+
+    ALLOCS(pnum = phfwdGet(pf, "123456"), count);
+    C(phnumGet(pnum, 0), "556");
+    phnumDelete(pnum);
+    T(count == 1);
+    ALLOCS(pnum = phfwdGet(pf, "999"), count);
+    phnumDelete(pnum);
+    T(count == 1);
+    ALLOCS(pnum = phfwdGet(pf, "12a"), count);
+    phnumDelete(pnum);
+    T(count == 1);
+    base[999] = '8';
+    ALLOCS(pnum = phfwdGet(pf, base), count);
+    phnumDelete(pnum);
+    T(count == 1);
+    base[999] = '7';
+    ALLOCS(pnum = phfwdGet(pf, base), count);
+    C(phnumGet(pnum, 0), "9");
+    phnumDelete(pnum);
+    T(count == 1);
+
+    ALLOCS(pnum = phfwdReverse(pf, "9"), count);
+    T(phnumSize(pnum) == 2);
+    phnumDelete(pnum);
+    T(count <= 2);
+    ALLOCS(pnum = phfwdReverse(pf, "45"), count);
+    T(phnumSize(pnum) == 101);
+    phnumDelete(pnum);
+    T(count <= 2);
+    // Długi numer bez pasujących przekierowań.
+    ALLOCS(pnum = phfwdReverse(pf, base), count);
+    T(phnumSize(pnum) == 1);
+    phnumDelete(pnum);
+    T(count <= 2);
+    ALLOCS(pnum = phfwdGetReverse(pf, "45"), count);
+    T(phnumSize(pnum) == 101);
+    phnumDelete(pnum);
+    T(count <= 2);
+
+    free(base);
+    CLEAN(pf);
+}
+
+// Sprawdza, czy ciągi numerów sa równe.
+static bool same_numbers(PhoneNumbers const *p, PhoneNumbers const *q) {
+    size_t i = 0;
+    for (; phnumGet(p, i) != NULL && phnumGet(q, i) != NULL; ++i) {
+        if (strcmp(phnumGet(p, i), phnumGet(q, i)) != 0)
+            return false;
+    }
+    return phnumGet(p, i) == phnumGet(q, i);
+}
+
+static int engines(void) {
+    PhoneForwardEngine const *engine;
+    PhoneForwardStats stats;
+    PhoneForward *other;
+    PhoneNumbers *pnum, *expected;
+
+    T(phfwdEngineAt(0) == phfwdEngine("trie"));
+    N(phfwdEngine("lazy_reverse"));
+    Z(phfwdEngine("no_such_engine"));
+    Z(phfwdEngine(NULL));
+    Z(phfwdEngineOf(NULL));
+
+    // Każdy silnik daje te same wyniki co silnik wzorcowy.
+    N(other = phfwdNewEngine(phfwdEngine("trie")));
+    T(phfwdEngineOf(other) == phfwdEngineAt(0));
+    T(phfwdAdd(other, "12", "34"));
+    T(phfwdAdd(other, "5", "34"));
+    T(phfwdAdd(other, "123", "6"));
+    phfwdRemove(other, "5");
+    for (size_t i = 0; (engine = phfwdEngineAt(i)) != NULL; ++i) {
+        PhoneForward *pf;
+        N(pf = phfwdNewEngine(engine));
+        T(phfwdEngineOf(pf) == engine);
+        T(phfwdAdd(pf, "12", "34"));
+        T(phfwdAdd(pf, "5", "34"));
+        T(phfwdAdd(pf, "123", "6"));
+        F(phfwdAdd(pf, "12", "12"));
+        phfwdRemove(pf, "5");
+        // Silnik wybiera tylko, czy drzewo odwrócone jest odroczone.
+        T(phfwdStats(pf, &stats));
+        T(stats.reverseStale == engine->reverseDeferred);
+        char const *queries[] = {"1234", "5", "34", "345", "6", "61"};
+        for (size_t j = 0; j < SIZE(queries); ++j) {
+            pnum = phfwdGet(pf, queries[j]);
+            expected = phfwdGet(other, queries[j]);
+            T(same_numbers(pnum, expected));
+            phnumDelete(pnum);
+            phnumDelete(expected);
+            pnum = phfwdGetReverse(pf, queries[j]);
+            expected = phfwdGetReverse(other, queries[j]);
+            T(same_numbers(pnum, expected));
+            phnumDelete(pnum);
+            phnumDelete(expected);
+        }
+        phfwdDelete(pf);
+    }
+    phfwdDelete(other);
+    return PASS;
+}
+
+// Liczy w osobnym wątku przekierowania na numer "7".
+static void *count_reverse(void *pf) {
+    return (void *)phfwdReverseCount(pf, "7");
+}
+
+// Zapytania wielu wątków o nieaktualne drzewo odwrócone
+static int concurrent_reverse(void) {
+    pthread_t threads[4];
+    char num[16];
+
+    INIT(pf);
+    phfwdSetReverseDeferred(pf, true);
+    for (int round = 1; round <= 20; ++round) {
+        for (int i = 0; i < 100; ++i) {
+            sprintf(num, "%d", round * 1000 + i);
+            T(phfwdAdd(pf, num, "7"));
+        }
+        for (int i = 0; i < 4; ++i)
+            Z(pthread_create(&threads[i], NULL, count_reverse, pf));
+        for (int i = 0; i < 4; ++i) {
+            void *count;
+            Z(pthread_join(threads[i], &count));
+            T((size_t)count == (size_t)round * 100 + 1);
+        }
+    }
+    CLEAN(pf);
+}
+
+// Obsługuje klientów serwera w osobnym wątku.
+static void *run_server(void *srv) {
+    phfwdServerRun(srv);
+    return NULL;
+}
+
+static int server(void) {
+    PhoneForwardServer *srv;
+    PhoneForwardClient *client;
+    pthread_t thread;
+    PhoneNumbers *results[1000], *expected;
+    char path[64], num[16];
+
+    INIT(pf);
+    T(phfwdAdd(pf, "12", "34"));
+    T(phfwdAdd(pf, "5", "34"));
+    T(phfwdAdd(pf, "123", "6"));
+    sprintf(path, "/tmp/phfwd_server_%d.sock", (int)getpid());
+    N(srv = phfwdServerNew(pf, path, 2));
+    Z(pthread_create(&thread, NULL, run_server, srv));
+    N(client = phfwdClientConnect(path));
+
+    // Dwie ramki wysłane przed odebraniem odpowiedzi.
+    T(phfwdClientQueue(client, OPERATION_GET, "1234"));
+    T(phfwdClientQueue(client, OPERATION_GET_REVERSE, "34"));
+    T(phfwdClientQueue(client, OPERATION_REVERSE, "6"));
+    T(phfwdClientQueue(client, OPERATION_GET, "12a"));
+    F(phfwdClientQueue(client, OPERATION_ADD, "1"));
+    T(phfwdClientSend(client));
+    T(phfwdClientQueue(client, OPERATION_GET, "5"));
+    T(phfwdClientSend(client));
+
+    T(phfwdClientReceive(client, results, 4));
+    C(phnumGet(results[0], 0), "64");
+    T(phnumSize(results[1]) == 3);
+    C(phnumGet(results[1], 0), "12");
+    C(phnumGet(results[1], 1), "34");
+    C(phnumGet(results[1], 2), "5");
+    T(phnumSize(results[2]) == 2);
+    C(phnumGet(results[2], 0), "123");
+    C(phnumGet(results[2], 1), "6");
+    T(phnumSize(results[3]) == 0);
+    for (size_t i = 0; i < 4; ++i)
+        phnumDelete(results[i]);
+    T(phfwdClientReceive(client, results, 1));
+    C(phnumGet(results[0], 0), "34");
+    phnumDelete(results[0]);
+
+    // Duża ramka daje te same wyniki co bezpośrednie wywołania.
+    for (size_t i = 0; i < SIZE(results); ++i) {
+        sprintf(num, "%zu", i);
+        T(phfwdClientQueue(client, (PhoneForwardOperation)(i % 3), num));
+    }
+    T(phfwdClientSend(client));
+    T(phfwdClientReceive(client, results, SIZE(results)));
+    for (size_t i = 0; i < SIZE(results); ++i) {
+        sprintf(num, "%zu", i);
+        if (i % 3 == OPERATION_GET)
+            expected = phfwdGet(pf, num);
+        else if (i % 3 == OPERATION_REVERSE)
+            expected = phfwdReverse(pf, num);
+        else
+            expected = phfwdGetReverse(pf, num);
+        T(same_numbers(results[i], expected));
+        phnumDelete(expected);
+        phnumDelete(results[i]);
+    }
+
+    phfwdClientDelete(client);
+    phfwdServerStop(srv);
+    Z(pthread_join(thread, NULL));
+    phfwdServerDelete(srv);
+    T(access(path, F_OK) != 0);
+
+    // Plik niebędący gniazdem nie jest usuwany.
+    FILE *file;
+    N(file = fopen(path, "w"));
+    fclose(file);
+    Z(phfwdServerNew(pf, path, 1));
+    T(access(path, F_OK) == 0);
+    T(unlink(path) == 0);
+    CLEAN(pf);
+}
+
+// Porównuje wyniki bazy współdzielonej z wynikami struktury.
+static bool same_as_shared(PhoneForward *pf, PhoneForwardShared const *shared, char const *num) {
+    PhoneNumbers *pnum, *expected;
+    bool same = true;
+
+    pnum = phfwdSharedGet(shared, num);
+    expected = phfwdGet(pf, num);
+    same = same && same_numbers(pnum, expected);
+    phnumDelete(pnum);
+    phnumDelete(expected);
+    pnum = phfwdSharedReverse(shared, num);
+    expected = phfwdReverse(pf, num);
+    same = same && same_numbers(pnum, expected);
+    phnumDelete(pnum);
+    phnumDelete(expected);
+    pnum = phfwdSharedGetReverse(shared, num);
+    expected = phfwdGetReverse(pf, num);
+    same = same && same_numbers(pnum, expected);
+    phnumDelete(pnum);
+    phnumDelete(expected);
+    return same;
+}
+
+static int shared(void) {
+    PhoneForwardShared *db, *old;
+    PhoneNumbers *pnum;
+    char name[64], num[16];
+    pid_t child;
+    int status;
+
+    INIT(pf);
+    sprintf(name, "/phfwd_test_%d", (int)getpid());
+    Z(phfwdSharedAttach(name));
+    F(phfwdSharedPublish(NULL, name));
+    F(phfwdSharedPublish(pf, NULL));
+
+    // Pusta baza.
+    T(phfwdSharedPublish(pf, name));
+    N(db = phfwdSharedAttach(name));
+    T(same_as_shared(pf, db, "123"));
+    phfwdSharedDetach(db);
+
+    T(phfwdAdd(pf, "12", "34"));
+    T(phfwdAdd(pf, "5", "34"));
+    T(phfwdAdd(pf, "123", "6"));
+    T(phfwdAdd(pf, "*#", "1*"));
+    for (size_t i = 0; i < 300; ++i) {
+        sprintf(num, "%zu", 7000 + i * 7);
+        T(phfwdAdd(pf, num, i % 2 ? "34" : "9"));
+    }
+    T(phfwdSharedPublish(pf, name));
+    N(db = phfwdSharedAttach(name));
+    N(pnum = phfwdSharedGet(db, "1234"));
+    C(phnumGet(pnum, 0), "64");
+    phnumDelete(pnum);
+    N(pnum = phfwdSharedGet(db, "12a"));
+    T(phnumSize(pnum) == 0);
+    phnumDelete(pnum);
+    Z(phfwdSharedGet(NULL, "1"));
+    for (size_t i = 0; i < 10000; ++i) {
+        sprintf(num, "%zu", i);
+        T(same_as_shared(pf, db, num));
+    }
+    T(same_as_shared(pf, db, "*#0"));
+    T(same_as_shared(pf, db, "1*"));
+
+    // Inny proces dołącza ta sama bazę.
+    child = fork();
+    T(child >= 0);
+    if (child == 0) {
+        PhoneForwardShared *other = phfwdSharedAttach(name);
+        bool ok = other != NULL && same_as_shared(pf, other, "1234") && same_as_shared(pf, other, "34");
+        phfwdSharedDetach(other);
+        _exit(ok ? 0 : 1);
+    }
+    T(waitpid(child, &status, 0) == child);
+    T(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // Ponowne opublikowanie nie zmienia bazy dołączonej wcześniej.
+    old = db;
+    phfwdRemove(pf, "12");
+    T(phfwdSharedPublish(pf, name));
+    N(db = phfwdSharedAttach(name));
+    N(pnum = phfwdSharedGet(old, "1234"));
+    C(phnumGet(pnum, 0), "64");
+    phnumDelete(pnum);
+    N(pnum = phfwdSharedGet(db, "1234"));
+    C(phnumGet(pnum, 0), "1234");
+    phnumDelete(pnum);
+    phfwdSharedDetach(old);
+
+    T(phfwdSharedUnlink(name));
+    F(phfwdSharedUnlink(name));
+    Z(phfwdSharedAttach(name));
+    T(same_as_shared(pf, db, "1234"));
+    phfwdSharedDetach(db);
+    phfwdSharedDetach(NULL);
+    CLEAN(pf);
+}
+
+// Zapisuje bajty do pliku tymczasowego i ustawia go na początek.
+static FILE *bytes_file(uint8_t const *bytes, size_t size) {
+    FILE *file = tmpfile();
+    if (file != NULL && (write(fileno(file), bytes, size) != (ssize_t)size
+                         || lseek(fileno(file), 0, SEEK_SET) != 0)) {
+        fclose(file);
+        file = NULL;
+    }
+    return file;
+}
+
+static int huge_number_length(void) {
+    // Długość numeru UINT64_MAX, dla której (długość + 1) / 2 wynosi 0.
+    #define HUGE_LENGTH 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01
+    uint8_t const snapshot[] = {'P', 'F', 'S', '2', 0, 1, 1, 1, 0x01, 0x00, 0x00, 0x10, HUGE_LENGTH};
+    uint8_t const journal[] = {1, HUGE_LENGTH};
+    uint8_t const frame[] = {11, OPERATION_GET, HUGE_LENGTH};
+    #undef HUGE_LENGTH
+    PhoneForwardServer *srv;
+    PhoneForwardClient *client;
+    PhoneNumbers *result;
+    pthread_t thread;
+    FILE *file;
+    char path[64];
+
+    N(file = bytes_file(snapshot, sizeof(snapshot)));
+    Z(phfwdLoad(fileno(file)));
+    fclose(file);
+
+    INIT(pf);
+    N(file = bytes_file(journal, sizeof(journal)));
+    T(phfwdJournalReplay(pf, fileno(file)));
+    CHECK(pf, "1", "1");
+    fclose(file);
+
+    // Serwer zamyka połączenie z niepoprawną ramką i obsługuje kolejne.
+    sprintf(path, "/tmp/phfwd_huge_%d.sock", (int)getpid());
+    N(srv = phfwdServerNew(pf, path, 1));
+    Z(pthread_create(&thread, NULL, run_server, srv));
+    N(client = phfwdClientConnect(path));
+    T(write(client->fd, frame, sizeof(frame)) == (ssize_t)sizeof(frame));
+    F(phfwdClientReceive(client, &result, 1));
+    phfwdClientDelete(client);
+    N(client = phfwdClientConnect(path));
+    T(phfwdClientQueue(client, OPERATION_GET, "12"));
+    T(phfwdClientSend(client));
+    T(phfwdClientReceive(client, &result, 1));
+    C(phnumGet(result, 0), "12");
+    phnumDelete(result);
+    phfwdClientDelete(client);
+    phfwdServerStop(srv);
+    Z(pthread_join(thread, NULL));
+    phfwdServerDelete(srv);
+    CLEAN(pf);
+}
+
 #define V(code, where) (((unsigned long)code) << (3 * where))
 
 // Test reakcji implementacji na niepowodzenie alokacji pamięci
@@ -1366,6 +3219,31 @@ static const test_list_t test_list[] = {
         TEST(cycle),
         TEST(sort),
         TEST(get_reverse),
+        TEST(deferred_reverse),
+        TEST(reverse_count),
+        TEST(reverse_page),
+        TEST(bulk_load),
+        TEST(changeset),
+        TEST(snapshot),
+        TEST(delta_snapshot),
+        TEST(import),
+        TEST(diff),
+        TEST(deep_diff),
+        TEST(merge),
+        TEST(deep_merge),
+        TEST(resolve),
+        TEST(concurrent_resolve),
+        TEST(stats),
+        TEST(counters),
+        TEST(trace),
+        TEST(write_ahead_log),
+        TEST(memory),
+        TEST(allocation_budget),
+        TEST(engines),
+        TEST(concurrent_reverse),
+        TEST(server),
+        TEST(shared),
+        TEST(huge_number_length),
         TEST(alloc_fail_1),
         TEST(alloc_fail_2),
         TEST(alloc_fail_3),
@@ -1378,6 +3256,24 @@ static int do_test(int (*function)(void)) {
 }
 
 int main() {
-    for (size_t i = 0; i < SIZE(test_list); ++i)
-    printf("Test no.: %lu, result: %i\n", i, do_test(test_list[i].function));
+    // Zestaw testów można uruchomić dla wybranego silnika (PHFWD_ENGINE=nazwa).
+    char const *engine = getenv("PHFWD_ENGINE");
+    if (engine != NULL) {
+        if (phfwdEngine(engine) == NULL) {
+            fprintf(stderr, "unknown engine: %s\n", engine);
+            return 1;
+        }
+        phfwdSetDefaultEngine(phfwdEngine(engine));
+    }
+    // Program kończy sie błędem, jeśli któryś test sie nie powiódł.
+    int status = 0;
+    for (size_t i = 0; i < SIZE(test_list); ++i) {
+        int result = do_test(test_list[i].function);
+        printf("Test no.: %lu, result: %i\n", i, result);
+        if (result == FAIL || result == WRONG_TEST) {
+            fprintf(stderr, "test %s failed\n", test_list[i].name);
+            status = 1;
+        }
+    }
+    return status;
 }
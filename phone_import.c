@@ -0,0 +1,261 @@
+/** @file
+ * Implementacja wczytywania przekierowań numerów telefonicznych z pliku
+ * tekstowego.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "phone_import.h"
+#include "phone_codec.h"
+#include "list_of_numbers.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Największa liczba wątków parsujących.
+ */
+#define MAX_THREADS 64
+
+
+
+/**
+ * @brief Fragment pliku parsowany przez jeden wątek.
+ */
+struct ImportChunk {
+    char const *begin;  ///<początek fragmentu.
+    char const *end;  ///<koniec fragmentu (za ostatnim znakiem).
+    char *numbers;  ///<numery fragmentu zakończone znakiem '\0'.
+    PhoneForwardRule *rules;  ///<przekierowania fragmentu.
+    size_t count;  ///<liczba przekierowań.
+    size_t lines;  ///<liczba przeczytanych wierszy.
+    bool valid;  ///<czy wszystkie wiersze sa poprawne.
+};
+
+
+/**
+ * @brief Sprawdza, czy znak jest białym znakiem oddzielającym numery.
+ * @param c - znak.
+ * @return Wartość @p true, jeśli znak jest spacja, tabulacja lub '\\r'.
+ */
+static bool isSeparator(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+/**
+ * @brief Kopiuje numer zaczynający sie w @p pos do bufora numerów.
+ * @param pos - wskaźnik na pozycję w wierszu (przesuwana za numer).
+ * @param end - koniec wiersza.
+ * @param out - wskaźnik na miejsce w buforze (przesuwany za '\0').
+ * @return wskaźnik na skopiowany numer lub NULL, jeśli numeru nie ma.
+ */
+static char const *copyNumber(char const **pos, char const *end, char **out) {
+    char *number = *out;
+    while (*pos < end && isNumberChar(**pos)) {
+        *(*out)++ = *(*pos)++;
+    }
+    if (*out == number) {
+        return NULL;
+    }
+    *(*out)++ = '\0';
+    return number;
+}
+
+
+/**
+ * @brief Parsuje fragment pliku (funkcja wątku).
+ * @param arg - wskaźnik na strukturę ImportChunk.
+ * @return NULL.
+ */
+static void *parseChunk(void *arg) {
+    struct ImportChunk *chunk = arg;
+    char *out = chunk->numbers;
+    chunk->valid = true;
+    for (char const *line = chunk->begin; line < chunk->end; chunk->lines++) {
+        char const *lineEnd = memchr(line, '\n', (size_t) (chunk->end - line));
+        lineEnd = lineEnd != NULL ? lineEnd : chunk->end;
+        char const *pos = line;
+        while (pos < lineEnd && isSeparator(*pos)) {
+            pos++;
+        }
+        if (pos < lineEnd) {
+            PhoneForwardRule *rule = &chunk->rules[chunk->count];
+            rule->from = copyNumber(&pos, lineEnd, &out);
+            char const *separator = pos;
+            while (pos < lineEnd && isSeparator(*pos)) {
+                pos++;
+            }
+            rule->to = pos > separator ? copyNumber(&pos, lineEnd, &out) : NULL;
+            while (pos < lineEnd && isSeparator(*pos)) {
+                pos++;
+            }
+            if (rule->from == NULL || rule->to == NULL || pos < lineEnd
+                || strcmp(rule->from, rule->to) == 0) {
+                chunk->valid = false;
+                chunk->lines++;
+                return NULL;
+            }
+            chunk->count++;
+        }
+        line = lineEnd + 1;
+    }
+    return NULL;
+}
+
+
+/**
+ * @brief Dzieli plik na fragmenty zakończone końcem wiersza.
+ * @param data - zawartość pliku.
+ * @param size - rozmiar pliku.
+ * @param chunks - tablica fragmentów.
+ * @param count - żądana liczba fragmentów.
+ * @return liczba niepustych fragmentów.
+ */
+static size_t splitChunks(char const *data, size_t size, struct ImportChunk *chunks, size_t count) {
+    size_t used = 0;
+    char const *begin = data, *end = data + size;
+    for (size_t i = 0; i < count && begin < end; i++) {
+        char const *chunkEnd = begin + (size_t) (end - begin) / (count - i);
+        chunkEnd = chunkEnd < end ? chunkEnd : end;
+        char const *newline = memchr(chunkEnd, '\n', (size_t) (end - chunkEnd));
+        chunkEnd = newline != NULL ? newline + 1 : end;
+        chunks[used].begin = begin;
+        chunks[used].end = chunkEnd;
+        used++;
+        begin = chunkEnd;
+    }
+    return used;
+}
+
+
+/**
+ * @brief Parsuje fragmenty, każdy w osobnym wątku.
+ * Fragment, dla którego nie udało sie utworzyć wątku, jest parsowany
+ * w wątku wywołującym.
+ * @param chunks - tablica fragmentów.
+ * @param count - liczba fragmentów.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool parseChunks(struct ImportChunk *chunks, size_t count) {
+    pthread_t threads[MAX_THREADS];
+    bool started[MAX_THREADS];
+    bool ok = true;
+    for (size_t i = 0; i < count; i++) {
+        size_t length = (size_t) (chunks[i].end - chunks[i].begin);
+        chunks[i].numbers = malloc(sizeof(char) * (length + 1));
+        // Najkrótszy wiersz ("1 2\n") ma 4 znaki, ostatni może nie mieć '\n'.
+        chunks[i].rules = malloc(sizeof(PhoneForwardRule) * ((length + 1) / 4 + 1));
+        chunks[i].count = 0;
+        chunks[i].lines = 0;
+        chunks[i].valid = false;
+        ok = ok && chunks[i].numbers != NULL && chunks[i].rules != NULL;
+    }
+    if (!ok) {
+        return false;
+    }
+    for (size_t i = 1; i < count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, parseChunk, &chunks[i]) == 0;
+    }
+    parseChunk(&chunks[0]);
+    for (size_t i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            parseChunk(&chunks[i]);
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @brief Sprawdza i dodaje przekierowania z zawartości pliku.
+ * @param pf - wskaźnik na strukturę przechowująca przekierowania.
+ * @param data - zawartość pliku.
+ * @param size - rozmiar zawartości (większy od 0).
+ * @param threads - liczba wątków parsujących (0 - liczba procesorów).
+ * @param badLine - wskaźnik na numer pierwszego niepoprawnego wiersza (może byc NULL).
+ * @return Wartość jak w @ref phfwdImportText.
+ */
+static bool importData(PhoneForward *pf, char const *data, size_t size, unsigned threads,
+                       size_t *badLine) {
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (unsigned) online : 1;
+    }
+    threads = threads < MAX_THREADS ? threads : MAX_THREADS;
+    struct ImportChunk chunks[MAX_THREADS];
+    size_t count = splitChunks(data, size, chunks, threads);
+    for (size_t i = 0; i < count; i++) {
+        chunks[i].numbers = NULL;
+        chunks[i].rules = NULL;
+    }
+    bool ok = parseChunks(chunks, count);
+
+    // Wszystkie wiersze sprawdzam przed pierwsza zmiana struktury.
+    size_t lines = 0;
+    for (size_t i = 0; ok && i < count; i++) {
+        lines += chunks[i].lines;
+        if (!chunks[i].valid) {
+            ok = false;
+            if (badLine != NULL) {
+                *badLine = lines;
+            }
+        }
+    }
+    if (ok) {
+        bool deferred = phfwdRootOf(pf)->reverseDeferred;
+        phfwdSetReverseDeferred(pf, true);
+        for (size_t i = 0; ok && i < count; i++) {
+            ok = phfwdBulkLoad(pf, chunks[i].rules, chunks[i].count);
+        }
+        phfwdSetReverseDeferred(pf, deferred);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        free(chunks[i].numbers);
+        free(chunks[i].rules);
+    }
+    return ok;
+}
+
+
+bool phfwdImportText(PhoneForward *pf, int fd, unsigned threads, size_t *badLine) {
+    if (badLine != NULL) {
+        *badLine = 0;
+    }
+    struct stat info;
+    if (pf == NULL || fstat(fd, &info) != 0) {
+        return false;
+    }
+    if (!S_ISREG(info.st_mode)) {
+        // Potoku ani gniazda nie można odwzorować w pamięci, więc czytam je
+        // do końca; st_size nie mówi nic o ich zawartości.
+        ByteBuffer content;
+        bufferInit(&content);
+        bool ok = bufferReadAll(&content, fd)
+                  && (content.size == 0
+                      || importData(pf, (char const *) content.data, content.size, threads, badLine));
+        bufferFree(&content);
+        return ok;
+    }
+    size_t size = (size_t) info.st_size;
+    if (size == 0) {
+        return true;
+    }
+    char const *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    posix_madvise((void *) data, size, POSIX_MADV_SEQUENTIAL);
+    bool ok = importData(pf, data, size, threads, badLine);
+    munmap((void *) data, size);
+    return ok;
+}
@@ -0,0 +1,43 @@
+/** @file
+ * Interfejs wczytywania przekierowań numerów telefonicznych z pliku
+ * tekstowego.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_IMPORT_H
+#define PHONE_IMPORT_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "phone_forward.h"
+
+
+
+/** @brief Dodaje przekierowania zapisane w pliku tekstowym.
+ * Każdy niepusty wiersz pliku to dwa numery oddzielone białymi znakami:
+ * prefiks numerów przekierowywanych i prefiks, na który sa przekierowywane.
+ * Zwykły plik jest odwzorowywany w pamięci (mmap), a potok lub inny plik,
+ * którego nie można odwzorować, jest czytany do końca. Zawartość jest dzielona
+ * na fragmenty zakończone końcem wiersza, które sa sprawdzane i parsowane
+ * równolegle. Numery składają sie ze znaków dozwolonych przez
+ * @ref isStringAPhoneNumber.
+ * Przekierowania sa następnie dodawane fragmentami przez @ref phfwdBulkLoad
+ * w kolejności wierszy, więc późniejszy wiersz zastępuje wcześniejszy.
+ * Drzewo odwrócone jest budowane w jednym przejściu przy pierwszym
+ * zapytaniu, które go potrzebuje.
+ * @param[in,out] pf   - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] fd       - deskryptor pliku otwartego do odczytu;
+ * @param[in] threads  - liczba wątków parsujących (0 - liczba procesorów);
+ * @param[out] badLine - wskaźnik, pod który jest wpisywany numer (od 1)
+ *                       pierwszego niepoprawnego wiersza lub 0 (może byc NULL).
+ * @return Wartość @p true, jeśli dodano wszystkie przekierowania.
+ *         Wartość @p false, jeśli @p pf ma wartość NULL, któryś wiersz jest
+ *         niepoprawny (nic nie jest wtedy dodawane), operacja na pliku się
+ *         nie udała lub nie udało sie alokować pamięci.
+ */
+bool phfwdImportText(PhoneForward *pf, int fd, unsigned threads, size_t *badLine);
+
+
+#endif //PHONE_IMPORT_H
@@ -0,0 +1,313 @@
+/** @file
+ * Implementacja dziennika operacji na przekierowaniach numerów telefonicznych.
+ * Zapis dziennika to bajt rodzaju operacji, a po nim numery zakodowane przez
+ * @ref bufferPutNumber.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "phone_journal.h"
+#include "phone_snapshot.h"
+#include <stdlib.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/**
+ * @brief Rodzaj zapisu dziennika.
+ */
+enum JournalRecord {
+    JOURNAL_ADD = 1,  ///<dodanie przekierowania (dwa numery).
+    JOURNAL_REMOVE = 2  ///<usunięcie przekierowań (jeden numer).
+};
+
+
+
+/**
+ * @brief Wykonuje pełne zapisy z bufora.
+ * @param pf - wskaźnik na strukturę przechowująca przekierowania.
+ * @param data - wskaźnik na zapisy.
+ * @param size - liczba bajtów.
+ * @param validSize - wskaźnik na liczbę bajtów tworzących pełne zapisy.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool replayBuffer(PhoneForward *pf, uint8_t const *data, size_t size, size_t *validSize) {
+    ByteReader reader = {data, data + size};
+    ByteBuffer num1, num2;
+    bufferInit(&num1);
+    bufferInit(&num2);
+    bool ok = true;
+    *validSize = 0;
+
+    while (ok && reader.pos < reader.end) {
+        uint8_t type = *reader.pos++;
+        if (type == JOURNAL_ADD) {
+            if (!readerGetNumber(&reader, &num1) || !readerGetNumber(&reader, &num2)) {
+                break;
+            }
+            ok = phfwdAdd(pf, (char *) num1.data, (char *) num2.data);
+        } else if (type == JOURNAL_REMOVE) {
+            if (!readerGetNumber(&reader, &num1)) {
+                break;
+            }
+            phfwdRemove(pf, (char *) num1.data);
+        } else {
+            break;
+        }
+        if (ok) {
+            *validSize = (size_t) (reader.pos - data);
+        }
+    }
+    bufferFree(&num1);
+    bufferFree(&num2);
+    return ok;
+}
+
+
+/**
+ * @brief Odtwarza operacje z pliku (patrz @ref phfwdJournalReplay).
+ * @param pf - wskaźnik na strukturę przechowująca przekierowania.
+ * @param fd - deskryptor pliku.
+ * @param validSize - wskaźnik na liczbę bajtów tworzących pełne zapisy.
+ * @return Wartość @p false, jeśli odczyt się nie udał lub nie udało sie
+ *         alokować pamięci.
+ */
+static bool replayFile(PhoneForward *pf, int fd, size_t *validSize) {
+    ByteBuffer content;
+    bufferInit(&content);
+    bool ok = bufferReadAll(&content, fd);
+    if (ok) {
+        // Drzewo odwrócone zbuduję raz, zamiast aktualizować przy każdej operacji.
+        bool deferred = phfwdRootOf(pf)->reverseDeferred;
+        phfwdSetReverseDeferred(pf, true);
+        ok = replayBuffer(pf, content.data, content.size, validSize);
+        phfwdSetReverseDeferred(pf, deferred);
+    }
+    bufferFree(&content);
+    return ok;
+}
+
+
+bool phfwdJournalReplay(PhoneForward *pf, int fd) {
+    size_t validSize;
+    return pf != NULL && replayFile(pf, fd, &validSize);
+}
+
+
+PhoneForwardJournal *phfwdJournalNew(PhoneForward *pf, int fd) {
+    if (pf == NULL) {
+        return NULL;
+    }
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    size_t validSize;
+    if (start < 0 || !replayFile(pf, fd, &validSize)) {
+        return NULL;
+    }
+    // Niepełny ostatni zapis odcinam, żeby nowe zapisy nie trafiły za niego.
+    off_t end = start + (off_t) validSize;
+    if (ftruncate(fd, end) != 0 || lseek(fd, end, SEEK_SET) != end) {
+        return NULL;
+    }
+
+    PhoneForwardJournal *journal = malloc(sizeof(PhoneForwardJournal));
+    if (journal == NULL) {
+        return NULL;
+    }
+    if (pthread_mutex_init(&journal->mutex, NULL) != 0) {
+        free(journal);
+        return NULL;
+    }
+    if (pthread_cond_init(&journal->flushed, NULL) != 0) {
+        pthread_mutex_destroy(&journal->mutex);
+        free(journal);
+        return NULL;
+    }
+    journal->pf = pf;
+    journal->fd = fd;
+    bufferInit(&journal->pending);
+    bufferInit(&journal->writing);
+    journal->appended = 0;
+    journal->durable = 0;
+    journal->flushing = false;
+    journal->deferred = false;
+    journal->failed = false;
+    return journal;
+}
+
+
+/**
+ * @brief Czeka na utrwalenie zapisu o numerze @p lsn (grupowe zatwierdzanie).
+ * Jeśli żaden wątek nie zapisuje grupy, wątek sam zapisuje wszystkie zapisy
+ * z bufora i wykonuje fsync poza sekcją krytyczną; w tym czasie inne wątki
+ * dopisują kolejne zapisy do nowej grupy.
+ * Wywoływana z zajętym muteksem dziennika.
+ * @param journal - wskaźnik na dziennik.
+ * @param lsn - numer zapisu.
+ * @return Wartość @p false, jeśli nie udało się utrwalić zapisu.
+ */
+static bool waitDurable(PhoneForwardJournal *journal, uint64_t lsn) {
+    while (journal->durable < lsn && !journal->failed) {
+        if (journal->flushing) {
+            pthread_cond_wait(&journal->flushed, &journal->mutex);
+            continue;
+        }
+        ByteBuffer group = journal->pending;
+        journal->pending = journal->writing;
+        journal->writing = group;
+        uint64_t target = journal->appended;
+        journal->flushing = true;
+
+        pthread_mutex_unlock(&journal->mutex);
+        bool ok = bufferWrite(&group, journal->fd) && fsync(journal->fd) == 0;
+        pthread_mutex_lock(&journal->mutex);
+
+        journal->writing.size = 0;
+        journal->flushing = false;
+        if (ok) {
+            if (journal->durable < target) {
+                journal->durable = target;
+            }
+        } else {
+            journal->failed = true;
+        }
+        pthread_cond_broadcast(&journal->flushed);
+    }
+    return journal->durable >= lsn;
+}
+
+
+/**
+ * @brief Kończy dopisywanie zapisu do bufora dziennika.
+ * Poza trybem odroczonym, lub gdy bufor jest duży, czeka na utrwalenie zapisu.
+ * Wywoływana z zajętym muteksem dziennika.
+ * @param journal - wskaźnik na dziennik.
+ * @return Wartość @p false, jeśli nie udało się utrwalić zapisu.
+ */
+static bool commitRecord(PhoneForwardJournal *journal) {
+    uint64_t lsn = ++journal->appended;
+    if (journal->deferred && journal->pending.size < JOURNAL_COMMIT_BYTES) {
+        return true;
+    }
+    return waitDurable(journal, lsn);
+}
+
+
+bool phfwdJournalSetDeferred(PhoneForwardJournal *journal, bool deferred) {
+    if (journal == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&journal->mutex);
+    journal->deferred = deferred;
+    bool ok = deferred || waitDurable(journal, journal->appended);
+    pthread_mutex_unlock(&journal->mutex);
+    return ok;
+}
+
+
+bool phfwdJournalSync(PhoneForwardJournal *journal) {
+    if (journal == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&journal->mutex);
+    bool ok = waitDurable(journal, journal->appended);
+    pthread_mutex_unlock(&journal->mutex);
+    return ok;
+}
+
+
+void phfwdJournalDelete(PhoneForwardJournal *journal) {
+    if (journal == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&journal->mutex);
+    waitDurable(journal, journal->appended);
+    pthread_mutex_unlock(&journal->mutex);
+
+    bufferFree(&journal->pending);
+    bufferFree(&journal->writing);
+    pthread_cond_destroy(&journal->flushed);
+    pthread_mutex_destroy(&journal->mutex);
+    free(journal);
+}
+
+
+bool phfwdJournalAdd(PhoneForwardJournal *journal, char const *num1, char const *num2) {
+    if (journal == NULL || num1 == NULL || num2 == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&journal->mutex);
+    ByteBuffer *pending = &journal->pending;
+    size_t before = pending->size;
+    bool ok = !journal->failed && isStringAPhoneNumber(num1) && isStringAPhoneNumber(num2)
+              && bufferPut(pending, &(uint8_t) {JOURNAL_ADD}, 1)
+              && bufferPutNumber(pending, num1) && bufferPutNumber(pending, num2)
+              && phfwdAdd(journal->pf, num1, num2);
+    if (ok) {
+        ok = commitRecord(journal);
+    } else {
+        pending->size = before;
+    }
+    pthread_mutex_unlock(&journal->mutex);
+    return ok;
+}
+
+
+bool phfwdJournalRemove(PhoneForwardJournal *journal, char const *num) {
+    if (journal == NULL || num == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&journal->mutex);
+    ByteBuffer *pending = &journal->pending;
+    size_t before = pending->size;
+    bool ok = !journal->failed && isStringAPhoneNumber(num)
+              && bufferPut(pending, &(uint8_t) {JOURNAL_REMOVE}, 1)
+              && bufferPutNumber(pending, num);
+    if (ok) {
+        phfwdRemove(journal->pf, num);
+        ok = commitRecord(journal);
+    } else {
+        pending->size = before;
+    }
+    pthread_mutex_unlock(&journal->mutex);
+    return ok;
+}
+
+
+bool phfwdJournalFailed(PhoneForwardJournal *journal) {
+    if (journal == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&journal->mutex);
+    bool failed = journal->failed;
+    pthread_mutex_unlock(&journal->mutex);
+    return failed;
+}
+
+
+bool phfwdJournalCheckpoint(PhoneForwardJournal *journal, int snapshotFd) {
+    if (journal == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&journal->mutex);
+    // Grupa zapisywana właśnie do pliku nie może trafić za obcięcie.
+    while (journal->flushing) {
+        pthread_cond_wait(&journal->flushed, &journal->mutex);
+    }
+    // Po błędzie zapisu zrzut utrwala też operacje wykonane tylko w pamięci.
+    bool ok = phfwdSave(journal->pf, snapshotFd) && fsync(snapshotFd) == 0;
+
+    if (ok) {
+        // Zrzut zawiera też operacje z bufora, więc sa one już utrwalone.
+        // Plik dziennika po błędzie może kończyć sie częścią grupy; obcinam go.
+        journal->pending.size = 0;
+        journal->durable = journal->appended;
+        ok = ftruncate(journal->fd, 0) == 0 && lseek(journal->fd, 0, SEEK_SET) == 0
+             && fsync(journal->fd) == 0;
+        journal->failed = !ok;
+        pthread_cond_broadcast(&journal->flushed);
+    }
+    pthread_mutex_unlock(&journal->mutex);
+    return ok;
+}
@@ -0,0 +1,176 @@
+/** @file
+ * Interfejs dziennika (write-ahead log) operacji na przekierowaniach
+ * numerów telefonicznych.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_JOURNAL_H
+#define PHONE_JOURNAL_H
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "phone_codec.h"
+#include "phone_forward.h"
+
+#define JOURNAL_COMMIT_BYTES (1u << 20) ///<Rozmiar bufora, od którego operacja w trybie odroczonym czeka na utrwalenie.
+
+
+/**
+ * @brief Dziennik operacji dodawania i usuwania przekierowań.
+ * Zapisy trafiają najpierw do bufora @p pending. Wątek, który jako pierwszy
+ * czeka na utrwalenie swojego zapisu, zapisuje cały bufor (także zapisy
+ * innych wątków) i wykonuje jedno fsync (grupowe zatwierdzanie). W trybie
+ * odroczonym operacje nie czekają na utrwalenie, wiec jedno fsync obejmuje
+ * wiele operacji także jednego wątku.
+ *
+ * Operacja jest wykonywana w pamięci przed utrwaleniem zapisu i nie jest
+ * wycofywana, gdy utrwalenie sie nie uda (w trybie odroczonym błąd może
+ * wystąpić dopiero przy późniejszym utrwalaniu). Po błędzie zapisu dziennik
+ * jest uszkodzony (@ref phfwdJournalFailed): struktura może zawierać
+ * nieutrwalone operacje, a kolejne operacje są odrzucane bez wykonania,
+ * aż @ref phfwdJournalCheckpoint utrwali stan struktury w zrzucie.
+ */
+struct PhoneForwardJournal {
+    PhoneForward *pf;  ///<struktura, której operacje sa zapisywane.
+    int fd;  ///<deskryptor pliku dziennika.
+    pthread_mutex_t mutex;  ///<chroni dziennik i strukturę @p pf.
+    pthread_cond_t flushed;  ///<sygnalizuje koniec zapisu grupy.
+    ByteBuffer pending;  ///<zapisy czekające na zapis do pliku.
+    ByteBuffer writing;  ///<zapisy zapisywane właśnie do pliku.
+    uint64_t appended;  ///<numer ostatniego zapisu dodanego do bufora.
+    uint64_t durable;  ///<numer ostatniego utrwalonego zapisu.
+    bool flushing;  ///<czy któryś wątek zapisuje właśnie grupę.
+    bool deferred;  ///<czy operacje nie czekają na utrwalenie (patrz @ref phfwdJournalSetDeferred).
+    bool failed;  ///<czy wystąpił błąd zapisu (dziennik jest wtedy nieużywalny).
+};
+/**
+ * @brief To jest typ PhoneForwardJournal.
+ *
+ */
+typedef struct PhoneForwardJournal PhoneForwardJournal;
+
+
+/** @brief Wykonuje na strukturze operacje zapisane w pliku.
+ * Czyta plik od bieżącej pozycji do końca. Niepełny ostatni zapis (np. po
+ * awarii w trakcie zapisu) jest pomijany.
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] fd     - deskryptor pliku dziennika.
+ * @return Wartość @p true, jeśli wykonano wszystkie pełne zapisy.
+ *         Wartość @p false, jeśli @p pf ma wartość NULL, odczyt się nie udał
+ *         lub nie udało sie alokować pamięci.
+ */
+bool phfwdJournalReplay(PhoneForward *pf, int fd);
+
+
+/** @brief Otwiera dziennik struktury @p pf.
+ * Najpierw odtwarza w @p pf operacje zapisane w pliku, obcina niepełny
+ * ostatni zapis i ustawia pozycję na koniec pliku. Dziennik nie przejmuje
+ * na własność ani struktury @p pf, ani deskryptora @p fd.
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] fd     - deskryptor pliku dziennika otwartego do odczytu i zapisu.
+ * @return Wskaźnik na utworzona strukturę lub NULL, gdy @p pf ma wartość NULL,
+ *         operacja na pliku się nie udała lub nie udało sie alokować pamięci.
+ */
+PhoneForwardJournal *phfwdJournalNew(PhoneForward *pf, int fd);
+
+
+/** @brief Zamyka dziennik.
+ * Zapisuje i utrwala zapisy z bufora. Nic nie robi, jeśli wskaźnik
+ * @p journal ma wartość NULL.
+ * @param[in] journal - wskaźnik na usuwana strukturę.
+ */
+void phfwdJournalDelete(PhoneForwardJournal *journal);
+
+
+/** @brief Włącza lub wyłącza tryb odroczony dziennika.
+ * W trybie odroczonym @ref phfwdJournalAdd i @ref phfwdJournalRemove nie
+ * czekają na utrwalenie swoich zapisów, chyba że bufor zapisów osiągnął
+ * rozmiar @ref JOURNAL_COMMIT_BYTES. Zapisy sa utrwalane przez
+ * @ref phfwdJournalSync, przy wyłączeniu trybu odroczonego i przy zamknięciu
+ * dziennika; po awarii mogą zostać utracone tylko zapisy nieutrwalone.
+ * Domyślnie tryb odroczony jest wyłączony.
+ * @param[in,out] journal - wskaźnik na dziennik;
+ * @param[in] deferred    - czy włączyć tryb odroczony.
+ * @return Wartość @p false, jeśli @p journal ma wartość NULL lub przy
+ *         wyłączaniu trybu nie udało sie utrwalić zapisów.
+ */
+bool phfwdJournalSetDeferred(PhoneForwardJournal *journal, bool deferred);
+
+
+/** @brief Czeka na utrwalenie wszystkich dotychczasowych zapisów.
+ * Funkcja może być wywoływana jednocześnie z wielu wątków.
+ * @param[in,out] journal - wskaźnik na dziennik.
+ * @return Wartość @p false, jeśli @p journal ma wartość NULL lub nie udało
+ *         sie utrwalić zapisów.
+ */
+bool phfwdJournalSync(PhoneForwardJournal *journal);
+
+
+/** @brief Dodaje przekierowanie i zapisuje je w dzienniku.
+ * Działa jak @ref phfwdAdd, a następnie czeka na utrwalenie zapisu (w trybie
+ * odroczonym - patrz @ref phfwdJournalSetDeferred). Funkcja
+ * może być wywoływana jednocześnie z wielu wątków.
+ * @param[in,out] journal - wskaźnik na dziennik;
+ * @param[in] num1 - wskaźnik na napis reprezentujący prefiks numerów
+ *                   przekierowywanych;
+ * @param[in] num2 - wskaźnik na napis reprezentujący prefiks numerów,
+ *                   na które jest wykonywane przekierowanie.
+ * @return Wartość @p true, jeśli przekierowanie zostało dodane i utrwalone
+ *         (w trybie odroczonym: zapisane w buforze dziennika).
+ *         Wartość @p false, jeśli przekierowanie nie zostało dodane (jak
+ *         w @ref phfwdAdd), dziennik był już uszkodzony lub nie udało się
+ *         utrwalić zapisu. W ostatnim przypadku przekierowanie pozostaje
+ *         dodane w pamięci, ale nie jest trwałe, a @ref phfwdJournalFailed
+ *         zwraca @p true.
+ */
+bool phfwdJournalAdd(PhoneForwardJournal *journal, char const *num1, char const *num2);
+
+
+/** @brief Usuwa przekierowania i zapisuje to w dzienniku.
+ * Działa jak @ref phfwdRemove, a następnie czeka na utrwalenie zapisu (w trybie
+ * odroczonym - patrz @ref phfwdJournalSetDeferred).
+ * Funkcja może być wywoływana jednocześnie z wielu wątków.
+ * @param[in,out] journal - wskaźnik na dziennik;
+ * @param[in] num - wskaźnik na napis reprezentujący prefiks numerów.
+ * @return Wartość @p true, jeśli operacja została utrwalona (w trybie
+ *         odroczonym: zapisana w buforze dziennika).
+ *         Wartość @p false, jeśli napis nie reprezentuje numeru, nie udało
+ *         sie alokować pamięci, dziennik był już uszkodzony lub nie udało się
+ *         utrwalić zapisu. W ostatnim przypadku przekierowania pozostają
+ *         usunięte w pamięci, ale nie jest to trwałe, a
+ *         @ref phfwdJournalFailed zwraca @p true.
+ */
+bool phfwdJournalRemove(PhoneForwardJournal *journal, char const *num);
+
+
+/** @brief Sprawdza, czy dziennik jest uszkodzony.
+ * Dziennik jest uszkodzony od pierwszego nieudanego zapisu do pliku do
+ * udanego @ref phfwdJournalCheckpoint. W tym czasie struktura może zawierać
+ * operacje, które nie zostały utrwalone, a @ref phfwdJournalAdd
+ * i @ref phfwdJournalRemove niczego nie zmieniają.
+ * @param[in] journal - wskaźnik na dziennik.
+ * @return Wartość @p true, jeśli dziennik jest uszkodzony.
+ *         Wartość @p false, jeśli nie jest lub @p journal ma wartość NULL.
+ */
+bool phfwdJournalFailed(PhoneForwardJournal *journal);
+
+
+/** @brief Zapisuje zrzut struktury i czyści dziennik.
+ * Zapisuje do @p snapshotFd zrzut struktury (przez @ref phfwdSave), utrwala
+ * go i dopiero wtedy obcina plik dziennika. Po awarii wystarczy wczytać zrzut
+ * (przez @ref phfwdLoad), a potem otworzyć dla niego dziennik. Udany zrzut
+ * uszkodzonego dziennika utrwala także operacje wykonane tylko w pamięci
+ * i przywraca dziennik do użytku.
+ * @param[in,out] journal - wskaźnik na dziennik;
+ * @param[in] snapshotFd  - deskryptor pustego pliku zrzutu.
+ * @return Wartość @p true, jeśli zrzut został utrwalony, a dziennik obcięty.
+ *         Wartość @p false, jeśli operacja na pliku się nie udała lub
+ *         nie udało sie alokować pamięci.
+ */
+bool phfwdJournalCheckpoint(PhoneForwardJournal *journal, int snapshotFd);
+
+
+#endif //PHONE_JOURNAL_H
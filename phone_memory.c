@@ -0,0 +1,265 @@
+/** @file
+ * Implementacja rozliczania pamięci zajmowanej przez struktury przekierowań.
+ * Rozliczane bloki sa przechowywane w tablicy z haszowaniem otwartym
+ * (adres bloku, rozmiar i rodzaj), alokowanej przez mmap.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#define _DEFAULT_SOURCE
+#include "phone_memory.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define MEMORY_EMPTY 0 ///<Klucz wolnego miejsca tablicy bloków.
+#define MEMORY_DELETED 1 ///<Klucz miejsca po usuniętym bloku.
+#define MEMORY_INITIAL_CAPACITY 4096 ///<Początkowy rozmiar tablicy bloków.
+
+
+
+/**
+ * @brief Rozliczany blok pamięci.
+ */
+struct MemoryBlock {
+    uintptr_t address;  ///<adres bloku (lub MEMORY_EMPTY, MEMORY_DELETED).
+    size_t size;  ///<rozmiar bloku w bajtach.
+    enum MemoryCategory category;  ///<rodzaj bloku.
+};
+
+
+/**
+ * @brief Stan rozliczania pamięci.
+ */
+struct MemoryAccounting {
+    pthread_mutex_t mutex;  ///<chroni wszystkie pozostałe pola.
+    struct MemoryBlock *blocks;  ///<tablica bloków (rozmiar jest potęgą dwójki).
+    size_t capacity;  ///<rozmiar tablicy bloków.
+    size_t used;  ///<liczba zajętych miejsc (także po usuniętych blokach).
+    size_t live;  ///<liczba rozliczanych bloków.
+    PhoneForwardMemory memory;  ///<liczniki.
+};
+
+
+_Thread_local volatile enum MemoryCategory memoryCategory = MEMORY_OTHER;
+
+/** @brief Czy rozliczanie trwa (sprawdzane bez blokowania muteksu). */
+static atomic_bool active = false;
+
+/** @brief Stan rozliczania. */
+static struct MemoryAccounting accounting = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+
+/**
+ * @brief Alokuje wyzerowaną tablicę bloków.
+ * @param capacity - rozmiar tablicy.
+ * @return Wskaźnik na tablicę lub NULL, gdy nie udało sie alokować pamięci.
+ */
+static struct MemoryBlock *mapBlocks(size_t capacity) {
+    void *blocks = mmap(NULL, sizeof(struct MemoryBlock) * capacity, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return blocks == MAP_FAILED ? NULL : blocks;
+}
+
+
+/**
+ * @brief Wyznacza pierwsze miejsce tablicy dla adresu.
+ * @param address - adres bloku.
+ * @return indeks miejsca.
+ */
+static size_t firstSlot(uintptr_t address) {
+    // Adresy bloków sa wyrównane, wiec najniższe bity odrzucam.
+    return (size_t) (((uint64_t) (address >> 4) * 0x9E3779B97F4A7C15u) >> 17)
+           & (accounting.capacity - 1);
+}
+
+
+/**
+ * @brief Szuka miejsca bloku o danym adresie.
+ * @param address - adres bloku.
+ * @return indeks miejsca bloku lub @p accounting.capacity, jeśli blok nie
+ *         jest rozliczany.
+ */
+static size_t findBlock(uintptr_t address) {
+    for (size_t i = firstSlot(address);; i = (i + 1) & (accounting.capacity - 1)) {
+        if (accounting.blocks[i].address == address) {
+            return i;
+        }
+        if (accounting.blocks[i].address == MEMORY_EMPTY) {
+            return accounting.capacity;
+        }
+    }
+}
+
+
+/**
+ * @brief Wstawia blok do tablicy, w której jest wolne miejsce.
+ * @param block - wstawiany blok.
+ */
+static void insertBlock(struct MemoryBlock block) {
+    size_t i = firstSlot(block.address);
+    while (accounting.blocks[i].address > MEMORY_DELETED) {
+        i = (i + 1) & (accounting.capacity - 1);
+    }
+    accounting.used += accounting.blocks[i].address == MEMORY_EMPTY;
+    accounting.blocks[i] = block;
+    accounting.live++;
+}
+
+
+/**
+ * @brief Zapewnia miejsce na kolejny blok.
+ * Tablica zapełniona w połowie jest przepisywana (z pominięciem usuniętych
+ * bloków) do tablicy dwa razy większej albo, jeśli to usunięte bloki
+ * zajmują większość miejsc, do tablicy tego samego rozmiaru.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool reserveBlock(void) {
+    if (2 * (accounting.used + 1) <= accounting.capacity) {
+        return true;
+    }
+    size_t capacity = 4 * (accounting.live + 1) > accounting.capacity
+                      ? 2 * accounting.capacity : accounting.capacity;
+    struct MemoryBlock *blocks = mapBlocks(capacity);
+    if (blocks == NULL) {
+        return false;
+    }
+    struct MemoryBlock *old = accounting.blocks;
+    size_t oldCapacity = accounting.capacity;
+    accounting.blocks = blocks;
+    accounting.capacity = capacity;
+    accounting.used = 0;
+    accounting.live = 0;
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (old[i].address > MEMORY_DELETED) {
+            insertBlock(old[i]);
+        }
+    }
+    munmap(old, sizeof(struct MemoryBlock) * oldCapacity);
+    return true;
+}
+
+
+/**
+ * @brief Usuwa blok z tablicy i liczników.
+ * @param i - indeks miejsca bloku.
+ */
+static void removeBlock(size_t i) {
+    struct MemoryBlock *block = &accounting.blocks[i];
+    accounting.memory.bytes[block->category] -= block->size;
+    accounting.memory.blocks[block->category]--;
+    accounting.memory.totalBytes -= block->size;
+    block->address = MEMORY_DELETED;
+    accounting.live--;
+}
+
+
+bool phfwdMemoryStart(void) {
+    pthread_mutex_lock(&accounting.mutex);
+    bool ok = !atomic_load(&active);
+    if (ok) {
+        accounting.blocks = mapBlocks(MEMORY_INITIAL_CAPACITY);
+        ok = accounting.blocks != NULL;
+    }
+    if (ok) {
+        accounting.capacity = MEMORY_INITIAL_CAPACITY;
+        accounting.used = 0;
+        accounting.live = 0;
+        memset(&accounting.memory, 0, sizeof(PhoneForwardMemory));
+        atomic_store(&active, true);
+    }
+    pthread_mutex_unlock(&accounting.mutex);
+    return ok;
+}
+
+
+void phfwdMemoryStop(void) {
+    pthread_mutex_lock(&accounting.mutex);
+    if (atomic_load(&active)) {
+        atomic_store(&active, false);
+        munmap(accounting.blocks, sizeof(struct MemoryBlock) * accounting.capacity);
+        accounting.blocks = NULL;
+        accounting.capacity = 0;
+    }
+    pthread_mutex_unlock(&accounting.mutex);
+}
+
+
+bool phfwdMemory(PhoneForwardMemory *memory) {
+    if (memory == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&accounting.mutex);
+    bool ok = atomic_load(&active);
+    if (ok) {
+        *memory = accounting.memory;
+    }
+    pthread_mutex_unlock(&accounting.mutex);
+    return ok;
+}
+
+
+void phfwdMemoryResetPeaks(void) {
+    pthread_mutex_lock(&accounting.mutex);
+    for (int i = 0; i < MEMORY_CATEGORIES; i++) {
+        accounting.memory.peakBytes[i] = accounting.memory.bytes[i];
+    }
+    accounting.memory.peakTotalBytes = accounting.memory.totalBytes;
+    pthread_mutex_unlock(&accounting.mutex);
+}
+
+
+void memoryAllocated(void const *old, void const *ptr, size_t size) {
+    if (!atomic_load_explicit(&active, memory_order_relaxed)) {
+        return;
+    }
+    enum MemoryCategory category = memoryCategory;
+    pthread_mutex_lock(&accounting.mutex);
+    if (atomic_load(&active)) {
+        if (old != NULL) {
+            size_t i = findBlock((uintptr_t) old);
+            if (i < accounting.capacity) {
+                if (category == MEMORY_OTHER) {
+                    category = accounting.blocks[i].category;
+                }
+                removeBlock(i);
+            }
+        }
+        // Blok, którego nie da sie zapamiętać, pozostaje nierozliczony.
+        if (reserveBlock()) {
+            insertBlock((struct MemoryBlock) {(uintptr_t) ptr, size, category});
+            PhoneForwardMemory *memory = &accounting.memory;
+            memory->bytes[category] += size;
+            memory->blocks[category]++;
+            memory->allocations[category]++;
+            memory->totalBytes += size;
+            if (memory->bytes[category] > memory->peakBytes[category]) {
+                memory->peakBytes[category] = memory->bytes[category];
+            }
+            if (memory->totalBytes > memory->peakTotalBytes) {
+                memory->peakTotalBytes = memory->totalBytes;
+            }
+        }
+    }
+    pthread_mutex_unlock(&accounting.mutex);
+}
+
+
+void memoryFreed(void const *ptr) {
+    if (ptr == NULL || !atomic_load_explicit(&active, memory_order_relaxed)) {
+        return;
+    }
+    pthread_mutex_lock(&accounting.mutex);
+    if (atomic_load(&active)) {
+        size_t i = findBlock((uintptr_t) ptr);
+        if (i < accounting.capacity) {
+            removeBlock(i);
+        }
+    }
+    pthread_mutex_unlock(&accounting.mutex);
+}
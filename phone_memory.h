@@ -0,0 +1,122 @@
+/** @file
+ * Interfejs rozliczania pamięci zajmowanej przez struktury przekierowań
+ * z podziałem na rodzaje bloków.
+ * Funkcje biblioteki oznaczają swoje alokacje rodzajem bloku (makra
+ * MEMORY_ENTER i MEMORY_LEAVE). Rozliczanie prowadzą funkcje przechwytujące
+ * malloc, realloc i free (opcje linkera -Wl,--wrap=...), które wywołują
+ * @ref memoryAllocated i @ref memoryFreed; bez nich liczniki pozostają zerowe.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_MEMORY_H
+#define PHONE_MEMORY_H
+#include <stdbool.h>
+#include <stddef.h>
+
+
+
+/**
+ * @brief Rodzaje rozliczanych bloków pamięci.
+ */
+enum MemoryCategory {
+    MEMORY_OTHER,  ///<pozostałe bloki (m.in. bufory pomocnicze).
+    MEMORY_FORWARD_NODES,  ///<wierzchołki drzewa przekierowań (także bloki wczytanych zrzutów).
+    MEMORY_REVERSE_NODES,  ///<wierzchołki drzewa odwróconego.
+    MEMORY_FORWARDINGS,  ///<napisy przekierowań.
+    MEMORY_REVERSE_LISTS,  ///<listy numerów w drzewie odwróconym.
+    MEMORY_RESULTS,  ///<wyniki zapytań (PhoneNumbers).
+    MEMORY_CATEGORIES  ///<liczba rodzajów bloków.
+};
+
+
+/**
+ * @brief Stan pamięci z podziałem na rodzaje bloków.
+ */
+struct PhoneForwardMemory {
+    size_t bytes[MEMORY_CATEGORIES];  ///<bajty w zaalokowanych blokach.
+    size_t blocks[MEMORY_CATEGORIES];  ///<liczba zaalokowanych bloków.
+    size_t allocations[MEMORY_CATEGORIES];  ///<liczba udanych alokacji od rozpoczęcia.
+    size_t peakBytes[MEMORY_CATEGORIES];  ///<największa wartość bytes.
+    size_t totalBytes;  ///<suma bytes.
+    size_t peakTotalBytes;  ///<największa wartość totalBytes.
+};
+/**
+ * @brief To jest typ PhoneForwardMemory.
+ *
+ */
+typedef struct PhoneForwardMemory PhoneForwardMemory;
+
+
+/**
+ * @brief Rodzaj bloków alokowanych w bieżącym wątku.
+ * Zmienna jest ulotna, bo kompilator zakłada, że malloc nie czyta zmiennych
+ * programu, i mógłby pominąć jej ustawienie przed alokacją.
+ */
+extern _Thread_local volatile enum MemoryCategory memoryCategory;
+
+/**
+ * @brief Oznacza kolejne alokacje wątku rodzajem @p category.
+ * Deklaruje zmienną memoryPrevious, więc może wystąpić raz w bloku.
+ */
+#define MEMORY_ENTER(category) \
+    enum MemoryCategory memoryPrevious = memoryCategory; \
+    memoryCategory = (category)
+
+/**
+ * @brief Przywraca rodzaj alokacji sprzed @ref MEMORY_ENTER.
+ */
+#define MEMORY_LEAVE() (memoryCategory = memoryPrevious)
+
+
+/** @brief Rozpoczyna rozliczanie pamięci.
+ * Liczniki sa zerowane; bloki zaalokowane wcześniej nie sa rozliczane.
+ * Tablica bloków jest alokowana przez mmap, a nie przez malloc, więc
+ * rozliczanie nie wpływa na przechwytywane alokacje.
+ * @return Wartość @p false, jeśli rozliczanie już trwa lub nie udało sie
+ *         alokować pamięci.
+ */
+bool phfwdMemoryStart(void);
+
+
+/** @brief Kończy rozliczanie pamięci i zwalnia tablicę bloków.
+ */
+void phfwdMemoryStop(void);
+
+
+/** @brief Odczytuje stan pamięci.
+ * @param[out] memory - wskaźnik na wypełniany stan.
+ * @return Wartość @p false, jeśli @p memory ma wartość NULL lub rozliczanie
+ *         nie trwa.
+ */
+bool phfwdMemory(PhoneForwardMemory *memory);
+
+
+/** @brief Ustawia największe wartości na bieżące.
+ * Pozwala zmierzyć szczyt zużycia pamięci przez wybrany fragment programu.
+ */
+void phfwdMemoryResetPeaks(void);
+
+
+/** @brief Rozlicza udaną alokację.
+ * Wywoływana przez funkcje przechwytujące alokacje. Przy realokacji blok
+ * @p old jest zastępowany blokiem @p ptr i zachowuje swój rodzaj, chyba że
+ * bieżący wątek oznacza alokacje innym rodzajem niż @ref MEMORY_OTHER.
+ * @param[in] old  - realokowany blok lub NULL;
+ * @param[in] ptr  - zaalokowany blok;
+ * @param[in] size - rozmiar bloku w bajtach.
+ */
+void memoryAllocated(void const *old, void const *ptr, size_t size);
+
+
+/** @brief Rozlicza zwolnienie bloku.
+ * Wywoływana przez funkcję przechwytującą free. Bloki nierozliczane sa
+ * pomijane.
+ * @param[in] ptr - zwalniany blok (może byc NULL).
+ */
+void memoryFreed(void const *ptr);
+
+
+#endif //PHONE_MEMORY_H
@@ -0,0 +1,230 @@
+/** @file
+ * Program odtwarzający ślad wywołań zapisany przez @ref phfwdTraceStart.
+ * Wywołania sa wykonywane jedno po drugim, bez przerw, na pustej strukturze
+ * albo na strukturze wczytanej ze zrzutu (@ref phfwdLoad), dzięki czemu ten
+ * sam ślad daje za każdym razem to samo obciążenie. Wyniki (przepustowość
+ * i histogram czasów dla każdego rodzaju operacji) sa wypisywane na
+ * standardowe wyjście jako obiekty JSON, po jednym w wierszu.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "phone_forward.h"
+#include "phone_snapshot.h"
+#include "phone_trace.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HISTOGRAM_BUCKETS 64 ///<Liczba przedziałów histogramu (potęgi dwójki nanosekund).
+
+
+
+/** @brief Nazwy rodzajów operacji w wynikach. */
+static char const *const operationNames[OPERATIONS_COUNT] = {
+        "get", "reverse", "get_reverse", "add", "remove"
+};
+
+
+/**
+ * @brief Czasy wykonania operacji jednego rodzaju.
+ * Przedział @p i histogramu zlicza operacje trwające od 2^i do 2^(i+1)-1
+ * nanosekund (przedział 0 także operacje trwające 0 ns).
+ */
+struct ReplayLatencies {
+    uint64_t count;  ///<liczba operacji.
+    uint64_t failed;  ///<liczba operacji, którym zabrakło pamięci.
+    uint64_t totalNs;  ///<łączny czas operacji.
+    uint64_t maxNs;  ///<najdłuższy czas operacji.
+    uint64_t histogram[HISTOGRAM_BUCKETS];  ///<liczby operacji w przedziałach.
+};
+
+
+/**
+ * @brief Stan odtwarzania.
+ */
+struct Replay {
+    PhoneForward *pf;  ///<struktura, na której sa wykonywane wywołania.
+    struct ReplayLatencies latencies[OPERATIONS_COUNT];  ///<czasy operacji każdego rodzaju.
+};
+
+
+/**
+ * @brief Zwraca bieżący czas w nanosekundach.
+ * @return czas zegara monotonicznego.
+ */
+static uint64_t now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000u + (uint64_t) time.tv_nsec;
+}
+
+
+/**
+ * @brief Wyznacza przedział histogramu dla czasu operacji.
+ * @param ns - czas operacji w nanosekundach.
+ * @return numer przedziału.
+ */
+static unsigned bucket(uint64_t ns) {
+    unsigned result = 0;
+    while (ns > 1) {
+        ns >>= 1;
+        result++;
+    }
+    return result;
+}
+
+
+/**
+ * @brief Wykonuje i mierzy jedno wywołanie odczytane ze śladu.
+ * Wynik zapytania jest zwalniany poza mierzonym czasem.
+ * @param data - wskaźnik na stan odtwarzania.
+ * @param operation - rodzaj wywołania.
+ * @param num1 - pierwszy argument.
+ * @param num2 - drugi argument.
+ * @return Wartość @p true (odtwarzanie jest kontynuowane).
+ */
+static bool replayCall(void *data, PhoneForwardOperation operation, char const *num1, char const *num2) {
+    struct Replay *replay = data;
+    PhoneNumbers *result = NULL;
+    bool ok = true;
+    uint64_t start = now();
+    switch (operation) {
+        case OPERATION_GET:
+            ok = (result = phfwdGet(replay->pf, num1)) != NULL;
+            break;
+        case OPERATION_REVERSE:
+            ok = (result = phfwdReverse(replay->pf, num1)) != NULL;
+            break;
+        case OPERATION_GET_REVERSE:
+            ok = (result = phfwdGetReverse(replay->pf, num1)) != NULL;
+            break;
+        case OPERATION_ADD:
+            // Niepowodzenie dodania niepoprawnych numerów jest częścią śladu.
+            ok = phfwdAdd(replay->pf, num1, num2) || !isStringAPhoneNumber(num1)
+                 || !isStringAPhoneNumber(num2);
+            break;
+        default:
+            phfwdRemove(replay->pf, num1);
+            break;
+    }
+    uint64_t ns = now() - start;
+    phnumDelete(result);
+
+    struct ReplayLatencies *latencies = &replay->latencies[operation];
+    latencies->count++;
+    latencies->failed += !ok;
+    latencies->totalNs += ns;
+    if (ns > latencies->maxNs) {
+        latencies->maxNs = ns;
+    }
+    latencies->histogram[bucket(ns)]++;
+    return true;
+}
+
+
+/**
+ * @brief Wypisuje wyniki odtwarzania.
+ * @param replay - wskaźnik na stan odtwarzania.
+ * @param elapsedNs - czas całego odtwarzania.
+ */
+static void report(struct Replay const *replay, uint64_t elapsedNs) {
+    uint64_t calls = 0;
+    for (int i = 0; i < OPERATIONS_COUNT; i++) {
+        struct ReplayLatencies const *latencies = &replay->latencies[i];
+        if (latencies->count == 0) {
+            continue;
+        }
+        calls += latencies->count;
+        printf("{\"op\":\"%s\",\"count\":%" PRIu64 ",\"failed\":%" PRIu64 ",\"ops_per_sec\":%.0f,"
+               "\"max_ns\":%" PRIu64 ",\"histogram_ns\":[",
+               operationNames[i], latencies->count, latencies->failed,
+               latencies->totalNs > 0 ? (double) latencies->count * 1e9 / (double) latencies->totalNs : 0.0,
+               latencies->maxNs);
+        bool first = true;
+        for (int j = 0; j < HISTOGRAM_BUCKETS; j++) {
+            if (latencies->histogram[j] > 0) {
+                // Para: górna granica przedziału (wyłącznie) i liczba operacji.
+                printf("%s[%" PRIu64 ",%" PRIu64 "]", first ? "" : ",",
+                       j + 1 < HISTOGRAM_BUCKETS ? (uint64_t) 1 << (j + 1) : UINT64_MAX,
+                       latencies->histogram[j]);
+                first = false;
+            }
+        }
+        printf("]}\n");
+    }
+    PhoneForwardStats stats;
+    phfwdStats(replay->pf, &stats);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("{\"calls\":%" PRIu64 ",\"elapsed_ns\":%" PRIu64 ",\"ops_per_sec\":%.0f,\"rules\":%zu,"
+           "\"forward_nodes\":%zu,\"peak_rss_kb\":%ld}\n",
+           calls, elapsedNs, elapsedNs > 0 ? (double) calls * 1e9 / (double) elapsedNs : 0.0,
+           stats.rules, stats.forwardNodes, usage.ru_maxrss);
+}
+
+
+/**
+ * @brief Tworzy strukturę, na której jest odtwarzany ślad.
+ * @param snapshot - ścieżka zrzutu lub NULL.
+ * @return Wskaźnik na strukturę lub NULL, gdy nie udało sie wczytać zrzutu
+ *         lub alokować pamięci.
+ */
+static PhoneForward *initial(char const *snapshot) {
+    if (snapshot == NULL) {
+        return phfwdNew();
+    }
+    int fd = open(snapshot, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    PhoneForward *pf = phfwdLoad(fd);
+    close(fd);
+    return pf;
+}
+
+
+/**
+ * @brief Odtwarza ślad podany w argumentach.
+ * @param argc - liczba argumentów.
+ * @param argv - argumenty: plik śladu i opcjonalnie plik zrzutu.
+ * @return 0, jeśli odtwarzanie sie udało, 1 - jeśli argumenty sa niepoprawne,
+ *         2 - jeśli nie udało sie wczytać plików lub zabrakło pamięci.
+ */
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s TRACE [SNAPSHOT]\n", argv[0]);
+        return 1;
+    }
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        perror(argv[1]);
+        return 2;
+    }
+    struct Replay replay = {0};
+    replay.pf = initial(argc == 3 ? argv[2] : NULL);
+    if (replay.pf == NULL) {
+        fprintf(stderr, "%s: cannot load snapshot\n", argv[0]);
+        close(fd);
+        return 2;
+    }
+    uint64_t start = now();
+    bool ok = phfwdTraceRead(fd, replayCall, &replay);
+    uint64_t elapsedNs = now() - start;
+    close(fd);
+    if (ok) {
+        report(&replay, elapsedNs);
+    } else {
+        fprintf(stderr, "%s: invalid trace\n", argv[0]);
+    }
+    phfwdDelete(replay.pf);
+    return ok ? 0 : 2;
+}
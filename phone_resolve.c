@@ -0,0 +1,362 @@
+/** @file
+ * Implementacja przechodniego rozwijania przekierowań numerów
+ * telefonicznych.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#include "phone_resolve.h"
+#include "list_of_numbers.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+/**
+ * @brief Krok rozwijania: zastosowane przekierowanie.
+ */
+struct ResolveStep {
+    PhoneForward const *rule;  ///<wierzchołek zastosowanego przekierowania.
+    size_t restLength;  ///<liczba cyfr numeru za prefiksem przekierowania.
+    bool independent;  ///<czy następny krok nie zależy od tych cyfr.
+};
+
+
+/**
+ * @brief Numer rozwijany przez phfwdResolve wraz z historia kroków.
+ */
+struct Resolution {
+    char *current;  ///<bieżący numer.
+    char *next;  ///<bufor na następny numer.
+    size_t capacity;  ///<rozmiar buforów current i next.
+    struct ResolveStep *steps;  ///<zastosowane przekierowania.
+    size_t hops;  ///<liczba zastosowanych przekierowań.
+    size_t stepsCapacity;  ///<rozmiar tablicy steps.
+};
+
+
+/**
+ * @brief Chroni pamięci rozwinięć przed jednoczesnym użyciem przez wiele
+ * wątków.
+ */
+static pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+void resolveCacheDelete(struct ResolveCache *cache) {
+    if (cache != NULL) {
+        for (size_t i = 0; i < cache->capacity; i++) {
+            free(cache->entries[i].tail);
+        }
+        free(cache->entries);
+        free(cache);
+    }
+}
+
+
+/**
+ * @brief Wyznacza miejsce przekierowania w tablicy rozwinięć.
+ * @param cache - wskaźnik na pamięć rozwinięć.
+ * @param rule - wierzchołek przekierowania.
+ * @return indeks miejsca z przekierowaniem lub pierwszego wolnego miejsca.
+ */
+static size_t findSlot(struct ResolveCache const *cache, PhoneForward const *rule) {
+    uint64_t hash = (uint64_t) (uintptr_t) rule * 0x9e3779b97f4a7c15ULL;
+    size_t mask = cache->capacity - 1;
+    size_t slot = (size_t) (hash >> 32) & mask;
+    while (cache->entries[slot].rule != NULL && cache->entries[slot].rule != rule) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+
+/**
+ * @brief Przygotowuje pamięć rozwinięć struktury.
+ * Tworzy ja przy pierwszym użyciu i czyści, jeśli jest nieaktualna.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @return wskaźnik na pamięć rozwinięć lub NULL, gdy nie udało sie alokować
+ *         pamięci (rozwijanie działa wtedy bez niej).
+ */
+static struct ResolveCache *prepareCache(PhoneForward *pf) {
+    struct ResolveCache *cache = phfwdRootOf(pf)->resolveCache;
+    if (cache == NULL) {
+        cache = malloc(sizeof(struct ResolveCache));
+        if (cache == NULL) {
+            return NULL;
+        }
+        cache->capacity = 64;
+        cache->entries = calloc(cache->capacity, sizeof(struct ResolveEntry));
+        if (cache->entries == NULL) {
+            free(cache);
+            return NULL;
+        }
+        cache->size = 0;
+        cache->stale = false;
+        phfwdRootOf(pf)->resolveCache = cache;
+    } else if (cache->stale) {
+        for (size_t i = 0; i < cache->capacity; i++) {
+            free(cache->entries[i].tail);
+            cache->entries[i].rule = NULL;
+            cache->entries[i].tail = NULL;
+        }
+        cache->size = 0;
+        cache->stale = false;
+    }
+    return cache;
+}
+
+
+/**
+ * @brief Zapamiętuje rozwinięcie przekierowania.
+ * Jeśli nie uda sie alokować pamięci, rozwinięcie nie jest zapamiętywane.
+ * @param cache - wskaźnik na pamięć rozwinięć.
+ * @param rule - wierzchołek przekierowania.
+ * @param tail - wskaźnik na prefiks wyniku.
+ * @param length - długość prefiksu wyniku.
+ * @param hops - liczba przekierowań w rozwinięciu.
+ */
+static void remember(struct ResolveCache *cache, PhoneForward const *rule, char const *tail,
+                     size_t length, size_t hops) {
+    if (2 * (cache->size + 1) > cache->capacity) {
+        struct ResolveCache bigger = {calloc(2 * cache->capacity, sizeof(struct ResolveEntry)), 0,
+                                      2 * cache->capacity, false};
+        if (bigger.entries == NULL) {
+            return;
+        }
+        for (size_t i = 0; i < cache->capacity; i++) {
+            if (cache->entries[i].rule != NULL) {
+                bigger.entries[findSlot(&bigger, cache->entries[i].rule)] = cache->entries[i];
+                bigger.size++;
+            }
+        }
+        free(cache->entries);
+        *cache = bigger;
+    }
+    size_t slot = findSlot(cache, rule);
+    if (cache->entries[slot].rule != NULL) {
+        return;
+    }
+    char *copy = malloc(sizeof(char) * (length + 1));
+    if (copy == NULL) {
+        return;
+    }
+    memcpy(copy, tail, sizeof(char) * length);
+    copy[length] = '\0';
+    cache->entries[slot].rule = rule;
+    cache->entries[slot].tail = copy;
+    cache->entries[slot].hops = hops;
+    cache->size++;
+}
+
+
+/**
+ * @brief Znajduje najdłuższy prefiks numeru, z którego jest przekierowanie.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @param num - wskaźnik na numer.
+ * @param qLength - długość prefiksu, który powstał z poprzedniego przekierowania.
+ * @param dependent - wskaźnik, pod który jest wpisywane, czy wierzchołek
+ *                    prefiksu długości @p qLength ma dzieci (wtedy wynik
+ *                    zależy od dalszych cyfr numeru).
+ * @param depth - wskaźnik na długość znalezionego prefiksu.
+ * @return wierzchołek przekierowania lub NULL, jeśli go nie ma.
+ */
+static PhoneForward const *findRule(PhoneForward const *pf, char const *num, size_t qLength,
+                                    bool *dependent, size_t *depth) {
+    PhoneForward const *rule = NULL;
+    *dependent = false;
+    for (size_t i = 0; num[i] != '\0'; i++) {
+        pf = pf->children[get_digit(num[i])];
+        if (pf == NULL) {
+            break;
+        }
+        if (pf->forwarding != NULL) {
+            rule = pf;
+            *depth = i + 1;
+        }
+        if (i + 1 == qLength) {
+            for (int j = 0; j < CHILDREN_NUMB && !*dependent; j++) {
+                *dependent = (pf->children[j] != NULL);
+            }
+        }
+    }
+    return rule;
+}
+
+
+/**
+ * @brief Zastępuje bieżący numer napisem @p prefix z dopisanymi cyframi
+ *        bieżącego numeru od pozycji @p from.
+ * @param res - wskaźnik na rozwijany numer.
+ * @param prefix - wskaźnik na prefiks nowego numeru.
+ * @param from - pozycja w bieżącym numerze.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool replacePrefix(struct Resolution *res, char const *prefix, size_t from) {
+    size_t prefixLength = strlen(prefix), restLength = strlen(res->current + from);
+    if (prefixLength + restLength + 1 > res->capacity) {
+        size_t capacity = 2 * (prefixLength + restLength + 1);
+        char *current = realloc(res->current, sizeof(char) * capacity);
+        if (current == NULL) {
+            return false;
+        }
+        res->current = current;
+        char *next = realloc(res->next, sizeof(char) * capacity);
+        if (next == NULL) {
+            return false;
+        }
+        res->next = next;
+        res->capacity = capacity;
+    }
+    memcpy(res->next, prefix, sizeof(char) * prefixLength);
+    memcpy(res->next + prefixLength, res->current + from, sizeof(char) * (restLength + 1));
+    char *swap = res->current;
+    res->current = res->next;
+    res->next = swap;
+    return true;
+}
+
+
+/**
+ * @brief Dopisuje krok do historii rozwijania.
+ * @param res - wskaźnik na rozwijany numer.
+ * @param rule - wierzchołek zastosowanego przekierowania.
+ * @param restLength - liczba cyfr numeru za prefiksem przekierowania.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool addStep(struct Resolution *res, PhoneForward const *rule, size_t restLength) {
+    if (res->hops == res->stepsCapacity) {
+        size_t capacity = res->stepsCapacity ? 2 * res->stepsCapacity : 8;
+        struct ResolveStep *steps = realloc(res->steps, sizeof(struct ResolveStep) * capacity);
+        if (steps == NULL) {
+            return false;
+        }
+        res->steps = steps;
+        res->stepsCapacity = capacity;
+    }
+    res->steps[res->hops].rule = rule;
+    res->steps[res->hops].restLength = restLength;
+    res->steps[res->hops].independent = false;
+    res->hops++;
+    return true;
+}
+
+
+/**
+ * @brief Rozwija numer; wynik zostawia w @p res->current.
+ * Cykle wykrywa algorytmem Brenta: porównuje bieżący numer z numerem
+ * zapamiętanym po 1, 2, 4, ... krokach.
+ * @param pf - wskaźnik na korzeń drzewa.
+ * @param cache - wskaźnik na pamięć rozwinięć (może byc NULL).
+ * @param res - wskaźnik na rozwijany numer.
+ * @param maxHops - największa liczba zastosowanych przekierowań.
+ * @param memoHops - wskaźnik na liczbę kroków wziętych z pamięci rozwinięć.
+ * @param resolved - wskaźnik, pod który jest wpisywane, czy numer rozwinięto.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool resolveChain(PhoneForward const *pf, struct ResolveCache const *cache,
+                         struct Resolution *res, size_t maxHops, size_t *memoHops, bool *resolved) {
+    char *checkpoint = malloc(sizeof(char) * (strlen(res->current) + 1));
+    if (checkpoint == NULL) {
+        return false;
+    }
+    strcpy(checkpoint, res->current);
+    size_t power = 1, lambda = 0, qLength = 0;
+    bool ok = true;
+    *resolved = false;
+    *memoHops = 0;
+
+    while (ok) {
+        bool dependent;
+        size_t depth = 0;
+        PhoneForward const *rule = findRule(pf, res->current, qLength, &dependent, &depth);
+        if (res->hops > 0) {
+            res->steps[res->hops - 1].independent = !dependent;
+        }
+        if (rule == NULL) {             // Numer sie już nie zmienia.
+            *resolved = true;
+            break;
+        }
+        if (cache != NULL && cache->size > 0) {
+            struct ResolveEntry const *entry = &cache->entries[findSlot(cache, rule)];
+            if (entry->rule != NULL && res->hops + entry->hops <= maxHops) {
+                ok = replacePrefix(res, entry->tail, depth);
+                *memoHops = entry->hops;
+                *resolved = ok;
+                break;
+            }
+        }
+        if (res->hops == maxHops) {
+            break;
+        }
+        ok = addStep(res, rule, strlen(res->current) - depth)
+             && replacePrefix(res, rule->forwarding, depth);
+        qLength = strlen(rule->forwarding);
+        if (ok && strcmp(res->current, checkpoint) == 0) {
+            break;                      // Cykl.
+        }
+        if (ok && ++lambda == power) {
+            char *copy = realloc(checkpoint, sizeof(char) * (strlen(res->current) + 1));
+            ok = (copy != NULL);
+            if (ok) {
+                checkpoint = copy;
+                strcpy(checkpoint, res->current);
+                power *= 2;
+                lambda = 0;
+            }
+        }
+    }
+    free(checkpoint);
+    return ok;
+}
+
+
+PhoneNumbers *phfwdResolve(PhoneForward const *pf, char const *num, size_t maxHops) {
+    if (pf == NULL) {
+        return NULL;
+    }
+    if (!isStringAPhoneNumber(num)) {
+        return phnumNew(NULL);
+    }
+    // Pamięć rozwinięć nie zmienia przekierowań, więc uaktualniam ja mimo const.
+    // Gdy używa jej inny wątek, rozwijam numer bez niej zamiast czekać.
+    bool locked = pthread_mutex_trylock(&cacheMutex) == 0;
+    struct ResolveCache *cache = locked ? prepareCache((PhoneForward *) pf) : NULL;
+    size_t length = strlen(num);
+    struct Resolution res = {malloc(sizeof(char) * (length + 1)), malloc(sizeof(char) * (length + 1)),
+                             length + 1, NULL, 0, 0};
+    size_t memoHops;
+    bool resolved = false;
+    bool ok = res.current != NULL && res.next != NULL;
+    if (ok) {
+        strcpy(res.current, num);
+        ok = resolveChain(pf, cache, &res, maxHops, &memoHops, &resolved);
+    }
+
+    if (ok && resolved && cache != NULL) {
+        // Kroki, po których wynik nie zależy od dalszych cyfr, rozwijają sie
+        // w prefiks wyniku niezależnie od pozostałej części numeru.
+        size_t resultLength = strlen(res.current);
+        for (size_t k = res.hops; k > 0 && res.steps[k - 1].independent; k--) {
+            struct ResolveStep const *step = &res.steps[k - 1];
+            remember(cache, step->rule, res.current, resultLength - step->restLength,
+                     res.hops - (k - 1) + memoHops);
+        }
+    }
+    if (locked) {
+        pthread_mutex_unlock(&cacheMutex);
+    }
+    List *numbers = NULL;
+    PhoneNumbers *pnum = NULL;
+    if (ok && (!resolved || insertToList(&numbers, res.current))) {
+        pnum = phnumNew(numbers);
+    }
+    listDelete(numbers);
+    free(res.current);
+    free(res.next);
+    free(res.steps);
+    return pnum;
+}
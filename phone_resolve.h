@@ -0,0 +1,70 @@
+/** @file
+ * Interfejs przechodniego rozwijania przekierowań numerów telefonicznych.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_RESOLVE_H
+#define PHONE_RESOLVE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "phone_forward.h"
+#include "phnum.h"
+
+
+
+/**
+ * @brief Zapamiętane rozwinięcie przekierowania.
+ * Każdy numer zaczynający sie prefiksem przekierowania @p rule rozwija sie
+ * (niezależnie od dalszych cyfr) w @p tail z dopisanymi tymi cyframi.
+ */
+struct ResolveEntry {
+    PhoneForward const *rule;  ///<wierzchołek przekierowania (NULL - wolne miejsce).
+    char *tail;  ///<prefiks wyniku rozwinięcia.
+    size_t hops;  ///<liczba przekierowań w rozwinięciu.
+};
+
+
+/**
+ * @brief Pamięć rozwinięć przekierowań (tablica z haszowaniem otwartym).
+ * Jest unieważniana przy każdej zmianie przekierowań.
+ */
+struct ResolveCache {
+    struct ResolveEntry *entries;  ///<tablica rozwinięć.
+    size_t size;  ///<liczba zajętych miejsc.
+    size_t capacity;  ///<rozmiar tablicy (potęga dwójki).
+    bool stale;  ///<czy zapamiętane rozwinięcia sa nieaktualne.
+};
+
+
+/** @brief Rozwija przekierowania numeru przechodnio.
+ * Stosuje @ref phfwdGet tak długo, aż numer przestanie sie zmieniać, ale
+ * bez tworzenia wyników pośrednich. Wykrywa cykle przekierowań (np. A -> B
+ * -> A). Zapamiętuje rozwinięcia przekierowań, których wynik nie zależy od
+ * dalszych cyfr numeru, więc kolejne rozwinięcia przez te przekierowania
+ * zajmują czas niezależny od długości łańcucha. Zapamiętane rozwinięcia sa
+ * unieważniane przy każdej zmianie przekierowań. Funkcja może być wywoływana
+ * jednocześnie z wielu wątków (także z innymi zapytaniami); z pamięci
+ * rozwinięć korzysta naraz jeden wątek, a pozostałe rozwijają numery bez niej.
+ * @param[in] pf      - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] num     - wskaźnik na napis reprezentujący numer;
+ * @param[in] maxHops - największa liczba zastosowanych przekierowań.
+ * @return Wskaźnik na strukturę przechowująca jeden numer - wynik rozwinięcia.
+ *         Jeśli napis nie reprezentuje numeru, przekierowania tworzą cykl
+ *         lub nie da sie ich rozwinąć w @p maxHops krokach, to wynikiem jest
+ *         pusty ciąg numerów. Zwraca NULL, gdy @p pf ma wartość NULL lub nie
+ *         udało sie alokować pamięci.
+ */
+PhoneNumbers *phfwdResolve(PhoneForward const *pf, char const *num, size_t maxHops);
+
+
+/** @brief Usuwa pamięć rozwinięć.
+ * Nic nie robi, jeśli wskaźnik @p cache ma wartość NULL.
+ * @param[in] cache - wskaźnik na usuwana strukturę.
+ */
+void resolveCacheDelete(struct ResolveCache *cache);
+
+
+#endif //PHONE_RESOLVE_H
@@ -10,7 +10,11 @@
 
 #include "phone_forward.h"
 #include "phone_reverse.h"
-#include "../../../../Pobrane/Telegram Desktop/duże/src/list_of_numbers.h"
+#include "list_of_numbers.h"
+#include "phone_counters.h"
+#include "phone_memory.h"
+#include "phone_engine.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
@@ -18,13 +22,22 @@
 
 
 PhoneReverse *phrevNew(void) {
+    MEMORY_ENTER(MEMORY_REVERSE_NODES);
     PhoneReverse *phrev = (PhoneReverse *) malloc(sizeof(PhoneReverse));
+    MEMORY_LEAVE();
     if (phrev != NULL) {
         for (int i = 0; i < CHILDREN_NUMB; i++) {
             phrev->children[i] = NULL;
         }
         phrev->parent = NULL;
         phrev->listOfFrwd = NULL;
+        phrev->count = 0;
+        phrev->stats = calloc(1, sizeof(struct PhoneReverseStats));
+        if (phrev->stats == NULL) {
+            free(phrev);
+            return NULL;
+        }
+        phrev->stats->nodes = 1;
     }
     return phrev;
 }
@@ -35,7 +48,10 @@ PhoneReverse *phrevNew(void) {
  * @return PhoneForward* nowy wierzchołek.
  */
 static PhoneReverse *newNodeReverse() {
+    COUNTERS_ADD(COUNTER_ALLOCATIONS, 1);
+    MEMORY_ENTER(MEMORY_REVERSE_NODES);
     PhoneReverse *node = (struct PhoneReverse *) malloc(sizeof(PhoneReverse));
+    MEMORY_LEAVE();
     if (node == NULL) {
         return node;
     }
@@ -43,10 +59,57 @@ static PhoneReverse *newNodeReverse() {
     for (int i = 0; i < CHILDREN_NUMB; i++) {
         node->children[i] = NULL;
     }
+    node->stats = NULL;
     return node;
 }
 
 
+/**
+ * @brief Wyznacza przedział histogramu długości list.
+ * @param length - długość listy (dodatnia).
+ * @return numer przedziału [2^i, 2^(i+1)) zawierającego @p length
+ *         (ostatni przedział obejmuje wszystkie dłuższe listy).
+ */
+static size_t lengthBucket(size_t length) {
+    size_t bucket = 0;
+    while (length > 1 && bucket < STATS_LENGTHS - 1) {
+        length >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+
+/**
+ * @brief Aktualizuje liczniki przekierowań w poddrzewach po zmianie listy.
+ * Poprawia liczniki wierzchołka i wszystkich jego przodków o zmianę
+ * długości listy przekierowań wierzchołka, a w korzeniu także statystyki
+ * drzewa.
+ * @param node - wskaźnik na wierzchołek, którego lista sie zmieniła.
+ * @param before - długość listy przed zmianą.
+ */
+static void updateCount(PhoneReverse *node, size_t before) {
+    size_t after = listSize(node->listOfFrwd);
+    PhoneReverse *root = node;
+    for (; node != NULL; node = node->parent) {
+        if (after >= before) {
+            node->count += after - before;
+        } else {
+            node->count -= before - after;
+        }
+        root = node;
+    }
+    if (before > 0) {
+        root->stats->lists--;
+        root->stats->lengths[lengthBucket(before)]--;
+    }
+    if (after > 0) {
+        root->stats->lists++;
+        root->stats->lengths[lengthBucket(after)]++;
+    }
+}
+
+
 bool phrevAdd(PhoneReverse *pfRev, char const *num1, char const *num2) {
     struct PhoneReverse *temp = pfRev;
     while (*num2) {
@@ -58,136 +121,694 @@ bool phrevAdd(PhoneReverse *pfRev, char const *num1, char const *num2) {
                 return false;
             }
             temp->children[code]->listOfFrwd = NULL;
+            temp->children[code]->count = 0;
             temp->children[code]->parent = temp;
+            pfRev->stats->nodes++;
         }
         // Przesuwam się do następnego węzła.
         temp = temp->children[code];
         //  Przesuwam się do następnej literki.
         num2++;
     }
-    pfRev = temp;
-    pfRev->listOfFrwd = insertToList(pfRev->listOfFrwd, num1);
-
+    size_t before = listSize(temp->listOfFrwd);
+    MEMORY_ENTER(MEMORY_REVERSE_LISTS);
+    bool inserted = insertToList(&temp->listOfFrwd, num1);
+    MEMORY_LEAVE();
+    if (!inserted) {
+        return false;
+    }
+    if (listSize(temp->listOfFrwd) > before) {
+        pfRev->stats->bytes += strlen(num1) + 1;
+    }
+    updateCount(temp, before);
     return true;
 }
 
 
-void phrevRemove(PhoneReverse *pfRev, const char *num1, const char *num2) {
-    if (pfRev != NULL) {
-        deleteFrwdFromList(getListOfForwardings(pfRev, num1), num2);
+PhoneReverse *phrevFind(PhoneReverse *pfRev, const char *num) {
+    PhoneReverse *curr = pfRev;
+    while (curr != NULL && *num != '\0') {
+        curr = curr->children[get_digit(*num)];
+        num++;
     }
+    return curr;
 }
 
 
-void phrevRemoveNumStartsWithPref(PhoneReverse *pfRev, const char *num1, const char *num2) {
-    if (pfRev != NULL) {
-        deleteFrwdStartsWthPref(getListOfForwardings(pfRev, num1), num2);
+void phrevRemove(PhoneReverse *pfRev, const char *num1, const char *num2) {
+    PhoneReverse *node = phrevFind(pfRev, num1);
+    if (node != NULL) {
+        size_t before = listSize(node->listOfFrwd);
+        pfRev->stats->bytes -= deleteFrwdFromList(&node->listOfFrwd, num2);
+        updateCount(node, before);
     }
 }
 
 
-PhoneNumbers *phfwdReverse(PhoneForward const *pf, char const *num) {
-    PhoneNumbers *pnum = (PhoneNumbers *) malloc(sizeof(PhoneNumbers));
+/**
+ * @brief Porównuje wskaźniki na wierzchołki drzewa odwróconego (dla qsort).
+ * @param a - wskaźnik na pierwszy wskaźnik.
+ * @param b - wskaźnik na drugi wskaźnik.
+ * @return liczba ujemna, zero lub dodatnia, jak w strcmp.
+ */
+static int compareNodes(void const *a, void const *b) {
+    uintptr_t first = (uintptr_t) *(PhoneReverse *const *) a;
+    uintptr_t second = (uintptr_t) *(PhoneReverse *const *) b;
+    return (first > second) - (first < second);
+}
 
-    if (pnum == NULL) {
-        return NULL;
+
+void phrevRemoveStartsWithPref(PhoneReverse *pfRev, PhoneReverse **nodes, size_t count,
+                               const char *prefix) {
+    qsort(nodes, count, sizeof(PhoneReverse *), compareNodes);
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && nodes[i] == nodes[i - 1]) {
+            continue;
+        }
+        size_t before = listSize(nodes[i]->listOfFrwd);
+        pfRev->stats->bytes -= deleteFrwdStartsWthPref(&nodes[i]->listOfFrwd, prefix);
+        updateCount(nodes[i], before);
     }
-    pnum->allNumbers = NULL;
+}
 
-    if (pf == NULL) {
-        free(pnum);
-        return NULL;
+
+/**
+ * @brief Zmienia histogram długości list drzewa o jedną listę.
+ * @param stats - wskaźnik na statystyki drzewa.
+ * @param length - długość listy (pusta lista nie jest liczona).
+ * @param added - czy lista jest dodawana (wpp. odejmowana).
+ */
+static void countList(struct PhoneReverseStats *stats, size_t length, bool added) {
+    if (length == 0) {
+        return;
     }
-    if (isStringAPhoneNumber(num) == false) {   // Podany napis nie reprezentuje numeru.
-        return pnum;
+    if (added) {
+        stats->lists++;
+        stats->lengths[lengthBucket(length)]++;
+    } else {
+        stats->lists--;
+        stats->lengths[lengthBucket(length)]--;
     }
+}
 
-    pnum->allNumbers = insertToList(pnum->allNumbers, num);   // Dodaje od razu num do ciągu wynikowego.
-    PhoneReverse *curr = pf->pfRev;
 
-    char *lastForward = NULL; // Ostatnie znalezione przekierowanie.
-    char *secondPart = NULL;
-    size_t length;
-    const char *lastSign = "\0";
-    while (*num != '\0') {
-        if (*num) {
-            curr = curr->children[get_digit(*num)];  // Ide do następnego wierzchołka
-        } else {
+/**
+ * @brief Scala listy odpowiadających sobie wierzchołków (patrz phrevMerge).
+ * @param dst - wierzchołek drzewa docelowego.
+ * @param src - wierzchołek drzewa źródłowego tego samego numeru.
+ * @param grafted - wskaźnik na statystyki przenoszonych poddrzew.
+ * @param duplicateBytes - wskaźnik na łączną długość powtórzonych numerów.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool mergeLists(PhoneReverse *dst, PhoneReverse *src, struct PhoneReverseStats *grafted,
+                       size_t *duplicateBytes) {
+    size_t dstBefore = listSize(dst->listOfFrwd);
+    size_t srcBefore = listSize(src->listOfFrwd);
+    size_t duplicates;
+    MEMORY_ENTER(MEMORY_REVERSE_LISTS);
+    bool ok = listMerge(&dst->listOfFrwd, &src->listOfFrwd, &duplicates);
+    MEMORY_LEAVE();
+    if (!ok) {
+        return false;
+    }
+    grafted->nodes--;
+    countList(grafted, srcBefore, false);
+    countList(grafted, dstBefore, false);
+    countList(grafted, listSize(dst->listOfFrwd), true);
+    *duplicateBytes += duplicates;
+    return true;
+}
+
+
+bool phrevMerge(PhoneReverse *dst, PhoneReverse *src) {
+    // Przenoszone poddrzewa to źródło bez części wspólnej, wiec ich
+    // statystyki wyznaczam bez przechodzenia ich.
+    struct PhoneReverseStats grafted = *src->stats;
+    size_t duplicateBytes = 0;
+    PhoneReverse *srcCurr = src, *curr = dst;
+    int next = 0;
+    bool ok = mergeLists(dst, src, &grafted, &duplicateBytes);
+    while (ok) {
+        while (next < CHILDREN_NUMB && srcCurr->children[next] == NULL) {
+            next++;
+        }
+        if (next < CHILDREN_NUMB && curr->children[next] == NULL) {
+            curr->children[next] = srcCurr->children[next];
+            curr->children[next]->parent = curr;
+            srcCurr->children[next] = NULL;
+            next++;
+            continue;
+        }
+        if (next < CHILDREN_NUMB) {
+            srcCurr = srcCurr->children[next];
+            curr = curr->children[next];
+            next = 0;
+            ok = mergeLists(curr, srcCurr, &grafted, &duplicateBytes);
+            continue;
+        }
+        // Liczniki wierzchołków części wspólnej wyznaczam po ich dzieciach.
+        curr->count = listSize(curr->listOfFrwd);
+        for (int i = 0; i < CHILDREN_NUMB; i++) {
+            curr->count += curr->children[i] != NULL ? curr->children[i]->count : 0;
+        }
+        if (srcCurr == src) {
             break;
         }
+        PhoneReverse *srcParent = srcCurr->parent;
+        for (next = 0; srcParent->children[next] != srcCurr; next++);
+        next++;
+        srcCurr = srcParent;
+        curr = curr->parent;
+    }
+    if (!ok) {
+        return false;
+    }
+    struct PhoneReverseStats *stats = dst->stats;
+    stats->nodes += grafted.nodes;
+    stats->lists += grafted.lists;
+    stats->bytes += src->stats->bytes - duplicateBytes;
+    for (size_t i = 0; i < STATS_LENGTHS; i++) {
+        stats->lengths[i] += grafted.lengths[i];
+    }
+    return true;
+}
+
+
+/**
+ * @brief Zbiera kandydatów do wyniku phfwdReverse.
+ * Kandydatami sa sam numer oraz numery y + num[d+1..] dla y z listy
+ * wierzchołka drzewa odwróconego odpowiadającego prefiksowi num[0..d].
+ * @param source - wskaźnik na opis przeszukiwanych drzew.
+ * @param num - wskaźnik na numer (poprawny).
+ * @param candidates - tablica kandydatów lub NULL (wtedy tylko liczy).
+ * @return liczba kandydatów.
+ */
+static size_t collectCandidates(ReverseSource const *source, char const *num,
+                                PhoneNumberParts *candidates) {
+    size_t numLength = strlen(num);
+    size_t count = 0;
+    if (candidates != NULL) {
+        candidates[count] = (PhoneNumberParts) {num, numLength, "", 0};
+    }
+    count++;
+    void const *curr = source->reverseRoot;
+    for (size_t depth = 0; depth < numLength; depth++) {
+        // Ide do następnego wierzchołka
+        curr = source->reverseChild(source->data, curr, get_digit(num[depth]));
         if (curr == NULL) break;
-        num++;              // Przesuwam się do innego znaku
-        length = strlen(num) + 1;
-        secondPart = realloc(secondPart, (sizeof(char) * length));
-        memcpy(secondPart, (char *) num, sizeof(char) * (length - 1));
-        memcpy(secondPart + length - 1, lastSign, sizeof(char));
-        List *currList = curr->listOfFrwd;
-
-        while (currList) {
-            createAForward(&currList->forwarding, &secondPart, &lastForward);
-            currList = currList->next;
-            if (lastForward != NULL) {
-                pnum->allNumbers = insertToList(pnum->allNumbers, lastForward);
-            }
+        size_t entries = source->entryCount(source->data, curr);
+        if (candidates == NULL) {
+            count += entries;
+            continue;
+        }
+        COUNTERS_ADD(COUNTER_NODES, 1);
+        COUNTERS_ADD(COUNTER_SCANNED, entries);
+        for (size_t i = 0; i < entries; i++) {
+            char const *prefix = source->entry(source->data, curr, i);
+            candidates[count++] = (PhoneNumberParts) {prefix, strlen(prefix), num + depth + 1,
+                                                      numLength - depth - 1};
         }
     }
-    if (secondPart) free(secondPart);
-    if (lastForward) free(lastForward);
+    return count;
+}
 
-    return pnum;
+
+/**
+ * @brief Porównuje leksykograficznie dwa numery złożone z części.
+ * @param a - wskaźnik na pierwszy numer (PhoneNumberParts).
+ * @param b - wskaźnik na drugi numer (PhoneNumberParts).
+ * @return int - liczba dodatnia/ujemna/zero w zależności od wyniku porównania
+ */
+static int compareCandidates(void const *a, void const *b) {
+    PhoneNumberParts const *x = a, *y = b;
+    COUNTERS_ADD(COUNTER_COMPARES, 1);
+    size_t xLength = x->firstLength + x->secondLength;
+    size_t yLength = y->firstLength + y->secondLength;
+    for (size_t i = 0; i < xLength && i < yLength; i++) {
+        char cx = i < x->firstLength ? x->first[i] : x->second[i - x->firstLength];
+        char cy = i < y->firstLength ? y->first[i] : y->second[i - y->firstLength];
+        if (cx != cy) {
+            return get_digit(cx) - get_digit(cy);
+        }
+    }
+    return (xLength > yLength) - (xLength < yLength);
 }
 
 
-PhoneNumbers *phfwdGetReverse(PhoneForward const *pf, char const *num) {
-    PhoneNumbers *pnum = (PhoneNumbers *) malloc(sizeof(PhoneNumbers));
-    if (pnum == NULL) return NULL;
-    pnum->allNumbers = NULL;
+/**
+ * @brief Sprawdza, czy phfwdGet przekierowuje numer first + second na num.
+ * Przechodzi drzewo przekierowań po znakach sklejenia napisów bez jego
+ * tworzenia i porównuje wynik najdłuższego pasującego przekierowania z @p num.
+ * @param source - wskaźnik na opis przeszukiwanych drzew.
+ * @param first - pierwsza część numeru.
+ * @param second - druga część numeru.
+ * @param num - oczekiwany wynik.
+ * @return Wartość @p true, jeśli wynikiem phfwdGet jest @p num.
+ */
+static bool forwardsTo(ReverseSource const *source, const char *first, const char *second,
+                       const char *num) {
+    size_t firstLength = strlen(first);
+    size_t length = firstLength + strlen(second);
+    void const *curr = source->forwardRoot;
+    char const *best = NULL;
+    size_t bestDepth = 0;
 
-    if (pf == NULL) {
-        free(pnum);
+    for (size_t i = 0; i < length; i++) {
+        char c = i < firstLength ? first[i] : second[i - firstLength];
+        curr = source->forwardChild(source->data, curr, get_digit(c));
+        if (curr == NULL) {
+            break;
+        }
+        COUNTERS_ADD(COUNTER_NODES, 1);
+        char const *forwarding = source->forwarding(source->data, curr);
+        if (forwarding != NULL) {
+            best = forwarding;
+            bestDepth = i + 1;
+        }
+    }
+    if (best != NULL) {
+        size_t prefixLength = strlen(best);
+        if (strncmp(best, num, prefixLength) != 0) {
+            return false;
+        }
+        num += prefixLength;
+    }
+    for (size_t i = bestDepth; i < length; i++, num++) {
+        char c = i < firstLength ? first[i] : second[i - firstLength];
+        if (*num != c) {
+            return false;
+        }
+    }
+    return *num == '\0';
+}
+
+
+PhoneNumbers *reverseNumbers(ReverseSource const *source, char const *num, bool onlyGet) {
+    // Kandydaci wskazują na napisy drzewa odwróconego i numer num, więc poza
+    // blokiem wyniku potrzebna jest tylko jedna tablica pomocnicza.
+    size_t count = collectCandidates(source, num, NULL);
+    COUNTERS_ADD(COUNTER_ALLOCATIONS, 1);
+    PhoneNumberParts *candidates = malloc(sizeof(PhoneNumberParts) * count);
+    if (candidates == NULL) {
         return NULL;
     }
+    collectCandidates(source, num, candidates);
+    qsort(candidates, count, sizeof(PhoneNumberParts), compareCandidates);
+
+    // Jednym przejściem usuwam powtórzenia, a dla phfwdGetReverse także
+    // numery, których phfwdGet nie przekierowuje na num.
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (kept > 0 && compareCandidates(&candidates[kept - 1], &candidates[i]) == 0) {
+            continue;
+        }
+        if (onlyGet) {
+            COUNTERS_ADD(COUNTER_SCANNED, 1);
+            if (!forwardsTo(source, candidates[i].first, candidates[i].second, num)) {
+                continue;
+            }
+        }
+        candidates[kept++] = candidates[i];
+    }
+    PhoneNumbers *pnum = phnumNewFromParts(candidates, kept);
+    free(candidates);
+    return pnum;
+}
+
+
+/**
+ * @brief Zwraca dziecko wierzchołka drzewa przekierowań struktury.
+ * @param data - nieużywany.
+ * @param node - wskaźnik na wierzchołek.
+ * @param digit - cyfra.
+ * @return wskaźnik na dziecko lub NULL.
+ */
+static void const *trieForwardChild(void const *data, void const *node, int digit) {
+    (void) data;
+    return ((PhoneForward const *) node)->children[digit];
+}
+
+
+/**
+ * @brief Zwraca przekierowanie wierzchołka drzewa przekierowań struktury.
+ * @param data - nieużywany.
+ * @param node - wskaźnik na wierzchołek.
+ * @return przekierowanie lub NULL.
+ */
+static char const *trieForwarding(void const *data, void const *node) {
+    (void) data;
+    return ((PhoneForward const *) node)->forwarding;
+}
+
+
+/**
+ * @brief Zwraca dziecko wierzchołka drzewa odwróconego struktury.
+ * @param data - nieużywany.
+ * @param node - wskaźnik na wierzchołek.
+ * @param digit - cyfra.
+ * @return wskaźnik na dziecko lub NULL.
+ */
+static void const *trieReverseChild(void const *data, void const *node, int digit) {
+    (void) data;
+    return ((PhoneReverse const *) node)->children[digit];
+}
+
+
+/**
+ * @brief Zwraca długość listy wierzchołka drzewa odwróconego struktury.
+ * @param data - nieużywany.
+ * @param node - wskaźnik na wierzchołek.
+ * @return długość listy.
+ */
+static size_t trieEntryCount(void const *data, void const *node) {
+    (void) data;
+    return listSize(((PhoneReverse const *) node)->listOfFrwd);
+}
+
+
+/**
+ * @brief Zwraca numer z listy wierzchołka drzewa odwróconego struktury.
+ * @param data - nieużywany.
+ * @param node - wskaźnik na wierzchołek.
+ * @param idx - indeks numeru.
+ * @return numer.
+ */
+static char const *trieEntry(void const *data, void const *node, size_t idx) {
+    (void) data;
+    return listGet(((PhoneReverse const *) node)->listOfFrwd, idx);
+}
+
+
+/**
+ * @brief Opisuje drzewa struktury dla funkcji wyznaczających przeciwobrazy.
+ * @param pf - wskaźnik na drzewo przekierowań (z aktualnym drzewem odwróconym).
+ * @return opis drzew.
+ */
+static ReverseSource trieSource(PhoneForward const *pf) {
+    ReverseSource source = {pf, pf, phfwdRootOf(pf)->pfRev, trieForwardChild, trieForwarding,
+                            trieReverseChild, trieEntryCount, trieEntry};
+    return source;
+}
+
+
+/**
+ * @brief Wyznacza wynik phfwdReverse lub phfwdGetReverse dla struktury.
+ * @param pf - wskaźnik na drzewo przekierowań.
+ * @param num - wskaźnik na numer.
+ * @param onlyGet - czy wyznaczyć wynik phfwdGetReverse.
+ * @return Wynik jak w @ref phfwdReverse.
+ */
+static PhoneNumbers *trieReverseNumbers(PhoneForward const *pf, char const *num, bool onlyGet) {
     if (isStringAPhoneNumber(num) == false) {   // Podany napis nie reprezentuje numeru.
-        return pnum;
+        return phnumNew(NULL);
     }
+    // Drzewo odwrócone jest odbudowywane leniwie po operacjach w trybie odroczonym.
+    if (!phfwdRebuildReverse((PhoneForward *) pf)) {
+        return NULL;
+    }
+    ReverseSource source = trieSource(pf);
+    return reverseNumbers(&source, num, onlyGet);
+}
+
 
-    PhoneNumbers *pnum1;
-    pnum1 = phfwdReverse(pf, num);
-    if (pnum1 == NULL) {
-        phnumDelete(pnum);
+PhoneNumbers *trieReverse(PhoneForward const *pf, char const *num) {
+    if (pf == NULL) {
         return NULL;
     }
-    List *temp = pnum1->allNumbers;
+    COUNTERS_ENTER(OPERATION_REVERSE);
+    PhoneNumbers *pnum = trieReverseNumbers(pf, num, false);
+    COUNTERS_LEAVE();
+    return pnum;
+}
+
+
+PhoneNumbers *trieGetReverse(PhoneForward const *pf, char const *num) {
+    if (pf == NULL) {
+        return NULL;
+    }
+    COUNTERS_ENTER(OPERATION_GET_REVERSE);
+    PhoneNumbers *pnum = trieReverseNumbers(pf, num, true);
+    COUNTERS_LEAVE();
+    return pnum;
+}
+
+
+/**
+ * @brief Porównuje leksykograficznie sklejenie napisów z napisem.
+ * @param first - pierwsza część sklejenia.
+ * @param firstLength - liczba znaków pierwszej części.
+ * @param second - druga część sklejenia.
+ * @param str - napis porównywany ze sklejeniem.
+ * @return int - liczba dodatnia/ujemna/zero w zależności od wyniku porównania
+ */
+static int compareJoined(const char *first, size_t firstLength, const char *second, const char *str) {
+    COUNTERS_ADD(COUNTER_COMPARES, 1);
+    for (size_t i = 0;; i++, str++) {
+        char c = i < firstLength ? first[i] : second[i - firstLength];
+        if (c == '\0' || *str == '\0' || get_digit(c) != get_digit(*str)) {
+            if (c == '\0' && *str == '\0') {
+                return 0;
+            }
+            return get_digit(c) - get_digit(*str);
+        }
+    }
+}
+
+
+/**
+ * @brief Wynik próby dodania kandydata do strony.
+ */
+enum PageOffer {
+    PAGE_TAKEN,     ///<kandydat trafił na stronę.
+    PAGE_REJECTED,  ///<kandydat nie jest mniejszy od ostatniego numeru pełnej strony.
+    PAGE_ERROR      ///<nie udało sie alokować pamięci.
+};
+
 
-    while (temp != NULL) {
-        PhoneNumbers *pnum2;
-        pnum2 = phfwdGet(pf, temp->forwarding);
-        List *curr = temp->next;
-        if (num && pnum2 && pnum2->allNumbers && strcmp(pnum2->allNumbers->forwarding, num) != 0) {
-            if (pnum1->allNumbers) {
-                deleteFrwdFromList(&(pnum1->allNumbers), temp->forwarding);
+/**
+ * @brief Próbuje dodać kandydata first + second do strony.
+ * Strona przechowuje co najwyżej @p limit najmniejszych dotychczasowych
+ * kandydatów.
+ * @param page - wskaźnik na wskaźnik listy numerów strony.
+ * @param first - pierwsza część kandydata.
+ * @param firstLength - liczba znaków pierwszej części.
+ * @param second - druga część kandydata.
+ * @param limit - maksymalny rozmiar strony.
+ * @return wynik próby dodania.
+ */
+static enum PageOffer offerToPage(List **page, const char *first, size_t firstLength,
+                                  const char *second, size_t limit) {
+    if (listSize(*page) == limit
+        && compareJoined(first, firstLength, second, listGet(*page, limit - 1)) >= 0) {
+        return PAGE_REJECTED;
+    }
+    size_t secondLength = strlen(second);
+    char *candidate = malloc(sizeof(char) * (firstLength + secondLength + 1));
+    if (candidate == NULL) {
+        return PAGE_ERROR;
+    }
+    memcpy(candidate, first, sizeof(char) * firstLength);
+    memcpy(candidate + firstLength, second, sizeof(char) * (secondLength + 1));
+    bool ok = insertToList(page, candidate);
+    free(candidate);
+    if (!ok) {
+        return PAGE_ERROR;
+    }
+    if (listSize(*page) > limit) {
+        deleteFrwdFromList(page, listGet(*page, limit));
+    }
+    return PAGE_TAKEN;
+}
+
+
+/**
+ * @brief Dodaje do strony kandydatów z jednego wierzchołka drzewa odwróconego.
+ * Kandydatami sa numery y + suffix dla y z listy wierzchołka. Numery y
+ * większe od @p afterKey tworzą sufiks posortowanej listy, a kandydaci z nich
+ * sa uporządkowani tak jak y, z wyjątkiem numerów przedłużających wcześniejsze
+ * y. Dlatego po pierwszym odrzuconym y sprawdzam już tylko jego przedłużenia.
+ * Numery y będące prefiksami @p afterKey (jest ich co najwyżej tyle, ile jego
+ * znaków) sprawdzam osobno.
+ * @param page - wskaźnik na wskaźnik listy numerów strony.
+ * @param list - lista wierzchołka drzewa odwróconego.
+ * @param suffix - sufiks dopisywany do numerów z listy.
+ * @param afterKey - numer, po którym zaczyna sie strona, lub NULL.
+ * @param limit - maksymalny rozmiar strony.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool fillPageFromList(List **page, List const *list, const char *suffix,
+                             const char *afterKey, size_t limit) {
+    size_t start = 0;
+    if (afterKey != NULL) {
+        size_t keyLength = strlen(afterKey);
+        for (size_t m = 1; m <= keyLength; m++) {
+            if (listContains(list, afterKey, m)
+                && compareJoined(afterKey, m, suffix, afterKey) > 0
+                && offerToPage(page, afterKey, m, suffix, limit) == PAGE_ERROR) {
+                return false;
             }
         }
-        temp = curr;
-        phnumDelete(pnum2);
+        start = listUpperBound(list, afterKey);
+    }
+
+    char const *boundary = NULL;
+    size_t boundaryLength = 0;
+    for (size_t t = start; t < listSize(list); t++) {
+        char const *y = listGet(list, t);
+        if (boundary != NULL && strncmp(y, boundary, boundaryLength) != 0) {
+            break;
+        }
+        enum PageOffer offer = offerToPage(page, y, strlen(y), suffix, limit);
+        if (offer == PAGE_ERROR) {
+            return false;
+        }
+        if (offer == PAGE_REJECTED) {
+            boundary = y;
+            boundaryLength = strlen(y);
+        }
     }
-    pnum->allNumbers = pnum1->allNumbers;
-    free(pnum1);
+    return true;
+}
+
+
+PhoneNumbers *phfwdReversePage(PhoneForward const *pf, char const *num,
+                               char const *afterKey, size_t limit) {
+    if (pf == NULL) {
+        return NULL;
+    }
+    if (!isStringAPhoneNumber(num) || (afterKey != NULL && !isStringAPhoneNumber(afterKey))
+        || limit == 0) {
+        return phnumNew(NULL);
+    }
+    if (!phfwdRebuildReverse((PhoneForward *) pf)) {
+        return NULL;
+    }
+
+    List *page = NULL;
+    bool ok = true;
+    if (afterKey == NULL || compareJoined(num, strlen(num), "", afterKey) > 0) {
+        ok = offerToPage(&page, num, strlen(num), "", limit) != PAGE_ERROR;
+    }
+    PhoneReverse const *curr = phfwdRootOf(pf)->pfRev;
+    for (size_t j = 1; ok && num[j - 1] != '\0'; j++) {
+        curr = curr->children[get_digit(num[j - 1])];
+        if (curr == NULL || curr->count == 0) {
+            break;
+        }
+        ok = fillPageFromList(&page, curr->listOfFrwd, num + j, afterKey, limit);
+    }
+    PhoneNumbers *pnum = ok ? phnumNew(page) : NULL;
+    listDelete(page);
 
     return pnum;
 }
 
 
-void deleteReverseTree(PhoneReverse *phrev) {
-    if (phrev != NULL) {
-        for (int i = 0; i < CHILDREN_NUMB; i++) {
-            if (phrev->children[i] != NULL) {
-                deleteReverseTree(phrev->children[i]);
+/**
+ * @brief Sprawdza, czy kandydat z danego poziomu został już wyznaczony wyżej.
+ * Kandydat to numer @p y z listy wierzchołka odpowiadającego prefiksowi
+ * num[0..j) z dopisanym sufiksem num[j..). Ten sam numer powstaje z poziomu
+ * i < j wtedy i tylko wtedy, gdy @p y kończy sie na num[i..j), a @p y bez tej
+ * końcówki należy do listy wierzchołka poziomu i. Jeśli @p y nie kończy sie na
+ * num[i..j), to nie kończy sie tez na dłuższych końcówkach, więc przerywam.
+ * @param node - wierzchołek poziomu @p j.
+ * @param j - długość prefiksu numeru @p num odpowiadającego @p node.
+ * @param y - numer z listy wierzchołka @p node.
+ * @param num - numer, dla którego szukamy przekierowań odwróconych.
+ * @return Wartość @p true, jeśli kandydat powstaje tez na niższym poziomie.
+ */
+static bool isCountedBefore(PhoneReverse const *node, size_t j, const char *y, const char *num) {
+    size_t length = strlen(y);
+    for (size_t k = 1; k < j && k < length; k++) {
+        if (get_digit(y[length - k]) != get_digit(num[j - k])) {
+            return false;
+        }
+        node = node->parent;
+        if (listContains(node->listOfFrwd, y, length - k)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @brief Liczy numery wyniku phfwdReverse (opcjonalnie tylko te z phfwdGetReverse).
+ * @param pf - wskaźnik na drzewo przekierowań.
+ * @param num - wskaźnik na numer.
+ * @param onlyGet - czy liczyć tylko numery przekierowywane przez phfwdGet na @p num.
+ * @return liczba numerów lub 0, gdy dane sa niepoprawne lub nie udało sie
+ *         alokować pamięci.
+ */
+static size_t reverseCount(PhoneForward const *pf, char const *num, bool onlyGet) {
+    if (pf == NULL || !isStringAPhoneNumber(num) || !phfwdRebuildReverse((PhoneForward *) pf)) {
+        return 0;
+    }
+    ReverseSource source = trieSource(pf);
+    size_t count = (!onlyGet || forwardsTo(&source, num, "", num)) ? 1 : 0;
+    PhoneReverse const *curr = phfwdRootOf(pf)->pfRev;
+
+    for (size_t j = 1; num[j - 1] != '\0'; j++) {
+        curr = curr->children[get_digit(num[j - 1])];
+        if (curr == NULL || curr->count == 0) {   // Głębiej nie ma już przekierowań.
+            break;
+        }
+        for (size_t i = 0; i < listSize(curr->listOfFrwd); i++) {
+            char const *y = listGet(curr->listOfFrwd, i);
+            if (!isCountedBefore(curr, j, y, num) && (!onlyGet || forwardsTo(&source, y, num + j, num))) {
+                count++;
             }
         }
+    }
+    return count;
+}
+
+
+size_t phfwdReverseCount(PhoneForward const *pf, char const *num) {
+    return reverseCount(pf, num, false);
+}
+
+
+size_t phfwdGetReverseCount(PhoneForward const *pf, char const *num) {
+    return reverseCount(pf, num, true);
+}
+
+
+void phrevStats(PhoneReverse const *pfRev, PhoneForwardStats *stats) {
+    struct PhoneReverseStats const *reverse = pfRev->stats;
+    stats->reverseNodes = reverse->nodes;
+    stats->reverseLists = reverse->lists;
+    stats->reverseEntries = pfRev->count;
+    stats->reverseBytes = reverse->bytes;
+    memcpy(stats->listLengths, reverse->lengths, sizeof(reverse->lengths));
+    stats->bytesAllocated += sizeof(struct PhoneReverseStats) + reverse->nodes * sizeof(PhoneReverse)
+                             + reverse->lists * sizeof(List) + pfRev->count * sizeof(char *)
+                             + reverse->bytes;
+}
+
+
+void deleteReverseTree(PhoneReverse *phrev) {
+    // Przechodzę drzewo iteracyjnie (w porządku postorder), żeby głębokość
+    // drzewa nie była ograniczona rozmiarem stosu.
+    PhoneReverse *curr = phrev;
+    while (curr != NULL) {
+        int i = 0;
+        while (i < CHILDREN_NUMB && curr->children[i] == NULL) {
+            i++;
+        }
+        if (i < CHILDREN_NUMB) {
+            curr = curr->children[i];
+            continue;
+        }
         // Usuwanie przekierowania (listy)
-        listDelete(phrev->listOfFrwd);
-        free(phrev);
-        phrev = NULL;
+        listDelete(curr->listOfFrwd);
+        free(curr->stats);
+        PhoneReverse *parent = curr == phrev ? NULL : curr->parent;
+        if (parent != NULL) {
+            for (i = 0; parent->children[i] != curr; i++);
+            parent->children[i] = NULL;
+        }
+        free(curr);
+        curr = parent;
     }
 }
\ No newline at end of file
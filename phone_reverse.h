@@ -9,11 +9,27 @@
 #ifndef PHONE_REVERSE_H
 #define PHONE_REVERSE_H
 #define CHILDREN_NUMB 12 ///<Rozmiar drzewa
+#define STATS_LENGTHS 16 ///<Liczba przedziałów histogramu długości list
 #include <stdbool.h>
+#include <stddef.h>
 #include "phnum.h"
 
 
 
+struct PhoneForwardStats;
+
+
+/**
+ * @brief Statystyki drzewa odwróconego, aktualizowane przy każdej zmianie.
+ */
+struct PhoneReverseStats {
+    size_t nodes;  ///<liczba wierzchołków (z korzeniem).
+    size_t lists;  ///<liczba niepustych list przekierowań.
+    size_t bytes;  ///<łączna długość numerów w listach (wraz z '\0').
+    size_t lengths[STATS_LENGTHS];  ///<liczba list o długości z przedziału [2^i, 2^(i+1)).
+};
+
+
 /**
  * @brief Struktura przekierowań odwróconych.
  * Trzymam drzewo odwrócone przekierowań.
@@ -24,6 +40,8 @@ struct PhoneReverse {
     struct PhoneReverse *children[CHILDREN_NUMB];  ///<"dzieci" wierzchołka drzewa.
     struct PhoneReverse *parent;  ///<Rodzic danego wierzchołka.
     struct List *listOfFrwd;  ///<Przekierowanie.
+    size_t count;  ///<Liczba przekierowań w poddrzewie (łącznie z tym wierzchołkiem).
+    struct PhoneReverseStats *stats;  ///<Statystyki drzewa (tylko w korzeniu, w pozostałych NULL).
 };
 /**
  * @brief To jest typ PhoneReverse
@@ -61,13 +79,81 @@ void phrevRemove(PhoneReverse *pfRev, const char *num1, const char *num2);
 
 
 /**
- * @brief Usuwa przekierowania (za prefiksem) z drzewa odwróconego
- * Usuwa z drzewa wszystkie przekierowania, zaczynające się podanym prefiksem
+ * @brief Znajduje wierzchołek drzewa odwróconego odpowiadający numerowi.
  * @param pfRev - wskaźnik na drzewo odwrócone.
- * @param num1- wskaźnik na numer przekierowania "dokąd"
- * @param num2- wskaźnik na numer przekierowania "skąd" (prefiks)
+ * @param num - wskaźnik na numer.
+ * @return wskaźnik na wierzchołek lub NULL, jeśli taki nie istnieje.
+ */
+PhoneReverse *phrevFind(PhoneReverse *pfRev, const char *num);
+
+
+/**
+ * @brief Usuwa przekierowania (za prefiksem) z list podanych wierzchołków.
+ * Z listy każdego z wierzchołków usuwa wszystkie przekierowania "skąd"
+ * zaczynające się podanym prefiksem; listę wierzchołka występującego
+ * w tablicy wielokrotnie przetwarza raz. Zmienia kolejność tablicy.
+ * @param pfRev - wskaźnik na korzeń drzewa odwróconego.
+ * @param nodes - tablica wierzchołków (numerów "dokąd").
+ * @param count - liczba elementów tablicy.
+ * @param prefix - wskaźnik na prefiks numerów "skąd".
+ */
+void phrevRemoveStartsWithPref(PhoneReverse *pfRev, PhoneReverse **nodes, size_t count,
+                               const char *prefix);
+
+
+/**
+ * @brief Przenosi przekierowania jednego drzewa odwróconego do drugiego.
+ * Poddrzewa, których brakuje w @p dst, sa przepinane w całości, a listy
+ * wierzchołków części wspólnej scalane, więc koszt zależy od części wspólnej
+ * drzew. Drzewo @p src nadaje sie potem tylko do usunięcia lub odbudowy.
+ * @param dst - wskaźnik na korzeń drzewa docelowego.
+ * @param src - wskaźnik na korzeń drzewa źródłowego.
+ * @return Wartość @p true, jeśli przekierowania zostały przeniesione.
+ *         Wartość @p false, jeśli nie udało sie alokować pamięci (oba drzewa
+ *         nadają sie wtedy tylko do usunięcia lub odbudowy).
+ */
+bool phrevMerge(PhoneReverse *dst, PhoneReverse *src);
+
+
+/**
+ * @brief Dostęp do drzew, z których wyznaczane sa wyniki phfwdReverse
+ * i phfwdGetReverse.
+ * Wierzchołki drzew sa przekazywane jako nieprzezroczyste wskaźniki, dzięki
+ * czemu te same funkcje obsługują strukturę w pamięci i bazę w pamięci
+ * współdzielonej (phone_shared.h).
+ */
+struct ReverseSource {
+    void const *data;  ///<przeszukiwana struktura (przekazywana funkcjom dostępu).
+    void const *forwardRoot;  ///<korzeń drzewa przekierowań.
+    void const *reverseRoot;  ///<korzeń drzewa odwróconego.
+    /** @brief Zwraca dziecko wierzchołka drzewa przekierowań lub NULL. */
+    void const *(*forwardChild)(void const *data, void const *node, int digit);
+    /** @brief Zwraca przekierowanie wierzchołka drzewa przekierowań lub NULL. */
+    char const *(*forwarding)(void const *data, void const *node);
+    /** @brief Zwraca dziecko wierzchołka drzewa odwróconego lub NULL. */
+    void const *(*reverseChild)(void const *data, void const *node, int digit);
+    /** @brief Zwraca długość posortowanej listy wierzchołka drzewa odwróconego. */
+    size_t (*entryCount)(void const *data, void const *node);
+    /** @brief Zwraca numer o danym indeksie z listy wierzchołka drzewa odwróconego. */
+    char const *(*entry)(void const *data, void const *node, size_t idx);
+};
+/**
+ * @brief To jest typ ReverseSource.
+ *
+ */
+typedef struct ReverseSource ReverseSource;
+
+
+/**
+ * @brief Wyznacza wynik phfwdReverse lub phfwdGetReverse.
+ * @param source - wskaźnik na opis przeszukiwanych drzew.
+ * @param num - wskaźnik na poprawny numer.
+ * @param onlyGet - czy zostawić tylko numery przekierowywane na @p num
+ *                  (wynik phfwdGetReverse).
+ * @return Wskaźnik na posortowany ciąg numerów lub NULL, gdy nie udało sie
+ *         alokować pamięci.
  */
-void phrevRemoveNumStartsWithPref(PhoneReverse *pfRev, const char *num1, const char *num2);
+PhoneNumbers *reverseNumbers(ReverseSource const *source, char const *num, bool onlyGet);
 
 
 /**
@@ -77,6 +163,16 @@ void phrevRemoveNumStartsWithPref(PhoneReverse *pfRev, const char *num1, const c
 PhoneReverse *phrevNew(void);
 
 
+/**
+ * @brief Uzupełnia statystyki struktury o dane drzewa odwróconego.
+ * Wypełnia pola reverseNodes, reverseLists, reverseEntries, reverseBytes
+ * i listLengths oraz dolicza pamięć drzewa do bytesAllocated.
+ * @param pfRev - wskaźnik na drzewo odwrócone.
+ * @param stats - wskaźnik na uzupełniane statystyki.
+ */
+void phrevStats(PhoneReverse const *pfRev, struct PhoneForwardStats *stats);
+
+
 /** @brief Usuwa strukturę.
  * Usuwa strukturę wskazywana przez @p phrev. Nic nie robi, jeśli wskaźnik ten ma
  * wartość NULL. (Funkcja pomocnicza do usuwania drzewa odwróconego).
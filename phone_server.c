@@ -0,0 +1,628 @@
+/** @file
+ * Implementacja serwera zapytań o przekierowania (gniazdo domeny uniksowej,
+ * epoll i wątki robocze) oraz klienta tego serwera.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#define _GNU_SOURCE
+#include "phone_server.h"
+#include "list_of_numbers.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVER_READ_SIZE (1 << 16) ///<Najmniejsze wolne miejsce bufora przy odczycie z gniazda.
+#define SERVER_MAX_PENDING (1u << 22) ///<Liczba niewysłanych bajtów, przy której serwer przestaje czytać zapytania.
+#define SERVER_EVENTS 64 ///<Liczba zdarzeń odbieranych przez wątek naraz.
+#define SERVER_BACKLOG 128 ///<Długość kolejki połączeń oczekujących na przyjęcie.
+
+
+
+/**
+ * @brief Połączenie obsługiwane przez serwer.
+ */
+struct ServerConnection {
+    int fd;  ///<gniazdo połączenia.
+    ByteBuffer input;  ///<odebrane, nieprzetworzone bajty.
+    ByteBuffer output;  ///<odpowiedzi czekające na wysłanie.
+    size_t written;  ///<liczba wysłanych bajtów bufora output.
+    struct ServerConnection *prev;  ///<poprzednie połączenie na liście serwera.
+    struct ServerConnection *next;  ///<następne połączenie na liście serwera.
+};
+
+
+/**
+ * @brief Bufory pomocnicze wątku roboczego.
+ */
+struct ServerWorker {
+    PhoneForwardServer *server;  ///<obsługiwany serwer.
+    ByteBuffer number;  ///<bufor na odczytywany numer.
+    ByteBuffer frame;  ///<zawartość budowanej ramki odpowiedzi.
+};
+
+
+/**
+ * @brief Sprawdza, czy bajt jest poprawnym rodzajem zapytania.
+ * @param operation - bajt rodzaju (bez bitu @ref SERVER_INVALID_NUMBER).
+ * @return Wartość @p true, jeśli to zapytanie obsługiwane przez serwer.
+ */
+static bool isQuery(unsigned operation) {
+    return operation == OPERATION_GET || operation == OPERATION_REVERSE
+           || operation == OPERATION_GET_REVERSE;
+}
+
+
+/**
+ * @brief Wysyła bajty bez zgłaszania sygnału SIGPIPE.
+ * @param fd - gniazdo.
+ * @param data - wskaźnik na bajty.
+ * @param size - liczba bajtów.
+ * @return liczba wysłanych bajtów lub -1, jak send.
+ */
+static ssize_t sendBytes(int fd, void const *data, size_t size) {
+    ssize_t result;
+    do {
+        result = send(fd, data, size, MSG_NOSIGNAL);
+    } while (result < 0 && errno == EINTR);
+    return result;
+}
+
+
+/**
+ * @brief Czyta z gniazda do bufora.
+ * @param fd - gniazdo.
+ * @param buffer - wskaźnik na bufor (dane sa dopisywane na koniec).
+ * @return liczba odczytanych bajtów, 0 na końcu danych lub -1, jak read
+ *         (także, gdy nie udało sie alokować pamięci).
+ */
+static ssize_t receiveBytes(int fd, ByteBuffer *buffer) {
+    if (!bufferReserve(buffer, SERVER_READ_SIZE)) {
+        errno = ENOMEM;
+        return -1;
+    }
+    ssize_t result;
+    do {
+        result = read(fd, buffer->data + buffer->size, buffer->capacity - buffer->size);
+    } while (result < 0 && errno == EINTR);
+    if (result > 0) {
+        buffer->size += (size_t) result;
+    }
+    return result;
+}
+
+
+/**
+ * @brief Usuwa gniazdo o podanej ścieżce.
+ * Plik innego rodzaju pozostaje nienaruszony.
+ * @param path - ścieżka gniazda.
+ */
+static void removeSocket(char const *path) {
+    struct stat status;
+    if (lstat(path, &status) == 0 && S_ISSOCK(status.st_mode)) {
+        unlink(path);
+    }
+}
+
+
+/**
+ * @brief Szuka w buforze pełnej ramki.
+ * @param buffer - wskaźnik na bufor.
+ * @param start - przesunięcie początku ramki w buforze.
+ * @param[out] frame - czytnik zawartości znalezionej ramki.
+ * @param limit - największa dopuszczalna długość zawartości.
+ * @return 1, jeśli ramka jest pełna, 0, jeśli brakuje jej bajtów, -1, jeśli
+ *         jej nagłówek jest niepoprawny lub długość przekracza @p limit.
+ */
+static int findFrame(ByteBuffer const *buffer, size_t start, ByteReader *frame, uint64_t limit) {
+    ByteReader reader = {buffer->data + start, buffer->data + buffer->size};
+    uint64_t length;
+    if (!readerGetVarint(&reader, &length)) {
+        // Niepełny nagłówek ma mniej niż 10 bajtów.
+        return buffer->size - start < 10 ? 0 : -1;
+    }
+    if (length > limit) {
+        return -1;
+    }
+    if ((uint64_t) (reader.end - reader.pos) < length) {
+        return 0;
+    }
+    frame->pos = reader.pos;
+    frame->end = reader.pos + length;
+    return 1;
+}
+
+
+/**
+ * @brief Usuwa z początku bufora przetworzone bajty.
+ * @param buffer - wskaźnik na bufor.
+ * @param count - liczba przetworzonych bajtów.
+ */
+static void consume(ByteBuffer *buffer, size_t count) {
+    if (count > 0) {
+        memmove(buffer->data, buffer->data + count, buffer->size - count);
+        buffer->size -= count;
+    }
+}
+
+
+/**
+ * @brief Dopisuje do ramki odpowiedzi wynik jednego zapytania.
+ * @param frame - wskaźnik na zawartość ramki odpowiedzi.
+ * @param pnum - wynik zapytania (NULL, gdy zabrakło pamięci).
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool putResult(ByteBuffer *frame, PhoneNumbers const *pnum) {
+    if (pnum == NULL) {
+        return bufferPutVarint(frame, 0);
+    }
+    size_t count = phnumSize(pnum);
+    bool ok = bufferPutVarint(frame, count + 1);
+    for (size_t i = 0; ok && i < count; i++) {
+        ok = bufferPutNumber(frame, phnumGet(pnum, i));
+    }
+    return ok;
+}
+
+
+/**
+ * @brief Wykonuje zapytania ramki i dopisuje ramkę odpowiedzi.
+ * @param worker - wskaźnik na wątek roboczy.
+ * @param request - czytnik zawartości ramki zapytań.
+ * @param output - wskaźnik na bufor odpowiedzi połączenia.
+ * @return Wartość @p false, jeśli ramka jest niepoprawna lub nie udało sie
+ *         alokować pamięci.
+ */
+static bool answerFrame(struct ServerWorker *worker, ByteReader request, ByteBuffer *output) {
+    PhoneForward const *pf = worker->server->pf;
+    worker->frame.size = 0;
+    while (request.pos < request.end) {
+        unsigned operation = *request.pos++;
+        bool invalid = (operation & SERVER_INVALID_NUMBER) != 0;
+        operation &= ~(unsigned) SERVER_INVALID_NUMBER;
+        if (!isQuery(operation) || (!invalid && !readerGetNumber(&request, &worker->number))) {
+            return false;
+        }
+        // Napis niebędący numerem jest zastępowany pustym napisem.
+        char const *num = invalid ? "" : (char const *) worker->number.data;
+        PhoneNumbers *pnum;
+        if (operation == OPERATION_GET) {
+            pnum = phfwdGet(pf, num);
+        } else if (operation == OPERATION_REVERSE) {
+            pnum = phfwdReverse(pf, num);
+        } else {
+            pnum = phfwdGetReverse(pf, num);
+        }
+        bool ok = putResult(&worker->frame, pnum);
+        phnumDelete(pnum);
+        if (!ok) {
+            return false;
+        }
+    }
+    return bufferPutVarint(output, worker->frame.size)
+           && bufferPut(output, worker->frame.data, worker->frame.size);
+}
+
+
+/**
+ * @brief Wysyła jak najwięcej oczekujących odpowiedzi.
+ * @param connection - wskaźnik na połączenie.
+ * @return Wartość @p false, jeśli wysyłanie sie nie udało.
+ */
+static bool flush(struct ServerConnection *connection) {
+    while (connection->written < connection->output.size) {
+        ssize_t result = sendBytes(connection->fd, connection->output.data + connection->written,
+                                   connection->output.size - connection->written);
+        if (result < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        connection->written += (size_t) result;
+    }
+    connection->output.size = 0;
+    connection->written = 0;
+    return true;
+}
+
+
+/**
+ * @brief Obsługuje zdarzenie połączenia: czyta zapytania, odpowiada na
+ * wszystkie pełne ramki i wysyła odpowiedzi.
+ * Czytanie jest wstrzymywane, gdy klient nie odbiera odpowiedzi.
+ * @param worker - wskaźnik na wątek roboczy.
+ * @param connection - wskaźnik na połączenie.
+ * @return Wartość @p false, jeśli połączenie należy zamknąć.
+ */
+static bool serve(struct ServerWorker *worker, struct ServerConnection *connection) {
+    bool open = true;
+    while (open && connection->output.size - connection->written < SERVER_MAX_PENDING) {
+        ssize_t result = receiveBytes(connection->fd, &connection->input);
+        if (result == 0) {
+            open = false;
+        } else if (result < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return false;
+            }
+            break;
+        }
+        // Przetworzone ramki usuwam z bufora raz po odpowiedzi na wszystkie.
+        ByteReader frame;
+        size_t done = 0;
+        int found;
+        while ((found = findFrame(&connection->input, done, &frame, SERVER_MAX_FRAME)) == 1) {
+            if (!answerFrame(worker, frame, &connection->output)) {
+                return false;
+            }
+            done = (size_t) (frame.end - connection->input.data);
+        }
+        if (found < 0) {
+            return false;
+        }
+        consume(&connection->input, done);
+    }
+    // Po zamknięciu przez klienta wysyłam jeszcze odpowiedzi, jeśli sie da.
+    return flush(connection) && open;
+}
+
+
+/**
+ * @brief Rejestruje ponownie gniazdo w obiekcie epoll (EPOLLONESHOT).
+ * @param server - wskaźnik na serwer.
+ * @param fd - gniazdo.
+ * @param data - wskaźnik zwracany ze zdarzeniami gniazda.
+ * @param events - oczekiwane zdarzenia.
+ * @param add - czy gniazdo jest rejestrowane pierwszy raz.
+ * @return Wartość @p false, jeśli rejestracja sie nie udała.
+ */
+static bool arm(PhoneForwardServer *server, int fd, void *data, uint32_t events, bool add) {
+    struct epoll_event event = {.events = events | EPOLLONESHOT, .data.ptr = data};
+    return epoll_ctl(server->epoll, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+
+/**
+ * @brief Zamyka połączenie i usuwa je z listy serwera.
+ * @param server - wskaźnik na serwer.
+ * @param connection - wskaźnik na połączenie.
+ */
+static void closeConnection(PhoneForwardServer *server, struct ServerConnection *connection) {
+    pthread_mutex_lock(&server->mutex);
+    if (connection->prev != NULL) {
+        connection->prev->next = connection->next;
+    } else {
+        server->connections = connection->next;
+    }
+    if (connection->next != NULL) {
+        connection->next->prev = connection->prev;
+    }
+    pthread_mutex_unlock(&server->mutex);
+    close(connection->fd);
+    bufferFree(&connection->input);
+    bufferFree(&connection->output);
+    free(connection);
+}
+
+
+/**
+ * @brief Przyjmuje oczekujące połączenia.
+ * @param server - wskaźnik na serwer.
+ */
+static void acceptConnections(PhoneForwardServer *server) {
+    int fd;
+    while ((fd = accept4(server->listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        struct ServerConnection *connection = calloc(1, sizeof(struct ServerConnection));
+        if (connection == NULL) {
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        bufferInit(&connection->input);
+        bufferInit(&connection->output);
+        pthread_mutex_lock(&server->mutex);
+        connection->next = server->connections;
+        if (connection->next != NULL) {
+            connection->next->prev = connection;
+        }
+        server->connections = connection;
+        pthread_mutex_unlock(&server->mutex);
+        if (!arm(server, fd, connection, EPOLLIN | EPOLLRDHUP, true)) {
+            closeConnection(server, connection);
+        }
+    }
+    arm(server, server->listener, &server->listener, EPOLLIN, false);
+}
+
+
+/**
+ * @brief Pętla wątku roboczego.
+ * @param data - wskaźnik na wątek roboczy.
+ * @return NULL.
+ */
+static void *workerLoop(void *data) {
+    struct ServerWorker *worker = data;
+    PhoneForwardServer *server = worker->server;
+    struct epoll_event events[SERVER_EVENTS];
+    bool stopped = false;
+    while (!stopped) {
+        int count = epoll_wait(server->epoll, events, SERVER_EVENTS, -1);
+        if (count < 0 && errno != EINTR) {
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &server->stopEvent) {
+                stopped = true;
+            } else if (ptr == &server->listener) {
+                acceptConnections(server);
+            } else {
+                struct ServerConnection *connection = ptr;
+                bool pending = false;
+                bool ok = (events[i].events & EPOLLERR) == 0 && serve(worker, connection);
+                if (ok) {
+                    pending = connection->written < connection->output.size;
+                    // Gdy klient nie odbiera odpowiedzi, czekam tylko na możliwość wysłania.
+                    bool reading = connection->output.size - connection->written < SERVER_MAX_PENDING;
+                    ok = arm(server, connection->fd, connection,
+                             (reading ? EPOLLIN | EPOLLRDHUP : 0) | (pending ? EPOLLOUT : 0), false);
+                }
+                if (!ok) {
+                    closeConnection(server, connection);
+                }
+            }
+        }
+    }
+    bufferFree(&worker->number);
+    bufferFree(&worker->frame);
+    return NULL;
+}
+
+
+PhoneForwardServer *phfwdServerNew(PhoneForward *pf, char const *path, size_t workers) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (pf == NULL || path == NULL || strlen(path) >= sizeof(address.sun_path)
+        || !phfwdRebuildReverse(pf)) {
+        return NULL;
+    }
+    strcpy(address.sun_path, path);
+    PhoneForwardServer *server = malloc(sizeof(PhoneForwardServer));
+    if (server == NULL) {
+        return NULL;
+    }
+    server->address = address;
+    server->pf = pf;
+    server->workers = workers;
+    if (workers == 0) {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        server->workers = processors > 0 ? (size_t) processors : 1;
+    }
+    server->connections = NULL;
+    pthread_mutex_init(&server->mutex, NULL);
+    server->listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    server->stopEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server->epoll = epoll_create1(EPOLL_CLOEXEC);
+    removeSocket(path);
+    // Zdarzenie zatrzymania nie ma EPOLLONESHOT, wiec budzi wszystkie wątki.
+    struct epoll_event stop = {.events = EPOLLIN, .data.ptr = &server->stopEvent};
+    bool ok = server->listener >= 0 && server->stopEvent >= 0 && server->epoll >= 0
+              && bind(server->listener, (struct sockaddr *) &address, sizeof(address)) == 0
+              && listen(server->listener, SERVER_BACKLOG) == 0
+              && epoll_ctl(server->epoll, EPOLL_CTL_ADD, server->stopEvent, &stop) == 0
+              && arm(server, server->listener, &server->listener, EPOLLIN, true);
+    if (!ok) {
+        phfwdServerDelete(server);
+        return NULL;
+    }
+    return server;
+}
+
+
+bool phfwdServerRun(PhoneForwardServer *server) {
+    struct ServerWorker *workers = calloc(server->workers, sizeof(struct ServerWorker));
+    pthread_t *threads = calloc(server->workers, sizeof(pthread_t));
+    bool *started = calloc(server->workers, sizeof(bool));
+    bool ok = workers != NULL && threads != NULL && started != NULL;
+    for (size_t i = 0; ok && i < server->workers; i++) {
+        workers[i].server = server;
+        bufferInit(&workers[i].number);
+        bufferInit(&workers[i].frame);
+    }
+    for (size_t i = 1; ok && i < server->workers; i++) {
+        started[i] = pthread_create(&threads[i], NULL, workerLoop, &workers[i]) == 0;
+    }
+    if (ok) {
+        workerLoop(&workers[0]);
+        for (size_t i = 1; i < server->workers; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+    }
+    free(workers);
+    free(threads);
+    free(started);
+    return ok;
+}
+
+
+void phfwdServerStop(PhoneForwardServer *server) {
+    uint64_t one = 1;
+    ssize_t result = write(server->stopEvent, &one, sizeof(one));
+    (void) result;
+}
+
+
+void phfwdServerDelete(PhoneForwardServer *server) {
+    if (server == NULL) {
+        return;
+    }
+    while (server->connections != NULL) {
+        closeConnection(server, server->connections);
+    }
+    if (server->listener >= 0) {
+        close(server->listener);
+        removeSocket(server->address.sun_path);
+    }
+    if (server->stopEvent >= 0) {
+        close(server->stopEvent);
+    }
+    if (server->epoll >= 0) {
+        close(server->epoll);
+    }
+    pthread_mutex_destroy(&server->mutex);
+    free(server);
+}
+
+
+PhoneForwardClient *phfwdClientConnect(char const *path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (path == NULL || strlen(path) >= sizeof(address.sun_path)) {
+        return NULL;
+    }
+    strcpy(address.sun_path, path);
+    PhoneForwardClient *client = malloc(sizeof(PhoneForwardClient));
+    if (client == NULL) {
+        return NULL;
+    }
+    bufferInit(&client->request);
+    bufferInit(&client->input);
+    client->received = 0;
+    bufferInit(&client->scratch);
+    client->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client->fd < 0 || connect(client->fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        phfwdClientDelete(client);
+        return NULL;
+    }
+    return client;
+}
+
+
+bool phfwdClientQueue(PhoneForwardClient *client, PhoneForwardOperation operation, char const *num) {
+    if (!isQuery(operation)) {
+        return false;
+    }
+    size_t size = client->request.size;
+    bool valid = isStringAPhoneNumber(num);
+    uint8_t byte = (uint8_t) (valid ? operation : operation | SERVER_INVALID_NUMBER);
+    if (!bufferPut(&client->request, &byte, 1) || (valid && !bufferPutNumber(&client->request, num))) {
+        client->request.size = size;
+        return false;
+    }
+    return true;
+}
+
+
+bool phfwdClientSend(PhoneForwardClient *client) {
+    ByteBuffer header;
+    bufferInit(&header);
+    bool ok = client->request.size <= SERVER_MAX_FRAME && bufferPutVarint(&header, client->request.size);
+    if (ok) {
+        struct iovec parts[2] = {
+                {header.data, header.size},
+                {client->request.data, client->request.size},
+        };
+        struct msghdr message = {.msg_iov = parts, .msg_iovlen = 2};
+        while (ok && message.msg_iovlen > 0) {
+            ssize_t result = sendmsg(client->fd, &message, MSG_NOSIGNAL);
+            if (result < 0) {
+                ok = errno == EINTR;
+                continue;
+            }
+            // Pomijam wysłane części.
+            while (message.msg_iovlen > 0 && (size_t) result >= message.msg_iov->iov_len) {
+                result -= (ssize_t) message.msg_iov->iov_len;
+                message.msg_iov++;
+                message.msg_iovlen--;
+            }
+            if (message.msg_iovlen > 0) {
+                message.msg_iov->iov_base = (uint8_t *) message.msg_iov->iov_base + result;
+                message.msg_iov->iov_len -= (size_t) result;
+            }
+        }
+    }
+    bufferFree(&header);
+    client->request.size = 0;
+    return ok;
+}
+
+
+/**
+ * @brief Odczytuje wynik jednego zapytania z ramki odpowiedzi.
+ * @param client - wskaźnik na klienta.
+ * @param reader - czytnik zawartości ramki.
+ * @param[out] pnum - wskaźnik na wynik (NULL, gdy serwerowi zabrakło pamięci).
+ * @return Wartość @p false, jeśli odpowiedź jest niepoprawna lub nie udało
+ *         sie alokować pamięci.
+ */
+static bool readResult(PhoneForwardClient *client, ByteReader *reader, PhoneNumbers **pnum) {
+    uint64_t count;
+    *pnum = NULL;
+    if (!readerGetVarint(reader, &count)) {
+        return false;
+    }
+    if (count == 0) {
+        return true;
+    }
+    List *numbers = NULL;
+    bool ok = true;
+    for (uint64_t i = 1; ok && i < count; i++) {
+        ok = readerGetNumber(reader, &client->scratch)
+             && insertToList(&numbers, (char const *) client->scratch.data);
+    }
+    if (ok) {
+        *pnum = phnumNew(numbers);
+        ok = *pnum != NULL;
+    }
+    listDelete(numbers);
+    return ok;
+}
+
+
+bool phfwdClientReceive(PhoneForwardClient *client, PhoneNumbers **results, size_t count) {
+    ByteReader frame;
+    int found;
+    while ((found = findFrame(&client->input, client->received, &frame, UINT64_MAX)) == 0) {
+        // Odebrane odpowiedzi usuwam z bufora dopiero przed kolejnym odczytem.
+        consume(&client->input, client->received);
+        client->received = 0;
+        if (receiveBytes(client->fd, &client->input) <= 0) {
+            return false;
+        }
+    }
+    bool ok = found > 0;
+    size_t done = 0;
+    while (ok && done < count) {
+        ok = readResult(client, &frame, &results[done]);
+        done += ok;
+    }
+    ok = ok && frame.pos == frame.end;
+    if (!ok) {
+        for (size_t i = 0; i < done; i++) {
+            phnumDelete(results[i]);
+        }
+    }
+    if (found > 0) {
+        client->received = (size_t) (frame.end - client->input.data);
+    }
+    return ok;
+}
+
+
+void phfwdClientDelete(PhoneForwardClient *client) {
+    if (client != NULL) {
+        if (client->fd >= 0) {
+            close(client->fd);
+        }
+        bufferFree(&client->request);
+        bufferFree(&client->input);
+        bufferFree(&client->scratch);
+        free(client);
+    }
+}
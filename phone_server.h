@@ -0,0 +1,165 @@
+/** @file
+ * Interfejs serwera odpowiadającego na zapytania o przekierowania przez
+ * gniazdo domeny uniksowej oraz klienta tego serwera.
+ *
+ * Protokół: klient wysyła ramki, a serwer na każdą ramkę odpowiada jedną
+ * ramką, w kolejności ramek zapytań (klient może wysłać wiele ramek przed
+ * odczytaniem odpowiedzi). Ramka to długość zawartości (@ref bufferPutVarint)
+ * i zawartość. Zawartość ramki zapytań to ciąg zapytań: bajt rodzaju
+ * (@ref OPERATION_GET, @ref OPERATION_REVERSE lub @ref OPERATION_GET_REVERSE)
+ * i numer (@ref bufferPutNumber); bajt z ustawionym bitem
+ * @ref SERVER_INVALID_NUMBER oznacza zapytanie o napis niebędący numerem
+ * i nie jest po nim zapisywany numer. Zawartość ramki odpowiedzi to dla
+ * każdego zapytania liczba numerów powiększona o 1 (0, gdy serwerowi
+ * zabrakło pamięci) i numery wyniku.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_SERVER_H
+#define PHONE_SERVER_H
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/un.h>
+#include "phone_codec.h"
+#include "phone_forward.h"
+
+#define SERVER_INVALID_NUMBER 0x80 ///<Bit rodzaju zapytania o napis niebędący numerem.
+#define SERVER_MAX_FRAME (1u << 20) ///<Największa długość zawartości ramki zapytań.
+
+
+
+/**
+ * @brief Serwer zapytań o przekierowania.
+ * Wątki robocze czekają na zdarzenia tego samego obiektu epoll. Gniazda sa
+ * rejestrowane z EPOLLONESHOT, wiec połączenie obsługuje naraz jeden wątek,
+ * a odpowiedzi na wszystkie ramki odczytane za jednym razem sa wysyłane
+ * razem.
+ */
+struct PhoneForwardServer {
+    PhoneForward const *pf;  ///<struktura, o która pytają klienci.
+    struct sockaddr_un address;  ///<adres gniazda (plik jest usuwany razem z serwerem).
+    int listener;  ///<gniazdo nasłuchujące.
+    int stopEvent;  ///<eventfd sygnalizujący zatrzymanie.
+    int epoll;  ///<obiekt epoll.
+    size_t workers;  ///<liczba wątków roboczych.
+    pthread_mutex_t mutex;  ///<chroni listę połączeń.
+    struct ServerConnection *connections;  ///<otwarte połączenia.
+};
+/**
+ * @brief To jest typ PhoneForwardServer.
+ *
+ */
+typedef struct PhoneForwardServer PhoneForwardServer;
+
+
+/**
+ * @brief Połączenie klienta z serwerem.
+ */
+struct PhoneForwardClient {
+    int fd;  ///<gniazdo połączenia.
+    ByteBuffer request;  ///<zawartość budowanej ramki zapytań.
+    ByteBuffer input;  ///<odebrane bajty.
+    size_t received;  ///<liczba bajtów bufora input tworzących odebrane już odpowiedzi.
+    ByteBuffer scratch;  ///<bufor na odczytywany numer.
+};
+/**
+ * @brief To jest typ PhoneForwardClient.
+ *
+ */
+typedef struct PhoneForwardClient PhoneForwardClient;
+
+
+/** @brief Tworzy serwer nasłuchujący na gnieździe o podanej ścieżce.
+ * Istniejące gniazdo o tej ścieżce jest usuwane (i jest usuwane ponownie
+ * przez @ref phfwdServerDelete); plik innego rodzaju nie jest usuwany i serwer
+ * nie powstaje. Jeśli drzewo odwrócone jest
+ * nieaktualne, jest odbudowywane. Struktura @p pf nie może byc zmieniana
+ * ani usuwana, dopóki serwer istnieje.
+ * @param[in] pf      - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] path    - ścieżka gniazda;
+ * @param[in] workers - liczba wątków roboczych (0 oznacza liczbę procesorów).
+ * @return Wskaźnik na serwer lub NULL, jeśli @p pf lub @p path ma wartość
+ *         NULL, pod ścieżką @p path jest plik niebędący gniazdem, nie udało
+ *         sie utworzyć gniazda lub alokować pamięci.
+ */
+PhoneForwardServer *phfwdServerNew(PhoneForward *pf, char const *path, size_t workers);
+
+
+/** @brief Obsługuje klientów do zatrzymania serwera.
+ * Uruchamia wątki robocze (jednym z nich jest wątek wywołujący) i czeka na
+ * ich zakończenie.
+ * @param[in,out] server - wskaźnik na serwer.
+ * @return Wartość @p false, jeśli nie udało sie uruchomić żadnego wątku.
+ */
+bool phfwdServerRun(PhoneForwardServer *server);
+
+
+/** @brief Zatrzymuje serwer.
+ * Może byc wywołana z innego wątku lub z funkcji obsługi sygnału;
+ * @ref phfwdServerRun kończy sie po obsłużeniu bieżących zdarzeń.
+ * @param[in,out] server - wskaźnik na serwer.
+ */
+void phfwdServerStop(PhoneForwardServer *server);
+
+
+/** @brief Usuwa serwer: zamyka połączenia i gniazdo nasłuchujące.
+ * Nie może byc wywołana w trakcie @ref phfwdServerRun. Nic nie robi, jeśli
+ * @p server ma wartość NULL.
+ * @param[in] server - wskaźnik na serwer.
+ */
+void phfwdServerDelete(PhoneForwardServer *server);
+
+
+/** @brief Łączy sie z serwerem.
+ * @param[in] path - ścieżka gniazda serwera.
+ * @return Wskaźnik na klienta lub NULL, jeśli połączenie sie nie udało lub
+ *         nie udało sie alokować pamięci.
+ */
+PhoneForwardClient *phfwdClientConnect(char const *path);
+
+
+/** @brief Dodaje zapytanie do budowanej ramki.
+ * @param[in,out] client - wskaźnik na klienta;
+ * @param[in] operation  - rodzaj zapytania (@ref OPERATION_GET,
+ *                         @ref OPERATION_REVERSE lub @ref OPERATION_GET_REVERSE);
+ * @param[in] num        - argument zapytania (może nie byc numerem).
+ * @return Wartość @p false, jeśli rodzaj zapytania jest niepoprawny lub nie
+ *         udało sie alokować pamięci.
+ */
+bool phfwdClientQueue(PhoneForwardClient *client, PhoneForwardOperation operation, char const *num);
+
+
+/** @brief Wysyła budowana ramkę zapytań.
+ * Kolejne zapytania trafiają do nowej ramki. Odpowiedź odbiera
+ * @ref phfwdClientReceive; przed jej odebraniem można wysłać kolejne ramki.
+ * @param[in,out] client - wskaźnik na klienta.
+ * @return Wartość @p false, jeśli ramka jest za długa lub wysyłanie sie nie
+ *         udało.
+ */
+bool phfwdClientSend(PhoneForwardClient *client);
+
+
+/** @brief Odbiera odpowiedź na najstarsza wysłaną ramkę.
+ * @param[in,out] client - wskaźnik na klienta;
+ * @param[out] results   - tablica na wyniki kolejnych zapytań ramki (wynik
+ *                         jest NULL, jeśli serwerowi zabrakło pamięci);
+ * @param[in] count      - liczba zapytań ramki.
+ * @return Wartość @p false, jeśli odbieranie sie nie udało, odpowiedź jest
+ *         niepoprawna lub nie udało sie alokować pamięci (tablica
+ *         @p results nie zawiera wtedy wyników).
+ */
+bool phfwdClientReceive(PhoneForwardClient *client, PhoneNumbers **results, size_t count);
+
+
+/** @brief Rozłącza klienta i zwalnia jego pamięć.
+ * Nic nie robi, jeśli @p client ma wartość NULL.
+ * @param[in] client - wskaźnik na klienta.
+ */
+void phfwdClientDelete(PhoneForwardClient *client);
+
+
+#endif //PHONE_SERVER_H
@@ -0,0 +1,500 @@
+/** @file
+ * Implementacja bazy przekierowań tylko do odczytu w pamięci współdzielonej.
+ * Segment to nagłówek, wierzchołki drzewa przekierowań, wierzchołki drzewa
+ * odwróconego, przesunięcia numerów list drzewa odwróconego i napisy.
+ * Wierzchołki sa numerowane w porządku BFS, wiec korzeń ma indeks 0, który
+ * w tablicy dzieci oznacza brak dziecka. Napisy zaczynają sie od pustego
+ * napisu, wiec przesunięcie 0 oznacza brak przekierowania.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#define _DEFAULT_SOURCE
+#include "phone_shared.h"
+#include "phone_codec.h"
+#include "list_of_numbers.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Znacznik pełnej bazy (zapisywany na końcu budowania).
+ */
+#define SHARED_MAGIC "PFSHM1"
+
+
+
+/**
+ * @brief Nagłówek segmentu. Przesunięcia liczone sa od początku segmentu.
+ */
+struct SharedHeader {
+    _Atomic uint64_t magic;  ///<znacznik (zerowy, dopóki baza nie jest pełna).
+    uint64_t size;  ///<rozmiar segmentu w bajtach.
+    uint64_t forwardNodes;  ///<liczba wierzchołków drzewa przekierowań.
+    uint64_t reverseNodes;  ///<liczba wierzchołków drzewa odwróconego.
+    uint64_t entries;  ///<łączna długość list drzewa odwróconego.
+    uint64_t stringBytes;  ///<łączna długość napisów (wraz z '\0').
+    uint64_t forwardOffset;  ///<przesunięcie wierzchołków drzewa przekierowań.
+    uint64_t reverseOffset;  ///<przesunięcie wierzchołków drzewa odwróconego.
+    uint64_t entriesOffset;  ///<przesunięcie list drzewa odwróconego.
+    uint64_t stringsOffset;  ///<przesunięcie napisów.
+};
+
+
+/**
+ * @brief Wierzchołek drzewa przekierowań w segmencie.
+ */
+struct SharedForwardNode {
+    uint32_t children[CHILDREN_NUMB];  ///<indeksy dzieci (0 oznacza brak dziecka).
+    uint32_t forwarding;  ///<przesunięcie przekierowania (0 oznacza brak).
+};
+
+
+/**
+ * @brief Wierzchołek drzewa odwróconego w segmencie.
+ */
+struct SharedReverseNode {
+    uint32_t children[CHILDREN_NUMB];  ///<indeksy dzieci (0 oznacza brak dziecka).
+    uint32_t first;  ///<indeks pierwszego numeru listy w tablicy entries.
+    uint32_t count;  ///<długość listy.
+};
+
+
+/**
+ * @brief Wierzchołki obu drzew w porządku BFS i rozmiary obszarów segmentu.
+ */
+struct SharedLayout {
+    ByteBuffer forward;  ///<wskaźniki na wierzchołki drzewa przekierowań.
+    ByteBuffer reverse;  ///<wskaźniki na wierzchołki drzewa odwróconego.
+    size_t entries;  ///<łączna długość list drzewa odwróconego.
+    size_t stringBytes;  ///<łączna długość napisów (wraz z '\0').
+};
+
+
+
+/**
+ * @brief Zwraca znacznik pełnej bazy jako liczbę.
+ * @return znacznik.
+ */
+static uint64_t sharedMagic(void) {
+    uint64_t magic = 0;
+    memcpy(&magic, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+    return magic;
+}
+
+
+/**
+ * @brief Zaokrągla przesunięcie w górę do wielokrotności 8.
+ * @param offset - przesunięcie.
+ * @return zaokrąglone przesunięcie.
+ */
+static size_t align8(size_t offset) {
+    return (offset + 7) & ~(size_t) 7;
+}
+
+
+/**
+ * @brief Wyznacza wierzchołki obu drzew w porządku BFS i rozmiary list
+ * i napisów.
+ * Kolejka BFS jest jednocześnie wynikowa tablicą wierzchołków.
+ * @param pf - wskaźnik na korzeń drzewa przekierowań.
+ * @param layout - wskaźnik na wypełniany układ.
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool collectNodes(PhoneForward const *pf, struct SharedLayout *layout) {
+    layout->entries = 0;
+    layout->stringBytes = 1;
+    bool ok = bufferPut(&layout->forward, &pf, sizeof(pf));
+    for (size_t i = 0; ok && i < layout->forward.size / sizeof(pf); i++) {
+        PhoneForward const *curr = ((PhoneForward const **) layout->forward.data)[i];
+        if (curr->forwarding != NULL) {
+            layout->stringBytes += strlen(curr->forwarding) + 1;
+        }
+        for (int j = 0; ok && j < CHILDREN_NUMB; j++) {
+            if (curr->children[j] != NULL) {
+                ok = bufferPut(&layout->forward, &curr->children[j], sizeof(pf));
+            }
+        }
+    }
+    PhoneReverse const *root = phfwdRootOf(pf)->pfRev;
+    ok = ok && bufferPut(&layout->reverse, &root, sizeof(root));
+    for (size_t i = 0; ok && i < layout->reverse.size / sizeof(root); i++) {
+        PhoneReverse const *curr = ((PhoneReverse const **) layout->reverse.data)[i];
+        layout->entries += listSize(curr->listOfFrwd);
+        for (size_t j = 0; j < listSize(curr->listOfFrwd); j++) {
+            layout->stringBytes += strlen(listGet(curr->listOfFrwd, j)) + 1;
+        }
+        for (int j = 0; ok && j < CHILDREN_NUMB; j++) {
+            if (curr->children[j] != NULL) {
+                ok = bufferPut(&layout->reverse, &curr->children[j], sizeof(root));
+            }
+        }
+    }
+    return ok;
+}
+
+
+/**
+ * @brief Dopisuje napis do obszaru napisów.
+ * @param strings - początek obszaru napisów.
+ * @param used - wskaźnik na liczbę zajętych bajtów obszaru.
+ * @param string - dopisywany napis.
+ * @return przesunięcie dopisanego napisu.
+ */
+static uint32_t putString(char *strings, size_t *used, char const *string) {
+    size_t length = strlen(string) + 1;
+    uint32_t offset = (uint32_t) *used;
+    memcpy(strings + *used, string, length);
+    *used += length;
+    return offset;
+}
+
+
+/**
+ * @brief Zapisuje bazę w odwzorowanym segmencie (bez znacznika).
+ * @param base - początek segmentu.
+ * @param layout - wskaźnik na układ bazy.
+ * @param header - nagłówek z przesunięciami obszarów.
+ */
+static void fillSegment(uint8_t *base, struct SharedLayout const *layout, struct SharedHeader const *header) {
+    struct SharedForwardNode *forward = (struct SharedForwardNode *) (base + header->forwardOffset);
+    struct SharedReverseNode *reverse = (struct SharedReverseNode *) (base + header->reverseOffset);
+    uint32_t *entries = (uint32_t *) (base + header->entriesOffset);
+    char *strings = (char *) (base + header->stringsOffset);
+    size_t used = 1;
+    strings[0] = '\0';
+
+    // Dzieci dostają kolejne indeksy w tej samej kolejności, w jakiej
+    // trafiły do kolejki w collectNodes.
+    uint32_t next = 1;
+    for (size_t i = 0; i < header->forwardNodes; i++) {
+        PhoneForward const *curr = ((PhoneForward const **) layout->forward.data)[i];
+        for (int j = 0; j < CHILDREN_NUMB; j++) {
+            forward[i].children[j] = curr->children[j] != NULL ? next++ : 0;
+        }
+        forward[i].forwarding = curr->forwarding != NULL ? putString(strings, &used, curr->forwarding) : 0;
+    }
+    next = 1;
+    uint32_t entry = 0;
+    for (size_t i = 0; i < header->reverseNodes; i++) {
+        PhoneReverse const *curr = ((PhoneReverse const **) layout->reverse.data)[i];
+        for (int j = 0; j < CHILDREN_NUMB; j++) {
+            reverse[i].children[j] = curr->children[j] != NULL ? next++ : 0;
+        }
+        reverse[i].first = entry;
+        reverse[i].count = (uint32_t) listSize(curr->listOfFrwd);
+        for (size_t j = 0; j < listSize(curr->listOfFrwd); j++) {
+            entries[entry++] = putString(strings, &used, listGet(curr->listOfFrwd, j));
+        }
+    }
+}
+
+
+bool phfwdSharedPublish(PhoneForward *pf, char const *name) {
+    if (pf == NULL || name == NULL || !phfwdRebuildReverse(pf)) {
+        return false;
+    }
+    struct SharedLayout layout;
+    bufferInit(&layout.forward);
+    bufferInit(&layout.reverse);
+    bool ok = collectNodes(pf, &layout);
+
+    struct SharedHeader header = {0};
+    header.forwardNodes = layout.forward.size / sizeof(PhoneForward *);
+    header.reverseNodes = layout.reverse.size / sizeof(PhoneReverse *);
+    header.entries = layout.entries;
+    header.stringBytes = layout.stringBytes;
+    header.forwardOffset = align8(sizeof(struct SharedHeader));
+    header.reverseOffset = align8(header.forwardOffset + header.forwardNodes * sizeof(struct SharedForwardNode));
+    header.entriesOffset = align8(header.reverseOffset + header.reverseNodes * sizeof(struct SharedReverseNode));
+    header.stringsOffset = align8(header.entriesOffset + header.entries * sizeof(uint32_t));
+    header.size = header.stringsOffset + header.stringBytes;
+    // Indeksy i przesunięcia napisów sa 32-bitowe.
+    ok = ok && header.forwardNodes <= UINT32_MAX && header.reverseNodes <= UINT32_MAX
+         && header.entries <= UINT32_MAX && header.stringBytes <= UINT32_MAX;
+
+    int fd = -1;
+    if (ok) {
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        ok = fd >= 0 && ftruncate(fd, (off_t) header.size) == 0;
+    }
+    uint8_t *base = MAP_FAILED;
+    if (ok) {
+        base = mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ok = base != MAP_FAILED;
+    }
+    if (ok) {
+        fillSegment(base, &layout, &header);
+        struct SharedHeader *target = (struct SharedHeader *) base;
+        memcpy((uint8_t *) target + sizeof(target->magic), (uint8_t const *) &header + sizeof(header.magic),
+               sizeof(struct SharedHeader) - sizeof(header.magic));
+        // Znacznik zapisuję na końcu, wiec dołączający widzą tylko pełna bazę.
+        atomic_store_explicit(&target->magic, sharedMagic(), memory_order_release);
+        munmap(base, header.size);
+    }
+    if (fd >= 0) {
+        close(fd);
+        if (!ok) {
+            shm_unlink(name);
+        }
+    }
+    bufferFree(&layout.forward);
+    bufferFree(&layout.reverse);
+    return ok;
+}
+
+
+/**
+ * @brief Sprawdza, czy obszar mieści sie w segmencie.
+ * @param header - nagłówek segmentu.
+ * @param offset - przesunięcie obszaru.
+ * @param count - liczba elementów obszaru (najwyżej UINT32_MAX).
+ * @param size - rozmiar elementu.
+ * @return Wartość @p true, jeśli obszar jest wyrównany i mieści sie w segmencie.
+ */
+static bool regionFits(struct SharedHeader const *header, uint64_t offset, uint64_t count, size_t size) {
+    return offset % sizeof(uint32_t) == 0 && offset <= header->size && count <= UINT32_MAX
+           && count * size <= header->size - offset;
+}
+
+
+/**
+ * @brief Sprawdza spójność dołączonej bazy.
+ * Po sprawdzeniu wszystkie indeksy i przesunięcia prowadzą do wnętrza
+ * odpowiednich obszarów, a każdy napis kończy sie w obszarze napisów.
+ * @param shared - wskaźnik na dołączana bazę (wskaźniki obszarów sa ustawiane).
+ * @return Wartość @p true, jeśli baza jest spójna.
+ */
+static bool validate(PhoneForwardShared *shared) {
+    struct SharedHeader const *header = shared->base;
+    if (shared->size < sizeof(struct SharedHeader)
+        || atomic_load_explicit(&header->magic, memory_order_acquire) != sharedMagic()
+        || header->size != shared->size || header->forwardNodes == 0 || header->reverseNodes == 0
+        || header->stringBytes == 0
+        || !regionFits(header, header->forwardOffset, header->forwardNodes, sizeof(struct SharedForwardNode))
+        || !regionFits(header, header->reverseOffset, header->reverseNodes, sizeof(struct SharedReverseNode))
+        || !regionFits(header, header->entriesOffset, header->entries, sizeof(uint32_t))
+        || !regionFits(header, header->stringsOffset, header->stringBytes, sizeof(char))) {
+        return false;
+    }
+    uint8_t const *base = shared->base;
+    shared->forward = (struct SharedForwardNode const *) (base + header->forwardOffset);
+    shared->reverse = (struct SharedReverseNode const *) (base + header->reverseOffset);
+    shared->entries = (uint32_t const *) (base + header->entriesOffset);
+    shared->strings = (char const *) (base + header->stringsOffset);
+    if (shared->strings[0] != '\0' || shared->strings[header->stringBytes - 1] != '\0') {
+        return false;
+    }
+    for (uint64_t i = 0; i < header->forwardNodes; i++) {
+        for (int j = 0; j < CHILDREN_NUMB; j++) {
+            if (shared->forward[i].children[j] >= header->forwardNodes) {
+                return false;
+            }
+        }
+        if (shared->forward[i].forwarding >= header->stringBytes) {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < header->reverseNodes; i++) {
+        for (int j = 0; j < CHILDREN_NUMB; j++) {
+            if (shared->reverse[i].children[j] >= header->reverseNodes) {
+                return false;
+            }
+        }
+        if ((uint64_t) shared->reverse[i].first + shared->reverse[i].count > header->entries) {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < header->entries; i++) {
+        if (shared->entries[i] >= header->stringBytes) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+PhoneForwardShared *phfwdSharedAttach(char const *name) {
+    if (name == NULL) {
+        return NULL;
+    }
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    PhoneForwardShared *shared = malloc(sizeof(PhoneForwardShared));
+    struct stat status;
+    bool ok = shared != NULL && fstat(fd, &status) == 0 && status.st_size > 0;
+    if (ok) {
+        shared->size = (size_t) status.st_size;
+        shared->base = mmap(NULL, shared->size, PROT_READ, MAP_SHARED, fd, 0);
+        ok = shared->base != MAP_FAILED;
+        if (ok && !validate(shared)) {
+            munmap(shared->base, shared->size);
+            ok = false;
+        }
+    }
+    close(fd);
+    if (!ok) {
+        free(shared);
+        return NULL;
+    }
+    return shared;
+}
+
+
+void phfwdSharedDetach(PhoneForwardShared *shared) {
+    if (shared != NULL) {
+        munmap(shared->base, shared->size);
+        free(shared);
+    }
+}
+
+
+bool phfwdSharedUnlink(char const *name) {
+    return name != NULL && shm_unlink(name) == 0;
+}
+
+
+/**
+ * @brief Szuka najgłębszego wierzchołka z przekierowaniem na ścieżce numeru.
+ * @param shared - wskaźnik na bazę.
+ * @param num - poprawny numer.
+ * @param[out] depth - długość prefiksu numeru, który jest przekierowywany
+ *                     (0, jeśli żaden nie jest).
+ * @return przesunięcie przekierowania lub 0, jeśli żaden prefiks nie jest
+ *         przekierowywany.
+ */
+static uint32_t findForwarding(PhoneForwardShared const *shared, char const *num, size_t *depth) {
+    uint32_t curr = 0;
+    uint32_t found = 0;
+    *depth = 0;
+    for (size_t i = 0; num[i] != '\0'; i++) {
+        curr = shared->forward[curr].children[get_digit(num[i])];
+        if (curr == 0) {
+            break;
+        }
+        if (shared->forward[curr].forwarding != 0) {
+            found = shared->forward[curr].forwarding;
+            *depth = i + 1;
+        }
+    }
+    return found;
+}
+
+
+PhoneNumbers *phfwdSharedGet(PhoneForwardShared const *shared, char const *num) {
+    if (shared == NULL) {
+        return NULL;
+    }
+    if (!isStringAPhoneNumber(num)) {
+        return phnumNew(NULL);
+    }
+    size_t depth;
+    uint32_t found = findForwarding(shared, num, &depth);
+    return found != 0 ? phnumNewJoined(shared->strings + found, num + depth) : phnumNewJoined(num, "");
+}
+
+
+/**
+ * @brief Zwraca dziecko wierzchołka drzewa przekierowań bazy.
+ * @param data - wskaźnik na bazę.
+ * @param node - wskaźnik na wierzchołek.
+ * @param digit - cyfra.
+ * @return wskaźnik na dziecko lub NULL.
+ */
+static void const *sharedForwardChild(void const *data, void const *node, int digit) {
+    PhoneForwardShared const *shared = data;
+    uint32_t child = ((struct SharedForwardNode const *) node)->children[digit];
+    return child != 0 ? &shared->forward[child] : NULL;
+}
+
+
+/**
+ * @brief Zwraca przekierowanie wierzchołka drzewa przekierowań bazy.
+ * @param data - wskaźnik na bazę.
+ * @param node - wskaźnik na wierzchołek.
+ * @return przekierowanie lub NULL.
+ */
+static char const *sharedForwarding(void const *data, void const *node) {
+    PhoneForwardShared const *shared = data;
+    uint32_t forwarding = ((struct SharedForwardNode const *) node)->forwarding;
+    return forwarding != 0 ? shared->strings + forwarding : NULL;
+}
+
+
+/**
+ * @brief Zwraca dziecko wierzchołka drzewa odwróconego bazy.
+ * @param data - wskaźnik na bazę.
+ * @param node - wskaźnik na wierzchołek.
+ * @param digit - cyfra.
+ * @return wskaźnik na dziecko lub NULL.
+ */
+static void const *sharedReverseChild(void const *data, void const *node, int digit) {
+    PhoneForwardShared const *shared = data;
+    uint32_t child = ((struct SharedReverseNode const *) node)->children[digit];
+    return child != 0 ? &shared->reverse[child] : NULL;
+}
+
+
+/**
+ * @brief Zwraca długość listy wierzchołka drzewa odwróconego bazy.
+ * @param data - wskaźnik na bazę.
+ * @param node - wskaźnik na wierzchołek.
+ * @return długość listy.
+ */
+static size_t sharedEntryCount(void const *data, void const *node) {
+    (void) data;
+    return ((struct SharedReverseNode const *) node)->count;
+}
+
+
+/**
+ * @brief Zwraca numer z listy wierzchołka drzewa odwróconego bazy.
+ * @param data - wskaźnik na bazę.
+ * @param node - wskaźnik na wierzchołek.
+ * @param idx - indeks numeru.
+ * @return numer.
+ */
+static char const *sharedEntry(void const *data, void const *node, size_t idx) {
+    PhoneForwardShared const *shared = data;
+    return shared->strings + shared->entries[((struct SharedReverseNode const *) node)->first + idx];
+}
+
+
+/**
+ * @brief Wyznacza wynik phfwdSharedReverse lub phfwdSharedGetReverse.
+ * @param shared - wskaźnik na bazę.
+ * @param num - wskaźnik na numer.
+ * @param onlyGet - czy wyznaczyć wynik phfwdSharedGetReverse.
+ * @return Wynik jak w @ref phfwdReverse.
+ */
+static PhoneNumbers *sharedReverseNumbers(PhoneForwardShared const *shared, char const *num,
+                                          bool onlyGet) {
+    if (shared == NULL) {
+        return NULL;
+    }
+    if (!isStringAPhoneNumber(num)) {
+        return phnumNew(NULL);
+    }
+    ReverseSource source = {shared, &shared->forward[0], &shared->reverse[0], sharedForwardChild,
+                            sharedForwarding, sharedReverseChild, sharedEntryCount, sharedEntry};
+    return reverseNumbers(&source, num, onlyGet);
+}
+
+
+PhoneNumbers *phfwdSharedReverse(PhoneForwardShared const *shared, char const *num) {
+    return sharedReverseNumbers(shared, num, false);
+}
+
+
+PhoneNumbers *phfwdSharedGetReverse(PhoneForwardShared const *shared, char const *num) {
+    return sharedReverseNumbers(shared, num, true);
+}
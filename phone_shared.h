@@ -0,0 +1,107 @@
+/** @file
+ * Interfejs bazy przekierowań tylko do odczytu w nazwanym segmencie pamięci
+ * współdzielonej (shm_open). Baza jest budowana raz na podstawie struktury
+ * przekierowań, a dowolna liczba procesów może ja dołączyć i odpytywać bez
+ * kopiowania danych: wierzchołki drzew odwołują sie do siebie przez indeksy,
+ * a do napisów przez przesunięcia, wiec segment może byc odwzorowany pod
+ * dowolnym adresem.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_SHARED_H
+#define PHONE_SHARED_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "phone_forward.h"
+
+
+
+/**
+ * @brief Baza dołączona przez proces.
+ * Wskaźniki prowadzą do obszarów odwzorowanego segmentu.
+ */
+struct PhoneForwardShared {
+    void *base;  ///<początek odwzorowania segmentu.
+    size_t size;  ///<rozmiar segmentu w bajtach.
+    struct SharedForwardNode const *forward;  ///<wierzchołki drzewa przekierowań (korzeń ma indeks 0).
+    struct SharedReverseNode const *reverse;  ///<wierzchołki drzewa odwróconego (korzeń ma indeks 0).
+    uint32_t const *entries;  ///<przesunięcia numerów list drzewa odwróconego.
+    char const *strings;  ///<napisy zakończone znakiem '\0'.
+};
+/**
+ * @brief To jest typ PhoneForwardShared.
+ *
+ */
+typedef struct PhoneForwardShared PhoneForwardShared;
+
+
+/** @brief Zapisuje przekierowania jako bazę w segmencie pamięci współdzielonej.
+ * Segment o nazwie @p name jest usuwany (procesy, które go dołączyły,
+ * zachowują dotychczasową bazę) i tworzony od nowa. Baza staje sie widoczna
+ * dla @ref phfwdSharedAttach dopiero po całkowitym zapisaniu. Jeśli drzewo
+ * odwrócone jest nieaktualne, jest odbudowywane.
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] name   - nazwa segmentu (postaci "/nazwa", jak w shm_open).
+ * @return Wartość @p true, jeśli baza została zapisana.
+ *         Wartość @p false, jeśli @p pf lub @p name ma wartość NULL, baza
+ *         przekroczyłaby 4 GiB, operacja na segmencie sie nie udała lub nie
+ *         udało sie alokować pamięci.
+ */
+bool phfwdSharedPublish(PhoneForward *pf, char const *name);
+
+
+/** @brief Dołącza bazę z segmentu pamięci współdzielonej tylko do odczytu.
+ * Sprawdza spójność bazy, wiec zapytania nie wychodzą poza segment.
+ * @param[in] name - nazwa segmentu.
+ * @return Wskaźnik na dołączona bazę lub NULL, jeśli segment nie istnieje,
+ *         nie zawiera pełnej, poprawnej bazy lub nie udało sie alokować
+ *         pamięci.
+ */
+PhoneForwardShared *phfwdSharedAttach(char const *name);
+
+
+/** @brief Odłącza bazę.
+ * Nic nie robi, jeśli @p shared ma wartość NULL.
+ * @param[in] shared - wskaźnik na dołączona bazę.
+ */
+void phfwdSharedDetach(PhoneForwardShared *shared);
+
+
+/** @brief Usuwa nazwę segmentu.
+ * Procesy, które dołączyły bazę, moga z niej dalej korzystać.
+ * @param[in] name - nazwa segmentu.
+ * @return Wartość @p false, jeśli segment nie istnieje lub nie udało sie
+ *         go usunąć.
+ */
+bool phfwdSharedUnlink(char const *name);
+
+
+/** @brief Wyznacza przekierowanie numeru w bazie (jak @ref phfwdGet).
+ * @param[in] shared - wskaźnik na dołączona bazę;
+ * @param[in] num    - wskaźnik na napis reprezentujący numer.
+ * @return Wynik jak w @ref phfwdGet.
+ */
+PhoneNumbers *phfwdSharedGet(PhoneForwardShared const *shared, char const *num);
+
+
+/** @brief Wyznacza przekierowania na numer w bazie (jak @ref phfwdReverse).
+ * @param[in] shared - wskaźnik na dołączona bazę;
+ * @param[in] num    - wskaźnik na napis reprezentujący numer.
+ * @return Wynik jak w @ref phfwdReverse.
+ */
+PhoneNumbers *phfwdSharedReverse(PhoneForwardShared const *shared, char const *num);
+
+
+/** @brief Wyznacza przeciwobraz numeru w bazie (jak @ref phfwdGetReverse).
+ * @param[in] shared - wskaźnik na dołączona bazę;
+ * @param[in] num    - wskaźnik na napis reprezentujący numer.
+ * @return Wynik jak w @ref phfwdGetReverse.
+ */
+PhoneNumbers *phfwdSharedGetReverse(PhoneForwardShared const *shared, char const *num);
+
+
+#endif //PHONE_SHARED_H
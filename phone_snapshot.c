@@ -0,0 +1,363 @@
+/** @file
+ * Implementacja binarnego zrzutu przekierowań numerów telefonicznych.
+ * Zrzut to nagłówek (znacznik, wersja struktury, liczba wierzchołków, liczba
+ * przekierowań, łączna długość przekierowań), a po nim wierzchołki w porządku
+ * preorder.
+ * Wierzchołek to maska jego dzieci (bity 0-11) i bit obecności
+ * przekierowania (bit 12) zapisane na dwóch bajtach, a po nich ewentualne
+ * przekierowanie zakodowane przez @ref bufferPutNumber. Numery "skąd" nie sa
+ * zapisywane, wynikają z położenia wierzchołka w drzewie.
+ * Zrzut przyrostowy to nagłówek (znacznik, wersja początkowa i końcowa,
+ * liczba usunięć, liczba przekierowań), usunięte prefiksy oraz pary numerów
+ * "skąd" i "dokąd" posortowane według numerów "skąd".
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#include "phone_snapshot.h"
+#include "phone_codec.h"
+#include "phone_memory.h"
+#include "list_of_numbers.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Znacznik początku zrzutu.
+ */
+#define SNAPSHOT_MAGIC "PFS2"
+
+/**
+ * @brief Znacznik początku zrzutu przyrostowego.
+ */
+#define DELTA_MAGIC "PFD1"
+
+/**
+ * @brief Bit obecności przekierowania w opisie wierzchołka.
+ */
+#define HAS_FORWARDING (1 << CHILDREN_NUMB)
+
+
+
+/**
+ * @brief Wyznacza następny wierzchołek w porządku preorder.
+ * @param root - wskaźnik na korzeń drzewa.
+ * @param curr - wskaźnik na bieżący wierzchołek.
+ * @return wskaźnik na następny wierzchołek lub NULL, jeśli @p curr był ostatni.
+ */
+static PhoneForward *nextInPreorder(PhoneForward const *root, PhoneForward *curr) {
+    int next = 0;
+    while (true) {
+        while (next < CHILDREN_NUMB && curr->children[next] == NULL) {
+            next++;
+        }
+        if (next < CHILDREN_NUMB) {
+            return curr->children[next];
+        }
+        if (curr == root) {
+            return NULL;
+        }
+        PhoneForward *parent = curr->parent;
+        for (next = 0; parent->children[next] != curr; next++);
+        next++;
+        curr = parent;
+    }
+}
+
+
+bool phfwdSave(PhoneForward const *pf, int fd) {
+    if (pf == NULL) {
+        return false;
+    }
+    ByteBuffer header, body;
+    bufferInit(&header);
+    bufferInit(&body);
+    size_t nodes = 0, rules = 0, stringBytes = 0;
+    bool ok = true;
+
+    for (PhoneForward *curr = (PhoneForward *) pf; ok && curr != NULL;
+         curr = nextInPreorder(pf, curr)) {
+        unsigned description = curr->forwarding != NULL ? HAS_FORWARDING : 0;
+        for (int i = 0; i < CHILDREN_NUMB; i++) {
+            if (curr->children[i] != NULL) {
+                description |= 1u << i;
+                nodes++;
+            }
+        }
+        uint8_t bytes[2] = {description & 0xff, description >> 8};
+        ok = bufferPut(&body, bytes, 2);
+        if (ok && curr->forwarding != NULL) {
+            ok = bufferPutNumber(&body, curr->forwarding);
+            rules++;
+            stringBytes += strlen(curr->forwarding) + 1;
+        }
+    }
+    ok = ok && bufferPut(&header, SNAPSHOT_MAGIC, 4) && bufferPutVarint(&header, phfwdVersion(pf))
+         && bufferPutVarint(&header, nodes)
+         && bufferPutVarint(&header, rules) && bufferPutVarint(&header, stringBytes)
+         && bufferWrite(&header, fd) && bufferWrite(&body, fd);
+    bufferFree(&header);
+    bufferFree(&body);
+    return ok;
+}
+
+
+/**
+ * @brief Odtwarza drzewo z opisów wierzchołków.
+ * Dzieci wierzchołka i przekierowania sa brane kolejno z bloku @p phfwdRootOf(pf)->arena.
+ * @param pf - wskaźnik na korzeń (z zaalokowanym blokiem).
+ * @param reader - wskaźnik na czytnik ustawiony za nagłówkiem.
+ * @param nodes - liczba wierzchołków (bez korzenia) zapisana w nagłówku.
+ * @param rules - liczba przekierowań zapisana w nagłówku.
+ * @return Wartość @p false, jeśli zrzut jest niepoprawny lub nie udało sie
+ *         alokować pamięci.
+ */
+static bool buildTree(PhoneForward *pf, ByteReader *reader, size_t nodes, size_t rules) {
+    PhoneForward *nextNode = phfwdRootOf(pf)->arena;
+    char *nextString = (char *) (nextNode + nodes);
+    char *stringsEnd = (char *) phfwdRootOf(pf)->arena + phfwdRootOf(pf)->arenaSize;
+    size_t usedNodes = 0, usedRules = 0;
+    ByteBuffer scratch;
+    bufferInit(&scratch);
+    bool ok = true;
+
+    for (PhoneForward *curr = pf; ok && curr != NULL; curr = nextInPreorder(pf, curr)) {
+        if (reader->end - reader->pos < 2) {
+            ok = false;
+            break;
+        }
+        unsigned description = reader->pos[0] | (unsigned) reader->pos[1] << 8;
+        reader->pos += 2;
+        if (description >> (CHILDREN_NUMB + 1) != 0 || (curr == pf && (description & HAS_FORWARDING))) {
+            ok = false;
+            break;
+        }
+        for (int i = 0; ok && i < CHILDREN_NUMB; i++) {
+            if (description & (1u << i)) {
+                ok = usedNodes < nodes;
+                if (ok) {
+                    PhoneForward *child = &nextNode[usedNodes++];
+                    for (int j = 0; j < CHILDREN_NUMB; j++) {
+                        child->children[j] = NULL;
+                    }
+                    child->parent = curr;
+                    child->forwarding = NULL;
+                    child->stamp = 0;
+                    child->hashValid = false;
+                    curr->children[i] = child;
+                }
+            }
+        }
+        if (ok && (description & HAS_FORWARDING)) {
+            ok = usedRules < rules && readerGetNumber(reader, &scratch)
+                 && (size_t) (stringsEnd - nextString) >= scratch.size;
+            if (ok) {
+                memcpy(nextString, scratch.data, scratch.size);
+                curr->forwarding = nextString;
+                nextString += scratch.size;
+                usedRules++;
+                size_t depth = 0;
+                for (PhoneForward const *node = curr; node != pf; node = node->parent) {
+                    depth++;
+                }
+                phfwdRootOf(pf)->stats->depths[depth < STATS_DEPTHS ? depth : STATS_DEPTHS - 1]++;
+            }
+        }
+    }
+    bufferFree(&scratch);
+    return ok && usedNodes == nodes && usedRules == rules && nextString == stringsEnd
+           && reader->pos == reader->end;
+}
+
+
+PhoneForward *phfwdLoad(int fd) {
+    ByteBuffer content;
+    bufferInit(&content);
+    if (!bufferReadAll(&content, fd)) {
+        bufferFree(&content);
+        return NULL;
+    }
+    ByteReader reader = {content.data, content.data + content.size};
+    uint64_t version, nodes, rules, stringBytes;
+    // Każdy wierzchołek zajmuje w zrzucie co najmniej 2 bajty, a przekierowanie
+    // o długości n (wraz z '\0') co najmniej n / 2 bajtów.
+    bool ok = content.size >= 4 && memcmp(content.data, SNAPSHOT_MAGIC, 4) == 0;
+    reader.pos += ok ? 4 : 0;
+    ok = ok && readerGetVarint(&reader, &version) && readerGetVarint(&reader, &nodes)
+         && readerGetVarint(&reader, &rules)
+         && readerGetVarint(&reader, &stringBytes)
+         && nodes <= content.size / 2 && rules <= nodes && stringBytes <= 2 * content.size;
+
+    PhoneForward *pf = ok ? phfwdNew() : NULL;
+    if (pf != NULL) {
+        phfwdRootOf(pf)->arenaSize = nodes * sizeof(PhoneForward) + stringBytes;
+        MEMORY_ENTER(MEMORY_FORWARD_NODES);
+        phfwdRootOf(pf)->arena = malloc(phfwdRootOf(pf)->arenaSize > 0 ? phfwdRootOf(pf)->arenaSize : 1);
+        MEMORY_LEAVE();
+        // Struktura zapisana w wersji różnej od 0 śledziła zmiany; kopia
+        // zaczyna od tej samej wersji, żeby przyjmować kolejne zrzuty przyrostowe.
+        if (phfwdRootOf(pf)->arena == NULL || !buildTree(pf, &reader, nodes, rules)
+            || (version > 0 && !phfwdTrackChanges(pf))) {
+            phfwdDelete(pf);
+            pf = NULL;
+        }
+    }
+    if (pf != NULL) {
+        // Drzewo odwrócone zostanie zbudowane jednym przejściem po drzewie,
+        // a skróty zawartości przy pierwszym porównaniu.
+        phfwdRootOf(pf)->reverseStale = rules > 0;
+        pf->hashValid = false;
+        phfwdRootOf(pf)->stats->forwardNodes += nodes;
+        phfwdRootOf(pf)->stats->rules = rules;
+        phfwdRootOf(pf)->stats->stringBytes = stringBytes;
+        if (phfwdRootOf(pf)->history != NULL) {
+            phfwdRootOf(pf)->history->version = version;
+            phfwdRootOf(pf)->history->start = version;
+        }
+    }
+    bufferFree(&content);
+    return pf;
+}
+
+
+/**
+ * @brief Przekierowania zrzutu przyrostowego zbierane przez phfwdForEachChanged.
+ */
+struct DeltaAdds {
+    ByteBuffer records;  ///<zakodowane pary numerów.
+    size_t count;  ///<liczba przekierowań.
+};
+
+
+/**
+ * @brief Dopisuje przekierowanie do zrzutu przyrostowego.
+ * @param data - wskaźnik na strukturę DeltaAdds.
+ * @param num1 - wskaźnik na numer "skąd".
+ * @param num2 - wskaźnik na numer "dokąd".
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool putDeltaAdd(void *data, char const *num1, char const *num2) {
+    struct DeltaAdds *adds = data;
+    adds->count++;
+    return bufferPutNumber(&adds->records, num1) && bufferPutNumber(&adds->records, num2);
+}
+
+
+bool phfwdSaveDelta(PhoneForward const *pf, uint64_t since, int fd) {
+    if (pf == NULL || phfwdRootOf(pf)->history == NULL || since < phfwdRootOf(pf)->history->start
+        || since > phfwdRootOf(pf)->history->version) {
+        return false;
+    }
+    PhoneForwardHistory const *history = phfwdRootOf(pf)->history;
+    // Usunięcia sa posortowane według wersji, szukam pierwszego po since.
+    size_t first = 0, last = history->size;
+    while (first < last) {
+        size_t middle = first + (last - first) / 2;
+        if (history->removals[middle].version <= since) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    ByteBuffer header;
+    struct DeltaAdds adds;
+    bufferInit(&header);
+    bufferInit(&adds.records);
+    adds.count = 0;
+
+    bool ok = bufferPut(&header, DELTA_MAGIC, 4) && bufferPutVarint(&header, since)
+              && bufferPutVarint(&header, history->version)
+              && bufferPutVarint(&header, history->size - first)
+              && phfwdForEachChanged(pf, since, putDeltaAdd, &adds)
+              && bufferPutVarint(&header, adds.count);
+    for (size_t i = first; ok && i < history->size; i++) {
+        ok = bufferPutNumber(&header, history->removals[i].prefix);
+    }
+    ok = ok && bufferWrite(&header, fd) && bufferWrite(&adds.records, fd);
+    bufferFree(&header);
+    bufferFree(&adds.records);
+    return ok;
+}
+
+
+/**
+ * @brief Czyta przekierowania zrzutu przyrostowego.
+ * Numery trafiają kolejno do bufora @p strings, a ich przesunięcia w nim
+ * do tablicy @p offsets.
+ * @param reader - wskaźnik na czytnik.
+ * @param count - liczba przekierowań.
+ * @param strings - wskaźnik na bufor numerów.
+ * @param offsets - tablica 2 * @p count przesunięć.
+ * @return Wartość @p false, jeśli zrzut jest niepoprawny lub nie udało sie
+ *         alokować pamięci.
+ */
+static bool readDeltaAdds(ByteReader *reader, size_t count, ByteBuffer *strings, size_t *offsets) {
+    ByteBuffer scratch;
+    bufferInit(&scratch);
+    bool ok = true;
+    for (size_t i = 0; ok && i < 2 * count; i++) {
+        offsets[i] = strings->size;
+        ok = readerGetNumber(reader, &scratch) && bufferPut(strings, scratch.data, scratch.size);
+    }
+    bufferFree(&scratch);
+    return ok;
+}
+
+
+bool phfwdApplyDelta(PhoneForward *pf, int fd) {
+    if (pf == NULL) {
+        return false;
+    }
+    ByteBuffer content, strings, scratch;
+    bufferInit(&content);
+    bufferInit(&strings);
+    bufferInit(&scratch);
+    List *removes = NULL;
+    size_t *offsets = NULL;
+    PhoneForwardRule *rules = NULL;
+    uint64_t since, version, removesCount, addsCount = 0;
+
+    bool ok = bufferReadAll(&content, fd) && content.size >= 4
+              && memcmp(content.data, DELTA_MAGIC, 4) == 0;
+    ByteReader reader = {content.data, content.data + content.size};
+    reader.pos += ok ? 4 : 0;
+    // Każdy numer zajmuje w zrzucie co najmniej 2 bajty.
+    ok = ok && readerGetVarint(&reader, &since) && readerGetVarint(&reader, &version)
+         && readerGetVarint(&reader, &removesCount) && readerGetVarint(&reader, &addsCount)
+         && since <= version && removesCount <= content.size / 2 && addsCount <= content.size / 4;
+    // Zrzut musi zaczynać sie od bieżącej wersji struktury; zrzut bez zmian
+    // nie zmienia wersji.
+    ok = ok && since == phfwdVersion(pf)
+         && (since < version ? phfwdTrackChanges(pf) : removesCount == 0 && addsCount == 0);
+    for (uint64_t i = 0; ok && i < removesCount; i++) {
+        ok = readerGetNumber(&reader, &scratch) && insertToList(&removes, (char *) scratch.data);
+    }
+    if (ok) {
+        offsets = malloc(sizeof(size_t) * (2 * addsCount + 1));
+        rules = malloc(sizeof(PhoneForwardRule) * (addsCount + 1));
+        ok = offsets != NULL && rules != NULL && readDeltaAdds(&reader, addsCount, &strings, offsets)
+             && reader.pos == reader.end;
+    }
+    // Przekierowania musza być poprawne i posortowane bez powtórzeń.
+    for (size_t i = 0; ok && i < addsCount; i++) {
+        rules[i].from = (char *) strings.data + offsets[2 * i];
+        rules[i].to = (char *) strings.data + offsets[2 * i + 1];
+        ok = strcmp(rules[i].from, rules[i].to) != 0
+             && (i == 0 || compareNumbers(rules[i - 1].from, rules[i].from) < 0);
+    }
+    if (ok && since < version) {
+        ok = phfwdApplyBatch(pf, removes, rules, addsCount);
+        if (ok) {
+            phfwdRootOf(pf)->history->version = version;
+        }
+    }
+
+    listDelete(removes);
+    free(offsets);
+    free(rules);
+    bufferFree(&content);
+    bufferFree(&strings);
+    bufferFree(&scratch);
+    return ok;
+}
@@ -0,0 +1,79 @@
+/** @file
+ * Interfejs zapisu i odczytu binarnego zrzutu przekierowań numerów
+ * telefonicznych.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_SNAPSHOT_H
+#define PHONE_SNAPSHOT_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "phone_forward.h"
+
+
+
+/** @brief Zapisuje zrzut przekierowań.
+ * Zrzut zawiera wersję struktury (@ref phfwdVersion), kształt drzewa (po dwa
+ * bajty na wierzchołek) oraz przekierowania zapisane po dwie cyfry w bajcie;
+ * drzewo odwrócone nie jest zapisywane. Funkcja nie wykonuje fsync.
+ * @param[in] pf - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] fd - deskryptor pliku otwartego do zapisu.
+ * @return Wartość @p true, jeśli zrzut został zapisany.
+ *         Wartość @p false, jeśli @p pf ma wartość NULL, zapis się nie udał
+ *         lub nie udało sie alokować pamięci.
+ */
+bool phfwdSave(PhoneForward const *pf, int fd);
+
+
+/** @brief Wczytuje zrzut przekierowań.
+ * Czyta plik od bieżącej pozycji do końca. Wszystkie wierzchołki
+ * i przekierowania umieszcza w jednym bloku pamięci, a drzewo odwrócone
+ * buduje w jednym przejściu przy pierwszym zapytaniu, które go potrzebuje.
+ * Jeśli zapisana wersja jest różna od 0, wczytana struktura śledzi zmiany
+ * (@ref phfwdTrackChanges) i ma tę samą wersję, więc można do niej stosować
+ * zrzuty przyrostowe struktury zapisanej.
+ * @param[in] fd - deskryptor pliku ze zrzutem zapisanym przez @ref phfwdSave.
+ * @return Wskaźnik na utworzona strukturę lub NULL, gdy odczyt się nie udał,
+ *         zrzut jest niepoprawny lub nie udało sie alokować pamięci.
+ */
+PhoneForward *phfwdLoad(int fd);
+
+
+/** @brief Zapisuje zrzut przyrostowy (zmiany od wersji @p since).
+ * Zrzut zawiera prefiksy usunięte po wersji @p since oraz przekierowania
+ * z poddrzew zmienionych po tej wersji; zajmuje czas proporcjonalny do
+ * liczby zmian. Wymaga śledzenia zmian (@ref phfwdTrackChanges).
+ * Funkcja nie wykonuje fsync.
+ * @param[in] pf    - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] since - numer wersji (patrz @ref phfwdVersion);
+ * @param[in] fd    - deskryptor pliku otwartego do zapisu.
+ * @return Wartość @p true, jeśli zrzut został zapisany.
+ *         Wartość @p false, jeśli @p pf ma wartość NULL, zmiany nie sa
+ *         śledzone, historia od wersji @p since nie jest dostępna, zapis się
+ *         nie udał lub nie udało sie alokować pamięci.
+ */
+bool phfwdSaveDelta(PhoneForward const *pf, uint64_t since, int fd);
+
+
+/** @brief Stosuje zrzut przyrostowy.
+ * Wersja struktury @p pf (@ref phfwdVersion) musi być równa wersji, od
+ * której zrzut został wyznaczony; po zastosowaniu struktura ma przekierowania
+ * i wersję, w której zrzut został zapisany (i śledzi zmiany). Dlatego zrzutu
+ * nie można zastosować do innej wersji ani drugi raz. Zrzut jest stosowany
+ * atomowo (@ref phfwdApplyBatch).
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] fd     - deskryptor pliku ze zrzutem zapisanym przez
+ *                     @ref phfwdSaveDelta.
+ * @return Wartość @p true, jeśli zrzut został zastosowany.
+ *         Wartość @p false, jeśli @p pf ma wartość NULL, odczyt się nie udał,
+ *         zrzut jest niepoprawny, wyznaczony od innej wersji niż wersja
+ *         @p pf lub nie udało sie alokować pamięci
+ *         (struktura pozostaje wtedy niezmieniona).
+ */
+bool phfwdApplyDelta(PhoneForward *pf, int fd);
+
+
+#endif //PHONE_SNAPSHOT_H
@@ -0,0 +1,203 @@
+/** @file
+ * Implementacja zapisu i odczytu śladu wywołań funkcji na przekierowaniach
+ * numerów telefonicznych.
+ * Ślad zaczyna sie od nagłówka "PFT1". Zapis wywołania to bajt rodzaju
+ * operacji (@ref PhoneForwardOperation), a po nim argumenty: poprawne numery
+ * zakodowane przez @ref bufferPutNumber, a jeśli któryś argument nie jest
+ * poprawnym numerem, to wszystkie argumenty zapisane dosłownie (długość
+ * powiększona o jeden, 0 oznacza NULL) i ustawiony bit @ref TRACE_RAW.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#include "phone_trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAGIC "PFT1" ///<Nagłówek pliku śladu.
+#define TRACE_RAW 0x80 ///<Bit rodzaju operacji oznaczający argumenty zapisane dosłownie.
+#define TRACE_FLUSH_SIZE (64 * 1024) ///<Rozmiar bufora, po którego przekroczeniu jest on zapisywany.
+
+
+
+bool phfwdTraceStart(PhoneForward *pf, int fd) {
+    if (pf == NULL || phfwdRootOf(pf)->trace != NULL) {
+        return false;
+    }
+    struct PhoneForwardTrace *trace = malloc(sizeof(struct PhoneForwardTrace));
+    if (trace == NULL) {
+        return false;
+    }
+    if (pthread_mutex_init(&trace->mutex, NULL) != 0) {
+        free(trace);
+        return false;
+    }
+    trace->fd = fd;
+    trace->records = 0;
+    trace->failed = false;
+    bufferInit(&trace->pending);
+    if (!bufferPut(&trace->pending, TRACE_MAGIC, 4) || !bufferWrite(&trace->pending, fd)) {
+        bufferFree(&trace->pending);
+        pthread_mutex_destroy(&trace->mutex);
+        free(trace);
+        return false;
+    }
+    trace->pending.size = 0;
+    phfwdRootOf(pf)->trace = trace;
+    return true;
+}
+
+
+bool phfwdTraceStop(PhoneForward *pf) {
+    if (pf == NULL || phfwdRootOf(pf)->trace == NULL) {
+        return false;
+    }
+    struct PhoneForwardTrace *trace = phfwdRootOf(pf)->trace;
+    phfwdRootOf(pf)->trace = NULL;
+    bool ok = !trace->failed && bufferWrite(&trace->pending, trace->fd);
+    bufferFree(&trace->pending);
+    pthread_mutex_destroy(&trace->mutex);
+    free(trace);
+    return ok;
+}
+
+
+/**
+ * @brief Dopisuje do bufora argument zapisany dosłownie.
+ * @param buffer - wskaźnik na bufor.
+ * @param num - argument (może byc NULL).
+ * @return Wartość @p false, jeśli nie udało sie alokować pamięci.
+ */
+static bool putRaw(ByteBuffer *buffer, char const *num) {
+    if (num == NULL) {
+        return bufferPutVarint(buffer, 0);
+    }
+    size_t length = strlen(num);
+    return bufferPutVarint(buffer, length + 1) && bufferPut(buffer, num, length);
+}
+
+
+void traceRecord(struct PhoneForwardTrace *trace, PhoneForwardOperation operation,
+                 char const *num1, char const *num2) {
+    bool twoArguments = operation == OPERATION_ADD;
+    bool raw = !isStringAPhoneNumber(num1) || (twoArguments && !isStringAPhoneNumber(num2));
+    uint8_t type = (uint8_t) (operation | (raw ? TRACE_RAW : 0));
+
+    pthread_mutex_lock(&trace->mutex);
+    if (!trace->failed) {
+        size_t size = trace->pending.size;
+        bool ok = bufferPut(&trace->pending, &type, 1);
+        if (raw) {
+            ok = ok && putRaw(&trace->pending, num1) && (!twoArguments || putRaw(&trace->pending, num2));
+        } else {
+            ok = ok && bufferPutNumber(&trace->pending, num1)
+                 && (!twoArguments || bufferPutNumber(&trace->pending, num2));
+        }
+        if (!ok) {
+            // Zapis bez brakującego wywołania nie odtwarzałby obciążenia.
+            trace->pending.size = size;
+            trace->failed = true;
+        } else {
+            trace->records++;
+            if (trace->pending.size >= TRACE_FLUSH_SIZE) {
+                trace->failed = !bufferWrite(&trace->pending, trace->fd);
+                trace->pending.size = 0;
+            }
+        }
+    }
+    pthread_mutex_unlock(&trace->mutex);
+}
+
+
+/**
+ * @brief Czyta argument zapisany dosłownie.
+ * @param reader - wskaźnik na czytnik.
+ * @param scratch - wskaźnik na bufor na argument.
+ * @param num - wskaźnik na odczytany argument (NULL lub zawartość @p scratch).
+ * @return Wartość @p false, jeśli dane sa niepełne lub nie udało sie alokować
+ *         pamięci.
+ */
+static bool readerGetRaw(ByteReader *reader, ByteBuffer *scratch, char const **num) {
+    uint64_t length;
+    if (!readerGetVarint(reader, &length)) {
+        return false;
+    }
+    if (length == 0) {
+        *num = NULL;
+        return true;
+    }
+    length--;
+    if ((uint64_t) (reader->end - reader->pos) < length) {
+        return false;
+    }
+    scratch->size = 0;
+    if (!bufferReserve(scratch, length + 1)) {
+        return false;
+    }
+    memcpy(scratch->data, reader->pos, length);
+    scratch->data[length] = '\0';
+    scratch->size = length + 1;
+    reader->pos += length;
+    *num = (char const *) scratch->data;
+    return true;
+}
+
+
+/**
+ * @brief Czyta argument wywołania.
+ * @param reader - wskaźnik na czytnik.
+ * @param raw - czy argument jest zapisany dosłownie.
+ * @param scratch - wskaźnik na bufor na argument.
+ * @param num - wskaźnik na odczytany argument.
+ * @return Wartość @p false, jeśli dane sa niepełne, niepoprawne lub nie udało
+ *         sie alokować pamięci.
+ */
+static bool readArgument(ByteReader *reader, bool raw, ByteBuffer *scratch, char const **num) {
+    if (raw) {
+        return readerGetRaw(reader, scratch, num);
+    }
+    if (!readerGetNumber(reader, scratch)) {
+        return false;
+    }
+    *num = (char const *) scratch->data;
+    return true;
+}
+
+
+bool phfwdTraceRead(int fd, PhoneForwardTraceVisitor visit, void *data) {
+    ByteBuffer content, scratch1, scratch2;
+    bufferInit(&content);
+    bufferInit(&scratch1);
+    bufferInit(&scratch2);
+    bool ok = bufferReadAll(&content, fd) && content.size >= 4
+              && memcmp(content.data, TRACE_MAGIC, 4) == 0;
+    ByteReader reader = {NULL, NULL};
+    if (ok) {
+        reader.pos = content.data + 4;
+        reader.end = content.data + content.size;
+    }
+
+    while (ok && reader.pos < reader.end) {
+        uint8_t type = *reader.pos++;
+        bool raw = (type & TRACE_RAW) != 0;
+        if ((type & ~TRACE_RAW) >= OPERATIONS_COUNT) {
+            ok = false;
+            break;
+        }
+        PhoneForwardOperation operation = (PhoneForwardOperation) (type & ~TRACE_RAW);
+        char const *num1 = NULL;
+        char const *num2 = NULL;
+        if (!readArgument(&reader, raw, &scratch1, &num1)
+            || (operation == OPERATION_ADD && !readArgument(&reader, raw, &scratch2, &num2))) {
+            // Niepełny ostatni zapis (np. przerwany program) jest pomijany.
+            break;
+        }
+        ok = visit(data, operation, num1, num2);
+    }
+    bufferFree(&content);
+    bufferFree(&scratch1);
+    bufferFree(&scratch2);
+    return ok;
+}
@@ -0,0 +1,108 @@
+/** @file
+ * Interfejs zapisu wywołań funkcji na przekierowaniach numerów telefonicznych
+ * (śladu), pozwalającego później odtworzyć to samo obciążenie.
+ *
+ * @author Kateryna Pavlichenko <marpe@mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef PHONE_TRACE_H
+#define PHONE_TRACE_H
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "phone_codec.h"
+#include "phone_forward.h"
+
+
+
+/**
+ * @brief Zapis śladu jednej struktury.
+ * Wywołania trafiają do bufora @p pending, który jest zapisywany do pliku,
+ * gdy urośnie, oraz przy zakończeniu zapisu.
+ */
+struct PhoneForwardTrace {
+    int fd;  ///<deskryptor pliku śladu.
+    pthread_mutex_t mutex;  ///<chroni bufor (odczyty moga byc wykonywane współbieżnie).
+    ByteBuffer pending;  ///<zapisy czekające na zapis do pliku.
+    uint64_t records;  ///<liczba zapisanych wywołań.
+    bool failed;  ///<czy wystąpił błąd (kolejne wywołania nie sa wtedy zapisywane).
+};
+
+
+/**
+ * @brief Funkcja wywoływana dla kolejnych wywołań odczytanych ze śladu.
+ * Argument @p num2 ma wartość NULL dla operacji innych niż
+ * @ref OPERATION_ADD. Argumenty sa przekazywane dokładnie tak, jak zostały
+ * podane w zapisanym wywołaniu (mogą byc niepoprawnymi numerami lub NULL).
+ * Zwrócenie @p false przerywa odczyt.
+ */
+typedef bool (*PhoneForwardTraceVisitor)(void *data, PhoneForwardOperation operation,
+                                         char const *num1, char const *num2);
+
+
+/** @brief Rozpoczyna zapis śladu struktury @p pf.
+ * Zapisuje nagłówek śladu, a następnie każde wywołanie @ref phfwdAdd,
+ * @ref phfwdRemove, @ref phfwdGet, @ref phfwdReverse
+ * i @ref phfwdGetReverse na strukturze @p pf (razem z argumentami, także
+ * niepoprawnymi). Zmiany wykonywane innymi funkcjami sa zapisywane jak
+ * te wywołania: @ref phfwdBulkLoad (także import) jako kolejne
+ * @ref phfwdAdd, a @ref phfwdApplyBatch (zestawy zmian i zrzuty
+ * przyrostowe) jako @ref phfwdRemove i @ref phfwdAdd. Scalanie
+ * (@ref phfwdMerge) struktury, dla której trwa zapis, nie jest możliwe.
+ * Deskryptor nie jest przejmowany na własność.
+ *
+ * Zapis wywołań jest chroniony muteksem śladu, więc zapytania na @p pf mogą
+ * byc wykonywane współbieżnie także w trakcie zapisu. Funkcje
+ * @ref phfwdTraceStart i @ref phfwdTraceStop nie mogą byc wywoływane
+ * współbieżnie z innymi funkcjami na @p pf.
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania;
+ * @param[in] fd     - deskryptor pliku otwartego do zapisu.
+ * @return Wartość @p true, jeśli zapis się rozpoczął. Wartość @p false, jeśli
+ *         @p pf ma wartość NULL, zapis śladu już trwa, operacja na pliku się
+ *         nie udała lub nie udało sie alokować pamięci.
+ */
+bool phfwdTraceStart(PhoneForward *pf, int fd);
+
+
+/** @brief Kończy zapis śladu struktury @p pf.
+ * Zapisuje do pliku zawartość bufora. Jest wywoływana przez
+ * @ref phfwdDelete, jeśli zapis trwa.
+ * @param[in,out] pf - wskaźnik na strukturę przechowująca przekierowania.
+ * @return Wartość @p true, jeśli wszystkie wywołania zostały zapisane.
+ *         Wartość @p false, jeśli @p pf ma wartość NULL, zapis nie trwał lub
+ *         wystąpił błąd zapisu.
+ */
+bool phfwdTraceStop(PhoneForward *pf);
+
+
+/** @brief Odczytuje ślad z pliku.
+ * Czyta plik od bieżącej pozycji do końca i wywołuje @p visit dla kolejnych
+ * zapisanych wywołań. Niepełny ostatni zapis jest pomijany.
+ * @param[in] fd    - deskryptor pliku śladu;
+ * @param[in] visit - funkcja wywoływana dla kolejnych wywołań;
+ * @param[in] data  - wskaźnik przekazywany do @p visit.
+ * @return Wartość @p true, jeśli odczytano wszystkie pełne zapisy.
+ *         Wartość @p false, jeśli plik nie jest śladem, odczyt się nie udał,
+ *         nie udało sie alokować pamięci lub @p visit zwróciła @p false.
+ */
+bool phfwdTraceRead(int fd, PhoneForwardTraceVisitor visit, void *data);
+
+
+/** @brief Zapisuje wywołanie w śladzie.
+ * Używana przez funkcje na przekierowaniach, gdy pole @p trace danych
+ * struktury (@ref PhoneForwardRoot) nie ma wartości NULL. Może byc
+ * wywoływana współbieżnie (także z zapytań na tej samej strukturze), bo
+ * bufor śladu jest chroniony muteksem.
+ * @param[in,out] trace - wskaźnik na zapis śladu;
+ * @param[in] operation - rodzaj wywołania;
+ * @param[in] num1      - pierwszy argument (może byc NULL);
+ * @param[in] num2      - drugi argument (NULL dla operacji innych niż
+ *                        @ref OPERATION_ADD).
+ */
+void traceRecord(struct PhoneForwardTrace *trace, PhoneForwardOperation operation,
+                 char const *num1, char const *num2);
+
+
+#endif //PHONE_TRACE_H